@@ -4065,6 +4065,30 @@ vim.bo.mp = vim.bo.makeprg
 vim.go.makeprg = vim.o.makeprg
 vim.go.mp = vim.go.makeprg
 
+--- Files of at least this many Kbyte are read through a read-only memory
+--- mapping instead of being copied into the buffer.  The lines are taken
+--- directly from the mapping until the buffer is changed for the first
+--- time, then the text is copied into the buffer like for any other
+--- file.  This makes opening very large files, such as logs, fast and
+--- keeps the memory use proportional to the part that is looked at.
+--- Zero disables mapping.
+--- A file is only mapped when it is read for editing, uses "unix"
+--- 'fileformat', is valid UTF-8 (or 'binary' is set), contains no NUL
+--- bytes, does not need conversion and no undo file is read for it
+--- ('undofile').  Otherwise it is read as usual.
+--- When the mapped file was changed by another program Nvim notices it
+--- before using the mapping and copies the text that is still there into
+--- the buffer, text may be lost then.  A file that is truncated at the
+--- very moment its text is used can still make Nvim crash, better not use
+--- this for files that are truncated in place (e.g. by logrotate).
+--- Not available on systems without mmap().
+---
+--- @type integer
+vim.o.mapfilesize = 0
+vim.o.mfs = vim.o.mapfilesize
+vim.go.mapfilesize = vim.o.mapfilesize
+vim.go.mfs = vim.go.mapfilesize
+
 --- Characters that form pairs.  The `%` command jumps from one to the
 --- other.
 --- Only character pairs are allowed that are different, thus you cannot
@@ -4147,6 +4171,36 @@ vim.o.mmp = vim.o.maxmempattern
 vim.go.maxmempattern = vim.o.maxmempattern
 vim.go.mmp = vim.go.maxmempattern
 
+--- Maximum amount of memory in Kbyte to use for the text of all buffers
+--- together.  When more is used, the least recently used blocks of text are
+--- written to the swap file, if they were changed, and dropped from
+--- memory.  They are read back when needed.  Only buffers that have a
+--- swap file can give back memory, see 'swapfile'.
+--- Zero means no limit: the text of all buffers is kept in memory.
+--- The number of blocks found in memory, read from the swap file and
+--- dropped can be obtained with `nvim__stats()`.
+---
+--- @type integer
+vim.o.maxmemtot = 0
+vim.o.mmt = vim.o.maxmemtot
+vim.go.maxmemtot = vim.o.maxmemtot
+vim.go.mmt = vim.go.maxmemtot
+
+--- Amount of memory in Kbyte for the most recently used text of all
+--- buffers together.  Blocks of text that were used less recently are
+--- compressed in memory, which usually makes them two to four times
+--- smaller.  They are decompressed when used again.  This lets the text
+--- of huge files stay in memory, see also 'maxmemtot'.
+--- Zero means text is never compressed.
+--- The memory used by compressed blocks and their size when decompressed
+--- can be obtained with `nvim__stats()`.
+---
+--- @type integer
+vim.o.memcompress = 0
+vim.o.mcm = vim.o.memcompress
+vim.go.memcompress = vim.o.memcompress
+vim.go.mcm = vim.go.memcompress
+
 --- Maximum number of items to use in a menu.  Used for menus that are
 --- generated from a list of items, e.g., the Buffers menu.  Changing this
 --- option has no direct effect, the menu must be refreshed first.
@@ -7359,6 +7413,19 @@ vim.bo.ul = vim.bo.undolevels
 vim.go.undolevels = vim.o.undolevels
 vim.go.ul = vim.go.undolevels
 
+--- Maximum amount of memory in Kbyte to use for the undo information of
+--- one buffer.  When a new change is started and more memory is used,
+--- the oldest changes are forgotten, like when there are more changes
+--- than 'undolevels'.  Older branches of the undo tree go first.  The
+--- current change is always kept, even when it is bigger.
+--- Zero means there is no limit.
+---
+--- @type integer
+vim.o.undomemory = 0
+vim.o.um = vim.o.undomemory
+vim.go.undomemory = vim.o.undomemory
+vim.go.um = vim.go.undomemory
+
 --- Save the whole buffer for undo when reloading it.  This applies to the
 --- ":e!" command and reloading for when the buffer changed outside of
 --- Vim. `FileChangedShell`
@@ -8091,6 +8158,26 @@ vim.o.wa = vim.o.writeany
 vim.go.writeany = vim.o.writeany
 vim.go.wa = vim.go.writeany
 
+--- When on, ":write" and ":update" of a whole buffer write the text on a
+--- worker thread, so that editing can continue while a large file is
+--- being written.  Lines are written from a copy-on-write snapshot of
+--- the buffer, and 'fsync' is done on the worker thread too.
+--- The "written" message, resetting 'modified' and the `BufWritePost`
+--- autocommands come when writing is done.  When the buffer was changed
+--- meanwhile it stays modified.  When writing fails an error is given
+--- then and the backup file is put back.
+--- The file is written the normal way when it needs conversion
+--- ('fileencoding', "mac" 'fileformat', ++opt), when 'undofile' or
+--- 'patchmode' is set, and when writing part of a buffer, appending or
+--- filtering.  Reading a file, abandoning a buffer and exiting wait for
+--- pending writes.
+---
+--- @type boolean
+vim.o.writeasync = false
+vim.o.was = vim.o.writeasync
+vim.go.writeasync = vim.o.writeasync
+vim.go.was = vim.go.writeasync
+
 --- Make a backup before overwriting a file.  The backup is removed after
 --- the file was successfully written, unless the 'backup' option is
 --- also on.
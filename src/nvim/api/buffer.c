@@ -410,21 +410,23 @@ void nvim_buf_set_lines(uint64_t channel_id, Buffer buffer, Integer start, Integ
   }
 
   // Now we may need to insert the remaining new old_len
-  for (size_t i = to_replace; i < new_len; i++) {
-    int64_t lnum = start + (int64_t)i - 1;
-
-    VALIDATE(lnum < MAXLNUM, "%s", "Index out of bounds", {
+  if (to_replace < new_len) {
+    VALIDATE(start + (int64_t)new_len - 2 < MAXLNUM, "%s", "Index out of bounds", {
       goto end;
     });
 
-    if (ml_append_buf(buf, (linenr_T)lnum, lines[i], 0, false) == FAIL) {
+    size_t to_append = new_len - to_replace;
+    if (ml_append_many(buf, (linenr_T)(start + (int64_t)to_replace - 1), lines + to_replace,
+                       NULL, (linenr_T)to_append, false) == FAIL) {
       api_set_error(err, kErrorTypeException, "Failed to insert line");
       goto end;
     }
 
-    inserted_bytes += (bcount_t)strlen(lines[i]) + 1;
+    for (size_t i = to_replace; i < new_len; i++) {
+      inserted_bytes += (bcount_t)strlen(lines[i]) + 1;
+    }
 
-    extra++;
+    extra += (ptrdiff_t)to_append;
   }
 
   // Adjust marks. Invalidate any which lie in the
@@ -647,19 +649,19 @@ void nvim_buf_set_text(uint64_t channel_id, Buffer buffer, Integer start_row, In
   }
 
   // Now we may need to insert the remaining new old_len
-  for (size_t i = to_replace; i < new_len; i++) {
-    int64_t lnum = start_row + (int64_t)i - 1;
-
-    VALIDATE((lnum < MAXLNUM), "%s", "Index out of bounds", {
+  if (to_replace < new_len) {
+    VALIDATE((start_row + (int64_t)new_len - 2 < MAXLNUM), "%s", "Index out of bounds", {
       goto end;
     });
 
-    if (ml_append_buf(buf, (linenr_T)lnum, lines[i], 0, false) == FAIL) {
+    size_t to_append = new_len - to_replace;
+    if (ml_append_many(buf, (linenr_T)(start_row + (int64_t)to_replace - 1), lines + to_replace,
+                       NULL, (linenr_T)to_append, false) == FAIL) {
       api_set_error(err, kErrorTypeException, "Failed to insert line");
       goto end;
     }
 
-    extra++;
+    extra += (ptrdiff_t)to_append;
   }
 
   colnr_T col_extent = (colnr_T)(end_col
@@ -53,6 +53,7 @@
 #include "nvim/mark_defs.h"
 #include "nvim/math.h"
 #include "nvim/mbyte.h"
+#include "nvim/memfile.h"
 #include "nvim/memline.h"
 #include "nvim/memory.h"
 #include "nvim/memory_defs.h"
@@ -1779,11 +1780,25 @@ Float nvim__id_float(Float flt)
 /// @return Map of various internal stats.
 Dictionary nvim__stats(Arena *arena)
 {
-  Dictionary rv = arena_dict(arena, 6);
+  Dictionary rv = arena_dict(arena, 18);
   PUT_C(rv, "fsync", INTEGER_OBJ(g_stats.fsync));
   PUT_C(rv, "log_skip", INTEGER_OBJ(g_stats.log_skip));
   PUT_C(rv, "lua_refcount", INTEGER_OBJ(nlua_get_global_ref_count()));
   PUT_C(rv, "redraw", INTEGER_OBJ(g_stats.redraw));
+  PUT_C(rv, "memfile_hit", INTEGER_OBJ(g_stats.mf_hit));
+  PUT_C(rv, "memfile_miss", INTEGER_OBJ(g_stats.mf_miss));
+  PUT_C(rv, "memfile_evict", INTEGER_OBJ(g_stats.mf_evict));
+  PUT_C(rv, "memfile_writeback", INTEGER_OBJ(g_stats.mf_writeback));
+  PUT_C(rv, "memfile_async", INTEGER_OBJ(g_stats.mf_async));
+  PUT_C(rv, "memfile_bytes", INTEGER_OBJ((Integer)mf_cache_bytes()));
+  PUT_C(rv, "memfile_snapshot", INTEGER_OBJ((Integer)mf_snapshot_bytes()));
+  size_t compressed_raw;
+  size_t compressed = mf_compressed_bytes(&compressed_raw);
+  PUT_C(rv, "memfile_compressed", INTEGER_OBJ((Integer)compressed));
+  PUT_C(rv, "memfile_compressed_raw", INTEGER_OBJ((Integer)compressed_raw));
+  PUT_C(rv, "regexp_cache_hit", INTEGER_OBJ(g_stats.regexp_cache_hit));
+  PUT_C(rv, "regexp_cache_miss", INTEGER_OBJ(g_stats.regexp_cache_miss));
+  PUT_C(rv, "regexp_cache_evict", INTEGER_OBJ(g_stats.regexp_cache_evict));
   PUT_C(rv, "arena_alloc_count", INTEGER_OBJ((Integer)arena_alloc_count));
   PUT_C(rv, "ts_query_parse_count", INTEGER_OBJ((Integer)tslua_query_parse_count));
   return rv;
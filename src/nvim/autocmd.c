@@ -2134,6 +2134,25 @@ char *getnextac(int c, void *cookie, int indent, bool do_concat)
 /// @param buf buffer the file is open in
 bool has_autocmd(event_T event, char *sfname, buf_T *buf)
   FUNC_ATTR_WARN_UNUSED_RESULT
+{
+  return has_autocmd_skip_groups(event, sfname, buf, NULL, 0);
+}
+
+/// Like has_autocmd(), but ignores autocommands in the "nskip" groups
+/// "skip_groups" and returns false when "event" would not be triggered
+/// because autocommands are blocked or it is in 'eventignore'.
+bool will_trigger_autocmd(event_T event, char *sfname, buf_T *buf, const int *skip_groups,
+                          size_t nskip)
+  FUNC_ATTR_WARN_UNUSED_RESULT
+{
+  if (is_autocmd_blocked() || event_ignored(event)) {
+    return false;
+  }
+  return has_autocmd_skip_groups(event, sfname, buf, skip_groups, nskip);
+}
+
+static bool has_autocmd_skip_groups(event_T event, char *sfname, buf_T *buf,
+                                    const int *skip_groups, size_t nskip)
 {
   char *tail = path_tail(sfname);
   bool retval = false;
@@ -2154,7 +2173,14 @@ bool has_autocmd(event_T event, char *sfname, buf_T *buf)
   AutoCmdVec *const acs = &autocmds[(int)event];
   for (size_t i = 0; i < kv_size(*acs); i++) {
     AutoPat *const ap = kv_A(*acs, i).pat;
-    if (ap != NULL
+    if (ap == NULL) {
+      continue;
+    }
+    size_t g = 0;
+    while (g < nskip && skip_groups[g] != ap->group) {
+      g++;
+    }
+    if (g == nskip
         && (ap->buflocal_nr == 0
             ? match_file_pat(NULL, &ap->reg_prog, fname, sfname, tail, ap->allow_dirs)
             : buf != NULL && ap->buflocal_nr == buf->b_fnum)) {
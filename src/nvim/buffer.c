@@ -35,6 +35,7 @@
 #include "nvim/autocmd_defs.h"
 #include "nvim/buffer.h"
 #include "nvim/buffer_updates.h"
+#include "nvim/bufwrite.h"
 #include "nvim/change.h"
 #include "nvim/channel.h"
 #include "nvim/charset.h"
@@ -1333,6 +1334,12 @@ int do_buffer(int action, int start, int dir, int count, int forceit)
       return FAIL;
     }
 
+    if (!forceit) {
+      buf_write_wait();
+      if (!bufref_valid(&bufref)) {
+        return FAIL;
+      }
+    }
     if (!forceit && bufIsChanged(buf)) {
       if ((p_confirm || (cmdmod.cmod_flags & CMOD_CONFIRM)) && p_write) {
         dialog_changed(buf, false);
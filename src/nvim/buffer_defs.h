@@ -263,6 +263,8 @@ typedef struct {
 typedef struct {
   hashtab_T b_keywtab;                  // syntax keywords hash table
   hashtab_T b_keywtab_ic;               // idem, ignore case
+  struct keyw_index *b_keyw_index;      // index of b_keywtab, NULL when not built
+  struct keyw_index *b_keyw_index_ic;   // idem, ignore case
   bool b_syn_error;                     // true when error occurred in HL
   bool b_syn_slow;                      // true when 'redrawtime' reached
   int b_syn_ic;                         // ignore case for :syn cmds
@@ -299,6 +301,9 @@ typedef struct {
   // b_sst_freecount    number of free entries in b_sst_array[]
   // b_sst_check_lnum   entries after this lnum need to be checked for
   //                    validity (MAXLNUM means no check needed)
+  // b_sst_idle_*       line up to which states were computed while waiting
+  //                    for input, below and above the window and from the
+  //                    start of the buffer
   synstate_T *b_sst_array;
   int b_sst_len;
   synstate_T *b_sst_first;
@@ -306,6 +311,9 @@ typedef struct {
   int b_sst_freecount;
   linenr_T b_sst_check_lnum;
   disptick_T b_sst_lasttick;    // last display tick
+  linenr_T b_sst_idle_below;
+  linenr_T b_sst_idle_above;
+  linenr_T b_sst_idle_lnum;
 
   // for spell checking
   garray_T b_langp;           // list of pointers to slang_T, see spell.c
@@ -480,12 +488,24 @@ struct file_buffer {
                                // if b_u_curhead is not NULL
   u_header_T *b_u_curhead;     // pointer to current header
   int b_u_numhead;             // current number of headers
+  size_t b_u_memused;          // bytes used by headers and entries
   bool b_u_synced;             // entry lists are synced
   int b_u_seq_last;            // last used undo sequence number
   int b_u_save_nr_last;        // counter for last file write
   int b_u_seq_cur;             // uh_seq of header below which we are now
   time_t b_u_time_cur;         // uh_time of header below which we are now
   int b_u_save_nr_cur;         // file write nr after which we are now
+  bool b_u_file_valid;         // undo file last written or read holds the
+                               // undo tree, apart from headers with
+                               // uh_dirty set and those in b_u_freed
+  FileID b_u_file_id;          // identity of that undo file
+  uint64_t b_u_file_size;      // its size after the last write
+  uint64_t b_u_file_base;      // size of the part before the journal
+  u_seq_vec_t b_u_freed;       // uh_seq of headers freed since then
+  uint8_t b_u_hash[UNDO_HASH_SIZE];  // hash of the text, valid when
+                               // b_u_hash_gen and b_u_hash_tick match
+  uint64_t b_u_hash_gen;       // ml_text_gen when b_u_hash was computed
+  varnumber_T b_u_hash_tick;   // changedtick when b_u_hash was computed
 
   // variables for "U" command in undo.c
   char *b_u_line_ptr;           // saved line for "U" command
@@ -867,6 +887,9 @@ typedef struct {
   int len;    ///< length: 0 - to the end of line
 } llpos_T;
 
+/// 'hlsearch' matches kept for lines of a window, see match.c.
+typedef struct searchhl_cache_S searchhl_cache_T;
+
 /// matchitem_T provides a linked list for storing match items for ":match",
 /// matchadd() and matchaddpos().
 typedef struct matchitem matchitem_T;
@@ -1283,6 +1306,7 @@ struct window_S {
   int w_changelistidx;                  // current position in b_changelist
 
   matchitem_T *w_match_head;            // head of match list
+  searchhl_cache_T *w_searchhl_cache;   // 'hlsearch' matches of lines
   int w_next_match_id;                  // next match ID
 
   // the tagstack grows from 0 upwards:
@@ -202,7 +202,17 @@ void buf_updates_send_changes(buf_T *buf, linenr_T firstline, int64_t num_added,
   size_t deleted_codepoints, deleted_codeunits;
   size_t deleted_bytes = ml_flush_deleted_bytes(buf, &deleted_codepoints,
                                                 &deleted_codeunits);
+  buf_updates_send_changes_deleted(buf, firstline, num_added, num_removed,
+                                   deleted_bytes, deleted_codepoints, deleted_codeunits);
+}
 
+/// Like buf_updates_send_changes(), for a caller that already flushed the
+/// size of the deleted text with ml_flush_deleted_bytes().  Used when
+/// several changes are reported at once.
+void buf_updates_send_changes_deleted(buf_T *buf, linenr_T firstline, int64_t num_added,
+                                      int64_t num_removed, size_t deleted_bytes,
+                                      size_t deleted_codepoints, size_t deleted_codeunits)
+{
   if (!buf_updates_active(buf)) {
     return;
   }
@@ -10,6 +10,7 @@
 #include <uv.h>
 
 #include "auto/config.h"
+#include "klib/kvec.h"
 #include "nvim/ascii_defs.h"
 #include "nvim/autocmd.h"
 #include "nvim/autocmd_defs.h"
@@ -21,6 +22,8 @@
 #include "nvim/errors.h"
 #include "nvim/eval.h"
 #include "nvim/eval/typval_defs.h"
+#include "nvim/event/loop.h"
+#include "nvim/event/multiqueue.h"
 #include "nvim/ex_cmds.h"
 #include "nvim/ex_cmds_defs.h"
 #include "nvim/ex_eval.h"
@@ -32,6 +35,7 @@
 #include "nvim/iconv_defs.h"
 #include "nvim/input.h"
 #include "nvim/macros_defs.h"
+#include "nvim/main.h"
 #include "nvim/mbyte.h"
 #include "nvim/memline.h"
 #include "nvim/memline_defs.h"
@@ -92,6 +96,61 @@ struct bw_info {
   iconv_t bw_iconv_fd;            // descriptor for iconv() or -1
 };
 
+/// Maximum number of buffers passed to one os_writev() call by
+/// buf_write_async_work().
+#define BW_ASYNC_BUFS 1024
+
+/// A buffer being written on a worker thread, see 'writeasync'.
+typedef struct bw_async_S bw_async_T;
+struct bw_async_S {
+  uv_work_t bw_req;
+  bw_async_T *bw_next;            ///< next job in "bw_jobs"
+
+  // Used by the worker thread.
+  int bw_fd;                      ///< file being written
+  buf_snapshot_T *bw_snap;        ///< text to be written
+  linenr_T bw_start;              ///< first line to write
+  linenr_T bw_end;                ///< last line to write
+  bool bw_no_eol;                 ///< no end-of-line after the last line
+  bool bw_eof;                    ///< write a trailing CTRL-Z
+  bool bw_fsync;                  ///< call fsync() when done
+  char bw_bom[8];                 ///< byte order mark
+  int bw_bom_len;                 ///< length of "bw_bom"
+  char bw_eol[2];                 ///< end-of-line sequence
+  int bw_eol_len;                 ///< length of "bw_eol"
+  kvec_t(char *) bw_copies;       ///< lines with NUL bytes, until written
+
+  // Set by the worker thread.
+  int bw_error;                   ///< write error or zero
+  int bw_fsync_error;             ///< fsync() error or zero
+  off_T bw_nchars;                ///< number of bytes written
+
+  // Used on the main thread when the job is done.
+  bool bw_finished;               ///< buf_write_async_finish() was called
+  bool bw_ok;                     ///< writing succeeded
+  bool bw_posted;                 ///< buf_write_async_post() was called
+  exarg_T bw_ea;                  ///< ++opt arguments, for v:cmdarg
+  int bw_bufnr;                   ///< buffer that was written
+  varnumber_T bw_changedtick;     ///< b:changedtick when the write started
+  char *bw_fname;                 ///< name of the written file
+  char *bw_backup;                ///< backup file or NULL
+  bool bw_backup_copy;            ///< backup was made by copying
+  bool bw_newfile;                ///< file did not exist before
+  int bw_perm;                    ///< permissions of the original file
+  bool bw_made_writable;          ///< 'w' bit was set for ":w!"
+  vim_acl_T bw_acl;               ///< ACL of the original file
+  FileInfo bw_file_info_old;      ///< info about the original file
+  int bw_fileformat;              ///< EOL_UNIX or EOL_DOS
+};
+
+/// Jobs that were started and not freed yet.
+static bw_async_T *bw_jobs = NULL;
+/// Number of jobs in "bw_jobs" that the worker did not finish yet.
+static int bw_jobs_running = 0;
+static uv_mutex_t bw_jobs_mutex;
+static uv_cond_t bw_jobs_cond;
+static bool bw_jobs_init = false;
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "bufwrite.c.generated.h"
 #endif
@@ -1038,6 +1097,397 @@ nobackup:
   return OK;
 }
 
+/// Reset 'modified' after the whole buffer was written.
+static void buf_write_unchanged(buf_T *buf)
+{
+  unchanged(buf, true, false);
+  const varnumber_T changedtick = buf_get_changedtick(buf);
+  if (buf->b_last_changedtick + 1 == changedtick) {
+    // b:changedtick may be incremented in unchanged() but that should not
+    // trigger a TextChanged event.
+    buf->b_last_changedtick = changedtick;
+  }
+  u_unchanged(buf);
+  u_update_save_nr(buf);
+}
+
+/// Write "nbufs" buffers for "job" and free the lines copied for them.
+static void buf_write_async_flush(bw_async_T *job, uv_buf_t *bufs, size_t nbufs)
+{
+  ptrdiff_t r = nbufs > 0 ? os_writev(job->bw_fd, bufs, nbufs) : 0;
+  for (size_t i = 0; i < kv_size(job->bw_copies); i++) {
+    xfree(kv_A(job->bw_copies, i));
+  }
+  kv_size(job->bw_copies) = 0;
+  if (r < 0) {
+    job->bw_error = (int)r;
+  }
+}
+
+/// Write the lines of a buffer snapshot, runs on a worker thread.
+static void buf_write_async_work(uv_work_t *req)
+{
+  bw_async_T *job = req->data;
+  uv_buf_t bufs[BW_ASYNC_BUFS];
+  size_t nbufs = 0;
+
+  if (job->bw_bom_len > 0) {
+    bufs[nbufs++] = uv_buf_init(job->bw_bom, (unsigned)job->bw_bom_len);
+    job->bw_nchars += job->bw_bom_len;
+  }
+
+  snappos_T pos = { 0 };
+  for (linenr_T lnum = job->bw_start; lnum <= job->bw_end && job->bw_error == 0; lnum++) {
+    size_t len;
+    const char *line = ml_snapshot_get_line(job->bw_snap, lnum, &pos, &len);
+    if (memchr(line, NL, len) != NULL) {
+      // NUL bytes are stored as NL in memory.
+      char *copy = xmemdup(line, len);
+      memchrsub(copy, NL, NUL, len);
+      kv_push(job->bw_copies, copy);
+      line = copy;
+    }
+    bufs[nbufs++] = uv_buf_init((char *)line, (unsigned)len);
+    job->bw_nchars += (off_T)len;
+    if (lnum < job->bw_end || !job->bw_no_eol) {
+      bufs[nbufs++] = uv_buf_init(job->bw_eol, (unsigned)job->bw_eol_len);
+      job->bw_nchars += job->bw_eol_len;
+    }
+    if (nbufs > BW_ASYNC_BUFS - 2) {
+      buf_write_async_flush(job, bufs, nbufs);
+      nbufs = 0;
+    }
+  }
+
+  if (job->bw_error == 0) {
+    if (job->bw_eof) {
+      // write trailing CTRL-Z
+      bufs[nbufs++] = uv_buf_init((char *)"\x1a", 1);
+    }
+    buf_write_async_flush(job, bufs, nbufs);
+  }
+  kv_destroy(job->bw_copies);
+
+  if (job->bw_error == 0 && job->bw_fsync) {
+    // Not os_fsync(), it updates the statistics that are not thread-safe.
+    uv_fs_t fs_req;
+    int r = uv_fs_fsync(NULL, &fs_req, job->bw_fd, NULL);
+    uv_fs_req_cleanup(&fs_req);
+    // fsync not supported on this storage.
+    if (r != 0 && r != UV_ENOTSUP) {
+      job->bw_fsync_error = r;
+    }
+  }
+
+  uv_mutex_lock(&bw_jobs_mutex);
+  bw_jobs_running--;
+  uv_cond_broadcast(&bw_jobs_cond);
+  uv_mutex_unlock(&bw_jobs_mutex);
+}
+
+/// Called on the main loop when a worker finished writing.
+static void buf_write_async_done(uv_work_t *req, int status)
+{
+  multiqueue_put(main_loop.events, buf_write_async_event, req->data);
+}
+
+/// Finish a write from the event loop, where autocommands can be triggered
+/// safely, and free the job.
+static void buf_write_async_event(void **argv)
+{
+  bw_async_T *job = argv[0];
+  if (!job->bw_finished) {
+    buf_write_async_finish(job);
+  }
+  buf_write_async_post(job);
+  for (bw_async_T **pp = &bw_jobs; *pp != NULL; pp = &(*pp)->bw_next) {
+    if (*pp == job) {
+      *pp = job->bw_next;
+      break;
+    }
+  }
+  xfree(job->bw_fname);
+  xfree(job);
+}
+
+/// Trigger BufWritePost for "job" when writing succeeded and the buffer
+/// still exists.  Only called where autocommands may free buffers.
+static void buf_write_async_post(bw_async_T *job)
+{
+  if (job->bw_posted) {
+    return;
+  }
+  job->bw_posted = true;
+  buf_T *buf = buflist_findnr(job->bw_bufnr);
+  if (!job->bw_ok || buf == NULL || buf->b_ml.ml_mfp == NULL) {
+    return;
+  }
+  // The job may be freed when autocommands process events.
+  exarg_T ea = job->bw_ea;
+  char *fname = xstrdup(job->bw_fname);
+  buf_write_do_post_autocmds(buf, fname, &ea, false, false, true, true);
+  xfree(fname);
+}
+
+/// Finish writing a buffer after the worker thread is done: close the file
+/// and report the result.  'modified' is only reset when writing succeeded
+/// and the buffer was not changed since it started.  When writing failed the
+/// backup is put back.  Does not trigger autocommands, see
+/// buf_write_async_post().
+static void buf_write_async_finish(bw_async_T *job)
+{
+  job->bw_finished = true;
+  ml_snapshot_unref(job->bw_snap);
+  job->bw_snap = NULL;
+
+  buf_T *buf = buflist_findnr(job->bw_bufnr);
+  char *fname = job->bw_fname;
+  char *backup = job->bw_backup;
+  int perm = job->bw_perm;
+  Error_T err = { 0 };
+  bool ok = true;
+  int error;
+
+  if (job->bw_fsync) {
+    g_stats.fsync++;
+  }
+  if (job->bw_error != 0) {
+    err = set_err(_(e_write_error_file_system_full));
+    ok = false;
+  } else if (job->bw_fsync_error != 0) {
+    err = set_err_arg(e_fsync, job->bw_fsync_error);
+    ok = false;
+  }
+
+  if (!job->bw_backup_copy) {
+#ifdef HAVE_XATTR
+    os_copy_xattr(backup, fname);
+#endif
+  }
+
+#ifdef UNIX
+  // When creating a new file, set its owner/group to that of the original
+  // file.  Get the new device and inode number.
+  if (backup != NULL && !job->bw_backup_copy) {
+    FileInfo file_info;
+    if (!os_fileinfo(fname, &file_info)
+        || file_info.stat.st_uid != job->bw_file_info_old.stat.st_uid
+        || file_info.stat.st_gid != job->bw_file_info_old.stat.st_gid) {
+      os_fchown(job->bw_fd, (uv_uid_t)job->bw_file_info_old.stat.st_uid,
+                (uv_gid_t)job->bw_file_info_old.stat.st_gid);
+      if (perm >= 0) {  // Set permission again, may have changed.
+        os_setperm(fname, perm);
+      }
+    }
+    if (buf != NULL) {
+      buf_set_file_id(buf);
+    }
+  } else if (buf != NULL && !buf->file_id_valid) {
+    // Set the file_id when creating a new file.
+    buf_set_file_id(buf);
+  }
+#endif
+
+  if ((error = os_close(job->bw_fd)) != 0 && ok) {
+    err = set_err_arg(_("E512: Close failed: %s"), error);
+    ok = false;
+  }
+
+#ifdef UNIX
+  if (job->bw_made_writable) {
+    perm &= ~0200;              // reset 'w' bit for security reasons
+  }
+#endif
+  if (perm >= 0) {  // Set perm. of new file same as old file.
+    os_setperm(fname, perm);
+  }
+  if (!job->bw_backup_copy) {
+    os_set_acl(fname, job->bw_acl);
+  }
+  os_free_acl(job->bw_acl);
+
+  job->bw_ok = ok;
+  if (ok) {
+    if (buf != NULL) {
+      if (buf_get_changedtick(buf) == job->bw_changedtick) {
+        buf_write_unchanged(buf);
+      }
+      // Update the timestamp of the swap file and reset the BF_WRITE_MASK
+      // flags. Also sets buf->b_mtime.
+      ml_timestamp(buf);
+      buf->b_flags &= ~BF_WRITE_MASK;
+
+      add_quoted_fname(IObuff, IOSIZE, buf, fname);
+      bool insert_space = false;
+      if (job->bw_newfile) {
+        xstrlcat(IObuff, _("[New]"), IOSIZE);
+        insert_space = true;
+      }
+      if (job->bw_no_eol) {
+        xstrlcat(IObuff, _("[noeol]"), IOSIZE);
+        insert_space = true;
+      }
+      // may add [unix/dos/mac]
+      if (msg_add_fileformat(job->bw_fileformat)) {
+        insert_space = true;
+      }
+      msg_add_lines(insert_space, job->bw_end - job->bw_start + 1, job->bw_nchars);
+      if (!shortmess(SHM_WRITE)) {
+        xstrlcat(IObuff, shortmess(SHM_WRI) ? _(" [w]") : _(" written"), IOSIZE);
+      }
+      set_keep_msg(msg_trunc(IObuff, false, 0), 0);
+    }
+
+    // Remove the backup unless 'backup' option is set
+    if (!p_bk && backup != NULL && os_remove(backup) != 0) {
+      emsg(_("E207: Can't delete backup file"));
+    }
+  } else {
+    // The new file is probably corrupt, put the backup in its place.
+    bool restored = false;
+    if (backup != NULL) {
+      if (job->bw_backup_copy) {
+        restored = os_copy(backup, fname, UV_FS_COPYFILE_FICLONE) == 0;
+      } else {
+        restored = vim_rename(backup, fname) == 0;
+      }
+    }
+
+    add_quoted_fname(IObuff, IOSIZE - 100, buf, fname);
+    emit_err(&err);
+    if (!restored) {
+      const int attr = HL_ATTR(HLF_E);  // Set highlight for error messages.
+      msg_puts_attr(_("\nWARNING: Original file may be lost or damaged\n"),
+                    attr | MSG_HIST);
+      msg_puts_attr(_("don't quit the editor until the file is successfully written!"),
+                    attr | MSG_HIST);
+    }
+
+    if (buf != NULL) {
+      // The buffer is still modified, update the timestamp to avoid an
+      // "overwrite changed file" prompt when writing again.
+      FileInfo file_info;
+      if (os_fileinfo(fname, &file_info)) {
+        buf_store_file_info(buf, &file_info);
+        buf->b_mtime_read = buf->b_mtime;
+        buf->b_mtime_read_ns = buf->b_mtime_ns;
+      }
+    }
+  }
+
+  XFREE_CLEAR(job->bw_backup);
+}
+
+/// Start writing "buf" on a worker thread, after buf_write() opened the file
+/// as "fd".  Takes ownership of "backup" and "acl".
+static void buf_write_async_start(buf_T *buf, char *fname, int fd, linenr_T start, linenr_T end,
+                                  bool no_eol, char *bom, int bom_len, int fileformat,
+                                  char *backup, bool backup_copy, bool newfile, int perm,
+                                  bool made_writable, vim_acl_T acl, FileInfo *file_info_old,
+                                  exarg_T *eap)
+{
+  if (!bw_jobs_init) {
+    uv_mutex_init(&bw_jobs_mutex);
+    uv_cond_init(&bw_jobs_cond);
+    bw_jobs_init = true;
+  }
+
+  bw_async_T *job = xcalloc(1, sizeof(bw_async_T));
+  job->bw_req.data = job;
+  job->bw_fd = fd;
+  job->bw_snap = ml_snapshot(buf);
+  job->bw_start = start;
+  job->bw_end = end;
+  job->bw_no_eol = no_eol;
+  job->bw_eof = !buf->b_p_fixeol && buf->b_p_eof;
+  job->bw_fsync = p_fs;
+  memcpy(job->bw_bom, bom, (size_t)bom_len);
+  job->bw_bom_len = bom_len;
+  if (fileformat == EOL_UNIX) {
+    job->bw_eol[job->bw_eol_len++] = NL;
+  } else {
+    job->bw_eol[job->bw_eol_len++] = CAR;
+    job->bw_eol[job->bw_eol_len++] = NL;
+  }
+  job->bw_bufnr = buf->b_fnum;
+  job->bw_changedtick = buf_get_changedtick(buf);
+  job->bw_fname = xstrdup(fname);
+  job->bw_backup = backup;
+  job->bw_backup_copy = backup_copy;
+  job->bw_newfile = newfile;
+  job->bw_perm = perm;
+  job->bw_made_writable = made_writable;
+  job->bw_acl = acl;
+  job->bw_file_info_old = *file_info_old;
+  job->bw_fileformat = fileformat;
+  // Only the arguments used for v:cmdarg, "eap" does not stay valid.
+  job->bw_ea.cmdidx = eap->cmdidx;
+  job->bw_ea.forceit = eap->forceit;
+  job->bw_ea.bad_char = eap->bad_char;
+  job->bw_ea.mkdir_p = eap->mkdir_p;
+
+  job->bw_next = bw_jobs;
+  bw_jobs = job;
+  uv_mutex_lock(&bw_jobs_mutex);
+  bw_jobs_running++;
+  uv_mutex_unlock(&bw_jobs_mutex);
+  uv_queue_work(&main_loop.uv, &job->bw_req, buf_write_async_work, buf_write_async_done);
+}
+
+/// @return  true when "buf" is being written on a worker thread.
+bool buf_write_pending(const buf_T *buf)
+  FUNC_ATTR_NONNULL_ALL FUNC_ATTR_PURE
+{
+  for (bw_async_T *job = bw_jobs; job != NULL; job = job->bw_next) {
+    if (!job->bw_finished && job->bw_bufnr == buf->b_fnum) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Trigger the BufWritePost autocommands of finished writes now, instead of
+/// from the event loop.  Used when exiting.
+void buf_write_post_all(void)
+{
+  // Autocommands may process events and free jobs, start from the list head
+  // every time.
+  while (true) {
+    bw_async_T *job = bw_jobs;
+    while (job != NULL && (!job->bw_finished || job->bw_posted)) {
+      job = job->bw_next;
+    }
+    if (job == NULL) {
+      break;
+    }
+    buf_write_async_post(job);
+  }
+}
+
+/// Wait for buffers that are being written on a worker thread to be done and
+/// finish writing them.  Called before anything that depends on the written
+/// file, and before checking whether a buffer can be abandoned: 'modified' is
+/// only reset when the write is done.  No autocommands are triggered, but
+/// callers must still check that a buffer is valid afterwards.
+void buf_write_wait(void)
+{
+  if (bw_jobs == NULL) {
+    return;
+  }
+
+  uv_mutex_lock(&bw_jobs_mutex);
+  while (bw_jobs_running > 0) {
+    uv_cond_wait(&bw_jobs_cond, &bw_jobs_mutex);
+  }
+  uv_mutex_unlock(&bw_jobs_mutex);
+
+  for (bw_async_T *job = bw_jobs; job != NULL; job = job->bw_next) {
+    if (!job->bw_finished) {
+      buf_write_async_finish(job);
+    }
+  }
+}
+
 /// buf_write() - write to file "fname" lines "start" through "end"
 ///
 /// We do our own buffering here because fwrite() is so slow.
@@ -1065,12 +1515,19 @@ int buf_write(buf_T *buf, char *fname, char *sfname, linenr_T start, linenr_T en
   // writing everything
   bool whole = (start == 1 && end == buf->b_ml.ml_line_count);
   bool write_undo_file = false;
+  bool undo_hash_cached = false;
+  uint8_t undo_hash[UNDO_HASH_SIZE];
+  bool async = false;  // writing on a worker thread
   context_sha256_T sha_ctx;
   unsigned bkc = get_bkc_flags(buf);
 
   if (fname == NULL || *fname == NUL) {  // safety check
     return FAIL;
   }
+
+  // A previous write of the file may still be in progress.
+  buf_write_wait();
+
   if (buf->b_ml.ml_mfp == NULL) {
     // This can happen during startup when there is a stray "w" in the
     // vimrc file.
@@ -1242,9 +1699,9 @@ int buf_write(buf_T *buf, char *fname, char *sfname, linenr_T start, linenr_T en
     }
   }
 
-#if defined(UNIX)
   bool made_writable = false;  // 'w' bit has been set
 
+#if defined(UNIX)
   // When using ":w!" and the file was read-only: make it writable
   if (forceit && perm >= 0 && !(perm & 0200)
       && file_info_old.stat.st_uid == getuid()
@@ -1361,6 +1818,17 @@ int buf_write(buf_T *buf, char *fname, char *sfname, linenr_T start, linenr_T en
     notconverted = true;
   }
 
+  // Write the buffer on a worker thread for a plain ":write", see
+  // 'writeasync'.  Writes that need conversion or must be complete before
+  // returning are done here.
+  async = p_was && eap != NULL
+          && (eap->cmdidx == CMD_write || eap->cmdidx == CMD_update)
+          && eap->force_enc == 0 && eap->force_ff == 0 && eap->force_bin == 0
+          && reset_changed && whole && overwriting && !append && !filtering
+          && !converted && wfname == fname && !device && !exiting
+          && *p_pm == NUL && !buf->b_p_udf && buf->b_ml.ml_map == NULL
+          && get_fileformat(buf) != EOL_MAC;
+
   bool no_eol = false;  // no end-of-line written
   int nchars;
   linenr_T lnum;
@@ -1399,6 +1867,12 @@ int buf_write(buf_T *buf, char *fname, char *sfname, linenr_T start, linenr_T en
                                      : (O_CREAT | O_TRUNC));
       const int mode = perm < 0 ? 0666 : (perm & 0777);
 
+      // A buffer may take its lines from a mapping of the file that is
+      // about to be truncated, possibly the buffer being written.
+      if (!append) {
+        ml_map_release_file(wfname);
+      }
+
       while ((fd = os_open(wfname, fflags, mode)) < 0) {
         // A forced write will try to create a new file if the old one
         // is still readonly. This may also happen when the directory
@@ -1493,6 +1967,24 @@ restore_backup:
       write_bin = buf->b_p_bin;
     }
 
+    if (async) {
+      char bom[8];
+      int bom_len = buf->b_p_bomb && !write_bin ? make_bom(bom, fenc) : 0;
+      fileformat = get_fileformat(buf);
+      no_eol = end >= start && (write_bin || !buf->b_p_fixeol)
+               && ((write_bin && end == buf->b_no_eol_lnum)
+                   || (end == buf->b_ml.ml_line_count && !buf->b_p_eol));
+      buf_write_async_start(buf, ffname, fd, start, end, no_eol, bom, bom_len, fileformat,
+                            backup, backup_copy, newfile, perm, made_writable, acl,
+                            &file_info_old, eap);
+      // Owned by the job now, 'modified' is reset when it is done.
+      // buf_check_timestamp() skips the buffer until then.
+      backup = NULL;
+      acl = NULL;
+      no_wait_return--;
+      goto nofail;
+    }
+
     // Skip the BOM when appending and the file already existed, the BOM
     // only makes sense at the start of the file.
     if (buf->b_p_bomb && !write_bin && (!append || perm < 0)) {
@@ -1512,8 +2004,12 @@ restore_backup:
     write_undo_file = (buf->b_p_udf && overwriting && !append
                        && !filtering && reset_changed && !checking_conversion);
     if (write_undo_file) {
-      // Prepare for computing the hash value of the text.
-      sha256_start(&sha_ctx);
+      // Prepare for computing the hash value of the text, unless it is known
+      // already because the text did not change since it was last computed.
+      undo_hash_cached = u_get_cached_hash(buf, undo_hash);
+      if (!undo_hash_cached) {
+        sha256_start(&sha_ctx);
+      }
     }
 
     write_info.bw_len = bufsize;
@@ -1525,7 +2021,7 @@ restore_backup:
       // The next while loop is done once for each character written.
       // Keep it fast!
       char *ptr = ml_get_buf(buf, lnum) - 1;
-      if (write_undo_file) {
+      if (write_undo_file && !undo_hash_cached) {
         sha256_update(&sha_ctx, (uint8_t *)ptr + 1, (uint32_t)(strlen(ptr + 1) + 1));
       }
       char c;
@@ -1685,6 +2181,7 @@ restore_backup:
       // The file was written to a temp file, now it needs to be converted
       // with 'charconvert' to (overwrite) the output file.
       if (end != 0) {
+        ml_map_release_file(fname);
         if (eval_charconvert("utf-8", fenc, wfname, fname) == FAIL) {
           write_info.bw_conv_error = true;
           end = 0;
@@ -1800,15 +2297,7 @@ restore_backup:
   if (reset_changed && whole && !append
       && !write_info.bw_conv_error
       && (overwriting || vim_strchr(p_cpo, CPO_PLUS) != NULL)) {
-    unchanged(buf, true, false);
-    const varnumber_T changedtick = buf_get_changedtick(buf);
-    if (buf->b_last_changedtick + 1 == changedtick) {
-      // b:changedtick may be incremented in unchanged() but that should not
-      // trigger a TextChanged event.
-      buf->b_last_changedtick = changedtick;
-    }
-    u_unchanged(buf);
-    u_update_save_nr(buf);
+    buf_write_unchanged(buf);
   }
 
   // If written to the current file, update the timestamp of the swap file
@@ -1921,13 +2410,14 @@ nofail:
   // When writing the whole file and 'undofile' is set, also write the undo
   // file.
   if (retval == OK && write_undo_file) {
-    uint8_t hash[UNDO_HASH_SIZE];
-
-    sha256_finish(&sha_ctx, hash);
-    u_write_undo(NULL, false, buf, hash);
+    if (!undo_hash_cached) {
+      sha256_finish(&sha_ctx, undo_hash);
+      u_set_cached_hash(buf, undo_hash);
+    }
+    u_write_undo(NULL, false, buf, undo_hash);
   }
 
-  if (!should_abort(retval)) {
+  if (!should_abort(retval) && !async) {
     buf_write_do_post_autocmds(buf, fname, eap, append, filtering, reset_changed, whole);
     if (aborting()) {       // autocmds may abort script processing
       retval = false;
@@ -34,6 +34,7 @@
 #include "nvim/mark.h"
 #include "nvim/mark_defs.h"
 #include "nvim/marktree_defs.h"
+#include "nvim/match.h"
 #include "nvim/mbyte.h"
 #include "nvim/mbyte_defs.h"
 #include "nvim/memline.h"
@@ -235,6 +236,7 @@ static void changed_common(buf_T *buf, linenr_T lnum, colnr_T col, linenr_T lnum
 {
   // mark the buffer as modified
   changed(buf);
+  search_stat_changed(buf, lnum, lnume, xtra);
 
   FOR_ALL_WINDOWS_IN_TAB(win, curtab) {
     if (win->w_buffer == buf && win->w_p_diff && diff_internal()) {
@@ -321,6 +323,8 @@ static void changed_common(buf_T *buf, linenr_T lnum, colnr_T col, linenr_T lnum
 
   FOR_ALL_TAB_WINDOWS(tp, wp) {
     if (wp->w_buffer == buf) {
+      searchhl_cache_changed(wp, lnum, lnume, xtra);
+
       // Mark this window to be redrawn later.
       if (!redraw_not_allowed && wp->w_redr_type < UPD_VALID) {
         wp->w_redr_type = UPD_VALID;
@@ -498,6 +502,15 @@ void deleted_lines(linenr_T lnum, linenr_T count)
 /// Make sure the cursor is on a valid line before calling, a GUI callback may
 /// be triggered to display the cursor.
 void deleted_lines_mark(linenr_T lnum, int count)
+{
+  deleted_lines_adjust(lnum, count);
+  changed_lines(curbuf, lnum, 0, lnum + (linenr_T)count, (linenr_T)(-count), true);
+}
+
+/// Adjust marks and extmarks for deleted lines, like deleted_lines_mark(),
+/// without marking the lines as changed.  The caller must call
+/// changed_lines() later.
+void deleted_lines_adjust(linenr_T lnum, int count)
 {
   bool made_empty = (count > 0) && curbuf->b_ml.ml_flags & ML_EMPTY;
 
@@ -505,7 +518,6 @@ void deleted_lines_mark(linenr_T lnum, int count)
   // if we deleted the entire buffer, we need to implicitly add a new empty line
   extmark_adjust(curbuf, lnum, (linenr_T)(lnum + count - 1), MAXLNUM,
                  -(linenr_T)count + (made_empty ? 1 : 0), kExtmarkUndo);
-  changed_lines(curbuf, lnum, 0, lnum + (linenr_T)count, (linenr_T)(-count), true);
 }
 
 /// Marks the area to be redrawn after a change.
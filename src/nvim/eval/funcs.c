@@ -6215,6 +6215,13 @@ static void read_file_or_blob(typval_T *argvars, typval_T *rettv, bool always_bl
     for (p = buf, start = buf;
          p < buf + readlen || (readlen <= 0 && (prevlen > 0 || binary));
          p++) {
+      if (readlen > 0) {
+        // Skip ahead to the next character that needs to be handled.
+        p = xmemscan3(p, '\n', NUL, binary ? NUL : (char)0xbf, (size_t)(buf + readlen - p));
+        if (p == buf + readlen) {
+          break;
+        }
+      }
       if (readlen <= 0 || *p == '\n') {
         char *s = NULL;
         size_t len = (size_t)(p - start);
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <uv.h>
 
 #include "auto/config.h"
 #include "klib/kvec.h"
@@ -61,6 +62,7 @@
 #include "nvim/main.h"
 #include "nvim/mark.h"
 #include "nvim/mark_defs.h"
+#include "nvim/math.h"
 #include "nvim/mbyte.h"
 #include "nvim/memline.h"
 #include "nvim/memline_defs.h"
@@ -93,6 +95,7 @@
 #include "nvim/state_defs.h"
 #include "nvim/strings.h"
 #include "nvim/terminal.h"
+#include "nvim/textformat.h"
 #include "nvim/types_defs.h"
 #include "nvim/ui.h"
 #include "nvim/ui_defs.h"
@@ -134,6 +137,47 @@ typedef struct {
   linenr_T lines_needed;  // lines needed in the preview window
 } PreviewLines;
 
+/// Lines changed by :substitute or deleted by :global that are reported to
+/// buffer update listeners as one change.  Numbers refer to the buffer _after_
+/// the command.
+typedef struct {
+  linenr_T first;             ///< first changed line
+  linenr_T last;              ///< below last changed line
+  linenr_T line_count;        ///< buffer line count before the change
+  linenr_T xtra;              ///< number of lines added by the change
+  size_t deleted_bytes;       ///< size of the replaced text, see ml_flush_deleted_bytes()
+  size_t deleted_codepoints;
+  size_t deleted_codeunits;
+} SubChange;
+
+typedef kvec_t(SubChange) SubChangeVec;
+
+/// Changes separated by fewer unchanged lines than this are reported as one,
+/// sending a few unchanged lines is cheaper than another event.
+enum { SUB_CHANGE_MAXGAP = 8, };
+
+/// Number to sort a line on for ":sort n", ":sort x", etc.
+typedef struct {
+  uint64_t key;           ///< number with the sign bit flipped, sorts as unsigned
+  linenr_T idx;           ///< index of the line in the sorted range
+} sortnum_T;
+
+/// Part of the work of sorting lines, done by one thread.
+typedef struct {
+  linenr_T *src;          ///< line indexes
+  linenr_T *dst;          ///< scratch space or merge result
+  size_t lo;              ///< first index
+  size_t mid;             ///< start of the second part when merging
+  size_t hi;              ///< below last index
+  bool merge;             ///< merge "src" into "dst" instead of sorting "src"
+} sortjob_T;
+
+enum {
+  SORT_RUN_LEN = 16,            ///< runs sorted with insertion sort before merging
+  SORT_PARALLEL_MIN = 50000,    ///< use several threads from this many lines
+  SORT_MAX_THREADS = 8,         ///< maximum number of threads for sorting
+};
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "ex_cmds.c.generated.h"
 #endif
@@ -349,11 +393,6 @@ static int linelen(int *has_tab)
   return len;
 }
 
-// Buffer for two lines used during sorting.  They are allocated to
-// contain the longest line being sorted.
-static char *sortbuf1;
-static char *sortbuf2;
-
 static bool sort_lc;      ///< sort using locale
 static bool sort_ic;      ///< ignore case
 static bool sort_nr;      ///< sort on number
@@ -362,21 +401,11 @@ static bool sort_flt;     ///< sort on floating number
 
 static bool sort_abort;   ///< flag to indicate if sorting has been interrupted
 
-/// Struct to store info to be sorted.
-typedef struct {
-  linenr_T lnum;          ///< line number
-  union {
-    struct {
-      varnumber_T start_col_nr;  ///< starting column number
-      varnumber_T end_col_nr;    ///< ending column number
-    } line;
-    struct {
-      varnumber_T value;         ///< value if sorting by integer
-      bool is_number;            ///< true when line contains a number
-    } num;
-    float_T value_flt;    ///< value if sorting by float
-  } st_u;
-} sorti_T;
+// Keys of the lines being sorted, indexed by the line number relative to the
+// start of the range.  They are extracted once before sorting, the threads
+// doing the sorting only read them.
+static char **sort_keys;        ///< text to sort on when sorting strings
+static float_T *sort_flts;      ///< value when sorting on floating numbers
 
 static int string_compare(const void *s1, const void *s2) FUNC_ATTR_NONNULL_ALL
 {
@@ -386,67 +415,223 @@ static int string_compare(const void *s1, const void *s2) FUNC_ATTR_NONNULL_ALL
   return sort_ic ? STRICMP(s1, s2) : strcmp(s1, s2);
 }
 
-static int sort_compare(const void *s1, const void *s2)
+/// Compare the keys of the lines with index "i1" and "i2".  Does not check
+/// for an interrupt, it is called from other threads.
+static int sort_compare(linenr_T i1, linenr_T i2)
 {
-  sorti_T l1 = *(sorti_T *)s1;
-  sorti_T l2 = *(sorti_T *)s2;
-  int result = 0;
+  int result;
+  if (sort_flt) {
+    result = sort_flts[i1] == sort_flts[i2]
+             ? 0
+             : sort_flts[i1] > sort_flts[i2] ? 1 : -1;
+  } else {
+    result = string_compare(sort_keys[i1], sort_keys[i2]);
+  }
 
-  // If the user interrupts, there's no way to stop qsort() immediately, but
-  // if we return 0 every time, qsort will assume it's done sorting and
-  // exit.
-  if (sort_abort) {
-    return 0;
+  // If two lines have the same value, preserve the original line order.
+  if (result == 0) {
+    return i1 - i2;
+  }
+  return result;
+}
+
+/// Merge the sorted parts src[lo] to src[mid - 1] and src[mid] to src[hi - 1]
+/// into dst[lo] to dst[hi - 1].
+static void sort_merge(const linenr_T *src, linenr_T *dst, size_t lo, size_t mid, size_t hi)
+{
+  size_t i = lo;
+  size_t j = mid;
+  size_t k = lo;
+
+  // Often the parts are already in order.
+  if (i < mid && j < hi && sort_compare(src[mid - 1], src[mid]) > 0) {
+    while (i < mid && j < hi) {
+      dst[k++] = sort_compare(src[j], src[i]) < 0 ? src[j++] : src[i++];
+    }
+  }
+  memcpy(dst + k, src + i, (mid - i) * sizeof(*dst));
+  k += mid - i;
+  memcpy(dst + k, src + j, (hi - j) * sizeof(*dst));
+}
+
+/// Sort idx[lo] to idx[hi - 1] with a merge sort, using the same part of
+/// "tmp" as scratch space.
+///
+/// @param check_int  check for an interrupt, only on the main thread
+static void sort_range(linenr_T *idx, linenr_T *tmp, size_t lo, size_t hi, bool check_int)
+{
+  // Sort short runs with insertion sort first.
+  for (size_t run = lo; run < hi; run += SORT_RUN_LEN) {
+    size_t end = MIN(run + SORT_RUN_LEN, hi);
+    for (size_t i = run + 1; i < end; i++) {
+      linenr_T v = idx[i];
+      size_t j = i;
+      for (; j > run && sort_compare(v, idx[j - 1]) < 0; j--) {
+        idx[j] = idx[j - 1];
+      }
+      idx[j] = v;
+    }
+  }
+
+  linenr_T *src = idx;
+  linenr_T *dst = tmp;
+  for (size_t width = SORT_RUN_LEN; width < hi - lo; width *= 2) {
+    for (size_t start = lo; start < hi; start += 2 * width) {
+      sort_merge(src, dst, start, MIN(start + width, hi), MIN(start + 2 * width, hi));
+      if (check_int) {
+        fast_breakcheck();
+        if (got_int) {
+          sort_abort = true;
+          return;
+        }
+      }
+    }
+    linenr_T *p = src;
+    src = dst;
+    dst = p;
+  }
+  if (src != idx) {
+    memcpy(idx + lo, src + lo, (hi - lo) * sizeof(*idx));
+  }
+}
+
+static void sort_job_run(sortjob_T *job, bool check_int)
+{
+  if (job->merge) {
+    sort_merge(job->src, job->dst, job->lo, job->mid, job->hi);
+  } else {
+    sort_range(job->src, job->dst, job->lo, job->hi, check_int);
+  }
+}
+
+static void sort_job_work(void *arg)
+{
+  sort_job_run(arg, false);
+}
+
+/// Run "njobs" jobs, all but the first one on another thread.  When a thread
+/// cannot be created the job is done on the main thread.
+static void sort_run_jobs(sortjob_T *jobs, int njobs)
+{
+  uv_thread_t threads[SORT_MAX_THREADS];
+  bool started[SORT_MAX_THREADS] = { false };
+
+  for (int i = 1; i < njobs; i++) {
+    started[i] = uv_thread_create(&threads[i], sort_job_work, &jobs[i]) == 0;
+  }
+  for (int i = 0; i < njobs; i++) {
+    if (!started[i]) {
+      sort_job_run(&jobs[i], true);
+    }
+  }
+  for (int i = 1; i < njobs; i++) {
+    if (started[i]) {
+      uv_thread_join(&threads[i]);
+    }
   }
   fast_breakcheck();
   if (got_int) {
     sort_abort = true;
   }
+}
 
-  // When sorting numbers "start_col_nr" is the number, not the column
-  // number.
-  if (sort_nr) {
-    if (l1.st_u.num.is_number != l2.st_u.num.is_number) {
-      result = l1.st_u.num.is_number > l2.st_u.num.is_number ? 1 : -1;
-    } else {
-      result = l1.st_u.num.value == l2.st_u.num.value
-               ? 0
-               : l1.st_u.num.value > l2.st_u.num.value ? 1 : -1;
+/// Sort the "count" line indexes in "idx" on "sort_keys" or "sort_flts".
+/// A large number of lines is split into parts that are sorted on separate
+/// threads, and then merged, also on several threads while there are enough
+/// parts.  "tmp" must have room for "count" indexes.
+static void sort_lines(linenr_T *idx, linenr_T *tmp, size_t count)
+{
+  int nthreads = (int)MIN(uv_available_parallelism(), (unsigned)SORT_MAX_THREADS);
+  if (count < SORT_PARALLEL_MIN || nthreads < 2) {
+    sort_range(idx, tmp, 0, count, true);
+    return;
+  }
+
+  size_t bounds[SORT_MAX_THREADS + 1];
+  sortjob_T jobs[SORT_MAX_THREADS];
+  for (int i = 0; i <= nthreads; i++) {
+    bounds[i] = count * (size_t)i / (size_t)nthreads;
+  }
+  for (int i = 0; i < nthreads; i++) {
+    jobs[i] = (sortjob_T){ .src = idx, .dst = tmp, .lo = bounds[i], .hi = bounds[i + 1] };
+  }
+  sort_run_jobs(jobs, nthreads);
+
+  // Merge neighbouring parts until one is left.
+  linenr_T *src = idx;
+  linenr_T *dst = tmp;
+  int nparts = nthreads;
+  while (nparts > 1 && !sort_abort) {
+    int njobs = 0;
+    for (int i = 0; i < nparts; i += 2) {
+      jobs[njobs] = (sortjob_T){ .src = src, .dst = dst, .lo = bounds[i],
+                                 .mid = bounds[MIN(i + 1, nparts)],
+                                 .hi = bounds[MIN(i + 2, nparts)], .merge = true };
+      bounds[njobs] = jobs[njobs].lo;
+      njobs++;
     }
-  } else if (sort_flt) {
-    result = l1.st_u.value_flt == l2.st_u.value_flt
-             ? 0
-             : l1.st_u.value_flt > l2.st_u.value_flt ? 1 : -1;
-  } else {
-    // We need to copy one line into "sortbuf1", because there is no
-    // guarantee that the first pointer becomes invalid when obtaining the
-    // second one.
-    memcpy(sortbuf1, ml_get(l1.lnum) + l1.st_u.line.start_col_nr,
-           (size_t)(l1.st_u.line.end_col_nr - l1.st_u.line.start_col_nr + 1));
-    sortbuf1[l1.st_u.line.end_col_nr - l1.st_u.line.start_col_nr] = NUL;
-    memcpy(sortbuf2, ml_get(l2.lnum) + l2.st_u.line.start_col_nr,
-           (size_t)(l2.st_u.line.end_col_nr - l2.st_u.line.start_col_nr + 1));
-    sortbuf2[l2.st_u.line.end_col_nr - l2.st_u.line.start_col_nr] = NUL;
+    bounds[njobs] = count;
+    nparts = njobs;
+    sort_run_jobs(jobs, njobs);
+    linenr_T *p = src;
+    src = dst;
+    dst = p;
+  }
+  if (src != idx) {
+    memcpy(idx, src, count * sizeof(*idx));
+  }
+}
 
-    result = string_compare(sortbuf1, sortbuf2);
+/// Sort "count" numbers with a radix sort, a byte at a time.  Bytes that are
+/// equal in all numbers are skipped, thus small numbers take only a few
+/// passes.  The sort is stable.  "tmp" must have room for "count" numbers.
+///
+/// @return  "nums" or "tmp", whichever holds the result.
+static sortnum_T *sort_radix(sortnum_T *nums, sortnum_T *tmp, size_t count)
+{
+  size_t counts[8][256] = { 0 };
+  for (size_t i = 0; i < count; i++) {
+    for (int b = 0; b < 8; b++) {
+      counts[b][(nums[i].key >> (8 * b)) & 0xff]++;
+    }
   }
 
-  // If two lines have the same value, preserve the original line order.
-  if (result == 0) {
-    return l1.lnum - l2.lnum;
+  for (int b = 0; b < 8; b++) {
+    size_t *pos = counts[b];
+    if (count == 0 || pos[(nums[0].key >> (8 * b)) & 0xff] == count) {
+      continue;
+    }
+    size_t total = 0;
+    for (int c = 0; c < 256; c++) {
+      size_t n = pos[c];
+      pos[c] = total;
+      total += n;
+    }
+    for (size_t i = 0; i < count; i++) {
+      tmp[pos[(nums[i].key >> (8 * b)) & 0xff]++] = nums[i];
+    }
+    sortnum_T *p = nums;
+    nums = tmp;
+    tmp = p;
   }
-  return result;
+  return nums;
 }
 
 /// ":sort".
 void ex_sort(exarg_T *eap)
 {
   regmatch_T regmatch;
-  int maxlen = 0;
   size_t count = (size_t)(eap->line2 - eap->line1) + 1;
   size_t i;
   bool unique = false;
   int sort_what = 0;
+  Arena arena = ARENA_EMPTY;
+  sortnum_T *nums = NULL;
+  sortnum_T *nums_tmp = NULL;
+  size_t nums_count = 0;
+  linenr_T *order_tmp = NULL;
+  char **new_lines = NULL;
+  colnr_T *new_lens = NULL;
 
   // Sorting one line is really quick!
   if (count <= 1) {
@@ -456,10 +641,12 @@ void ex_sort(exarg_T *eap)
   if (u_save((linenr_T)(eap->line1 - 1), (linenr_T)(eap->line2 + 1)) == FAIL) {
     return;
   }
-  sortbuf1 = NULL;
-  sortbuf2 = NULL;
   regmatch.regprog = NULL;
-  sorti_T *nrs = xmalloc(count * sizeof(sorti_T));
+  char **lines = xmalloc(count * sizeof(char *));
+  colnr_T *lens = xmalloc(count * sizeof(colnr_T));
+  linenr_T *order = xmalloc(count * sizeof(linenr_T));
+  sort_keys = NULL;
+  sort_flts = NULL;
 
   sort_abort = sort_ic = sort_lc = sort_rx = sort_nr = sort_flt = false;
   size_t format_found = 0;
@@ -534,18 +721,27 @@ void ex_sort(exarg_T *eap)
   // sorting.
   sort_nr |= sort_what;
 
-  // Make an array with all line numbers.  This avoids having to copy all
-  // the lines into allocated memory.
-  // When sorting on strings "start_col_nr" is the offset in the line, for
-  // numbers sorting it's the number to sort on.  This means the pattern
-  // matching and number conversion only has to be done once per line.
-  // Also get the longest line length for allocating "sortbuf".
+  if (sort_nr) {
+    nums = xmalloc(count * sizeof(sortnum_T));
+  } else if (sort_flt) {
+    sort_flts = xmalloc(count * sizeof(float_T));
+  } else {
+    sort_keys = xmalloc(count * sizeof(char *));
+  }
+
+  // Copy all the lines, they are needed for putting them back in the sorted
+  // order and the text may become invalid in ml_get().  Extract the key to
+  // sort on for every line, so that the pattern matching and number
+  // conversion only has to be done once per line.  Lines without a number
+  // sort before any number and keep their order, they go into "order" right
+  // away.
+  linenr_T no_number = 0;
   for (linenr_T lnum = eap->line1; lnum <= eap->line2; lnum++) {
-    char *s = ml_get(lnum);
+    linenr_T idx = lnum - eap->line1;
     int len = ml_get_len(lnum);
-    if (maxlen < len) {
-      maxlen = len;
-    }
+    char *s = arena_memdupz(&arena, ml_get(lnum), (size_t)len);
+    lines[idx] = s;
+    lens[idx] = len + 1;
 
     colnr_T start_col = 0;
     colnr_T end_col = len;
@@ -581,12 +777,13 @@ void ex_sort(exarg_T *eap)
         }
         if (*s == NUL) {
           // line without number should sort before any number
-          nrs[lnum - eap->line1].st_u.num.is_number = false;
-          nrs[lnum - eap->line1].st_u.num.value = 0;
+          order[no_number++] = idx;
         } else {
-          nrs[lnum - eap->line1].st_u.num.is_number = true;
-          vim_str2nr(s, NULL, NULL, sort_what,
-                     &nrs[lnum - eap->line1].st_u.num.value, NULL, 0, false, NULL);
+          varnumber_T value;
+          vim_str2nr(s, NULL, NULL, sort_what, &value, NULL, 0, false, NULL);
+          nums[nums_count].key = (uint64_t)value ^ ((uint64_t)1 << 63);
+          nums[nums_count].idx = idx;
+          nums_count++;
         }
       } else {
         s = skipwhite(p);
@@ -596,20 +793,18 @@ void ex_sort(exarg_T *eap)
 
         if (*s == NUL) {
           // empty line should sort before any number
-          nrs[lnum - eap->line1].st_u.value_flt = -DBL_MAX;
+          sort_flts[idx] = -DBL_MAX;
         } else {
-          nrs[lnum - eap->line1].st_u.value_flt = strtod(s, NULL);
+          sort_flts[idx] = strtod(s, NULL);
         }
       }
       *s2 = c;
+    } else if (start_col == 0 && end_col == len) {
+      sort_keys[idx] = s;
     } else {
-      // Store the column to sort at.
-      nrs[lnum - eap->line1].st_u.line.start_col_nr = start_col;
-      nrs[lnum - eap->line1].st_u.line.end_col_nr = end_col;
+      sort_keys[idx] = arena_memdupz(&arena, s + start_col, (size_t)(end_col - start_col));
     }
 
-    nrs[lnum - eap->line1].lnum = lnum;
-
     if (regmatch.regprog != NULL) {
       fast_breakcheck();
     }
@@ -618,12 +813,20 @@ void ex_sort(exarg_T *eap)
     }
   }
 
-  // Allocate a buffer that can hold the longest line.
-  sortbuf1 = xmalloc((size_t)maxlen + 1);
-  sortbuf2 = xmalloc((size_t)maxlen + 1);
-
-  // Sort the array of line numbers.  Note: can't be interrupted!
-  qsort((void *)nrs, count, sizeof(sorti_T), sort_compare);
+  if (sort_nr) {
+    // Sort the numbers, the lines without a number come first.
+    nums_tmp = xmalloc(nums_count * sizeof(sortnum_T));
+    sortnum_T *sorted = sort_radix(nums, nums_tmp, nums_count);
+    for (i = 0; i < nums_count; i++) {
+      order[no_number + (linenr_T)i] = sorted[i].idx;
+    }
+  } else {
+    for (i = 0; i < count; i++) {
+      order[i] = (linenr_T)i;
+    }
+    order_tmp = xmalloc(count * sizeof(linenr_T));
+    sort_lines(order, order_tmp, count);
+  }
 
   if (sort_abort) {
     goto sortend;
@@ -632,44 +835,42 @@ void ex_sort(exarg_T *eap)
   bcount_t old_count = 0;
   bcount_t new_count = 0;
 
-  // Insert the lines in the sorted order below the last one.
-  linenr_T lnum = eap->line2;
+  // Collect the lines in the sorted order, leaving out duplicates for
+  // "unique".
+  new_lines = xmalloc(count * sizeof(char *));
+  new_lens = xmalloc(count * sizeof(colnr_T));
+  linenr_T new_lcount = 0;
   for (i = 0; i < count; i++) {
-    const linenr_T get_lnum = nrs[eap->forceit ? count - i - 1 : i].lnum;
+    const linenr_T idx = order[eap->forceit ? count - i - 1 : i];
 
-    // If the original line number of the line being placed is not the same
-    // as "lnum" (accounting for offset), we know that the buffer changed.
-    if (get_lnum + ((linenr_T)count - 1) != lnum) {
+    // If the original position of the line being placed is not the same as
+    // its new position, we know that the buffer changed.
+    if (idx != new_lcount) {
       change_occurred = true;
     }
 
-    char *s = ml_get(get_lnum);
-    colnr_T bytelen = ml_get_len(get_lnum) + 1;  // include EOL in bytelen
-    old_count += bytelen;
-    if (!unique || i == 0 || string_compare(s, sortbuf1) != 0) {
-      // Copy the line into a buffer, it may become invalid in
-      // ml_append(). And it's needed for "unique".
-      STRCPY(sortbuf1, s);
-      if (ml_append(lnum++, sortbuf1, 0, false) == FAIL) {
-        break;
-      }
-      new_count += bytelen;
-    }
-    fast_breakcheck();
-    if (got_int) {
-      goto sortend;
+    old_count += lens[idx];
+    if (!unique || i == 0 || string_compare(lines[idx], new_lines[new_lcount - 1]) != 0) {
+      new_lines[new_lcount] = lines[idx];
+      new_lens[new_lcount] = lens[idx];
+      new_lcount++;
+      new_count += lens[idx];
     }
   }
 
-  // delete the original lines if appending worked
-  if (i == count) {
-    for (i = 0; i < count; i++) {
-      ml_delete(eap->line1, false);
-    }
-  } else {
+  // Insert the lines in the sorted order below the last one, all at once.
+  linenr_T old_line_count = curbuf->b_ml.ml_line_count;
+  linenr_T lnum = eap->line2 + new_lcount;
+  if (ml_append_many(curbuf, eap->line2, new_lines, new_lens, new_lcount, false) == FAIL) {
+    lnum = eap->line2 + (curbuf->b_ml.ml_line_count - old_line_count);
     count = 0;
   }
 
+  // delete the original lines if appending worked
+  for (i = 0; i < count; i++) {
+    ml_delete(eap->line1, false);
+  }
+
   // Adjust marks for deleted (or added) lines and prepare for displaying.
   linenr_T deleted = (linenr_T)count - (lnum - eap->line2);
   if (deleted > 0) {
@@ -691,9 +892,17 @@ void ex_sort(exarg_T *eap)
   beginline(BL_WHITE | BL_FIX);
 
 sortend:
-  xfree(nrs);
-  xfree(sortbuf1);
-  xfree(sortbuf2);
+  arena_mem_free(arena_finish(&arena));
+  xfree(lines);
+  xfree(lens);
+  xfree(order);
+  xfree(order_tmp);
+  xfree(nums);
+  xfree(nums_tmp);
+  xfree(new_lines);
+  xfree(new_lens);
+  XFREE_CLEAR(sort_keys);
+  XFREE_CLEAR(sort_flts);
   vim_regfree(regmatch.regprog);
   if (got_int) {
     emsg(_(e_interr));
@@ -1897,6 +2106,9 @@ void do_wqall(exarg_T *eap)
     exiting = true;
   }
 
+  // A pending ":write" may still reset 'modified'.
+  buf_write_wait();
+
   FOR_ALL_BUFFERS(buf) {
     if (exiting
         && buf->terminal
@@ -2036,6 +2248,7 @@ int getfile(int fnum, char *ffname_arg, char *sfname_arg, bool setpm, linenr_T l
 
   if (other) {
     no_wait_return++;               // don't wait for autowrite message
+    buf_write_wait();
   }
   if (other && !forceit && curbuf->b_nwindows == 1 && !buf_hide(curbuf)
       && curbufIsChanged() && autowrite(curbuf, forceit) == FAIL) {
@@ -3253,6 +3466,52 @@ static char *sub_parse_flags(char *cmd, subflags_T *subflags, int *which_pat)
   return cmd;
 }
 
+/// Called before :substitute changes line "lnum".  Starts a new change in
+/// "changes" when "lnum" is not near the current one, which ends at
+/// "last_line".
+static void sub_change_before(SubChangeVec *changes, linenr_T lnum, linenr_T last_line)
+{
+  if (kv_size(*changes) > 0) {
+    if (lnum < last_line + SUB_CHANGE_MAXGAP) {
+      return;
+    }
+    sub_change_finish(&kv_last(*changes), last_line);
+  }
+  kv_push(*changes, ((SubChange){ .first = lnum, .line_count = curbuf->b_ml.ml_line_count }));
+}
+
+/// Finish change "c", which ends at "last_line".
+static void sub_change_finish(SubChange *c, linenr_T last_line)
+{
+  c->last = MAX(last_line, c->first);
+  c->xtra = curbuf->b_ml.ml_line_count - c->line_count;
+  c->deleted_bytes = ml_flush_deleted_bytes(curbuf, &c->deleted_codepoints,
+                                            &c->deleted_codeunits);
+}
+
+/// Report the changes collected by :substitute or :global to buffer update
+/// listeners, one event for each.  Like undo, every event after the first one
+/// gets its own b:changedtick.
+static void sub_send_changes(SubChangeVec *changes)
+{
+  bool first = true;
+  for (size_t i = 0; i < kv_size(*changes); i++) {
+    SubChange *c = &kv_A(*changes, i);
+    if (c->last == c->first && c->xtra == 0) {
+      continue;  // failed to change the line
+    }
+    if (!first) {
+      buf_inc_changedtick(curbuf);
+    }
+    first = false;
+    int64_t num_added = c->last - c->first;
+    int64_t num_removed = num_added - c->xtra;
+    buf_updates_send_changes_deleted(curbuf, c->first, num_added, num_removed,
+                                     c->deleted_bytes, c->deleted_codepoints,
+                                     c->deleted_codeunits);
+  }
+}
+
 /// Skip over the "sub" part in :s/pat/sub/ where "delimiter" is the separating
 /// character.
 static char *skip_substitute(char *start, int delimiter)
@@ -3348,6 +3607,7 @@ static int do_sub(exarg_T *eap, const proftime_T timeout, const int cmdpreview_n
   char *sub_firstline;    // allocated copy of first sub line
   bool endcolumn = false;   // cursor in last column when done
   PreviewLines preview_lines = { KV_INITIAL_VALUE, 0 };
+  SubChangeVec changes = KV_INITIAL_VALUE;
   static int pre_hl_id = 0;
   pos_T old_cursor = curwin->w_cursor;
   int start_nsubs;
@@ -3520,6 +3780,12 @@ static int do_sub(exarg_T *eap, const proftime_T timeout, const int cmdpreview_n
     }
   }
 
+  // Without confirmation nothing is redrawn or reported until all
+  // substitutions are done, collect the changes and report each range of
+  // changed lines once.
+  const bool collect_changes = !subflags.do_ask && cmdpreview_ns <= 0;
+  const bool batch_splices = !subflags.do_ask && extmark_splice_batch_start(curbuf);
+
   // Check for a match on each line.
   // If preview: limit to max('cmdwinheight', viewport).
   linenr_T line2 = eap->line2;
@@ -4025,6 +4291,9 @@ static int do_sub(exarg_T *eap, const proftime_T timeout, const int cmdpreview_n
               sublen--;  // correct the byte counts for extmark_splice()
               STRMOVE(p1, p1 + 1);
             } else if (*p1 == CAR) {
+              if (collect_changes) {
+                sub_change_before(&changes, lnum, last_line);
+              }
               if (u_inssub(lnum) == OK) {             // prepare for undo
                 *p1 = NUL;                            // truncate up to the CR
                 ml_append(lnum - 1, new_start,
@@ -4113,6 +4382,9 @@ skip:
             prev_matchcol = (colnr_T)strlen(sub_firstline)
                             - prev_matchcol;
 
+            if (collect_changes) {
+              sub_change_before(&changes, lnum, last_line);
+            }
             if (u_savesub(lnum) != OK) {
               break;
             }
@@ -4222,6 +4494,9 @@ skip:
     }
   }
 
+  if (batch_splices) {
+    extmark_splice_batch_end(curbuf);
+  }
   curbuf->deleted_bytes2 = 0;
 
   if (first_line != 0) {
@@ -4231,10 +4506,16 @@ skip:
     i = curbuf->b_ml.ml_line_count - old_line_count;
     changed_lines(curbuf, first_line, 0, last_line - (linenr_T)i, (linenr_T)i, false);
 
-    int64_t num_added = last_line - first_line;
-    int64_t num_removed = num_added - i;
-    buf_updates_send_changes(curbuf, first_line, num_added, num_removed);
+    if (kv_size(changes) > 0 && buf_updates_active(curbuf)) {
+      sub_change_finish(&kv_last(changes), last_line);
+      sub_send_changes(&changes);
+    } else {
+      int64_t num_added = last_line - first_line;
+      int64_t num_removed = num_added - i;
+      buf_updates_send_changes(curbuf, first_line, num_added, num_removed);
+    }
   }
+  kv_destroy(changes);
 
   xfree(sub_firstline);   // may have to free allocated copy of the line
 
@@ -4464,7 +4745,9 @@ void ex_global(exarg_T *eap)
     }
   } else {
     int ndone = 0;
-    // pass 1: set marks for each (not) matching line
+    // pass 1: set a bit for each (not) matching line
+    size_t nwords = (size_t)(eap->line2 - eap->line1) / 64 + 1;
+    uint64_t *marked = xcalloc(nwords, sizeof(uint64_t));
     for (lnum = eap->line1; lnum <= eap->line2 && !got_int; lnum++) {
       // a match on this line?
       int match = vim_regexec_multi(&regmatch, curwin, curbuf, lnum, 0, NULL, NULL);
@@ -4472,7 +4755,8 @@ void ex_global(exarg_T *eap)
         break;  // re-compiling regprog failed
       }
       if ((type == 'g' && match) || (type == 'v' && !match)) {
-        ml_setmarked(lnum);
+        size_t idx = (size_t)(lnum - eap->line1);
+        marked[idx / 64] |= (uint64_t)1 << (idx % 64);
         ndone++;
       }
       line_breakcheck();
@@ -4488,15 +4772,188 @@ void ex_global(exarg_T *eap)
         smsg(0, _("Pattern not found: %s"), used_pat);
       }
     } else {
-      global_exe(cmd);
+      global_exe_lines(cmd, marked, nwords, eap->line1);
     }
-    ml_clearmarked();         // clear rest of the marks
+    xfree(marked);
   }
   vim_regfree(regmatch.regprog);
 }
 
+/// @return  the first line after "lnum" that is set in bitmap "marked", where
+///          bit N stands for line "line1" + N, or zero if there is none.
+static linenr_T global_next_marked(const uint64_t *marked, size_t nwords, linenr_T line1,
+                                   linenr_T lnum)
+{
+  size_t idx = (size_t)(lnum + 1 - line1);
+  size_t i = idx / 64;
+  if (i >= nwords) {
+    return 0;
+  }
+  uint64_t bits = marked[i] & (UINT64_MAX << (idx % 64));
+  while (bits == 0) {
+    if (++i >= nwords) {
+      return 0;
+    }
+    bits = marked[i];
+  }
+  return line1 + (linenr_T)(i * 64) + xctz(bits);
+}
+
+/// Check if "cmd" of a ":global" command is a plain ":delete" that
+/// global_delete() can do.
+///
+/// @return  the register to delete into: NUL or '_', -1 for another command.
+static int global_delete_regname(const char *cmd)
+{
+  const char *p = cmd;
+  while (*p == ':' || ascii_iswhite(*p)) {
+    p++;
+  }
+  const char *name = p;
+  while (ASCII_ISLOWER(*p)) {
+    p++;
+  }
+  size_t len = (size_t)(p - name);
+  if (len == 0 || len > 6 || strncmp(name, "delete", len) != 0) {
+    return -1;
+  }
+  p = skipwhite(p);
+  int regname = NUL;
+  if (*p == '_') {
+    regname = '_';
+    p = skipwhite(p + 1);
+  }
+  return *p == NUL ? regname : -1;
+}
+
+/// Delete "count" lines from "lnum" for global_delete(), without marking them
+/// as changed.  Adds the change to "changes".
+///
+/// @return  FAIL when saving for undo failed.
+static int global_delete_range(SubChangeVec *changes, linenr_T lnum, linenr_T count)
+{
+  if (u_savedel(lnum, count) == FAIL) {
+    return FAIL;
+  }
+
+  linenr_T n = 0;
+  while (n < count && !(curbuf->b_ml.ml_flags & ML_EMPTY)) {
+    ml_delete(lnum, true);
+    n++;
+    // If we delete the last line in the file, stop
+    if (lnum > curbuf->b_ml.ml_line_count) {
+      break;
+    }
+  }
+  deleted_lines_adjust(lnum, n);
+
+  SubChange c = { .first = lnum, .last = lnum, .xtra = -n };
+  c.deleted_bytes = ml_flush_deleted_bytes(curbuf, &c.deleted_codepoints,
+                                           &c.deleted_codeunits);
+  kv_push(*changes, c);
+  return OK;
+}
+
+/// Do ":g/pat/d" without executing ":delete" for each line in "marked", see
+/// global_exe_lines().  Consecutive lines are deleted together and the buffer
+/// is marked as changed once, the registers, marks and undo end up like
+/// after deleting each line by itself.
+///
+/// @return  false when "cmd" must be executed for each line.
+static bool global_delete(const char *cmd, const uint64_t *marked, size_t nwords,
+                          linenr_T line1)
+{
+  int regname = global_delete_regname(cmd);
+  if (regname < 0
+      || !MODIFIABLE(curbuf)
+      || text_locked()
+      || curbuf->b_ro_locked > 0
+      || allbuf_lock > 0
+      || VIsual_active
+      || has_format_option(FO_AUTO)
+      // every deleted line would be yanked separately
+      || (regname == NUL
+          && (has_event(EVENT_TEXTYANKPOST) || (cb_flags & CB_UNNAMEDMASK)))) {
+    return false;
+  }
+
+  size_t total = 0;
+  for (size_t i = 0; i < nwords; i++) {
+    total += xpopcount(marked[i]);
+  }
+  if (total == 0) {
+    return true;
+  }
+
+  // Only the last nine lines remain in the numbered registers.  Yank them
+  // before deleting anything, while the line numbers are still valid.
+  if (regname == NUL) {
+    size_t n = 0;
+    for (linenr_T lnum = global_next_marked(marked, nwords, line1, line1 - 1);
+         lnum != 0; lnum = global_next_marked(marked, nwords, line1, lnum)) {
+      if (total - n++ <= 9) {
+        yank_deleted_line(lnum);
+      }
+    }
+  }
+
+  // Position the cursor like ":delete" does, for undo.
+  linenr_T lnum = global_next_marked(marked, nwords, line1, line1 - 1);
+  curwin->w_cursor.lnum = lnum;
+  curwin->w_cursor.col = 0;
+  beginline(BL_SOL | BL_FIX);
+
+  SubChangeVec changes = KV_INITIAL_VALUE;
+  linenr_T first_line = lnum;  // first deleted line
+  linenr_T last_line = 0;      // last deleted line, before deleting
+  linenr_T deleted = 0;        // number of lines deleted so far
+  while (lnum != 0 && !got_int) {
+    // Delete consecutive lines at once.
+    linenr_T count = 1;
+    linenr_T next;
+    while ((next = global_next_marked(marked, nwords, line1, lnum + count - 1)) == lnum + count) {
+      count++;
+    }
+    if (global_delete_range(&changes, lnum - deleted, count) == FAIL) {
+      break;
+    }
+    last_line = lnum + count - 1;
+    deleted += count;
+    lnum = next;
+    fast_breakcheck();
+  }
+
+  if (kv_size(changes) > 0) {
+    changed_lines(curbuf, first_line, 0, last_line + 1, -deleted, false);
+    if (buf_updates_active(curbuf)) {
+      sub_send_changes(&changes);
+    }
+
+    // The cursor and the '[ and '] marks are where the last line was deleted.
+    linenr_T last_lnum = kv_last(changes).first;
+    curwin->w_cursor.lnum = last_lnum;
+    curwin->w_cursor.col = 0;
+    check_cursor_lnum(curwin);
+    beginline(BL_WHITE | BL_FIX);
+    u_clearline(curbuf);  // "U" command not possible after "dd"
+    if ((cmdmod.cmod_flags & CMOD_LOCKMARKS) == 0) {
+      curbuf->b_op_start = (pos_T){ .lnum = last_lnum };
+      curbuf->b_op_end = curbuf->b_op_start;
+    }
+  }
+  kv_destroy(changes);
+  return true;
+}
+
 /// Execute `cmd` on lines marked with ml_setmarked().
 void global_exe(char *cmd)
+{
+  global_exe_lines(cmd, NULL, 0, 0);
+}
+
+/// Execute `cmd` on the lines in bitmap "marked", where bit N stands for line
+/// "line1" + N.  When "marked" is NULL on lines marked with ml_setmarked().
+static void global_exe_lines(char *cmd, const uint64_t *marked, size_t nwords, linenr_T line1)
 {
   linenr_T old_lcount;      // b_ml.ml_line_count before the command
   buf_T *old_buf = curbuf;  // remember what buffer we started in
@@ -4516,9 +4973,24 @@ void global_exe(char *cmd)
   global_busy = 1;
   old_lcount = curbuf->b_ml.ml_line_count;
 
-  while (!got_int && (lnum = ml_firstmarked()) != 0 && global_busy == 1) {
-    global_exe_one(cmd, lnum);
-    os_breakcheck();
+  if (marked == NULL || !global_delete(cmd, marked, nwords, line1)) {
+    if (marked != NULL) {
+      // Marks in the memline move with the lines when the command inserts or
+      // deletes lines.
+      for (lnum = global_next_marked(marked, nwords, line1, line1 - 1);
+           lnum != 0; lnum = global_next_marked(marked, nwords, line1, lnum)) {
+        ml_setmarked(lnum);
+      }
+    }
+
+    while (!got_int && (lnum = ml_firstmarked()) != 0 && global_busy == 1) {
+      global_exe_one(cmd, lnum);
+      os_breakcheck();
+    }
+
+    if (marked != NULL) {
+      ml_clearmarked();         // clear rest of the marks
+    }
   }
 
   global_busy = 0;
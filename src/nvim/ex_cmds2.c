@@ -154,6 +154,12 @@ bool check_changed(buf_T *buf, int flags)
   bufref_T bufref;
   set_bufref(&bufref, buf);
 
+  buf_write_wait();
+  if (!bufref_valid(&bufref)) {
+    // The buffer was deleted, it's not changed now.
+    return false;
+  }
+
   if (!forceit
       && bufIsChanged(buf)
       && ((flags & CCGD_MULTWIN) || buf->b_nwindows <= 1)
@@ -282,6 +288,12 @@ bool dialog_close_terminal(buf_T *buf)
 /// hidden, autowriting it or unloading it.
 bool can_abandon(buf_T *buf, bool forceit)
 {
+  bufref_T bufref;
+  set_bufref(&bufref, buf);
+  buf_write_wait();
+  if (!bufref_valid(&bufref)) {
+    return true;
+  }
   return buf_hide(buf)
          || !bufIsChanged(buf)
          || buf->b_nwindows > 1
@@ -317,6 +329,8 @@ bool check_changed_any(bool hidden, bool unload)
   int bufnum = 0;
   size_t bufcount = 0;
 
+  buf_write_wait();
+
   // Make a list of all buffers, with the most important ones first.
   FOR_ALL_BUFFERS(buf) {
     bufcount++;
@@ -20,6 +20,7 @@
 #include "nvim/autocmd_defs.h"
 #include "nvim/buffer.h"
 #include "nvim/buffer_defs.h"
+#include "nvim/bufwrite.h"
 #include "nvim/change.h"
 #include "nvim/charset.h"
 #include "nvim/cmdexpand.h"
@@ -5056,6 +5057,9 @@ static void ex_exit(exarg_T *eap)
     return;
   }
 
+  // A pending ":write" may still reset 'modified'.
+  buf_write_wait();
+
   // we plan to exit if there is only one relevant window
   if (check_more(false, eap->forceit) == OK && only_one_window()) {
     exiting = true;
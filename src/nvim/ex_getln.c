@@ -150,12 +150,15 @@ typedef struct {
   u_header_T *save_b_u_newhead;
   u_header_T *save_b_u_curhead;
   int save_b_u_numhead;
+  size_t save_b_u_memused;
   bool save_b_u_synced;
   int save_b_u_seq_last;
   int save_b_u_save_nr_last;
   int save_b_u_seq_cur;
   time_t save_b_u_time_cur;
   int save_b_u_save_nr_cur;
+  bool save_b_u_file_valid;
+  u_seq_vec_t save_b_u_freed;
   char *save_b_u_line_ptr;
   linenr_T save_b_u_line_lnum;
   colnr_T save_b_u_line_colnr;
@@ -2329,11 +2332,15 @@ static void cmdpreview_save_undo(CpUndoInfo *cp_undoinfo, buf_T *buf)
   cp_undoinfo->save_b_u_newhead = buf->b_u_newhead;
   cp_undoinfo->save_b_u_curhead = buf->b_u_curhead;
   cp_undoinfo->save_b_u_numhead = buf->b_u_numhead;
+  cp_undoinfo->save_b_u_memused = buf->b_u_memused;
   cp_undoinfo->save_b_u_seq_last = buf->b_u_seq_last;
   cp_undoinfo->save_b_u_save_nr_last = buf->b_u_save_nr_last;
   cp_undoinfo->save_b_u_seq_cur = buf->b_u_seq_cur;
   cp_undoinfo->save_b_u_time_cur = buf->b_u_time_cur;
   cp_undoinfo->save_b_u_save_nr_cur = buf->b_u_save_nr_cur;
+  cp_undoinfo->save_b_u_file_valid = buf->b_u_file_valid;
+  cp_undoinfo->save_b_u_freed = buf->b_u_freed;
+  kv_init(buf->b_u_freed);
   cp_undoinfo->save_b_u_line_ptr = buf->b_u_line_ptr;
   cp_undoinfo->save_b_u_line_lnum = buf->b_u_line_lnum;
   cp_undoinfo->save_b_u_line_colnr = buf->b_u_line_colnr;
@@ -2346,11 +2353,15 @@ static void cmdpreview_restore_undo(const CpUndoInfo *cp_undoinfo, buf_T *buf)
   buf->b_u_newhead = cp_undoinfo->save_b_u_newhead;
   buf->b_u_curhead = cp_undoinfo->save_b_u_curhead;
   buf->b_u_numhead = cp_undoinfo->save_b_u_numhead;
+  buf->b_u_memused = cp_undoinfo->save_b_u_memused;
   buf->b_u_seq_last = cp_undoinfo->save_b_u_seq_last;
   buf->b_u_save_nr_last = cp_undoinfo->save_b_u_save_nr_last;
   buf->b_u_seq_cur = cp_undoinfo->save_b_u_seq_cur;
   buf->b_u_time_cur = cp_undoinfo->save_b_u_time_cur;
   buf->b_u_save_nr_cur = cp_undoinfo->save_b_u_save_nr_cur;
+  buf->b_u_file_valid = cp_undoinfo->save_b_u_file_valid;
+  kv_destroy(buf->b_u_freed);
+  buf->b_u_freed = cp_undoinfo->save_b_u_freed;
   buf->b_u_line_ptr = cp_undoinfo->save_b_u_line_ptr;
   buf->b_u_line_lnum = cp_undoinfo->save_b_u_line_lnum;
   buf->b_u_line_colnr = cp_undoinfo->save_b_u_line_colnr;
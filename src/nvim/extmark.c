@@ -49,6 +49,14 @@
 # include "extmark.c.generated.h"
 #endif
 
+/// Splice being collected between extmark_splice_batch_start() and
+/// extmark_splice_batch_end().
+static struct {
+  buf_T *buf;            ///< buffer being collected for, NULL when not collecting
+  bool pending;          ///< "splice" holds a change
+  ExtmarkSplice splice;  ///< merged change, for buffer update callbacks
+} splice_batch = { .buf = NULL };
+
 /// Create or update an extmark
 ///
 /// must not be used during iteration!
@@ -541,6 +549,17 @@ void extmark_splice_impl(buf_T *buf, int start_row, colnr_T start_col, bcount_t
                          int old_row, colnr_T old_col, bcount_t old_byte, int new_row,
                          colnr_T new_col, bcount_t new_byte, ExtmarkOp undo)
 {
+  if (splice_batch.buf == buf) {
+    ExtmarkSplice splice = {
+      .start_row = start_row, .start_col = start_col, .start_byte = start_byte,
+      .old_row = old_row, .old_col = old_col, .old_byte = old_byte,
+      .new_row = new_row, .new_col = new_col, .new_byte = new_byte,
+    };
+    if (splice_batch_add(buf, splice, undo)) {
+      return;
+    }
+  }
+
   buf->deleted_bytes2 = 0;
   buf_updates_send_splice(buf, start_row, start_col, start_byte,
                           old_row, old_col, old_byte,
@@ -573,61 +592,159 @@ void extmark_splice_impl(buf_T *buf, int start_row, colnr_T start_col, bcount_t
   }
 
   if (undo == kExtmarkUndo) {
-    u_header_T *uhp = u_force_get_undo_header(buf);
-    if (!uhp) {
-      return;
-    }
+    extmark_splice_save_undo(buf, (ExtmarkSplice){
+      .start_row = start_row, .start_col = start_col, .start_byte = start_byte,
+      .old_row = old_row, .old_col = old_col, .old_byte = old_byte,
+      .new_row = new_row, .new_col = new_col, .new_byte = new_byte,
+    });
+  }
+}
 
-    bool merged = false;
-    // TODO(bfredl): this is quite rudimentary. We merge small (within line)
-    // inserts with each other and small deletes with each other. Add full
-    // merge algorithm later.
-    if (old_row == 0 && new_row == 0 && kv_size(uhp->uh_extmark)) {
-      ExtmarkUndoObject *item = &kv_A(uhp->uh_extmark,
-                                      kv_size(uhp->uh_extmark) - 1);
-      if (item->type == kExtmarkSplice) {
-        ExtmarkSplice *splice = &item->data.splice;
-        if (splice->start_row == start_row && splice->old_row == 0
-            && splice->new_row == 0) {
-          if (old_col == 0 && start_col >= splice->start_col
-              && start_col <= splice->start_col + splice->new_col) {
-            splice->new_col += new_col;
-            splice->new_byte += new_byte;
-            merged = true;
-          } else if (new_col == 0
-                     && start_col == splice->start_col + splice->new_col) {
-            splice->old_col += old_col;
-            splice->old_byte += old_byte;
-            merged = true;
-          } else if (new_col == 0
-                     && start_col + old_col == splice->start_col) {
-            splice->start_col = start_col;
-            splice->start_byte = start_byte;
-            splice->old_col += old_col;
-            splice->old_byte += old_byte;
-            merged = true;
-          }
+/// Add the splice "s" to the undo header of "buf".
+static void extmark_splice_save_undo(buf_T *buf, ExtmarkSplice s)
+{
+  u_header_T *uhp = u_force_get_undo_header(buf);
+  if (!uhp) {
+    return;
+  }
+
+  bool merged = false;
+  // TODO(bfredl): this is quite rudimentary. We merge small (within line)
+  // inserts with each other and small deletes with each other. Add full
+  // merge algorithm later.
+  if (s.old_row == 0 && s.new_row == 0 && kv_size(uhp->uh_extmark)) {
+    ExtmarkUndoObject *item = &kv_A(uhp->uh_extmark,
+                                    kv_size(uhp->uh_extmark) - 1);
+    if (item->type == kExtmarkSplice) {
+      ExtmarkSplice *splice = &item->data.splice;
+      if (splice->start_row == s.start_row && splice->old_row == 0
+          && splice->new_row == 0) {
+        if (s.old_col == 0 && s.start_col >= splice->start_col
+            && s.start_col <= splice->start_col + splice->new_col) {
+          splice->new_col += s.new_col;
+          splice->new_byte += s.new_byte;
+          merged = true;
+        } else if (s.new_col == 0
+                   && s.start_col == splice->start_col + splice->new_col) {
+          splice->old_col += s.old_col;
+          splice->old_byte += s.old_byte;
+          merged = true;
+        } else if (s.new_col == 0
+                   && s.start_col + s.old_col == splice->start_col) {
+          splice->start_col = s.start_col;
+          splice->start_byte = s.start_byte;
+          splice->old_col += s.old_col;
+          splice->old_byte += s.old_byte;
+          merged = true;
         }
       }
     }
+  }
+
+  if (!merged) {
+    kv_push(uhp->uh_extmark,
+            ((ExtmarkUndoObject){ .type = kExtmarkSplice,
+                                  .data.splice = s }));
+  }
+}
 
-    if (!merged) {
-      ExtmarkSplice splice;
-      splice.start_row = start_row;
-      splice.start_col = start_col;
-      splice.start_byte = start_byte;
-      splice.old_row = old_row;
-      splice.old_col = old_col;
-      splice.old_byte = old_byte;
-      splice.new_row = new_row;
-      splice.new_col = new_col;
-      splice.new_byte = new_byte;
-
-      kv_push(uhp->uh_extmark,
-              ((ExtmarkUndoObject){ .type = kExtmarkSplice,
-                                    .data.splice = splice }));
+/// Start collecting the splices of "buf" into as few splices as possible.
+///
+/// As long as "buf" has no extmarks only undo and the buffer update
+/// callbacks need to know about a splice. Undo still gets every splice, a
+/// merged one would move marks in the unchanged text between two changes
+/// when undoing.  For the callbacks a splice that starts at or after the end
+/// of the text inserted by the previous one is merged into it, so that for
+/// example ":%s" reports one change instead of one per match.
+///
+/// @return  false when already collecting, then extmark_splice_batch_end()
+///          must not be called.
+bool extmark_splice_batch_start(buf_T *buf)
+{
+  if (splice_batch.buf != NULL) {
+    return false;
+  }
+  splice_batch.buf = buf;
+  splice_batch.pending = false;
+  return true;
+}
+
+/// Apply the splice collected since extmark_splice_batch_start().
+void extmark_splice_batch_end(buf_T *buf)
+{
+  if (splice_batch.buf != buf) {
+    return;
+  }
+  splice_batch_flush();
+  splice_batch.buf = NULL;
+}
+
+/// Send the collected splice to the buffer update callbacks.  Marks and undo
+/// have already been handled.
+static void splice_batch_flush(void)
+{
+  if (!splice_batch.pending) {
+    return;
+  }
+  splice_batch.pending = false;
+  ExtmarkSplice s = splice_batch.splice;
+  buf_updates_send_splice(splice_batch.buf, s.start_row, s.start_col, s.start_byte,
+                          s.old_row, s.old_col, s.old_byte,
+                          s.new_row, s.new_col, s.new_byte);
+}
+
+/// Add "row" and "col" of an extent that follows the extent "*rowp", "*colp".
+static void splice_extent_add(int *rowp, colnr_T *colp, int row, colnr_T col)
+{
+  if (row > 0) {
+    *rowp += row;
+    *colp = col;
+  } else {
+    *colp += col;
+  }
+}
+
+/// Merge splice "s" of "buf" into the collected splice.
+///
+/// @return  false if "s" must be applied as usual.
+static bool splice_batch_add(buf_T *buf, ExtmarkSplice s, ExtmarkOp undo)
+{
+  if (buf->b_marktree->n_keys > 0) {
+    // Marks must see every change, in order.
+    splice_batch_flush();
+    return false;
+  }
+
+  buf->deleted_bytes2 = 0;
+  if (undo == kExtmarkUndo) {
+    extmark_splice_save_undo(buf, s);
+  }
+
+  ExtmarkSplice *p = &splice_batch.splice;
+  if (splice_batch.pending) {
+    int end_row = p->start_row + p->new_row;
+    colnr_T end_col = (p->new_row ? 0 : p->start_col) + p->new_col;
+    bcount_t gap_byte = s.start_byte - (p->start_byte + p->new_byte);
+    if (gap_byte >= 0
+        && (s.start_row > end_row || (s.start_row == end_row && s.start_col >= end_col))) {
+      // The text between the two changes is unchanged and becomes part of
+      // both the old and the new text.
+      int gap_row = s.start_row - end_row;
+      colnr_T gap_col = gap_row > 0 ? s.start_col : s.start_col - end_col;
+      splice_extent_add(&p->old_row, &p->old_col, gap_row, gap_col);
+      splice_extent_add(&p->old_row, &p->old_col, s.old_row, s.old_col);
+      p->old_byte += gap_byte + s.old_byte;
+      splice_extent_add(&p->new_row, &p->new_col, gap_row, gap_col);
+      splice_extent_add(&p->new_row, &p->new_col, s.new_row, s.new_col);
+      p->new_byte += gap_byte + s.new_byte;
+      return true;
     }
   }
+
+  splice_batch_flush();
+  *p = s;
+  splice_batch.pending = true;
+  return true;
 }
 
 void extmark_splice_cols(buf_T *buf, int start_row, colnr_T start_col, colnr_T old_col,
@@ -642,6 +759,10 @@ void extmark_move_region(buf_T *buf, int start_row, colnr_T start_col, bcount_t
                          int extent_row, colnr_T extent_col, bcount_t extent_byte, int new_row,
                          colnr_T new_col, bcount_t new_byte, ExtmarkOp undo)
 {
+  if (splice_batch.buf == buf) {
+    splice_batch_flush();
+  }
+
   buf->deleted_bytes2 = 0;
   // TODO(bfredl): this is not synced to the buffer state inside the callback.
   // But unless we make the undo implementation smarter, this is not ensured
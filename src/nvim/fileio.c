@@ -16,12 +16,14 @@
 #include <uv.h>
 
 #include "auto/config.h"
+#include "klib/kvec.h"
 #include "nvim/ascii_defs.h"
 #include "nvim/autocmd.h"
 #include "nvim/autocmd_defs.h"
 #include "nvim/buffer.h"
 #include "nvim/buffer_defs.h"
 #include "nvim/buffer_updates.h"
+#include "nvim/bufwrite.h"
 #include "nvim/change.h"
 #include "nvim/cursor.h"
 #include "nvim/diff.h"
@@ -206,6 +208,7 @@ int readfile(char *fname, char *sfname, linenr_T from, linenr_T lines_to_skip,
   linenr_T read_no_eol_lnum = 0;        // non-zero lnum when last line of
                                         // last read was missing the eol
   bool file_rewind = false;
+  bool map_tried = false;               // tried reading through a mapping
   linenr_T conv_error = 0;              // line nr with conversion error
   linenr_T illegal_byte = 0;            // line nr with illegal byte
   bool keep_dest_enc = false;           // don't retry when char doesn't fit
@@ -235,6 +238,9 @@ int readfile(char *fname, char *sfname, linenr_T from, linenr_T lines_to_skip,
   int using_b_fname;
   static char *msg_is_a_directory = N_("is a directory");
 
+  // The file may still be written on a worker thread.
+  buf_write_wait();
+
   curbuf->b_au_did_filetype = false;  // reset before triggering any autocommands
 
   curbuf->b_no_eol_lnum = 0;    // in case it was set by the previous read
@@ -878,6 +884,47 @@ retry:
     }
   }
 
+  // A large file may be read through a memory mapping, see 'mapfilesize'.
+  if (!map_tried && p_mfs > 0 && newfile && wasempty && from == 0
+      && !filtering && !read_stdin && !read_buffer && !read_fifo && !recoverymode
+      && S_ISREG(perm) && lines_to_skip == 0 && lines_to_read == MAXLNUM
+      && !read_undo_file && !converted && tmpname == NULL
+      && (fileformat == EOL_UNIX || (fileformat == EOL_UNKNOWN && try_unix))) {
+    FileInfo map_info;
+    map_tried = true;
+    uint64_t map_size = os_fileinfo_fd(fd, &map_info) ? os_fileinfo_size(&map_info) : 0;
+    if (map_size >= (uint64_t)p_mfs * 1024 && map_size == (size_t)map_size) {
+      bool bom = false;
+      bool noeol = false;
+      linenr_T map_lines = readfile_map(fd, (size_t)map_size,
+                                        !curbuf->b_p_bin && (*fenc == 'u' || *fenc == NUL),
+                                        !curbuf->b_p_bin, fileformat == EOL_UNKNOWN,
+                                        &bom, &noeol);
+      if (map_lines > 0) {
+        lnum = map_lines;
+        filesize = (off_T)map_size;
+        linerest = 0;
+        if (fileformat == EOL_UNKNOWN) {
+          fileformat = EOL_UNIX;
+          if (set_options) {
+            set_fileformat(fileformat, OPT_LOCAL);
+          }
+        }
+        if (bom && set_options) {
+          curbuf->b_p_bomb = true;
+          curbuf->b_start_bomb = true;
+        }
+        if (noeol) {
+          if (set_options) {
+            curbuf->b_p_eol = false;
+          }
+          read_no_eol_lnum = lnum;
+        }
+        goto failed;
+      }
+    }
+  }
+
   while (!error && !got_int) {
     // We allocate as much space for the file as we can get, plus
     // space for the old line plus room for one terminating NUL.
@@ -1421,6 +1468,10 @@ rewind_retry:
           }
 
           for (p = (uint8_t *)ptr; p < (uint8_t *)ptr + size; p++) {
+            p = xmemscan3(p, NL, CAR, CAR, (size_t)(((uint8_t *)ptr + size) - p));
+            if (p == (uint8_t *)ptr + size) {
+              break;
+            }
             if (*p == NL) {
               if (!try_unix
                   || (try_dos && p > (uint8_t *)ptr && p[-1] == CAR)) {
@@ -1483,7 +1534,14 @@ rewind_retry:
       while (++ptr, --size >= 0) {
         // catch most common case first
         if ((c = *ptr) != NUL && c != CAR && c != NL) {
-          continue;
+          // skip ahead to the next special character
+          char *next = xmemscan3(ptr, NUL, CAR, NL, (size_t)size + 1);
+          size -= next - ptr;
+          ptr = next;
+          if (size < 0) {
+            break;
+          }
+          c = *ptr;
         }
         if (c == NUL) {
           *ptr = NL;            // NULs are replaced by newlines!
@@ -1516,7 +1574,14 @@ rewind_retry:
       ptr--;
       while (++ptr, --size >= 0) {
         if ((c = *ptr) != NUL && c != NL) {        // catch most common case
-          continue;
+          // skip ahead to the next special character
+          char *next = xmemscan3(ptr, NUL, NL, NL, (size_t)size + 1);
+          size -= next - ptr;
+          ptr = next;
+          if (size < 0) {
+            break;
+          }
+          c = *ptr;
         }
         if (c == NUL) {
           *ptr = NL;            // NULs are replaced by newlines!
@@ -1663,7 +1728,10 @@ failed:
   if (!recoverymode) {
     // need to delete the last line, which comes from the empty buffer
     if (newfile && wasempty && !(curbuf->b_ml.ml_flags & ML_EMPTY)) {
-      ml_delete(curbuf->b_ml.ml_line_count, false);
+      // A mapped file does not count that line, see ml_map_set().
+      if (curbuf->b_ml.ml_map == NULL) {
+        ml_delete(curbuf->b_ml.ml_line_count, false);
+      }
       linecnt--;
     }
     curbuf->deleted_bytes = 0;
@@ -1904,6 +1972,144 @@ bool is_dev_fd_file(char *fname)
 }
 #endif
 
+/// Read the file "fd" of "size" bytes through a read-only memory mapping, see
+/// 'mapfilesize'.  The lines are not copied, thus the text must be usable as
+/// it is: no conversion, NUL or CR and, when "check_utf8" is set, valid UTF-8.
+///
+/// @param check_bom   skip a UTF-8 BOM, sets "*bomp"
+/// @param detect_ff   'fileformat' is to be detected, the first NL must be
+///                    in the part of the file that would be checked
+/// @param[out] noeolp  set when the last line has no line break
+///
+/// @return  the number of lines, zero when the file is to be read the normal
+///          way.
+static linenr_T readfile_map(int fd, size_t size, bool check_bom, bool check_utf8,
+                             bool detect_ff, bool *bomp, bool *noeolp)
+{
+  linenr_T count;
+  mapline_T *mm = file_map_lines(fd, size, check_bom, check_utf8, detect_ff, &count);
+  if (mm == NULL) {
+    return 0;
+  }
+  *noeolp = mm->mm_end == size;
+  *bomp = mm->mm_start > 0;
+  // Keep the file open to notice when another program changes it.
+  mm->mm_fd = os_dup(fd);
+  if (mm->mm_fd >= 0) {
+    os_set_cloexec(mm->mm_fd);
+  }
+  ml_map_set(curbuf, mm, count);
+  return count;
+}
+
+/// Map the file "fd" of "size" bytes and check that its lines can be taken
+/// from the mapping, see readfile_map() for the arguments.  Does not use any
+/// global state, thus can be called on a worker thread.
+///
+/// @param[out] countp  number of lines
+///
+/// @return  the lines for ml_map_set(), NULL when the file is to be read the
+///          normal way.
+mapline_T *file_map_lines(int fd, size_t size, bool check_bom, bool check_utf8, bool detect_ff,
+                          linenr_T *countp)
+  FUNC_ATTR_NONNULL_ALL FUNC_ATTR_WARN_UNUSED_RESULT
+{
+  char *base = os_mmap_readonly(fd, size);
+  if (base == NULL) {
+    return NULL;
+  }
+  mapline_T *mm = file_index_lines(base, size, check_bom, check_utf8, detect_ff, countp);
+  if (mm == NULL) {
+    os_munmap(base, size);
+    return NULL;
+  }
+  // The pages were only needed for checking.
+  os_mmap_release(base, size);
+  os_fileinfo_fd(fd, &mm->mm_file_info);
+  return mm;
+}
+
+/// Like file_map_lines(), but read the file into allocated memory, for a file
+/// that is too small to be worth mapping.
+mapline_T *file_read_lines(int fd, size_t size, bool check_bom, bool check_utf8, bool detect_ff,
+                           linenr_T *countp)
+  FUNC_ATTR_NONNULL_ALL FUNC_ATTR_WARN_UNUSED_RESULT
+{
+  char *base = xmalloc(size);
+  bool eof;
+  if (os_read(fd, &eof, base, size, false) != (ptrdiff_t)size) {
+    xfree(base);
+    return NULL;
+  }
+  mapline_T *mm = file_index_lines(base, size, check_bom, check_utf8, detect_ff, countp);
+  if (mm == NULL) {
+    xfree(base);
+    return NULL;
+  }
+  mm->mm_alloced = true;
+  return mm;
+}
+
+/// Check the "size" bytes of text at "base" and index its lines, for
+/// file_map_lines() and file_read_lines().
+static mapline_T *file_index_lines(char *base, size_t size, bool check_bom, bool check_utf8,
+                                   bool detect_ff, linenr_T *countp)
+{
+  kvec_t(size_t) index = KV_INITIAL_VALUE;
+  linenr_T count = 0;
+  size_t start = 0;
+  if (check_bom && size >= 3 && memcmp(base, "\xef\xbb\xbf", 3) == 0) {
+    start = 3;
+  }
+  if (detect_ff && memchr(base + start, NL, MIN(size - start, 0x10000)) == NULL) {
+    goto fail;
+  }
+
+  // Check the text and remember where every ML_MAP_STEP'th line starts.
+  const char *end = base + size;
+  for (const char *p = base + start; p < end;) {
+    if (count % ML_MAP_STEP == 0) {
+      kv_push(index, (size_t)(p - base));
+    }
+    if (count == MAXLNUM) {
+      goto fail;
+    }
+    const char *nl = xmemscan3(p, NUL, CAR, NL, (size_t)(end - p));
+    if ((nl < end && *nl != NL) || nl - p >= MAXCOL) {
+      goto fail;
+    }
+    for (; p < nl && check_utf8; p++) {
+      if ((uint8_t)(*p) >= 0x80) {
+        int l = utf_ptr2len_len(p, (int)(nl - p));
+        if (l == 1 || l > nl - p) {
+          goto fail;
+        }
+        p += l - 1;
+      }
+    }
+    count++;
+    p = nl + 1;
+  }
+  if (count == 0) {
+    goto fail;
+  }
+
+  mapline_T *mm = xcalloc(1, sizeof(mapline_T));
+  mm->mm_base = base;
+  mm->mm_size = size;
+  mm->mm_start = start;
+  mm->mm_end = base[size - 1] != NL ? size : size - 1;
+  mm->mm_index = index.items;
+  mm->mm_fd = -1;
+  mm->mm_refcount = 1;
+  *countp = count;
+  return mm;
+
+fail:
+  kv_destroy(index);
+  return NULL;
+}
+
 /// From the current line count and characters read after that, estimate the
 /// line number where we are now.
 /// Used for error messages that include a line number.
@@ -2895,6 +3101,7 @@ int buf_check_timestamp(buf_T *buf)
       || buf->b_ml.ml_mfp == NULL
       || !bt_normal(buf)
       || buf->b_saving
+      || buf_write_pending(buf)
       || busy) {
     return 0;
   }
@@ -7,6 +7,7 @@
 #include "nvim/eval/typval_defs.h"
 #include "nvim/ex_cmds_defs.h"  // IWYU pragma: keep
 #include "nvim/garray_defs.h"  // IWYU pragma: keep
+#include "nvim/memline_defs.h"  // IWYU pragma: keep
 #include "nvim/os/fs_defs.h"  // IWYU pragma: keep
 #include "nvim/os/os_defs.h"  // IWYU pragma: keep
 #include "nvim/pos_defs.h"  // IWYU pragma: keep
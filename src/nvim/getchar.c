@@ -1484,8 +1484,11 @@ static void updatescript(int c)
   }
   bool idle = (c == 0);
   if (idle || (p_uc > 0 && ++count >= p_uc)) {
+    // Write on a worker thread, so that typing is not delayed by a slow
+    // disk.
     ml_sync_all(idle, true,
-                (!!p_fs || idle));  // Always fsync at idle (CursorHold).
+                (!!p_fs || idle),  // Always fsync at idle (CursorHold).
+                true);
     count = 0;
   }
 }
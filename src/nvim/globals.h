@@ -85,7 +85,15 @@ EXTERN struct nvim_stats_s {
   int64_t fsync;
   int64_t redraw;
   int16_t log_skip;  // How many logs were tried and skipped before log_init.
-} g_stats INIT( = { 0, 0, 0 });
+  int64_t mf_hit;  // memfile blocks found in memory
+  int64_t mf_miss;  // memfile blocks read from the swap file
+  int64_t mf_evict;  // memfile blocks released for 'maxmemtot'
+  int64_t mf_writeback;  // of those, blocks written to the swap file first
+  int64_t mf_async;  // memfile blocks written to the swap file by a worker thread
+  int64_t regexp_cache_hit;  // compiled patterns shared by vim_regcomp()
+  int64_t regexp_cache_miss;  // patterns compiled and kept by vim_regcomp()
+  int64_t regexp_cache_evict;  // kept patterns dropped for newer ones
+} g_stats INIT( = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 });
 
 // Values for "starting".
 #define NO_SCREEN       2       // no screen updating yet
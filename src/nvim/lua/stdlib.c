@@ -13,6 +13,7 @@
 #endif
 
 #include "cjson/lua_cjson.h"
+#include "klib/kvec.h"
 #include "mpack/lmpack.h"
 #include "nvim/api/private/defs.h"
 #include "nvim/api/private/helpers.h"
@@ -36,6 +37,7 @@
 #include "nvim/mbyte.h"
 #include "nvim/mbyte_defs.h"
 #include "nvim/memline.h"
+#include "nvim/memline_defs.h"
 #include "nvim/memory.h"
 #include "nvim/pos_defs.h"
 #include "nvim/regexp.h"
@@ -49,6 +51,12 @@
 # include "lua/stdlib.c.generated.h"
 #endif
 
+/// Buffer snapshots taken with vim._buf_snapshot(), the handle of a snapshot
+/// is its index plus one.  Freed entries are NULL.
+static kvec_t(buf_snapshot_T *) nlua_snapshots = KV_INITIAL_VALUE;
+static uv_mutex_t nlua_snapshots_mutex;
+static bool nlua_snapshots_init = false;
+
 static int regex_match(lua_State *lstate, regprog_T **prog, char *str)
 {
   regmatch_T rm;
@@ -547,6 +555,125 @@ static int nlua_iconv(lua_State *lstate)
   return 1;
 }
 
+/// Take a snapshot of the text of a buffer, that can be read from luv threads.
+///
+/// vim._buf_snapshot(bufnr) returns a handle for vim._buf_snapshot_get_lines()
+/// and friends.
+static int nlua_buf_snapshot(lua_State *lstate)
+{
+  handle_T bufnr = (handle_T)luaL_checkinteger(lstate, 1);
+  buf_T *buf = bufnr ? handle_get_buffer(bufnr) : curbuf;
+  if (!buf || buf->b_ml.ml_mfp == NULL) {
+    return luaL_error(lstate, "invalid buffer");
+  }
+
+  buf_snapshot_T *snap = ml_snapshot(buf);
+
+  uv_mutex_lock(&nlua_snapshots_mutex);
+  size_t i;
+  for (i = 0; i < kv_size(nlua_snapshots); i++) {
+    if (kv_A(nlua_snapshots, i) == NULL) {
+      break;
+    }
+  }
+  if (i == kv_size(nlua_snapshots)) {
+    kv_push(nlua_snapshots, snap);
+  } else {
+    kv_A(nlua_snapshots, i) = snap;
+  }
+  uv_mutex_unlock(&nlua_snapshots_mutex);
+
+  lua_pushinteger(lstate, (lua_Integer)i + 1);
+  return 1;
+}
+
+/// Get the snapshot for the handle at stack index 1, with a reference added.
+///
+/// @return  NULL if there is no such snapshot.
+static buf_snapshot_T *nlua_snapshot_ref(lua_State *lstate)
+{
+  lua_Integer handle = luaL_checkinteger(lstate, 1);
+  buf_snapshot_T *snap = NULL;
+  uv_mutex_lock(&nlua_snapshots_mutex);
+  if (handle >= 1 && (size_t)handle <= kv_size(nlua_snapshots)) {
+    snap = kv_A(nlua_snapshots, handle - 1);
+    if (snap != NULL) {
+      ml_snapshot_ref(snap);
+    }
+  }
+  uv_mutex_unlock(&nlua_snapshots_mutex);
+  return snap;
+}
+
+/// vim._buf_snapshot_line_count(handle)
+static int nlua_buf_snapshot_line_count(lua_State *lstate)
+{
+  buf_snapshot_T *snap = nlua_snapshot_ref(lstate);
+  if (snap == NULL) {
+    return luaL_error(lstate, "invalid snapshot");
+  }
+  lua_pushinteger(lstate, snap->bs_line_count);
+  ml_snapshot_unref(snap);
+  return 1;
+}
+
+/// vim._buf_snapshot_get_lines(handle, start, end): zero-based, end-exclusive
+/// like nvim_buf_get_lines(), negative indices count from the end.
+static int nlua_buf_snapshot_get_lines(lua_State *lstate)
+{
+  lua_Integer start = luaL_checkinteger(lstate, 2);
+  lua_Integer end = luaL_checkinteger(lstate, 3);
+  buf_snapshot_T *snap = nlua_snapshot_ref(lstate);
+  if (snap == NULL) {
+    return luaL_error(lstate, "invalid snapshot");
+  }
+
+  lua_Integer count = snap->bs_line_count;
+  start = start < 0 ? count + start + 1 : start;
+  end = end < 0 ? count + end + 1 : end;
+  if (start < 0 || start > count || end < start || end > count) {
+    ml_snapshot_unref(snap);
+    return luaL_error(lstate, "Index out of bounds");
+  }
+
+  lua_createtable(lstate, (int)(end - start), 0);
+  snappos_T pos = { 0 };
+  for (lua_Integer i = start; i < end; i++) {
+    size_t len;
+    const char *line = ml_snapshot_get_line(snap, (linenr_T)i + 1, &pos, &len);
+    if (memchr(line, NL, len) == NULL) {
+      lua_pushlstring(lstate, line, len);
+    } else {
+      // NUL bytes are stored as NL
+      char *copy = xmemdupz(line, len);
+      memchrsub(copy, NL, NUL, len);
+      lua_pushlstring(lstate, copy, len);
+      xfree(copy);
+    }
+    lua_rawseti(lstate, -2, (int)(i - start + 1));
+  }
+  ml_snapshot_unref(snap);
+  return 1;
+}
+
+/// vim._buf_snapshot_free(handle)
+static int nlua_buf_snapshot_free(lua_State *lstate)
+{
+  lua_Integer handle = luaL_checkinteger(lstate, 1);
+  buf_snapshot_T *snap = NULL;
+  uv_mutex_lock(&nlua_snapshots_mutex);
+  if (handle >= 1 && (size_t)handle <= kv_size(nlua_snapshots)) {
+    snap = kv_A(nlua_snapshots, handle - 1);
+    kv_A(nlua_snapshots, handle - 1) = NULL;
+  }
+  uv_mutex_unlock(&nlua_snapshots_mutex);
+  if (snap == NULL) {
+    return luaL_error(lstate, "invalid snapshot");
+  }
+  ml_snapshot_unref(snap);
+  return 0;
+}
+
 // Update foldlevels (e.g., by evaluating 'foldexpr') for the given line range in the given window,
 // without invoking other side effects. Unlike `zx`, it does not close manually opened folds and
 // does not open folds under the cursor.
@@ -731,6 +858,14 @@ void nlua_state_add_stdlib(lua_State *const lstate, bool is_thread)
     luaopen_base64(lstate);
     lua_setfield(lstate, -2, "base64");
 
+    // _buf_snapshot
+    if (!nlua_snapshots_init) {
+      uv_mutex_init(&nlua_snapshots_mutex);
+      nlua_snapshots_init = true;
+    }
+    lua_pushcfunction(lstate, &nlua_buf_snapshot);
+    lua_setfield(lstate, -2, "_buf_snapshot");
+
     nlua_state_add_internal(lstate);
   }
 
@@ -764,6 +899,14 @@ void nlua_state_add_stdlib(lua_State *const lstate, bool is_thread)
   lua_pushcfunction(lstate, &nlua_xdl_diff);
   lua_setfield(lstate, -2, "diff");
 
+  // _buf_snapshot_line_count, _buf_snapshot_get_lines, _buf_snapshot_free
+  lua_pushcfunction(lstate, &nlua_buf_snapshot_line_count);
+  lua_setfield(lstate, -2, "_buf_snapshot_line_count");
+  lua_pushcfunction(lstate, &nlua_buf_snapshot_get_lines);
+  lua_setfield(lstate, -2, "_buf_snapshot_get_lines");
+  lua_pushcfunction(lstate, &nlua_buf_snapshot_free);
+  lua_setfield(lstate, -2, "_buf_snapshot_free");
+
   // vim.json
   lua_cjson_new(lstate);
   lua_setfield(lstate, -2, "json");
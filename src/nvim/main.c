@@ -30,6 +30,7 @@
 #include "nvim/autocmd_defs.h"
 #include "nvim/buffer.h"
 #include "nvim/buffer_defs.h"
+#include "nvim/bufwrite.h"
 #include "nvim/channel.h"
 #include "nvim/channel_defs.h"
 #include "nvim/decoration.h"
@@ -706,6 +707,11 @@ void getout(int exitval)
   FUNC_ATTR_NORETURN
 {
   assert(!ui_client_channel_id);
+
+  // Finish writing files before anything is torn down.
+  buf_write_wait();
+  buf_write_post_all();
+
   exiting = true;
 
   // make sure startuptimes have been flushed
@@ -866,7 +872,7 @@ void preserve_exit(const char *errmsg)
       if (errmsg != NULL) {
         fprintf(stderr, "Vim: preserving files...\r\n");
       }
-      ml_sync_all(false, false, true);  // preserve all swap files
+      ml_sync_all(false, false, true, false);  // preserve all swap files
       break;
     }
   }
@@ -6,7 +6,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "klib/kvec.h"
 #include "nvim/ascii_defs.h"
+#include "nvim/buffer.h"
 #include "nvim/buffer_defs.h"
 #include "nvim/charset.h"
 #include "nvim/drawscreen.h"
@@ -33,10 +35,49 @@
 #include "nvim/pos_defs.h"
 #include "nvim/profile.h"
 #include "nvim/regexp.h"
+#include "nvim/search.h"
 #include "nvim/strings.h"
 #include "nvim/types_defs.h"
 #include "nvim/vim_defs.h"
 
+/// Maximum number of lines and matches kept for 'hlsearch' in a window, when
+/// there are more they are all dropped.
+enum {
+  SEARCHHL_CACHE_MAX_LINES = 1000,
+  SEARCHHL_CACHE_MAX_COLS = 10000,
+};
+
+/// Line for which the 'hlsearch' matches are kept.
+typedef struct {
+  linenr_T lnum;
+  size_t idx;      ///< index of the first match in "cols"
+  size_t count;    ///< number of matches in the line
+} searchhl_line_T;
+
+/// Columns of a kept 'hlsearch' match.
+typedef struct {
+  colnr_T startcol;
+  colnr_T endcol;
+} searchhl_col_T;
+
+/// 'hlsearch' matches of the last used search pattern kept for lines of a
+/// window, so that redrawing does not search the lines again when only the
+/// cursor moved.  Only used for patterns where the matches in a line only
+/// depend on the text of that line.  When lines change
+/// searchhl_cache_changed() drops them.
+struct searchhl_cache_S {
+  search_pat_key_T key;         ///< pattern and options, "key.pat" is NULL
+                                ///< when no matches are kept
+  buf_T *buf;                   ///< buffer of the matches
+  handle_T handle;              ///< handle of "buf"
+  uint64_t text_gen;            ///< ml_text_gen of "buf" for the matches
+  varnumber_T changedtick;      ///< b:changedtick of "buf" for the matches
+  kvec_t(searchhl_line_T) lines;  ///< sorted on line number
+  kvec_t(searchhl_col_T) cols;
+  linenr_T cur_lnum;            ///< line of the match last used, zero if none
+  size_t cur_idx;               ///< index of that match in the line
+};
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "match.c.generated.h"
 #endif
@@ -340,10 +381,243 @@ void init_search_hl(win_T *wp, match_T *search_hl)
   search_hl->lnum = 0;
   search_hl->first_lnum = 0;
   search_hl->attr = win_hl_attr(wp, HLF_L);
+  searchhl_cache_check(wp, search_hl);
 
   // time limit is set at the toplevel, for all windows
 }
 
+static void searchhl_cache_clear(searchhl_cache_T *c)
+{
+  search_pat_key_clear(&c->key);
+  c->buf = NULL;
+  kv_size(c->lines) = 0;
+  kv_size(c->cols) = 0;
+  c->cur_lnum = 0;
+}
+
+void searchhl_cache_free(win_T *wp)
+  FUNC_ATTR_NONNULL_ALL
+{
+  searchhl_cache_T *c = wp->w_searchhl_cache;
+  if (c == NULL) {
+    return;
+  }
+  search_pat_key_clear(&c->key);
+  kv_destroy(c->lines);
+  kv_destroy(c->cols);
+  XFREE_CLEAR(wp->w_searchhl_cache);
+}
+
+/// Drop the 'hlsearch' matches kept for window "wp" when they are not for its
+/// buffer and the last used search pattern.
+static void searchhl_cache_check(win_T *wp, match_T *search_hl)
+{
+  if (search_hl->rm.regprog == NULL) {
+    return;
+  }
+
+  searchhl_cache_T *c = wp->w_searchhl_cache;
+  buf_T *buf = wp->w_buffer;
+  if (c != NULL) {
+    c->cur_lnum = 0;
+    if (c->buf != NULL
+        && c->buf == buf
+        && c->handle == buf->handle
+        && c->text_gen == buf->b_ml.ml_text_gen
+        && search_pat_key_equal(&c->key, buf)) {
+      // The text did not change, "b:changedtick" may have.
+      c->changedtick = buf_get_changedtick(buf);
+      return;
+    }
+    searchhl_cache_clear(c);
+  } else {
+    c = wp->w_searchhl_cache = xcalloc(1, sizeof(*c));
+  }
+
+  bool line_local;
+  if (!search_pat_key_set(&c->key, buf, &line_local)) {
+    return;
+  }
+  if (!line_local || re_multiline(search_hl->rm.regprog)) {
+    search_pat_key_clear(&c->key);
+    return;
+  }
+  c->buf = buf;
+  c->handle = buf->handle;
+  c->text_gen = buf->b_ml.ml_text_gen;
+  c->changedtick = buf_get_changedtick(buf);
+}
+
+/// Called when lines "lnum" to "lnume" (exclusive) of the buffer in window
+/// "wp" were changed and "xtra" lines were added, after b:changedtick was
+/// incremented.  Drops the 'hlsearch' matches kept for the changed lines.
+void searchhl_cache_changed(win_T *wp, linenr_T lnum, linenr_T lnume, linenr_T xtra)
+  FUNC_ATTR_NONNULL_ALL
+{
+  searchhl_cache_T *c = wp->w_searchhl_cache;
+  if (c == NULL || c->buf == NULL) {
+    return;
+  }
+  // Only when nothing else changed since the matches were found.
+  if (c->buf != wp->w_buffer
+      || c->handle != wp->w_buffer->handle
+      || buf_get_changedtick(c->buf) != c->changedtick + 1) {
+    searchhl_cache_clear(c);
+    return;
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < kv_size(c->lines); i++) {
+    searchhl_line_T line = kv_A(c->lines, i);
+    if (line.lnum >= lnum && line.lnum < lnume) {
+      continue;  // the matches in "cols" are dropped when there are too many
+    }
+    if (line.lnum >= lnume) {
+      line.lnum += xtra;
+    }
+    kv_A(c->lines, n++) = line;
+  }
+  kv_size(c->lines) = n;
+  c->cur_lnum = 0;
+  c->changedtick = buf_get_changedtick(c->buf);
+  c->text_gen = c->buf->b_ml.ml_text_gen;
+}
+
+/// Find all 'hlsearch' matches in line "lnum", in the same order as the loop
+/// in next_search_hl(), and add them to the kept matches.
+///
+/// @return  false when the matches cannot be kept or searching failed.  After
+///          an error or timeout the pattern is no longer used, like in
+///          next_search_hl().
+static bool searchhl_cache_search(win_T *wp, match_T *shl, linenr_T lnum)
+{
+  searchhl_cache_T *c = wp->w_searchhl_cache;
+  const int called_emsg_before = called_emsg;
+  colnr_T matchcol = 0;
+
+  while (true) {
+    if (profile_passed_limit(shl->tm)) {
+      return false;
+    }
+    int timed_out = false;
+    int nmatched = vim_regexec_multi(&shl->rm, wp, shl->buf, lnum, matchcol,
+                                     &(shl->tm), &timed_out);
+    if (called_emsg > called_emsg_before || got_int || timed_out) {
+      // Error while handling regexp: stop using this regexp.
+      vim_regfree(shl->rm.regprog);
+      set_no_hlsearch(true);
+      shl->rm.regprog = NULL;
+      shl->lnum = 0;
+      got_int = false;  // avoid the "Type :quit to exit Vim" message
+      return false;
+    }
+    if (nmatched == 0) {
+      return true;
+    }
+    if (shl->rm.startpos[0].lnum != 0 || shl->rm.endpos[0].lnum != 0) {
+      return false;
+    }
+
+    searchhl_col_T m = { shl->rm.startpos[0].col, shl->rm.endpos[0].col };
+    kv_push(c->cols, m);
+    if (!c->key.cpo_search || m.endcol <= m.startcol) {
+      matchcol = m.startcol;
+      char *ml = ml_get_buf(shl->buf, lnum) + matchcol;
+      if (*ml == NUL) {
+        return true;
+      }
+      matchcol += utfc_ptr2len(ml);
+    } else {
+      matchcol = m.endcol;
+    }
+  }
+}
+
+/// Get the 'hlsearch' matches kept for line "lnum", search the line when they
+/// are not kept yet.
+///
+/// @return  NULL when the line could not be searched.
+static searchhl_line_T *searchhl_cache_line(win_T *wp, match_T *shl, linenr_T lnum)
+{
+  searchhl_cache_T *c = wp->w_searchhl_cache;
+  size_t lo = 0;
+  size_t hi = kv_size(c->lines);
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (kv_A(c->lines, mid).lnum < lnum) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < kv_size(c->lines) && kv_A(c->lines, lo).lnum == lnum) {
+    return &kv_A(c->lines, lo);
+  }
+
+  if (kv_size(c->lines) >= SEARCHHL_CACHE_MAX_LINES
+      || kv_size(c->cols) >= SEARCHHL_CACHE_MAX_COLS) {
+    kv_size(c->lines) = 0;
+    kv_size(c->cols) = 0;
+    lo = 0;
+  }
+  searchhl_line_T line = { .lnum = lnum, .idx = kv_size(c->cols) };
+  if (!searchhl_cache_search(wp, shl, lnum)) {
+    kv_size(c->cols) = line.idx;
+    return NULL;
+  }
+  line.count = kv_size(c->cols) - line.idx;
+
+  (void)kv_pushp(c->lines);
+  memmove(&kv_A(c->lines, lo + 1), &kv_A(c->lines, lo),
+          (kv_size(c->lines) - 1 - lo) * sizeof(searchhl_line_T));
+  kv_A(c->lines, lo) = line;
+  return &kv_A(c->lines, lo);
+}
+
+/// Same as the search loop in next_search_hl() for 'hlsearch', but using the
+/// matches kept for line "lnum".
+///
+/// @return  false when there are no kept matches for the line, true when a
+///          match was found, none was found or the pattern was dropped.
+static bool next_search_hl_cached(win_T *wp, match_T *shl, linenr_T lnum, colnr_T mincol)
+{
+  searchhl_cache_T *c = wp->w_searchhl_cache;
+  if (c == NULL || c->buf == NULL || c->buf != shl->buf || shl->rm.regprog == NULL) {
+    return false;
+  }
+
+  size_t idx = 0;
+  if (shl->lnum != 0) {
+    // Continue after the previous match in this line.
+    if (c->cur_lnum != lnum) {
+      return false;
+    }
+    idx = c->cur_idx + 1;
+  }
+  searchhl_line_T *line = searchhl_cache_line(wp, shl, lnum);
+  if (line == NULL) {
+    c->cur_lnum = 0;
+    return shl->rm.regprog == NULL;
+  }
+
+  for (; idx < line->count; idx++) {
+    const searchhl_col_T *m = &kv_A(c->cols, line->idx + idx);
+    if (m->startcol >= mincol || m->endcol > mincol) {
+      shl->lnum = lnum;
+      shl->rm.startpos[0].lnum = 0;
+      shl->rm.startpos[0].col = m->startcol;
+      shl->rm.endpos[0].lnum = 0;
+      shl->rm.endpos[0].col = m->endcol;
+      c->cur_lnum = lnum;
+      c->cur_idx = idx;
+      return true;
+    }
+  }
+  shl->lnum = 0;  // no match found
+  c->cur_lnum = 0;
+  return true;
+}
+
 /// @param shl       points to a match. Fill on match.
 /// @param posmatch  match item with positions
 /// @param mincol    minimal column for a match
@@ -435,6 +709,10 @@ static void next_search_hl(win_T *win, match_T *search_hl, match_T *shl, linenr_
     }
   }
 
+  if (shl == search_hl && next_search_hl_cached(win, shl, lnum, mincol)) {
+    return;
+  }
+
   // Repeat searching for a match until one is found that includes "mincol"
   // or none is found in this line.
   while (true) {
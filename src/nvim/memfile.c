@@ -9,6 +9,16 @@
 ///   moment, they get a new, positive, number. A list is used for translation
 ///   of negative to positive numbers.
 ///
+/// The blocks in memory of all memfiles are kept in one list, most recently
+/// used first. When they take more than 'maxmemtot', the least recently used
+/// ones that are not locked are written to the file if needed and released.
+/// When 'memcompress' is set, blocks that are not among the most recently used
+/// ones are compressed in memory, and decompressed again by mf_get().
+///
+/// The data of a block can be shared with readers on other threads, see
+/// mf_share().  The memfile gets its own copy with mf_unshare() before the
+/// block is changed.
+///
 /// The size of a block is a multiple of a page size, normally the page size of
 /// the device the file is on. Most blocks are 1 page long. A block of multiple
 /// pages is used for a line that does not fit in a single page.
@@ -30,8 +40,13 @@
 /// mf_get()          get an existing block and lock it
 /// mf_put()          unlock a block, may be marked for writing
 /// mf_free()         remove a block
+/// mf_share()        share the data of a block with other threads
+/// mf_unshare()      copy the data of a shared block before changing it
 /// mf_sync()         sync changed parts of memfile to disk
+/// mf_sync_wait()    wait for syncing on the worker thread to finish
 /// mf_release_all()  release as much memory as possible
+/// mf_trim_cache()   compress and release blocks for 'memcompress' and
+///                   'maxmemtot'
 /// mf_trans_del()    may translate negative to positive block number
 /// mf_fullname()     make file name full path (use before first :cd)
 
@@ -43,19 +58,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <uv.h>
 
+#include "klib/kvec.h"
 #include "nvim/assert_defs.h"
 #include "nvim/buffer_defs.h"
 #include "nvim/errors.h"
+#include "nvim/event/loop.h"
 #include "nvim/fileio.h"
 #include "nvim/gettext_defs.h"
 #include "nvim/globals.h"
+#include "nvim/main.h"
 #include "nvim/map_defs.h"
 #include "nvim/memfile.h"
 #include "nvim/memfile_defs.h"
 #include "nvim/memline.h"
 #include "nvim/memory.h"
 #include "nvim/message.h"
+#include "nvim/option_vars.h"
 #include "nvim/os/fs.h"
 #include "nvim/os/fs_defs.h"
 #include "nvim/os/input.h"
@@ -67,12 +87,69 @@
 
 #define MEMFILE_PAGE_SIZE 4096       /// default page size
 
+#define MF_LZ_HASH_BITS 12           ///< size of the compressor hash table
+#define MF_LZ_MIN_MATCH 4            ///< shortest match that is encoded
+
+/// Copy of a dirty block, to be written by a worker thread.
+typedef struct {
+  blocknr_T bnum;                    ///< block number
+  off_T offset;                      ///< offset in the file
+  void *data;                        ///< copy of the block
+  unsigned size;                     ///< number of bytes
+} mfblock_T;
+
+/// Blocks of a memfile written to the swap file by a worker thread, see
+/// mf_sync() with MFS_ASYNC.
+typedef struct mfjob_S mfjob_T;
+struct mfjob_S {
+  uv_work_t req;
+  memfile_T *mfp;                    ///< NULL when the memfile was closed
+  int fd;                            ///< file descriptor of the swap file
+  bool fsync;                        ///< call fsync() after writing
+  bool failed;                       ///< a write or fsync() failed
+  bool checked;                      ///< mf_job_check() was called
+  kvec_t(mfblock_T) blocks;
+  mfjob_T *next;                     ///< next job in mf_jobs
+};
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "memfile.c.generated.h"
 #endif
 
 static const char e_block_was_not_locked[] = N_("E293: Block was not locked");
 
+/// Used list of the blocks of all memfiles, most recently used first.
+static bhdr_T *mf_used_first = NULL;
+static bhdr_T *mf_used_last = NULL;
+/// Number of bytes of memory used by the blocks in the used list.
+static size_t mf_used_bytes = 0;
+/// First block of the cold part of the used list, which goes to the end of
+/// the list. These blocks have BH_COLD set and may be compressed.
+static bhdr_T *mf_cold_first = NULL;
+/// Uncompressed size of the blocks in front of mf_cold_first.
+static size_t mf_hot_bytes = 0;
+/// Memory used by compressed blocks and their size when decompressed.
+static size_t mf_comp_bytes = 0;
+static size_t mf_comp_raw_bytes = 0;
+/// Buffer to decompress a block in for writing it.
+static uint8_t *mf_zbuf = NULL;
+static size_t mf_zbuf_size = 0;
+
+/// Jobs that were queued and whose completion was not handled yet.
+static mfjob_T *mf_jobs = NULL;
+/// Number of jobs that still have to write, protected by mf_jobs_mutex.
+static int mf_jobs_running = 0;
+static uv_mutex_t mf_jobs_mutex;
+static uv_cond_t mf_jobs_cond;
+static bool mf_jobs_init = false;
+
+/// Protects the reference counts of shared block data and mf_shared_bytes.
+static uv_mutex_t mf_shared_mutex;
+static bool mf_shared_init = false;
+/// Number of bytes of shared block data that is only used by readers, not by
+/// a memfile anymore.
+static size_t mf_shared_bytes = 0;
+
 /// Open a new or existing memory block file.
 ///
 /// @param fname  Name of file to use.
@@ -103,6 +180,7 @@ memfile_T *mf_open(char *fname, int flags)
 
   mfp->mf_free_first = NULL;         // free list is empty
   mfp->mf_dirty = MF_DIRTY_NO;
+  mfp->mf_async_failed = false;
   mfp->mf_hash = (PMap(int64_t)) MAP_INIT;
   mfp->mf_trans = (Map(int64_t, int64_t)) MAP_INIT;
   mfp->mf_page_size = MEMFILE_PAGE_SIZE;
@@ -173,6 +251,12 @@ void mf_close(memfile_T *mfp, bool del_file)
   if (mfp == NULL) {                    // safety check
     return;
   }
+  mf_sync_wait();
+  for (mfjob_T *job = mf_jobs; job != NULL; job = job->next) {
+    if (job->mfp == mfp) {
+      job->mfp = NULL;
+    }
+  }
   if (mfp->mf_fd >= 0 && close(mfp->mf_fd) < 0) {
     emsg(_(e_swapclose));
   }
@@ -183,6 +267,7 @@ void mf_close(memfile_T *mfp, bool del_file)
   // free entries in used list
   bhdr_T *hp;
   map_foreach_value(&mfp->mf_hash, hp, {
+    mf_rem_used(hp);
     mf_free_bhdr(hp);
   })
   while (mfp->mf_free_first != NULL) {  // free entries in free list
@@ -211,6 +296,7 @@ void mf_close_file(buf_T *buf, bool getlines)
     }
   }
 
+  mf_sync_wait();
   if (close(mfp->mf_fd) < 0) {           // close the file
     emsg(_(e_swapclose));
   }
@@ -226,7 +312,14 @@ void mf_close_file(buf_T *buf, bool getlines)
 /// and the size it indicates differs from what was guessed.
 void mf_new_page_size(memfile_T *mfp, unsigned new_size)
 {
+  bhdr_T *hp;
+  map_foreach_value(&mfp->mf_hash, hp, {
+    mf_used_sub(hp);
+  })
   mfp->mf_page_size = new_size;
+  map_foreach_value(&mfp->mf_hash, hp, {
+    mf_used_add(hp);
+  })
 }
 
 /// Get a new block
@@ -256,6 +349,8 @@ bhdr_T *mf_new(memfile_T *mfp, bool negative, unsigned page_count)
       void *p = xmalloc((size_t)mfp->mf_page_size * page_count);
       hp = mf_rem_free(mfp);
       hp->bh_data = p;
+      hp->bh_csize = 0;
+      hp->bh_shared = NULL;
     }
   } else {                      // get a new number
     hp = mf_alloc_bhdr(mfp, page_count);
@@ -271,11 +366,13 @@ bhdr_T *mf_new(memfile_T *mfp, bool negative, unsigned page_count)
   mfp->mf_dirty = MF_DIRTY_YES;
   hp->bh_page_count = page_count;
   pmap_put(int64_t)(&mfp->mf_hash, hp->bh_bnum, hp);
+  mf_ins_used(mfp, hp);
 
   // Init the data to all zero, to avoid reading uninitialized data.
   // This also avoids that the passwd file ends up in the swap file!
   memset(hp->bh_data, 0, (size_t)mfp->mf_page_size * page_count);
 
+  mf_trim_cache();
   return hp;
 }
 
@@ -308,18 +405,24 @@ bhdr_T *mf_get(memfile_T *mfp, blocknr_T nr, unsigned page_count)
     }
 
     hp->bh_bnum = nr;
-    hp->bh_flags = 0;
+    hp->bh_flags = BH_LOCKED;
     hp->bh_page_count = page_count;
     if (mf_read(mfp, hp) == FAIL) {             // cannot read the block
       mf_free_bhdr(hp);
       return NULL;
     }
-  } else {
-    pmap_del(int64_t)(&mfp->mf_hash, hp->bh_bnum, NULL);
+    g_stats.mf_miss++;
+    pmap_put(int64_t)(&mfp->mf_hash, hp->bh_bnum, hp);
+    mf_ins_used(mfp, hp);
+    mf_trim_cache();
+    return hp;
   }
 
+  g_stats.mf_hit++;
   hp->bh_flags |= BH_LOCKED;
-  pmap_put(int64_t)(&mfp->mf_hash, hp->bh_bnum, hp);  // put in front of hash table
+  mf_decompress(hp);
+  mf_rem_used(hp);                              // put in front of used list
+  mf_ins_used(mfp, hp);
 
   return hp;
 }
@@ -351,7 +454,8 @@ void mf_put(memfile_T *mfp, bhdr_T *hp, bool dirty, bool infile)
 /// Signal block as no longer used (may put it in the free list).
 void mf_free(memfile_T *mfp, bhdr_T *hp)
 {
-  xfree(hp->bh_data);           // free data
+  mf_rem_used(hp);
+  mf_free_data(hp);             // free data
   pmap_del(int64_t)(&mfp->mf_hash, hp->bh_bnum, NULL);  // get *hp out of the hash table
   if (hp->bh_bnum < 0) {
     xfree(hp);                  // don't want negative numbers in free list
@@ -370,6 +474,8 @@ void mf_free(memfile_T *mfp, bhdr_T *hp)
 ///               MFS_FLUSH  Make sure buffers are flushed to disk, so they will
 ///                          survive a system crash.
 ///               MFS_ZERO   Only write block 0.
+///               MFS_ASYNC  Copy the blocks and write them on a worker
+///                          thread, do not wait for it.  Not with MFS_ALL.
 ///
 /// @return FAIL  If failure. Possible causes:
 ///               - No file (nothing to do).
@@ -385,6 +491,13 @@ int mf_sync(memfile_T *mfp, int flags)
     return FAIL;
   }
 
+  // After a failure on the worker thread write here, to get an error
+  // message when it fails again.
+  if ((flags & MFS_ASYNC) && !mfp->mf_async_failed) {
+    return mf_sync_async(mfp, flags);
+  }
+  mfp->mf_async_failed = false;
+
   // Only a CTRL-C while writing will break us here, not one typed previously.
   got_int = false;
 
@@ -439,6 +552,170 @@ int mf_sync(memfile_T *mfp, int flags)
   return status;
 }
 
+/// Sync the dirty blocks with a positive number of "mfp" on a worker thread.
+/// Blocks that extend the file are written here, so that the file never has
+/// gaps.
+///
+/// @param flags  MFS_FLUSH  call fsync() after writing
+static int mf_sync_async(memfile_T *mfp, int flags)
+{
+  // Blocks written by an earlier job could end up in the file after the
+  // ones written now, wait for the next time instead.
+  for (mfjob_T *job = mf_jobs; job != NULL; job = job->next) {
+    if (job->mfp == mfp) {
+      return OK;
+    }
+  }
+
+  mfjob_T *job = xcalloc(1, sizeof(mfjob_T));
+  job->mfp = mfp;
+  job->fd = mfp->mf_fd;
+  job->fsync = flags & MFS_FLUSH;
+  kv_init(job->blocks);
+
+  int status = OK;
+  bhdr_T *hp;
+  map_foreach_value(&mfp->mf_hash, hp, {
+    if (hp->bh_bnum < 0 || !(hp->bh_flags & BH_DIRTY)) {
+      continue;
+    }
+    if (hp->bh_bnum + (blocknr_T)hp->bh_page_count > mfp->mf_infile_count) {
+      if (mf_write(mfp, hp) == FAIL) {
+        status = FAIL;
+      }
+      continue;
+    }
+    unsigned size = mfp->mf_page_size * hp->bh_page_count;
+    kv_push(job->blocks, ((mfblock_T){
+      .bnum = hp->bh_bnum,
+      .offset = (off_T)mfp->mf_page_size * hp->bh_bnum,
+      .data = xmemdup(mf_block_data(hp), size),
+      .size = size,
+    }));
+    hp->bh_flags &= ~BH_DIRTY;
+  })
+  mfp->mf_dirty = MF_DIRTY_NO;
+
+  if (kv_size(job->blocks) == 0 && !job->fsync) {
+    kv_destroy(job->blocks);
+    xfree(job);
+    return status;
+  }
+
+  if (!mf_jobs_init) {
+    uv_mutex_init(&mf_jobs_mutex);
+    uv_cond_init(&mf_jobs_cond);
+    mf_jobs_init = true;
+  }
+  job->next = mf_jobs;
+  mf_jobs = job;
+  uv_mutex_lock(&mf_jobs_mutex);
+  mf_jobs_running++;
+  uv_mutex_unlock(&mf_jobs_mutex);
+  job->req.data = job;
+  if (uv_queue_work(&main_loop.uv, &job->req, mf_job_work, mf_job_done) != 0) {
+    mf_job_work(&job->req);
+    mf_job_done(&job->req, 0);
+  }
+  return status;
+}
+
+/// Write the blocks of a job.  Runs on a worker thread, must not touch
+/// anything but the job.
+static void mf_job_work(uv_work_t *req)
+{
+  mfjob_T *job = req->data;
+  uv_fs_t fs_req;
+
+  for (size_t i = 0; i < kv_size(job->blocks) && !job->failed; i++) {
+    mfblock_T *block = &kv_A(job->blocks, i);
+    uv_buf_t buf = uv_buf_init(block->data, block->size);
+    int r = uv_fs_write(NULL, &fs_req, job->fd, &buf, 1, block->offset, NULL);
+    uv_fs_req_cleanup(&fs_req);
+    job->failed = r != (int)block->size;
+  }
+  if (job->fsync && !job->failed) {
+    int r = uv_fs_fsync(NULL, &fs_req, job->fd, NULL);
+    uv_fs_req_cleanup(&fs_req);
+    job->failed = r != 0;
+  }
+
+  uv_mutex_lock(&mf_jobs_mutex);
+  mf_jobs_running--;
+  uv_cond_broadcast(&mf_jobs_cond);
+  uv_mutex_unlock(&mf_jobs_mutex);
+}
+
+/// Called on the main thread when a job is done.
+static void mf_job_done(uv_work_t *req, int status)
+{
+  mfjob_T *job = req->data;
+
+  for (mfjob_T **jp = &mf_jobs; *jp != NULL; jp = &(*jp)->next) {
+    if (*jp == job) {
+      *jp = job->next;
+      break;
+    }
+  }
+  if (!job->failed) {
+    g_stats.mf_async += (int64_t)kv_size(job->blocks);
+    if (job->fsync) {
+      g_stats.fsync++;
+    }
+  }
+  if (status != 0) {
+    job->failed = true;
+  }
+  mf_job_check(job);
+
+  for (size_t i = 0; i < kv_size(job->blocks); i++) {
+    xfree(kv_A(job->blocks, i).data);
+  }
+  kv_destroy(job->blocks);
+  xfree(job);
+}
+
+/// When writing the blocks of a finished job failed, mark them dirty again,
+/// so that they are not released from memory and are written again next time,
+/// without the worker thread.
+static void mf_job_check(mfjob_T *job)
+{
+  if (job->checked) {
+    return;
+  }
+  job->checked = true;
+  memfile_T *mfp = job->mfp;
+  if (mfp == NULL || !job->failed) {
+    return;
+  }
+  mfp->mf_async_failed = true;
+  mfp->mf_dirty = MF_DIRTY_YES;
+  for (size_t i = 0; i < kv_size(job->blocks); i++) {
+    bhdr_T *hp = pmap_get(int64_t)(&mfp->mf_hash, kv_A(job->blocks, i).bnum);
+    if (hp != NULL) {
+      hp->bh_flags |= BH_DIRTY;
+    }
+  }
+}
+
+/// Wait until the worker threads are done writing blocks.  Must be called
+/// before the swap file is read, written or closed here, and before blocks
+/// are released from memory.
+void mf_sync_wait(void)
+{
+  if (mf_jobs == NULL) {
+    return;
+  }
+  uv_mutex_lock(&mf_jobs_mutex);
+  while (mf_jobs_running > 0) {
+    uv_cond_wait(&mf_jobs_cond, &mf_jobs_mutex);
+  }
+  uv_mutex_unlock(&mf_jobs_mutex);
+  for (mfjob_T *job = mf_jobs; job != NULL; job = job->next) {
+    mf_job_check(job);
+  }
+}
+
 /// Set dirty flag for all blocks in memory file with a positive block number.
 /// These are blocks that need to be written to a newly created swapfile.
 void mf_set_dirty(memfile_T *mfp)
@@ -460,6 +737,7 @@ void mf_set_dirty(memfile_T *mfp)
 bool mf_release_all(void)
 {
   bool retval = false;
+  mf_sync_wait();
   FOR_ALL_BUFFERS(buf) {
     memfile_T *mfp = buf->b_ml.ml_mfp;
     if (mfp != NULL) {
@@ -476,6 +754,7 @@ bool mf_release_all(void)
               && (!(hp->bh_flags & BH_DIRTY)
                   || mf_write(mfp, hp) != FAIL)) {
             pmap_del(int64_t)(&mfp->mf_hash, hp->bh_bnum, NULL);
+            mf_rem_used(hp);
             mf_free_bhdr(hp);
             retval = true;
             // Rerun with the same value of i. another item will have taken
@@ -490,11 +769,370 @@ bool mf_release_all(void)
   return retval;
 }
 
+/// Compress blocks for 'memcompress', then release the least recently used
+/// blocks of all memfiles until they use no more than 'maxmemtot', including
+/// the data that only snapshots still use.  Changed blocks are written to the
+/// swap file first.  Locked blocks, shared blocks, which would not free any
+/// memory, and blocks of a memfile without a swap file are kept.
+void mf_trim_cache(void)
+{
+  mf_compress_cold();
+  if (p_mmt <= 0) {
+    return;
+  }
+  size_t limit = (size_t)p_mmt * 1024;
+  size_t shared = mf_snapshot_bytes();
+  limit = limit > shared ? limit - shared : 0;
+  mf_sync_wait();
+
+  bhdr_T *hp = mf_used_last;
+  while (hp != NULL && mf_used_bytes > limit) {
+    bhdr_T *prev = hp->bh_prev;
+    memfile_T *mfp = hp->bh_mfp;
+    if (!(hp->bh_flags & BH_LOCKED) && !mf_still_shared(hp) && mfp->mf_fd >= 0) {
+      if (hp->bh_flags & BH_DIRTY) {
+        if (mf_write(mfp, hp) == FAIL) {
+          break;  // probably a full disk, don't keep on trying
+        }
+        g_stats.mf_writeback++;
+      }
+      pmap_del(int64_t)(&mfp->mf_hash, hp->bh_bnum, NULL);
+      mf_rem_used(hp);
+      mf_free_bhdr(hp);
+      g_stats.mf_evict++;
+    }
+    hp = prev;
+  }
+}
+
+/// @return  number of bytes of memory used by the blocks of all memfiles.
+size_t mf_cache_bytes(void)
+{
+  return mf_used_bytes;
+}
+
+/// @return  number of bytes of block data that only snapshots still use.
+size_t mf_snapshot_bytes(void)
+{
+  if (!mf_shared_init) {
+    return 0;
+  }
+  uv_mutex_lock(&mf_shared_mutex);
+  size_t bytes = mf_shared_bytes;
+  uv_mutex_unlock(&mf_shared_mutex);
+  return bytes;
+}
+
+/// Get the memory used by compressed blocks of all memfiles.
+///
+/// @param[out] raw  size of these blocks when decompressed
+size_t mf_compressed_bytes(size_t *raw)
+{
+  *raw = mf_comp_raw_bytes;
+  return mf_comp_bytes;
+}
+
+/// @return  number of bytes of block "hp" when decompressed.
+static size_t mf_block_size(bhdr_T *hp)
+{
+  return (size_t)hp->bh_mfp->mf_page_size * hp->bh_page_count;
+}
+
+/// Add block "hp" to the memory accounting of the used list.
+static void mf_used_add(bhdr_T *hp)
+{
+  size_t size = mf_block_size(hp);
+  if (hp->bh_csize != 0) {
+    mf_used_bytes += hp->bh_csize;
+    mf_comp_bytes += hp->bh_csize;
+    mf_comp_raw_bytes += size;
+  } else {
+    mf_used_bytes += size;
+  }
+  if (!(hp->bh_flags & BH_COLD)) {
+    mf_hot_bytes += size;
+  }
+}
+
+/// Remove block "hp" from the memory accounting of the used list.
+static void mf_used_sub(bhdr_T *hp)
+{
+  size_t size = mf_block_size(hp);
+  if (hp->bh_csize != 0) {
+    mf_used_bytes -= hp->bh_csize;
+    mf_comp_bytes -= hp->bh_csize;
+    mf_comp_raw_bytes -= size;
+  } else {
+    mf_used_bytes -= size;
+  }
+  if (!(hp->bh_flags & BH_COLD)) {
+    mf_hot_bytes -= size;
+  }
+}
+
+/// Move blocks from the end of the hot part of the used list to the cold
+/// part until the hot part is no more than 'memcompress', and compress them.
+/// Block 0 and locked blocks are not compressed, their data may be used
+/// directly.  Shared blocks are not compressed, the data would be kept for
+/// the readers anyway.
+static void mf_compress_cold(void)
+{
+  if (p_mcm <= 0) {
+    return;
+  }
+  size_t limit = (size_t)p_mcm * 1024;
+
+  while (mf_hot_bytes > limit) {
+    bhdr_T *hp = mf_cold_first == NULL ? mf_used_last : mf_cold_first->bh_prev;
+    if (hp == NULL) {
+      break;
+    }
+    mf_hot_bytes -= mf_block_size(hp);
+    hp->bh_flags |= BH_COLD;
+    mf_cold_first = hp;
+    if (!(hp->bh_flags & BH_LOCKED) && hp->bh_bnum != 0 && !mf_still_shared(hp)) {
+      mf_compress(hp);
+    }
+  }
+}
+
+/// Compress the data of block "hp", if that saves at least an eighth of it.
+static void mf_compress(bhdr_T *hp)
+{
+  size_t size = mf_block_size(hp);
+  size_t limit = size - size / 8;
+  if (mf_zbuf_size < limit) {
+    xfree(mf_zbuf);
+    mf_zbuf = xmalloc(limit);
+    mf_zbuf_size = limit;
+  }
+  size_t csize = mf_lz_compress(hp->bh_data, size, mf_zbuf, limit);
+  if (csize == 0) {
+    return;
+  }
+  mf_used_sub(hp);
+  mf_free_data(hp);
+  hp->bh_data = xmemdup(mf_zbuf, csize);
+  hp->bh_csize = (unsigned)csize;
+  mf_used_add(hp);
+}
+
+/// Decompress the data of block "hp", if it is compressed.
+static void mf_decompress(bhdr_T *hp)
+{
+  if (hp->bh_csize == 0) {
+    return;
+  }
+  size_t size = mf_block_size(hp);
+  uint8_t *data = xmalloc(size);
+  mf_lz_decompress(hp->bh_data, hp->bh_csize, data, size);
+  mf_used_sub(hp);
+  xfree(hp->bh_data);
+  hp->bh_data = data;
+  hp->bh_csize = 0;
+  mf_used_add(hp);
+}
+
+/// @return  the data of block "hp". When it is compressed, it is decompressed
+///          in a buffer that is valid until the next call.
+static void *mf_block_data(bhdr_T *hp)
+{
+  if (hp->bh_csize == 0) {
+    return hp->bh_data;
+  }
+  size_t size = mf_block_size(hp);
+  if (mf_zbuf_size < size) {
+    xfree(mf_zbuf);
+    mf_zbuf = xmalloc(size);
+    mf_zbuf_size = size;
+  }
+  mf_lz_decompress(hp->bh_data, hp->bh_csize, mf_zbuf, size);
+  return mf_zbuf;
+}
+
+/// Append the part of a length that does not fit in the token of a sequence.
+///
+/// @return  pointer after the length, NULL if it does not fit before "oend".
+static uint8_t *mf_lz_put_len(uint8_t *op, const uint8_t *oend, size_t len)
+{
+  for (len -= 15;; len -= 255) {
+    if (op >= oend) {
+      return NULL;
+    }
+    if (len < 255) {
+      *op++ = (uint8_t)len;
+      return op;
+    }
+    *op++ = 255;
+  }
+}
+
+/// Append a sequence of "litlen" literal bytes from "lit", followed by a
+/// match of "mlen" + MF_LZ_MIN_MATCH bytes "offset" bytes back.  The last
+/// sequence has no match, "offset" is zero.
+///
+/// @return  pointer after the sequence, NULL if it does not fit before "oend".
+static uint8_t *mf_lz_put_seq(uint8_t *op, const uint8_t *oend, const uint8_t *lit,
+                              size_t litlen, size_t offset, size_t mlen)
+{
+  if (op >= oend) {
+    return NULL;
+  }
+  uint8_t *token = op++;
+  *token = (uint8_t)((MIN(litlen, 15) << 4) | MIN(mlen, 15));
+  if (litlen >= 15 && (op = mf_lz_put_len(op, oend, litlen)) == NULL) {
+    return NULL;
+  }
+  if ((size_t)(oend - op) < litlen) {
+    return NULL;
+  }
+  memcpy(op, lit, litlen);
+  op += litlen;
+  if (offset == 0) {
+    return op;
+  }
+  if (oend - op < 2) {
+    return NULL;
+  }
+  *op++ = (uint8_t)offset;
+  *op++ = (uint8_t)(offset >> 8);
+  if (mlen >= 15 && (op = mf_lz_put_len(op, oend, mlen)) == NULL) {
+    return NULL;
+  }
+  return op;
+}
+
+/// Compress "len" bytes at "src" into "dst", using a byte-oriented LZ77
+/// encoding in the style of LZ4: each sequence is a token with the number of
+/// literal bytes and the match length, the literal bytes, and a two byte
+/// offset of the match.  Text blocks typically shrink two to four times.
+///
+/// @return  number of bytes written, zero when it does not fit in "dstlen".
+static size_t mf_lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t dstlen)
+{
+  static uint32_t table[1 << MF_LZ_HASH_BITS];
+  memset(table, 0, sizeof(table));
+
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  const uint8_t *iend = src + len;
+  uint8_t *op = dst;
+  const uint8_t *oend = dst + dstlen;
+
+  while (iend - ip >= MF_LZ_MIN_MATCH) {
+    uint32_t v;
+    memcpy(&v, ip, sizeof(v));
+    uint32_t h = (v * 2654435761U) >> (32 - MF_LZ_HASH_BITS);
+    const uint8_t *ref = src + table[h];
+    table[h] = (uint32_t)(ip - src);
+    if (ref >= ip || ip - ref > 0xffff || memcmp(ref, ip, MF_LZ_MIN_MATCH) != 0) {
+      ip++;
+      continue;
+    }
+    const uint8_t *mp = ip + MF_LZ_MIN_MATCH;
+    ref += MF_LZ_MIN_MATCH;
+    while (mp < iend && *mp == *ref) {
+      mp++;
+      ref++;
+    }
+    op = mf_lz_put_seq(op, oend, anchor, (size_t)(ip - anchor), (size_t)(mp - ref),
+                       (size_t)(mp - ip) - MF_LZ_MIN_MATCH);
+    if (op == NULL) {
+      return 0;
+    }
+    ip = anchor = mp;
+  }
+  op = mf_lz_put_seq(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+  return op == NULL ? 0 : (size_t)(op - dst);
+}
+
+/// Decompress "len" bytes at "src", produced by mf_lz_compress(), into the
+/// "dstlen" bytes at "dst".
+static void mf_lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t dstlen)
+{
+  const uint8_t *ip = src;
+  const uint8_t *iend = src + len;
+  uint8_t *op = dst;
+
+  while (ip < iend) {
+    unsigned token = *ip++;
+    size_t n = token >> 4;
+    if (n == 15) {
+      uint8_t b;
+      do {
+        b = *ip++;
+        n += b;
+      } while (b == 255);
+    }
+    memcpy(op, ip, n);
+    op += n;
+    ip += n;
+    if (ip >= iend) {
+      break;
+    }
+    size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    n = token & 15;
+    if (n == 15) {
+      uint8_t b;
+      do {
+        b = *ip++;
+        n += b;
+      } while (b == 255);
+    }
+    n += MF_LZ_MIN_MATCH;
+    // the match may overlap with the bytes being written
+    const uint8_t *ref = op - offset;
+    while (n-- > 0) {
+      *op++ = *ref++;
+    }
+  }
+  assert(op == dst + dstlen);
+  (void)dstlen;
+}
+
+/// Insert block "hp" of "mfp" in front of the used list.
+static void mf_ins_used(memfile_T *mfp, bhdr_T *hp)
+{
+  hp->bh_mfp = mfp;
+  hp->bh_flags &= ~BH_COLD;
+  hp->bh_prev = NULL;
+  hp->bh_next = mf_used_first;
+  if (mf_used_first == NULL) {
+    mf_used_last = hp;
+  } else {
+    mf_used_first->bh_prev = hp;
+  }
+  mf_used_first = hp;
+  mf_used_add(hp);
+}
+
+/// Remove block "hp" from the used list.
+static void mf_rem_used(bhdr_T *hp)
+{
+  mf_used_sub(hp);
+  if (hp == mf_cold_first) {
+    mf_cold_first = hp->bh_next;
+  }
+  if (hp->bh_prev == NULL) {
+    mf_used_first = hp->bh_next;
+  } else {
+    hp->bh_prev->bh_next = hp->bh_next;
+  }
+  if (hp->bh_next == NULL) {
+    mf_used_last = hp->bh_prev;
+  } else {
+    hp->bh_next->bh_prev = hp->bh_prev;
+  }
+}
+
 /// Allocate a block header and a block of memory for it.
 static bhdr_T *mf_alloc_bhdr(memfile_T *mfp, unsigned page_count)
 {
   bhdr_T *hp = xmalloc(sizeof(bhdr_T));
   hp->bh_data = xmalloc((size_t)mfp->mf_page_size * page_count);
+  hp->bh_csize = 0;
+  hp->bh_shared = NULL;
   hp->bh_page_count = page_count;
   return hp;
 }
@@ -502,10 +1140,108 @@ static bhdr_T *mf_alloc_bhdr(memfile_T *mfp, unsigned page_count)
 /// Free a block header and its block memory.
 static void mf_free_bhdr(bhdr_T *hp)
 {
-  xfree(hp->bh_data);
+  mf_free_data(hp);
   xfree(hp);
 }
 
+/// Free the block memory of "hp", or release it when it is shared.
+static void mf_free_data(bhdr_T *hp)
+{
+  if (hp->bh_shared != NULL) {
+    mf_shared_release(hp->bh_shared);
+    hp->bh_shared = NULL;
+  } else {
+    xfree(hp->bh_data);
+  }
+}
+
+/// Share the data of locked block "hp", so that it can be read without the
+/// memfile, also from other threads.  It is not changed, the memfile gets a
+/// copy with mf_unshare() before changing the block.
+///
+/// @return  reference to the data, release it with mf_shared_unref().
+mfshared_T *mf_share(bhdr_T *hp)
+{
+  assert((hp->bh_flags & BH_LOCKED) && hp->bh_csize == 0);
+  if (!mf_shared_init) {
+    uv_mutex_init(&mf_shared_mutex);
+    mf_shared_init = true;
+  }
+  if (hp->bh_shared == NULL) {
+    hp->bh_shared = xmalloc(sizeof(mfshared_T));
+    hp->bh_shared->ms_refcount = 1;  // reference of the memfile
+    hp->bh_shared->ms_data = hp->bh_data;
+    hp->bh_shared->ms_size = mf_block_size(hp);
+    hp->bh_shared->ms_detached = false;
+  }
+  uv_mutex_lock(&mf_shared_mutex);
+  hp->bh_shared->ms_refcount++;
+  uv_mutex_unlock(&mf_shared_mutex);
+  return hp->bh_shared;
+}
+
+/// Release a reference to shared block data.  Can be called from any thread.
+void mf_shared_unref(mfshared_T *sp)
+{
+  uv_mutex_lock(&mf_shared_mutex);
+  bool last = --sp->ms_refcount == 0;
+  if (last && sp->ms_detached) {
+    mf_shared_bytes -= sp->ms_size;
+  }
+  uv_mutex_unlock(&mf_shared_mutex);
+  if (last) {
+    xfree(sp->ms_data);
+    xfree(sp);
+  }
+}
+
+/// Release the reference of the memfile to shared block data.  When readers
+/// still use it, it is counted in mf_shared_bytes until they release it.
+static void mf_shared_release(mfshared_T *sp)
+{
+  uv_mutex_lock(&mf_shared_mutex);
+  bool last = --sp->ms_refcount == 0;
+  if (!last) {
+    sp->ms_detached = true;
+    mf_shared_bytes += sp->ms_size;
+  }
+  uv_mutex_unlock(&mf_shared_mutex);
+  if (last) {
+    xfree(sp->ms_data);
+    xfree(sp);
+  }
+}
+
+/// @return  true when readers still use the data of block "hp".  Otherwise
+///          the data is not shared anymore.
+static bool mf_still_shared(bhdr_T *hp)
+{
+  if (hp->bh_shared == NULL) {
+    return false;
+  }
+  // Only mf_share() adds a reference, on this thread.
+  uv_mutex_lock(&mf_shared_mutex);
+  bool shared = hp->bh_shared->ms_refcount > 1;
+  uv_mutex_unlock(&mf_shared_mutex);
+  if (!shared) {
+    xfree(hp->bh_shared);
+    hp->bh_shared = NULL;
+  }
+  return shared;
+}
+
+/// Give locked block "hp" its own copy of its data, if it is shared.  Must be
+/// done before the block is changed.
+void mf_unshare(bhdr_T *hp)
+{
+  if (!mf_still_shared(hp)) {
+    return;
+  }
+  hp->bh_data = xmemdup(hp->bh_data, mf_block_size(hp));
+  mf_shared_release(hp->bh_shared);
+  hp->bh_shared = NULL;
+}
+
 /// Insert a block in the free list.
 static void mf_ins_free(memfile_T *mfp, bhdr_T *hp)
 {
@@ -534,6 +1270,7 @@ static int mf_read(memfile_T *mfp, bhdr_T *hp)
   if (mfp->mf_fd < 0) {     // there is no file, can't read
     return FAIL;
   }
+  mf_sync_wait();
 
   unsigned page_size = mfp->mf_page_size;
   // TODO(elmart): Check (page_size * hp->bh_bnum) within off_T bounds.
@@ -569,6 +1306,7 @@ static int mf_write(memfile_T *mfp, bhdr_T *hp)
   if (mfp->mf_fd < 0) {     // there is no file, can't write
     return FAIL;
   }
+  mf_sync_wait();
 
   if (hp->bh_bnum < 0) {    // must assign file block number
     if (mf_trans_add(mfp, hp) == FAIL) {
@@ -603,7 +1341,7 @@ static int mf_write(memfile_T *mfp, bhdr_T *hp)
       page_count = hp2->bh_page_count;
     }
     unsigned size = page_size * page_count;  // number of bytes written
-    void *data = (hp2 == NULL) ? hp->bh_data : hp2->bh_data;
+    void *data = mf_block_data(hp2 == NULL ? hp : hp2);
     if ((unsigned)write_eintr(mfp->mf_fd, data, size) != size) {
       /// Avoid repeating the error message, this mostly happens when the
       /// disk is full. We give the message again only after a successful
@@ -9,6 +9,7 @@ enum {
   MFS_STOP  = 2,  ///< stop syncing when a character is available
   MFS_FLUSH = 4,  ///< flushed file to disk
   MFS_ZERO  = 8,  ///< only write block 0
+  MFS_ASYNC = 16,  ///< write on a worker thread
 };
 
 enum {
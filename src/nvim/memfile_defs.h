@@ -13,6 +13,19 @@
 /// with negative numbers are currently in memory only.
 typedef int64_t blocknr_T;
 
+typedef struct memfile memfile_T;
+typedef struct bhdr bhdr_T;
+
+/// Data of a block that is shared with readers that may run on other threads,
+/// see mf_share().  The data is not changed, it is freed when the last
+/// reference is released.
+typedef struct {
+  int ms_refcount;                   ///< protected by a mutex
+  void *ms_data;                     ///< the data of the block
+  size_t ms_size;                    ///< size of ms_data
+  bool ms_detached;                  ///< the memfile does not use it anymore
+} mfshared_T;
+
 /// A block header.
 ///
 /// There is a block header for each previously used block in the memfile.
@@ -20,20 +33,31 @@ typedef int64_t blocknr_T;
 /// The block may be linked in the used list OR in the free list.
 ///
 /// The used list is a doubly linked list, most recently used block first.
+/// It is shared by all memfiles, so that 'maxmemtot' can be applied to the
+/// blocks of all buffers together.
 /// The blocks in the used list have a block of memory allocated.
 /// The free list is a single linked list, not sorted.
 /// The blocks in the free list have no block of memory allocated and
 /// the contents of the block in the file (if any) is irrelevant.
-typedef struct {
+struct bhdr {
   blocknr_T bh_bnum;                 ///< key used in hash table
 
   void *bh_data;                     ///< pointer to memory (for used block)
   unsigned bh_page_count;            ///< number of pages in this block
 
+  unsigned bh_csize;                 ///< size of compressed bh_data, zero
+                                     ///< when it is not compressed
+  mfshared_T *bh_shared;             ///< not NULL when bh_data is shared
+
 #define BH_DIRTY    1U
 #define BH_LOCKED   2U
-  unsigned bh_flags;                 ///< BH_DIRTY or BH_LOCKED
-} bhdr_T;
+#define BH_COLD     4U               ///< in the cold part of the used list
+  unsigned bh_flags;                 ///< BH_DIRTY, BH_LOCKED or BH_COLD
+
+  bhdr_T *bh_prev;                   ///< previous block in the used list
+  bhdr_T *bh_next;                   ///< next block in the used list
+  memfile_T *bh_mfp;                 ///< memfile the block belongs to
+};
 
 typedef enum {
   MF_DIRTY_NO = 0,      ///< no dirty blocks
@@ -42,7 +66,7 @@ typedef enum {
 } mfdirty_T;
 
 /// A memory file.
-typedef struct {
+struct memfile {
   char *mf_fname;                    ///< name of the file
   char *mf_ffname;                   ///< idem, full path
   int mf_fd;                         ///< file descriptor
@@ -63,4 +87,5 @@ typedef struct {
   blocknr_T mf_infile_count;         ///< number of pages in the file
   unsigned mf_page_size;             ///< number of bytes in a page
   mfdirty_T mf_dirty;
-} memfile_T;
+  bool mf_async_failed;              ///< writing on the worker thread failed
+};
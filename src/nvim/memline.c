@@ -39,6 +39,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -231,6 +232,10 @@ typedef struct {
 // executing a global command).
 static linenr_T lowest_marked = 0;
 
+/// Protects the reference counts of snapshots, see ml_snapshot().
+static uv_mutex_t ml_snapshot_mutex;
+static bool ml_snapshot_init = false;
+
 // arguments for ml_find_line()
 enum {
   ML_DELETE = 0x11,  // delete line
@@ -297,6 +302,11 @@ int ml_open(buf_T *buf)
   buf->b_ml.ml_line_offset = 0;
   buf->b_ml.ml_chunksize = NULL;
   buf->b_ml.ml_usedchunks = 0;
+  buf->b_ml.ml_chunktree = NULL;
+  buf->b_ml.ml_chunktree_valid = false;
+  buf->b_ml.ml_map = NULL;
+  ml_locators_init(buf);
+  ml_text_changed(buf);
 
   if (cmdmod.cmod_flags & CMOD_NOSWAPFILE) {
     buf->b_p_swf = false;
@@ -438,6 +448,7 @@ void ml_setname(buf_T *buf)
     }
     // need to close the swapfile before renaming
     if (mfp->mf_fd >= 0) {
+      mf_sync_wait();
       close(mfp->mf_fd);
       mfp->mf_fd = -1;
     }
@@ -579,7 +590,14 @@ void ml_close(buf_T *buf, int del_file)
   }
   xfree(buf->b_ml.ml_stack);
   XFREE_CLEAR(buf->b_ml.ml_chunksize);
+  XFREE_CLEAR(buf->b_ml.ml_chunktree);
+  buf->b_ml.ml_chunktree_valid = false;
+  if (buf->b_ml.ml_map != NULL) {
+    ml_map_free(buf->b_ml.ml_map);
+    buf->b_ml.ml_map = NULL;
+  }
   buf->b_ml.ml_mfp = NULL;
+  buf->b_ml.ml_text_gen = 0;
 
   // Reset the "recovered" flag, give the ATTENTION prompt the next time
   // this buffer is loaded.
@@ -835,6 +853,7 @@ void ml_recover(bool checkext)
   buf->b_ml.ml_line_offset = 0;
   buf->b_ml.ml_locked = NULL;           // no locked block
   buf->b_ml.ml_flags = 0;
+  ml_locators_init(buf);
 
   // open the memfile from the old swapfile
   char *p = xstrdup(fname_used);  // save "fname_used" for the message:
@@ -1692,7 +1711,8 @@ static int recov_file_names(char **names, char *path, bool prepend_dot)
 /// @param check_char  if true, stop syncing when character becomes available, but
 ///
 /// always sync at least one block.
-void ml_sync_all(int check_file, int check_char, bool do_fsync)
+/// @param async  write the blocks on a worker thread, see mf_sync()
+void ml_sync_all(int check_file, int check_char, bool do_fsync, bool async)
 {
   FOR_ALL_BUFFERS(buf) {
     if (buf->b_ml.ml_mfp == NULL || buf->b_ml.ml_mfp->mf_fname == NULL) {
@@ -1717,7 +1737,8 @@ void ml_sync_all(int check_file, int check_char, bool do_fsync)
     }
     if (buf->b_ml.ml_mfp->mf_dirty == MF_DIRTY_YES) {
       mf_sync(buf->b_ml.ml_mfp, (check_char ? MFS_STOP : 0)
-              | (do_fsync && bufIsChanged(buf) ? MFS_FLUSH : 0));
+              | (do_fsync && bufIsChanged(buf) ? MFS_FLUSH : 0)
+              | (async ? MFS_ASYNC : 0));
       if (check_char && os_char_avail()) {      // character available now
         break;
       }
@@ -1755,6 +1776,7 @@ void ml_preserve(buf_T *buf, bool message, bool do_fsync)
 
   // stack is invalid after mf_sync(.., MFS_ALL)
   buf->b_ml.ml_stack_top = 0;
+  ml_locators_clear(buf);
 
   // Some of the data blocks may have been changed from negative to
   // positive block number. In that case the pointer blocks need to be
@@ -1783,6 +1805,7 @@ void ml_preserve(buf_T *buf, bool message, bool do_fsync)
       status = FAIL;
     }
     buf->b_ml.ml_stack_top = 0;  // stack is invalid now
+    ml_locators_clear(buf);
   }
 theend:
   got_int |= got_int_save;
@@ -1904,6 +1927,19 @@ errorret:
     return "";
   }
 
+  if (buf->b_ml.ml_map != NULL) {
+    if (!will_change) {
+      char *line = ml_map_get(buf, lnum);
+      if (line != NULL) {
+        return line;
+      }
+    } else {
+      // The line is going to be changed in place, which requires the text to
+      // be in the memline.
+      ml_map_materialize(buf);
+    }
+  }
+
   // See if it is the same line as requested last time.
   // Otherwise may need to flush last used line.
   // Don't use the last used line when 'swapfile' is reset, need to load all
@@ -1943,7 +1979,10 @@ errorret:
     buf->b_ml.ml_flags &= ~(ML_LINE_DIRTY | ML_ALLOCATED);
   }
   if (will_change) {
+    // The line may be changed in the data block.
+    ml_unshare_locked(buf);
     buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
+    ml_text_changed(buf);
 #ifdef ML_GET_ALLOC_LINES
     if (buf->b_ml.ml_flags & ML_ALLOCATED) {
       // can't make the change in the data block
@@ -1976,6 +2015,310 @@ int ml_line_alloced(void)
   return curbuf->b_ml.ml_flags & ML_LINE_DIRTY;
 }
 
+/// Let the lines of "buf" be taken from the mapped file "mm", which holds
+/// "count" lines.  The buffer must be empty, its empty line is not counted.
+/// "mm" is owned by the memline afterwards.
+void ml_map_set(buf_T *buf, mapline_T *mm, linenr_T count)
+  FUNC_ATTR_NONNULL_ALL
+{
+  assert(buf->b_ml.ml_map == NULL && (buf->b_ml.ml_flags & ML_EMPTY));
+  ml_flush_line(buf, false);
+  buf->b_ml.ml_map = mm;
+  buf->b_ml.ml_line_count = count;
+  buf->b_ml.ml_flags &= ~ML_EMPTY;
+  ml_text_changed(buf);
+}
+
+/// Free the lines of a mapped file and release the mapping.  When snapshots
+/// still use the lines the mapping gets its own copy of the pages, because
+/// the file may be written after this.
+void ml_map_free(mapline_T *mm)
+  FUNC_ATTR_NONNULL_ALL
+{
+  if (ml_snapshot_init) {
+    // Only ml_snapshot() adds a reference, on this thread.
+    uv_mutex_lock(&ml_snapshot_mutex);
+    bool shared = mm->mm_refcount > 1;
+    uv_mutex_unlock(&ml_snapshot_mutex);
+    size_t size;
+    if (shared && !mm->mm_alloced && !ml_map_changed(mm, &size)) {
+      os_mmap_privatize(mm->mm_base, mm->mm_size);
+    }
+  }
+  if (mm->mm_fd >= 0) {
+    os_close(mm->mm_fd);
+    mm->mm_fd = -1;
+  }
+  XFREE_CLEAR(mm->mm_line);
+  ml_map_unref(mm);
+}
+
+/// Release a reference to the lines of a mapped file, free them when it was
+/// the last one.  Can be called from any thread.
+static void ml_map_unref(mapline_T *mm)
+{
+  if (ml_snapshot_init) {
+    uv_mutex_lock(&ml_snapshot_mutex);
+    bool last = --mm->mm_refcount == 0;
+    uv_mutex_unlock(&ml_snapshot_mutex);
+    if (!last) {
+      return;
+    }
+  }
+  if (mm->mm_alloced) {
+    xfree(mm->mm_base);
+  } else {
+    os_munmap(mm->mm_base, mm->mm_size);
+  }
+  xfree(mm->mm_index);
+  xfree(mm);
+}
+
+/// Move the lines of every buffer that maps the file "fname" into its
+/// memline.  Must be done before the file is truncated, the mapping would
+/// then no longer hold the text.
+void ml_map_release_file(const char *fname)
+  FUNC_ATTR_NONNULL_ALL
+{
+  FileID file_id;
+  if (!os_fileid(fname, &file_id)) {
+    return;
+  }
+  FOR_ALL_BUFFERS(buf) {
+    if (buf->b_ml.ml_map != NULL
+        && os_fileid_equal_fileinfo(&file_id, &buf->b_ml.ml_map->mm_file_info)) {
+      ml_map_materialize(buf);
+    }
+  }
+}
+
+/// @return  offset of line "lnum" in the mapped file "mm".
+static size_t ml_map_line_start(mapline_T *mm, linenr_T lnum)
+{
+  linenr_T l;
+  size_t off;
+
+  // Mostly lines are obtained one after another, continue from the line
+  // looked up last when it is close.  Otherwise start at the index entry.
+  if (mm->mm_last_lnum > 0 && mm->mm_last_lnum <= lnum
+      && lnum - mm->mm_last_lnum < ML_MAP_STEP) {
+    l = mm->mm_last_lnum;
+    off = mm->mm_last_off;
+  } else {
+    size_t i = (size_t)(lnum - 1) / ML_MAP_STEP;
+    l = (linenr_T)(i * ML_MAP_STEP) + 1;
+    off = mm->mm_index[i];
+  }
+  for (; l < lnum && off < mm->mm_end; l++) {
+    char *nl = memchr(mm->mm_base + off, NL, mm->mm_end - off);
+    off = nl == NULL ? mm->mm_end : (size_t)(nl - mm->mm_base) + 1;
+  }
+  mm->mm_last_lnum = lnum;
+  mm->mm_last_off = off;
+  return off;
+}
+
+/// @return  offset just after the text of the line that starts at "off".
+static size_t ml_map_line_end(mapline_T *mm, size_t off)
+{
+  if (off >= mm->mm_end) {
+    return off;
+  }
+  char *nl = memchr(mm->mm_base + off, NL, mm->mm_end - off);
+  return nl == NULL ? mm->mm_end : (size_t)(nl - mm->mm_base);
+}
+
+/// Check whether the mapped file was changed by another program since it was
+/// mapped.  The mapping then does not hold the text that was read, and
+/// accessing a part that was truncated would crash.
+///
+/// @param[out] sizep  when changed: size of the part that can still be
+///                    accessed
+static bool ml_map_changed(const mapline_T *mm, size_t *sizep)
+{
+  FileInfo file_info;
+  if (mm->mm_fd < 0 || !os_fileinfo_fd(mm->mm_fd, &file_info)) {
+    return false;
+  }
+  const uv_stat_t *old = &mm->mm_file_info.stat;
+  const uv_stat_t *cur = &file_info.stat;
+  if (cur->st_size == old->st_size
+      && cur->st_mtim.tv_sec == old->st_mtim.tv_sec
+      && cur->st_mtim.tv_nsec == old->st_mtim.tv_nsec) {
+    return false;
+  }
+  *sizep = MIN(mm->mm_size, (size_t)cur->st_size);
+  return true;
+}
+
+/// Check that the lines of "buf" can be taken from its mapping.  When the file
+/// was changed the lines are moved into the memline.
+///
+/// @return  false when the lines are not mapped anymore.
+static bool ml_map_check(buf_T *buf)
+{
+  size_t size;
+  if (!ml_map_changed(buf->b_ml.ml_map, &size)) {
+    return true;
+  }
+  ml_map_materialize(buf);
+  return false;
+}
+
+/// Get line "lnum" of "buf", which is taken from a mapped file.  The line is
+/// copied, a NUL needs to be appended.
+///
+/// @return  NULL when the file was changed and the lines are not mapped
+///          anymore.
+static char *ml_map_get(buf_T *buf, linenr_T lnum)
+{
+  if (buf->b_ml.ml_line_lnum == lnum) {
+    return buf->b_ml.ml_line_ptr;
+  }
+  if (!ml_map_check(buf)) {
+    return NULL;
+  }
+  ml_flush_line(buf, false);
+
+  mapline_T *mm = buf->b_ml.ml_map;
+  size_t start = ml_map_line_start(mm, lnum);
+  size_t len = ml_map_line_end(mm, start) - start;
+  if (len + 1 > mm->mm_line_size) {
+    xfree(mm->mm_line);
+    mm->mm_line_size = MAX(len + 1, 2 * mm->mm_line_size);
+    mm->mm_line = xmalloc(mm->mm_line_size);
+  }
+  memcpy(mm->mm_line, mm->mm_base + start, len);
+  mm->mm_line[len] = NUL;
+
+  buf->b_ml.ml_line_ptr = mm->mm_line;
+  buf->b_ml.ml_line_len = (colnr_T)len + 1;
+  buf->b_ml.ml_line_lnum = lnum;
+  buf->b_ml.ml_flags &= ~(ML_LINE_DIRTY | ML_ALLOCATED);
+  return buf->b_ml.ml_line_ptr;
+}
+
+/// Move the lines of a mapped file into the memline of "buf", so that they
+/// can be changed.  The mapping is released.  When the file was changed by
+/// another program only the text that is still there is used, keeping the
+/// number of lines.
+static void ml_map_materialize(buf_T *buf)
+{
+  mapline_T *mm = buf->b_ml.ml_map;
+  linenr_T count = buf->b_ml.ml_line_count;
+  // Snapshots may be reading "mm", use a copy to limit the text.
+  mapline_T limited = *mm;
+  size_t size;
+  bool changed = ml_map_changed(mm, &size);
+  if (changed) {
+    limited.mm_end = MIN(mm->mm_end, size);
+  }
+
+  ml_flush_line(buf, false);
+  buf->b_ml.ml_map = NULL;
+  buf->b_ml.ml_line_count = 1;
+  buf->b_ml.ml_stack_top = 0;
+
+  // Append the lines after the empty line of the empty buffer, then delete
+  // that one.
+  size_t off = mm->mm_start;
+  size_t linesize = 0;
+  char *line = NULL;
+  for (linenr_T lnum = 1; lnum <= count; lnum++) {
+    size_t end = ml_map_line_end(&limited, off);
+    size_t len = end - off;
+    if (len + 1 > linesize) {
+      linesize = MAX(len + 1, 2 * linesize);
+      line = xrealloc(line, linesize);
+    }
+    memcpy(line, mm->mm_base + off, len);
+    line[len] = NUL;
+    ml_append_int(buf, lnum, line, (colnr_T)len + 1, true, false);
+    off = MIN(end + 1, limited.mm_end);
+  }
+  xfree(line);
+
+  inhibit_delete_count++;
+  ml_delete_int(buf, 1, false);
+  inhibit_delete_count--;
+
+  ml_map_free(mm);
+
+  if (changed) {
+    semsg(_("E5432: File was changed while it was mapped, text may be lost: %s"),
+          buf->b_fname == NULL ? "" : buf->b_fname);
+  }
+}
+
+/// ml_find_line_or_offset() for a buffer with the lines of a mapped file.
+/// "ffdos" is one when a CR is counted for every line.
+static int ml_map_find_line_or_offset(buf_T *buf, linenr_T lnum, int *offp, int ffdos,
+                                      bool can_cache)
+{
+  mapline_T *mm = buf->b_ml.ml_map;
+  linenr_T line_count = buf->b_ml.ml_line_count;
+  // Size of the text, with one byte for every line break.
+  uint64_t total = mm->mm_end - mm->mm_start + 1 + (uint64_t)ffdos * (uint64_t)line_count;
+
+  if (lnum == 0) {
+    int offset = offp == NULL ? 0 : *offp;
+    if (offset <= 0) {
+      return 1;       // offset 0 _must_ be in line 1
+    }
+    if ((uint64_t)offset >= total) {
+      return -1;
+    }
+
+    // Find the last index entry before the offset, then go over the lines
+    // from there.
+    size_t lo = 0;
+    size_t hi = (size_t)(line_count - 1) / ML_MAP_STEP;
+    while (lo < hi) {
+      size_t mid = (lo + hi + 1) / 2;
+      if (mm->mm_index[mid] - mm->mm_start + (size_t)ffdos * mid * ML_MAP_STEP
+          <= (size_t)offset) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
+      }
+    }
+    linenr_T l = (linenr_T)(lo * ML_MAP_STEP) + 1;
+    size_t start = mm->mm_index[lo];
+    while (true) {
+      size_t end = ml_map_line_end(mm, start);
+      // Offset just after the line break of line "l".
+      if ((size_t)offset < end - mm->mm_start + 1 + (size_t)ffdos * (size_t)l) {
+        break;
+      }
+      start = end + 1;
+      l++;
+    }
+    *offp = offset - (int)(start - mm->mm_start + (size_t)ffdos * (size_t)(l - 1));
+    return l;
+  }
+
+  if (lnum < 0 || lnum > line_count + 1) {
+    return -1;
+  }
+  uint64_t size = total;
+  if (lnum <= line_count) {
+    size = ml_map_line_start(mm, lnum) - mm->mm_start + (uint64_t)ffdos * (uint64_t)(lnum - 1);
+  }
+
+  // Don't count the last line break if 'noeol' and ('bin' or 'nofixeol').
+  if ((!buf->b_p_fixeol || buf->b_p_bin) && !buf->b_p_eol && lnum > line_count) {
+    size -= (uint64_t)ffdos + 1;
+  }
+  if (size > INT_MAX) {
+    return -1;
+  }
+
+  if (can_cache && size > 0) {
+    buf->b_ml.ml_line_offset = (size_t)size;
+  }
+  return (int)size;
+}
+
 /// Append a line after lnum (may be 0 to insert a line in front of the file).
 /// "line" does not need to be allocated, but can't be another line in a
 /// buffer, unlocking may make it invalid.
@@ -2001,6 +2344,9 @@ int ml_append(linenr_T lnum, char *line, colnr_T len, bool newfile)
   if (curbuf->b_ml.ml_line_lnum != 0) {
     ml_flush_line(curbuf, false);
   }
+  if (curbuf->b_ml.ml_map != NULL) {
+    ml_map_materialize(curbuf);
+  }
   return ml_append_int(curbuf, lnum, line, len, newfile, false);
 }
 
@@ -2021,9 +2367,146 @@ int ml_append_buf(buf_T *buf, linenr_T lnum, char *line, colnr_T len, bool newfi
   if (buf->b_ml.ml_line_lnum != 0) {
     ml_flush_line(buf, false);
   }
+  if (buf->b_ml.ml_map != NULL) {
+    ml_map_materialize(buf);
+  }
   return ml_append_int(buf, lnum, line, len, newfile, false);
 }
 
+/// Append "count" lines after "lnum" in "buf" (may be 0 to insert in front of
+/// the file).  Does the same as ml_append_buf() for every line, but copies as
+/// many lines into a data block as fit at once, only goes through the tree
+/// again when a block is full and updates the chunk sizes once.
+///
+/// @param lnum  append after this line (can be 0)
+/// @param lines  text of the new lines
+/// @param lens  length of every line, including NUL, or NULL
+/// @param count  number of lines in "lines"
+/// @param newfile  flag, see ml_append()
+///
+/// @return  FAIL for failure, OK otherwise
+int ml_append_many(buf_T *buf, linenr_T lnum, char **lines, const colnr_T *lens,
+                   linenr_T count, bool newfile)
+  FUNC_ATTR_NONNULL_ARG(1)
+{
+  if (buf->b_ml.ml_mfp == NULL) {
+    return FAIL;
+  }
+  if (buf->b_ml.ml_line_lnum != 0) {
+    ml_flush_line(buf, false);
+  }
+  if (buf->b_ml.ml_map != NULL) {
+    ml_map_materialize(buf);
+  }
+  if (lnum > buf->b_ml.ml_line_count) {
+    return FAIL;
+  }
+  if (count == 1) {
+    return ml_append_int(buf, lnum, lines[0], lens == NULL ? 0 : lens[0], newfile, false);
+  }
+
+  if (lowest_marked && lowest_marked > lnum) {
+    lowest_marked = lnum + 1;
+  }
+  ml_text_changed(buf);
+
+  int retval = OK;
+  int total_size = 0;
+  linenr_T done = 0;
+  while (done < count) {
+    linenr_T after = lnum + done;       // append after this line
+
+    bhdr_T *hp = ml_find_line(buf, after == 0 ? 1 : after, ML_INSERT);
+    if (hp == NULL) {
+      retval = FAIL;
+      break;
+    }
+    buf->b_ml.ml_flags &= ~ML_EMPTY;
+
+    int db_idx = after == 0 ? -1 : after - buf->b_ml.ml_locked_low;
+    // number of lines in the block before the insertion
+    int line_count = buf->b_ml.ml_locked_high - buf->b_ml.ml_locked_low;
+    DataBlock *dp = hp->bh_data;
+
+    // Find out how many lines fit in the free space of the block.
+    int nlines = 0;
+    int text_size = 0;
+    while (done + nlines < count) {
+      int len = ml_append_len(lines, lens, done + nlines);
+      if (text_size + len + (nlines + 1) * (int)INDEX_SIZE > (int)dp->db_free) {
+        break;
+      }
+      text_size += len;
+      nlines++;
+    }
+
+    if (nlines == 0) {
+      // Not even one line fits, ml_append_block() splits the block.  It
+      // finds the block again, undo the line count update.
+      (buf->b_ml.ml_locked_lineadd)--;
+      (buf->b_ml.ml_locked_high)--;
+      int len = ml_append_len(lines, lens, done);
+      if (ml_append_block(buf, after, lines[done], len, newfile, false) == FAIL) {
+        retval = FAIL;
+        break;
+      }
+      total_size += len;
+      done++;
+      continue;
+    }
+
+    // ml_find_line() counted one line, add the others.
+    buf->b_ml.ml_locked_lineadd += nlines - 1;
+    buf->b_ml.ml_locked_high += nlines - 1;
+    buf->b_ml.ml_line_count += nlines;
+
+    // The text of the new lines ends where the text of line "after" starts.
+    int offset = db_idx < 0 ? (int)dp->db_txt_end : (int)(dp->db_index[db_idx] & DB_INDEX_MASK);
+    dp->db_txt_start -= (unsigned)text_size;
+    dp->db_free -= (unsigned)text_size + (unsigned)nlines * (unsigned)INDEX_SIZE;
+    dp->db_line_count += nlines;
+
+    // move the text of the lines that follow to the front
+    // adjust the indexes of the lines that follow
+    if (line_count > db_idx + 1) {
+      memmove((char *)dp + dp->db_txt_start,
+              (char *)dp + dp->db_txt_start + text_size,
+              (size_t)offset - (dp->db_txt_start + (size_t)text_size));
+      for (int i = line_count - 1; i > db_idx; i--) {
+        dp->db_index[i + nlines] = dp->db_index[i] - (unsigned)text_size;
+      }
+    }
+
+    // copy the text into the block
+    for (int i = 0; i < nlines; i++) {
+      int len = ml_append_len(lines, lens, done + i);
+      offset -= len;
+      dp->db_index[db_idx + 1 + i] = (unsigned)offset;
+      memmove((char *)dp + offset, lines[done + i], (size_t)len);
+    }
+
+    // Mark the block dirty.
+    buf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+    if (!newfile) {
+      buf->b_ml.ml_flags |= ML_LOCKED_POS;
+    }
+    total_size += text_size;
+    done += nlines;
+  }
+
+  // The lines were inserted below 'lnum'
+  if (done > 0) {
+    ml_updatechunk_lines(buf, lnum + 1, done, total_size);
+  }
+  return retval;
+}
+
+/// @return  length of line "idx" of "lines", including NUL.
+static inline int ml_append_len(char **lines, const colnr_T *lens, linenr_T idx)
+{
+  return lens == NULL ? (int)strlen(lines[idx]) + 1 : (int)lens[idx];
+}
+
 /// @param lnum  append after this line (can be 0)
 /// @param line  text of the new line
 /// @param len  length of line, including NUL, or 0
@@ -2031,6 +2514,28 @@ int ml_append_buf(buf_T *buf, linenr_T lnum, char *line, colnr_T len, bool newfi
 /// @param mark  mark the new line
 static int ml_append_int(buf_T *buf, linenr_T lnum, char *line, colnr_T len, bool newfile,
                          bool mark)
+{
+  if (len == 0) {
+    len = (colnr_T)strlen(line) + 1;            // space needed for the text
+  }
+  if (ml_append_block(buf, lnum, line, len, newfile, mark) == FAIL) {
+    return FAIL;
+  }
+
+  // The line was inserted below 'lnum'
+  ml_updatechunk(buf, lnum + 1, len, ML_CHNK_ADDLINE);
+  return OK;
+}
+
+/// Insert a line in the tree of blocks, without updating the chunk sizes.
+///
+/// @param lnum  append after this line (can be 0)
+/// @param line  text of the new line
+/// @param len  length of line, including NUL
+/// @param newfile  flag, see ml_append()
+/// @param mark  mark the new line
+static int ml_append_block(buf_T *buf, linenr_T lnum, char *line, colnr_T len, bool newfile,
+                           bool mark)
 {
   // lnum out of range
   if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL) {
@@ -2040,10 +2545,8 @@ static int ml_append_int(buf_T *buf, linenr_T lnum, char *line, colnr_T len, boo
   if (lowest_marked && lowest_marked > lnum) {
     lowest_marked = lnum + 1;
   }
+  ml_text_changed(buf);
 
-  if (len == 0) {
-    len = (colnr_T)strlen(line) + 1;            // space needed for the text
-  }
   int space_needed = len + (int)INDEX_SIZE;     // space needed for text + index
 
   memfile_T *mfp = buf->b_ml.ml_mfp;
@@ -2427,8 +2930,6 @@ static int ml_append_int(buf_T *buf, linenr_T lnum, char *line, colnr_T len, boo
     }
   }
 
-  // The line was inserted below 'lnum'
-  ml_updatechunk(buf, lnum + 1, len, ML_CHNK_ADDLINE);
   return OK;
 }
 
@@ -2489,6 +2990,10 @@ int ml_replace_buf(buf_T *buf, linenr_T lnum, char *line, bool copy, bool noallo
     line = xstrdup(line);
   }
 
+  if (buf->b_ml.ml_map != NULL) {
+    ml_map_materialize(buf);
+  }
+
   if (buf->b_ml.ml_line_lnum != lnum) {
     // another line is buffered, flush it
     ml_flush_line(buf, false);
@@ -2506,6 +3011,7 @@ int ml_replace_buf(buf_T *buf, linenr_T lnum, char *line, bool copy, bool noallo
   buf->b_ml.ml_line_len = (colnr_T)strlen(line) + 1;
   buf->b_ml.ml_line_lnum = lnum;
   buf->b_ml.ml_flags = (buf->b_ml.ml_flags | ML_LINE_DIRTY) & ~ML_EMPTY;
+  ml_text_changed(buf);
   if (noalloc) {
     // TODO(bfredl): this is a bit of a hack. but replacing lines in a loop is really common,
     // and allocating a separate scratch buffer for each line which is immediately freed adds
@@ -2528,6 +3034,9 @@ int ml_replace_buf(buf_T *buf, linenr_T lnum, char *line, bool copy, bool noallo
 int ml_delete(linenr_T lnum, bool message)
 {
   ml_flush_line(curbuf, false);
+  if (curbuf->b_ml.ml_map != NULL) {
+    ml_map_materialize(curbuf);
+  }
   return ml_delete_int(curbuf, lnum, message);
 }
 
@@ -2541,6 +3050,9 @@ int ml_delete(linenr_T lnum, bool message)
 int ml_delete_buf(buf_T *buf, linenr_T lnum, bool message)
 {
   ml_flush_line(buf, false);
+  if (buf->b_ml.ml_map != NULL) {
+    ml_map_materialize(buf);
+  }
   return ml_delete_int(buf, lnum, message);
 }
 
@@ -2553,6 +3065,7 @@ static int ml_delete_int(buf_T *buf, linenr_T lnum, bool message)
   if (lowest_marked && lowest_marked > lnum) {
     lowest_marked--;
   }
+  ml_text_changed(buf);
 
   // If the file becomes empty the last line is replaced by an empty line.
   if (buf->b_ml.ml_line_count == 1) {       // file becomes empty
@@ -2677,6 +3190,9 @@ void ml_setmarked(linenr_T lnum)
       || curbuf->b_ml.ml_mfp == NULL) {
     return;                         // give error message?
   }
+  if (curbuf->b_ml.ml_map != NULL) {
+    ml_map_materialize(curbuf);
+  }
   if (lowest_marked == 0 || lowest_marked > lnum) {
     lowest_marked = lnum;
   }
@@ -2688,6 +3204,7 @@ void ml_setmarked(linenr_T lnum)
   if ((hp = ml_find_line(curbuf, lnum, ML_FIND)) == NULL) {
     return;                 // give error message?
   }
+  ml_unshare_locked(curbuf);
   DataBlock *dp = hp->bh_data;
   dp->db_index[lnum - curbuf->b_ml.ml_locked_low] |= DB_MARKED;
   curbuf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
@@ -2696,7 +3213,9 @@ void ml_setmarked(linenr_T lnum)
 /// find the first line with its B_MARKED flag set
 linenr_T ml_firstmarked(void)
 {
-  if (curbuf->b_ml.ml_mfp == NULL) {
+  // A mapped file has no marks, ml_setmarked() moves the lines into the
+  // memline.
+  if (curbuf->b_ml.ml_mfp == NULL || curbuf->b_ml.ml_map != NULL) {
     return 0;
   }
 
@@ -2715,6 +3234,8 @@ linenr_T ml_firstmarked(void)
     for (int i = lnum - curbuf->b_ml.ml_locked_low;
          lnum <= curbuf->b_ml.ml_locked_high; i++, lnum++) {
       if ((dp->db_index[i]) & DB_MARKED) {
+        ml_unshare_locked(curbuf);
+        dp = hp->bh_data;
         (dp->db_index[i]) &= DB_INDEX_MASK;
         curbuf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
         lowest_marked = lnum + 1;
@@ -2732,6 +3253,10 @@ void ml_clearmarked(void)
   if (curbuf->b_ml.ml_mfp == NULL) {        // nothing to do
     return;
   }
+  if (curbuf->b_ml.ml_map != NULL) {        // no marks in a mapped file
+    lowest_marked = 0;
+    return;
+  }
 
   // The search starts with line lowest_marked.
   for (linenr_T lnum = lowest_marked; lnum <= curbuf->b_ml.ml_line_count;) {
@@ -2747,6 +3272,8 @@ void ml_clearmarked(void)
     for (int i = lnum - curbuf->b_ml.ml_locked_low;
          lnum <= curbuf->b_ml.ml_locked_high; i++, lnum++) {
       if ((dp->db_index[i]) & DB_MARKED) {
+        ml_unshare_locked(curbuf);
+        dp = hp->bh_data;
         (dp->db_index[i]) &= DB_INDEX_MASK;
         curbuf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
       }
@@ -2791,6 +3318,7 @@ static void ml_flush_line(buf_T *buf, bool noalloc)
     if (hp == NULL) {
       siemsg(_("E320: Cannot find line %" PRId64), (int64_t)lnum);
     } else {
+      ml_unshare_locked(buf);
       DataBlock *dp = hp->bh_data;
       int idx = lnum - buf->b_ml.ml_locked_low;
       int start = ((dp->db_index[idx]) & DB_INDEX_MASK);
@@ -2896,6 +3424,24 @@ static bhdr_T *ml_new_ptr(memfile_T *mfp)
 /// if ml_locked != NULL ml_locked_lineadd must be added to ip_high.
 ///
 /// @return  NULL for failure, pointer to block header otherwise
+/// Give the locked data block of "buf" its own copy of the data before it is
+/// changed, when the data is shared with a snapshot.  The cached line may
+/// point into the block.
+static void ml_unshare_locked(buf_T *buf)
+{
+  bhdr_T *hp = buf->b_ml.ml_locked;
+  if (hp == NULL || hp->bh_shared == NULL) {
+    return;
+  }
+  char *old_data = hp->bh_data;
+  mf_unshare(hp);
+  if (buf->b_ml.ml_line_lnum >= buf->b_ml.ml_locked_low
+      && buf->b_ml.ml_line_lnum <= buf->b_ml.ml_locked_high
+      && !(buf->b_ml.ml_flags & (ML_LINE_DIRTY | ML_ALLOCATED))) {
+    buf->b_ml.ml_line_ptr = (char *)hp->bh_data + (buf->b_ml.ml_line_ptr - old_data);
+  }
+}
+
 static bhdr_T *ml_find_line(buf_T *buf, linenr_T lnum, int action)
 {
   bhdr_T *hp;
@@ -2903,6 +3449,11 @@ static bhdr_T *ml_find_line(buf_T *buf, linenr_T lnum, int action)
 
   memfile_T *mfp = buf->b_ml.ml_mfp;
 
+  // Inserting or deleting a line changes the line numbers in the tree.
+  if (action == ML_INSERT || action == ML_DELETE) {
+    ml_locators_clear(buf);
+  }
+
   // If there is a locked block check if the wanted line is in it.
   // If not, flush and release the locked block.
   // Don't do this for ML_INSERT_SAME, because the stack need to be updated.
@@ -2920,6 +3471,9 @@ static bhdr_T *ml_find_line(buf_T *buf, linenr_T lnum, int action)
         (buf->b_ml.ml_locked_lineadd)--;
         (buf->b_ml.ml_locked_high)--;
       }
+      if (action != ML_FIND) {
+        ml_unshare_locked(buf);
+      }
       return buf->b_ml.ml_locked;
     }
 
@@ -2944,7 +3498,10 @@ static bhdr_T *ml_find_line(buf_T *buf, linenr_T lnum, int action)
   linenr_T low = 1;
   linenr_T high = buf->b_ml.ml_line_count;
 
-  if (action == ML_FIND) {      // first try stack entries
+  if (action == ML_FIND) {      // first try remembered paths, then stack entries
+    if ((hp = ml_locator_find(buf, lnum)) != NULL) {
+      return hp;
+    }
     for (top = buf->b_ml.ml_stack_top - 1; top >= 0; top--) {
       infoptr_T *ip = &(buf->b_ml.ml_stack[top]);
       if (ip->ip_low <= lnum && ip->ip_high >= lnum) {
@@ -2981,6 +3538,11 @@ static bhdr_T *ml_find_line(buf_T *buf, linenr_T lnum, int action)
       buf->b_ml.ml_locked_high = high;
       buf->b_ml.ml_locked_lineadd = 0;
       buf->b_ml.ml_flags &= ~(ML_LOCKED_DIRTY | ML_LOCKED_POS);
+      if (action == ML_FIND) {
+        ml_locator_save(buf, bnum, page_count);
+      } else {
+        ml_unshare_locked(buf);
+      }
       return hp;
     }
 
@@ -3056,6 +3618,111 @@ error_noblock:
   return NULL;
 }
 
+/// Give the text of "buf" a new generation number, to tell that it may have
+/// changed.  The numbers are unique over all buffers.
+static void ml_text_changed(buf_T *buf)
+{
+  static uint64_t text_gen = 0;
+  buf->b_ml.ml_text_gen = ++text_gen;
+}
+
+/// Forget all remembered paths to data blocks of "buf".
+static void ml_locators_init(buf_T *buf)
+{
+  memset(buf->b_ml.ml_locators, 0, sizeof(buf->b_ml.ml_locators));
+  buf->b_ml.ml_locator_gen = 1;
+  buf->b_ml.ml_locator_tick = 0;
+}
+
+/// Invalidate the remembered paths to data blocks of "buf", because the line
+/// numbers or the blocks in the tree changed.
+static inline void ml_locators_clear(buf_T *buf)
+{
+  if (++buf->b_ml.ml_locator_gen == 0) {
+    ml_locators_init(buf);
+  }
+}
+
+/// Remember the path in ml_stack to data block "bnum", which was just locked
+/// by ml_find_line().  Replaces the least recently used path.
+static void ml_locator_save(buf_T *buf, blocknr_T bnum, int page_count)
+{
+  int depth = buf->b_ml.ml_stack_top;
+
+  // A negative block number may change when the swap file is written.
+  if (bnum < 0 || depth > ML_LOCATOR_DEPTH) {
+    return;
+  }
+  for (int i = 0; i < depth; i++) {
+    if (buf->b_ml.ml_stack[i].ip_bnum < 0) {
+      return;
+    }
+  }
+
+  unsigned gen = buf->b_ml.ml_locator_gen;
+  mllocator_T *loc = NULL;
+  for (int i = 0; i < ML_LOCATORS; i++) {
+    mllocator_T *l = &buf->b_ml.ml_locators[i];
+    if (l->mll_gen == gen && l->mll_bnum == bnum) {
+      loc = l;
+      break;
+    }
+    if (loc == NULL || (loc->mll_gen == gen
+                        && (l->mll_gen != gen || l->mll_used < loc->mll_used))) {
+      loc = l;
+    }
+  }
+
+  loc->mll_gen = gen;
+  loc->mll_used = ++buf->b_ml.ml_locator_tick;
+  loc->mll_depth = depth;
+  memmove(loc->mll_stack, buf->b_ml.ml_stack, sizeof(infoptr_T) * (size_t)depth);
+  loc->mll_bnum = bnum;
+  loc->mll_page_count = page_count;
+  loc->mll_low = buf->b_ml.ml_locked_low;
+  loc->mll_high = buf->b_ml.ml_locked_high;
+}
+
+/// Lock the data block with line "lnum" through a remembered path, if there
+/// is one, and restore ml_stack to lead to it.
+///
+/// @return  NULL when there is no path for "lnum", the block otherwise
+static bhdr_T *ml_locator_find(buf_T *buf, linenr_T lnum)
+{
+  for (int i = 0; i < ML_LOCATORS; i++) {
+    mllocator_T *loc = &buf->b_ml.ml_locators[i];
+    if (loc->mll_gen != buf->b_ml.ml_locator_gen
+        || lnum < loc->mll_low || lnum > loc->mll_high) {
+      continue;
+    }
+    if (loc->mll_depth > buf->b_ml.ml_stack_size) {
+      loc->mll_gen = 0;
+      return NULL;
+    }
+    bhdr_T *hp = mf_get(buf->b_ml.ml_mfp, loc->mll_bnum, (unsigned)loc->mll_page_count);
+    if (hp == NULL) {
+      loc->mll_gen = 0;
+      return NULL;
+    }
+    if (((DataBlock *)hp->bh_data)->db_id != DATA_ID) {
+      mf_put(buf->b_ml.ml_mfp, hp, false, false);
+      loc->mll_gen = 0;
+      return NULL;
+    }
+
+    memmove(buf->b_ml.ml_stack, loc->mll_stack, sizeof(infoptr_T) * (size_t)loc->mll_depth);
+    buf->b_ml.ml_stack_top = loc->mll_depth;
+    buf->b_ml.ml_locked = hp;
+    buf->b_ml.ml_locked_low = loc->mll_low;
+    buf->b_ml.ml_locked_high = loc->mll_high;
+    buf->b_ml.ml_locked_lineadd = 0;
+    buf->b_ml.ml_flags &= ~(ML_LOCKED_DIRTY | ML_LOCKED_POS);
+    loc->mll_used = ++buf->b_ml.ml_locator_tick;
+    return hp;
+  }
+  return NULL;
+}
+
 /// add an entry to the info pointer stack
 ///
 /// @return  number of the new entry
@@ -3737,6 +4404,109 @@ enum {
   MLCS_MINL = 400,  // should be half of MLCS_MAXL
 };
 
+// Cached position of ml_updatechunk() for appending lines one by one.
+static buf_T *ml_upd_lastbuf = NULL;
+static linenr_T ml_upd_lastline;
+static linenr_T ml_upd_lastcurline;
+static int ml_upd_lastcurix;
+
+/// Allocate the chunk size table of "buf", with one chunk for the line of the
+/// empty buffer.
+static void ml_init_chunks(buf_T *buf)
+{
+  buf->b_ml.ml_chunksize = xmalloc(sizeof(chunksize_T) * 100);
+  buf->b_ml.ml_numchunks = 100;
+  buf->b_ml.ml_usedchunks = 1;
+  buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
+  buf->b_ml.ml_chunksize[0].mlcs_totalsize = 1;
+  buf->b_ml.ml_chunktree_valid = false;
+}
+
+/// Rebuild the Fenwick tree of the chunk sizes of "buf", after chunks were
+/// inserted, removed or moved.  Unused chunks count as empty, so that a chunk
+/// added at the end only needs ml_chunktree_add().
+static void ml_chunktree_build(buf_T *buf)
+{
+  int n = buf->b_ml.ml_numchunks;
+  buf->b_ml.ml_chunktree = xrealloc(buf->b_ml.ml_chunktree,
+                                    sizeof(chunksize_T) * (size_t)(n + 1));
+  chunksize_T *tree = buf->b_ml.ml_chunktree;
+  memset(tree, 0, sizeof(chunksize_T) * (size_t)(n + 1));
+  memmove(tree + 1, buf->b_ml.ml_chunksize,
+          sizeof(chunksize_T) * (size_t)buf->b_ml.ml_usedchunks);
+  for (int i = 1; i <= n; i++) {
+    int parent = i + (i & -i);
+    if (parent <= n) {
+      tree[parent].mlcs_numlines += tree[i].mlcs_numlines;
+      tree[parent].mlcs_totalsize += tree[i].mlcs_totalsize;
+    }
+  }
+  buf->b_ml.ml_chunktree_valid = true;
+}
+
+/// Add "lines" and "size" to chunk "ix" in the Fenwick tree of "buf".  Does
+/// nothing when the tree needs to be rebuilt anyway.
+static void ml_chunktree_add(buf_T *buf, int ix, int lines, int size)
+{
+  if (!buf->b_ml.ml_chunktree_valid) {
+    return;
+  }
+  chunksize_T *tree = buf->b_ml.ml_chunktree;
+  for (int i = ix + 1; i <= buf->b_ml.ml_numchunks; i += i & -i) {
+    tree[i].mlcs_numlines += lines;
+    tree[i].mlcs_totalsize += size;
+  }
+}
+
+/// Find the chunk of "buf" that contains line "lnum", or byte "offset" when
+/// "lnum" is zero.  The last chunk is used when "lnum" or "offset" is beyond
+/// the end.
+///
+/// @param ffdos  count a CR for every line when looking for "offset"
+/// @param[out] curlinep  first line of the chunk
+/// @param[out] sizep  number of bytes before the chunk
+///
+/// @return  index of the chunk
+static int ml_chunktree_find(buf_T *buf, linenr_T lnum, int offset, int ffdos,
+                             linenr_T *curlinep, int *sizep)
+{
+  if (!buf->b_ml.ml_chunktree_valid) {
+    ml_chunktree_build(buf);
+  }
+  chunksize_T *tree = buf->b_ml.ml_chunktree;
+  int last = buf->b_ml.ml_usedchunks - 1;
+  int step = 1;
+  while (step * 2 <= last) {
+    step *= 2;
+  }
+
+  // Descend the tree, skipping every range of chunks that ends before the
+  // line or offset.
+  int ix = 0;
+  linenr_T lines = 0;
+  int size = 0;
+  for (; step > 0 && last > 0; step /= 2) {
+    int next = ix + step;
+    if (next > last) {
+      continue;
+    }
+    if (lnum != 0
+        ? lnum >= 1 + lines + tree[next].mlcs_numlines
+        : offset > size + tree[next].mlcs_totalsize
+        + ffdos * (lines + tree[next].mlcs_numlines)) {
+      ix = next;
+      lines += tree[next].mlcs_numlines;
+      size += tree[next].mlcs_totalsize;
+    }
+  }
+
+  *curlinep = lines + 1;
+  if (sizep != NULL) {
+    *sizep = size + (offset != 0 && ffdos ? lines : 0);
+  }
+  return ix;
+}
+
 /// Keep information for finding byte offset of a line
 ///
 /// @param updtype  may be one of:
@@ -3746,11 +4516,6 @@ enum {
 ///                 ML_CHNK_UPDLINE: Add len to parent chunk, as a signed entity.
 static void ml_updatechunk(buf_T *buf, linenr_T line, int len, int updtype)
 {
-  static buf_T *ml_upd_lastbuf = NULL;
-  static linenr_T ml_upd_lastline;
-  static linenr_T ml_upd_lastcurline;
-  static int ml_upd_lastcurix;
-
   linenr_T curline = ml_upd_lastcurline;
   int curix = ml_upd_lastcurix;
   bhdr_T *hp;
@@ -3759,11 +4524,7 @@ static void ml_updatechunk(buf_T *buf, linenr_T line, int len, int updtype)
     return;
   }
   if (buf->b_ml.ml_chunksize == NULL) {
-    buf->b_ml.ml_chunksize = xmalloc(sizeof(chunksize_T) * 100);
-    buf->b_ml.ml_numchunks = 100;
-    buf->b_ml.ml_usedchunks = 1;
-    buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
-    buf->b_ml.ml_chunksize[0].mlcs_totalsize = 1;
+    ml_init_chunks(buf);
   }
 
   if (updtype == ML_CHNK_UPDLINE && buf->b_ml.ml_line_count == 1) {
@@ -3771,6 +4532,7 @@ static void ml_updatechunk(buf_T *buf, linenr_T line, int len, int updtype)
     buf->b_ml.ml_usedchunks = 1;
     buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
     buf->b_ml.ml_chunksize[0].mlcs_totalsize = buf->b_ml.ml_line_len;
+    buf->b_ml.ml_chunktree_valid = false;
     return;
   }
 
@@ -3778,13 +4540,7 @@ static void ml_updatechunk(buf_T *buf, linenr_T line, int len, int updtype)
   // chunk.
   if (buf != ml_upd_lastbuf || line != ml_upd_lastline + 1
       || updtype != ML_CHNK_ADDLINE) {
-    for (curline = 1, curix = 0;
-         curix < buf->b_ml.ml_usedchunks - 1
-         && line >= curline +
-         buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-         curix++) {
-      curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-    }
+    curix = ml_chunktree_find(buf, line, 0, 0, &curline, NULL);
   } else if (curix < buf->b_ml.ml_usedchunks - 1
              && line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines) {
     // Adjust cached curix & curline
@@ -3797,6 +4553,8 @@ static void ml_updatechunk(buf_T *buf, linenr_T line, int len, int updtype)
     len = -len;
   }
   curchnk->mlcs_totalsize += len;
+  ml_chunktree_add(buf, curix, updtype == ML_CHNK_ADDLINE ? 1
+                   : updtype == ML_CHNK_DELLINE ? -1 : 0, len);
   if (updtype == ML_CHNK_ADDLINE) {
     int rest;
     DataBlock *dp;
@@ -3807,11 +4565,13 @@ static void ml_updatechunk(buf_T *buf, linenr_T line, int len, int updtype)
       buf->b_ml.ml_numchunks = buf->b_ml.ml_numchunks * 3 / 2;
       buf->b_ml.ml_chunksize = xrealloc(buf->b_ml.ml_chunksize,
                                         sizeof(chunksize_T) * (size_t)buf->b_ml.ml_numchunks);
+      buf->b_ml.ml_chunktree_valid = false;
     }
 
     if (buf->b_ml.ml_chunksize[curix].mlcs_numlines >= MLCS_MAXL) {
       int text_end;
 
+      buf->b_ml.ml_chunktree_valid = false;
       memmove(buf->b_ml.ml_chunksize + curix + 1,
               buf->b_ml.ml_chunksize + curix,
               (size_t)(buf->b_ml.ml_usedchunks - curix) * sizeof(chunksize_T));
@@ -3881,6 +4641,8 @@ static void ml_updatechunk(buf_T *buf, linenr_T line, int len, int updtype)
         curchnk->mlcs_numlines = 1;
         curchnk[-1].mlcs_totalsize -= rest;
         curchnk[-1].mlcs_numlines -= 1;
+        ml_chunktree_add(buf, curix + 1, 1, rest);
+        ml_chunktree_add(buf, curix, -1, -rest);
       }
     }
   } else if (updtype == ML_CHNK_DELLINE) {
@@ -3892,6 +4654,7 @@ static void ml_updatechunk(buf_T *buf, linenr_T line, int len, int updtype)
       curix++;
       curchnk = buf->b_ml.ml_chunksize + curix;
     } else if (curix == 0 && curchnk->mlcs_numlines <= 0) {
+      buf->b_ml.ml_chunktree_valid = false;
       buf->b_ml.ml_usedchunks--;
       memmove(buf->b_ml.ml_chunksize, buf->b_ml.ml_chunksize + 1,
               (size_t)buf->b_ml.ml_usedchunks * sizeof(chunksize_T));
@@ -3904,6 +4667,7 @@ static void ml_updatechunk(buf_T *buf, linenr_T line, int len, int updtype)
     }
 
     // Collapse chunks
+    buf->b_ml.ml_chunktree_valid = false;
     curchnk[-1].mlcs_numlines += curchnk->mlcs_numlines;
     curchnk[-1].mlcs_totalsize += curchnk->mlcs_totalsize;
     buf->b_ml.ml_usedchunks--;
@@ -3920,6 +4684,88 @@ static void ml_updatechunk(buf_T *buf, linenr_T line, int len, int updtype)
   ml_upd_lastcurix = curix;
 }
 
+/// Like ml_updatechunk() with ML_CHNK_ADDLINE for "count" lines with "size"
+/// bytes in total, which were inserted from "line" on.  A chunk that becomes
+/// too big is split into chunks of MLCS_MINL lines in one go.
+static void ml_updatechunk_lines(buf_T *buf, linenr_T line, linenr_T count, int size)
+{
+  if (count == 1) {
+    ml_updatechunk(buf, line, size, ML_CHNK_ADDLINE);
+    return;
+  }
+  if (buf->b_ml.ml_usedchunks == -1 || size == 0) {
+    return;
+  }
+  if (buf->b_ml.ml_chunksize == NULL) {
+    ml_init_chunks(buf);
+  }
+  ml_upd_lastbuf = NULL;        // Force recalc of curix & curline
+
+  // Find chunk that our line belongs to, curline will be at start of the
+  // chunk.
+  linenr_T curline;
+  int curix = ml_chunktree_find(buf, line, 0, 0, &curline, NULL);
+  int numlines = buf->b_ml.ml_chunksize[curix].mlcs_numlines + count;
+  int totalsize = buf->b_ml.ml_chunksize[curix].mlcs_totalsize + size;
+  buf->b_ml.ml_chunksize[curix].mlcs_numlines = numlines;
+  buf->b_ml.ml_chunksize[curix].mlcs_totalsize = totalsize;
+  ml_chunktree_add(buf, curix, count, size);
+  if (numlines < MLCS_MAXL) {
+    return;
+  }
+  buf->b_ml.ml_chunktree_valid = false;
+
+  // Split into chunks of MLCS_MINL lines, the last one gets the rest.
+  int extra = numlines / MLCS_MINL - 1;
+  if (buf->b_ml.ml_usedchunks + extra + 1 >= buf->b_ml.ml_numchunks) {
+    buf->b_ml.ml_numchunks = (buf->b_ml.ml_usedchunks + extra + 1) * 3 / 2;
+    buf->b_ml.ml_chunksize = xrealloc(buf->b_ml.ml_chunksize,
+                                      sizeof(chunksize_T) * (size_t)buf->b_ml.ml_numchunks);
+  }
+  memmove(buf->b_ml.ml_chunksize + curix + 1 + extra,
+          buf->b_ml.ml_chunksize + curix + 1,
+          (size_t)(buf->b_ml.ml_usedchunks - curix - 1) * sizeof(chunksize_T));
+  buf->b_ml.ml_usedchunks += extra;
+
+  for (int i = 0; i < extra; i++) {
+    int chunk_size = ml_lines_size(buf, curline, MLCS_MINL);
+    if (chunk_size < 0) {
+      buf->b_ml.ml_usedchunks = -1;
+      return;
+    }
+    buf->b_ml.ml_chunksize[curix + i].mlcs_numlines = MLCS_MINL;
+    buf->b_ml.ml_chunksize[curix + i].mlcs_totalsize = chunk_size;
+    curline += MLCS_MINL;
+    numlines -= MLCS_MINL;
+    totalsize -= chunk_size;
+  }
+  buf->b_ml.ml_chunksize[curix + extra].mlcs_numlines = numlines;
+  buf->b_ml.ml_chunksize[curix + extra].mlcs_totalsize = totalsize;
+}
+
+/// @return  the number of bytes of "count" lines from "lnum" on, including a
+///          NUL for every line, or -1 when a block cannot be found.
+static int ml_lines_size(buf_T *buf, linenr_T lnum, int count)
+{
+  int size = 0;
+  while (count > 0) {
+    bhdr_T *hp = ml_find_line(buf, lnum, ML_FIND);
+    if (hp == NULL) {
+      return -1;
+    }
+    DataBlock *dp = hp->bh_data;
+    int idx = lnum - buf->b_ml.ml_locked_low;
+    int last = MIN(buf->b_ml.ml_locked_high - buf->b_ml.ml_locked_low, idx + count - 1);
+    // The text of the first line in the block is at the end.
+    int text_end = idx == 0 ? (int)dp->db_txt_end
+                            : (int)(dp->db_index[idx - 1] & DB_INDEX_MASK);
+    size += text_end - (int)(dp->db_index[last] & DB_INDEX_MASK);
+    count -= last - idx + 1;
+    lnum += last - idx + 1;
+  }
+  return size;
+}
+
 /// Find offset for line or line with offset.
 ///
 /// @param buf buffer to use
@@ -3955,6 +4801,10 @@ int ml_find_line_or_offset(buf_T *buf, linenr_T lnum, int *offp, bool no_ff)
     return (int)buf->b_ml.ml_line_offset;
   }
 
+  if (buf->b_ml.ml_map != NULL && ml_map_check(buf)) {
+    return ml_map_find_line_or_offset(buf, lnum, offp, ffdos, can_cache);
+  }
+
   if (buf->b_ml.ml_usedchunks == -1
       || buf->b_ml.ml_chunksize == NULL
       || lnum < 0) {
@@ -3974,25 +4824,11 @@ int ml_find_line_or_offset(buf_T *buf, linenr_T lnum, int *offp, bool no_ff)
   if (lnum == 0 && offset <= 0) {
     return 1;       // Not a "find offset" and offset 0 _must_ be in line 1
   }
-  // Find the last chunk before the one containing our line. Last chunk is
-  // special because it will never qualify
-  linenr_T curline = 1;
-  int curix = 0;
-  int size = 0;
-  while (curix < buf->b_ml.ml_usedchunks - 1
-         && ((lnum != 0
-              && lnum >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines)
-             || (offset != 0
-                 && offset > size +
-                 buf->b_ml.ml_chunksize[curix].mlcs_totalsize
-                 + ffdos * buf->b_ml.ml_chunksize[curix].mlcs_numlines))) {
-    curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-    size += buf->b_ml.ml_chunksize[curix].mlcs_totalsize;
-    if (offset && ffdos) {
-      size += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-    }
-    curix++;
-  }
+  // Find the chunk containing our line. Last chunk is special because it
+  // will never be skipped.
+  linenr_T curline;
+  int size;
+  ml_chunktree_find(buf, lnum, offset, ffdos, &curline, &size);
 
   while ((lnum != 0 && curline < lnum) || (offset != 0 && size < offset)) {
     if (curline > buf->b_ml.ml_line_count
@@ -4178,3 +5014,151 @@ int decl(pos_T *lp)
   }
   return r;
 }
+
+/// Take a snapshot of the text of "buf": a read-only view that stays the same
+/// when the buffer is changed and that can be read from other threads, see
+/// ml_snapshot_get_line().  No text is copied, the data blocks are shared with
+/// the memfile, which makes a copy of a block before changing it.  All data
+/// blocks are read into memory, they stay there as long as the snapshot is
+/// used.  The lines of a mapped file are shared with the buffer.
+///
+/// @return  snapshot with a reference count of one, release it with
+///          ml_snapshot_unref().
+buf_snapshot_T *ml_snapshot(buf_T *buf)
+{
+  if (!ml_snapshot_init) {
+    uv_mutex_init(&ml_snapshot_mutex);
+    ml_snapshot_init = true;
+  }
+
+  buf_snapshot_T *snap = xmalloc(sizeof(buf_snapshot_T));
+  snap->bs_refcount = 1;
+  snap->bs_line_count = 0;
+  snap->bs_map = NULL;
+  kvec_t(snapblock_T) blocks = KV_INITIAL_VALUE;
+
+  if (buf->b_ml.ml_map != NULL) {
+    snap->bs_map = buf->b_ml.ml_map;
+    uv_mutex_lock(&ml_snapshot_mutex);
+    snap->bs_map->mm_refcount++;
+    uv_mutex_unlock(&ml_snapshot_mutex);
+    snap->bs_line_count = buf->b_ml.ml_line_count;
+  } else if (buf->b_ml.ml_mfp != NULL) {
+    // The changed line is not in the data block yet.
+    ml_flush_line(buf, false);
+    ml_find_line(buf, 0, ML_FLUSH);
+
+    linenr_T lnum = 1;
+    while (lnum <= buf->b_ml.ml_line_count) {
+      bhdr_T *hp = ml_find_line(buf, lnum, ML_FIND);
+      if (hp == NULL) {
+        siemsg(_("E320: Cannot find line %" PRId64), (int64_t)lnum);
+        break;
+      }
+      kv_push(blocks, ((snapblock_T){
+        .sb_low = buf->b_ml.ml_locked_low,
+        .sb_data = mf_share(hp),
+      }));
+      lnum = buf->b_ml.ml_locked_high + 1;
+    }
+    snap->bs_line_count = lnum - 1;
+    ml_find_line(buf, 0, ML_FLUSH);
+  }
+
+  snap->bs_nblocks = kv_size(blocks);
+  snap->bs_blocks = blocks.items;
+  return snap;
+}
+
+/// Add a reference to snapshot "snap".  Can be called from any thread.
+void ml_snapshot_ref(buf_snapshot_T *snap)
+{
+  uv_mutex_lock(&ml_snapshot_mutex);
+  snap->bs_refcount++;
+  uv_mutex_unlock(&ml_snapshot_mutex);
+}
+
+/// Release a reference to snapshot "snap", free it when it was the last one.
+/// Can be called from any thread.
+void ml_snapshot_unref(buf_snapshot_T *snap)
+{
+  uv_mutex_lock(&ml_snapshot_mutex);
+  bool last = --snap->bs_refcount == 0;
+  uv_mutex_unlock(&ml_snapshot_mutex);
+  if (!last) {
+    return;
+  }
+  for (size_t i = 0; i < snap->bs_nblocks; i++) {
+    mf_shared_unref(snap->bs_blocks[i].sb_data);
+  }
+  if (snap->bs_map != NULL) {
+    ml_map_unref(snap->bs_map);
+  }
+  xfree(snap->bs_blocks);
+  xfree(snap);
+}
+
+/// Get line "lnum" of snapshot "snap".  Can be called from any thread.
+///
+/// @param pos  where the previous line was found, to be used for the next
+///             call.  Zero-initialize it for the first call.
+/// @param[out] len  length of the line
+///
+/// @return  pointer to the text of the line, not NUL terminated, valid as
+///          long as the snapshot is referenced.  NUL bytes in the line are
+///          stored as NL.
+const char *ml_snapshot_get_line(const buf_snapshot_T *snap, linenr_T lnum, snappos_T *pos,
+                                 size_t *len)
+{
+  assert(lnum >= 1 && lnum <= snap->bs_line_count);
+
+  if (snap->bs_map != NULL) {
+    // Continue from the previous line when it is close, otherwise start at
+    // the index entry.  The line lookup cache of the buffer is not used, it
+    // is not thread-safe.
+    const mapline_T *mm = snap->bs_map;
+    linenr_T l;
+    size_t off;
+    if (pos->sp_lnum > 0 && pos->sp_lnum < lnum && lnum - pos->sp_lnum <= ML_MAP_STEP) {
+      l = pos->sp_lnum + 1;
+      off = pos->sp_end + 1;
+    } else {
+      size_t i = (size_t)(lnum - 1) / ML_MAP_STEP;
+      l = (linenr_T)(i * ML_MAP_STEP) + 1;
+      off = mm->mm_index[i];
+    }
+    while (true) {
+      off = MIN(off, mm->mm_end);
+      const char *nl = memchr(mm->mm_base + off, NL, mm->mm_end - off);
+      size_t end = nl == NULL ? mm->mm_end : (size_t)(nl - mm->mm_base);
+      if (l == lnum) {
+        pos->sp_lnum = lnum;
+        pos->sp_end = end;
+        *len = end - off;
+        return mm->mm_base + off;
+      }
+      off = end + 1;
+      l++;
+    }
+  }
+
+  // find the last block that starts at or before "lnum"
+  size_t lo = 0;
+  size_t hi = snap->bs_nblocks;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (snap->bs_blocks[mid].sb_low <= lnum) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  const snapblock_T *sb = &snap->bs_blocks[lo];
+  const DataBlock *dp = sb->sb_data->ms_data;
+  int idx = lnum - sb->sb_low;
+  unsigned start = (dp->db_index[idx] & DB_INDEX_MASK);
+  unsigned end = idx == 0 ? dp->db_txt_end : (dp->db_index[idx - 1] & DB_INDEX_MASK);
+  *len = end - start - 1;
+  return (const char *)dp + start;
+}
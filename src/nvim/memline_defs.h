@@ -1,6 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "nvim/memfile_defs.h"
+#include "nvim/os/fs_defs.h"
 #include "nvim/pos_defs.h"
 
 ///
@@ -15,6 +20,70 @@ typedef struct {
   int ip_index;                 // index for block with current lnum
 } infoptr_T;    // block/index pair
 
+/// Number of paths to data blocks remembered for a buffer.
+#define ML_LOCATORS 4
+/// Deepest tree for which a path is remembered.
+#define ML_LOCATOR_DEPTH 6
+
+/// Path from the root of the tree to a data block, remembered by
+/// ml_find_line() so that going back to a part of the buffer that was used
+/// before does not need to start at the root.
+typedef struct {
+  unsigned mll_gen;             ///< ml_locator_gen when stored, 0 if unused
+  unsigned mll_used;            ///< ml_locator_tick when last used
+  int mll_depth;                ///< number of entries in mll_stack
+  infoptr_T mll_stack[ML_LOCATOR_DEPTH];  ///< copy of ml_stack
+  blocknr_T mll_bnum;           ///< block number of the data block
+  int mll_page_count;           ///< number of pages of the data block
+  linenr_T mll_low;             ///< first line in the data block
+  linenr_T mll_high;            ///< last line in the data block
+} mllocator_T;
+
+/// Lines of a file that is read through a read-only memory mapping (see
+/// 'mapfilesize').  As long as the buffer is not changed the lines are taken
+/// from the mapping, the memline tree only holds the initial empty line.
+typedef struct {
+  char *mm_base;                ///< start of the mapping
+  size_t mm_size;               ///< size of the mapping
+  size_t mm_start;              ///< offset of the first line (after a BOM)
+  size_t mm_end;                ///< offset just after the text of the last line
+  size_t *mm_index;             ///< offset of every ML_MAP_STEP'th line
+  linenr_T mm_last_lnum;        ///< last line that was looked up, 0 if none
+  size_t mm_last_off;           ///< offset of mm_last_lnum
+  char *mm_line;                ///< NUL terminated copy of the cached line
+  size_t mm_line_size;          ///< allocated size of mm_line
+  FileInfo mm_file_info;        ///< the mapped file when it was mapped
+  int mm_fd;                    ///< the mapped file, to notice changes; -1 if not open
+  bool mm_alloced;              ///< mm_base is allocated memory, not a mapping
+  int mm_refcount;              ///< the buffer and snapshots, protected by a mutex
+} mapline_T;
+
+/// Number of lines between two entries in mm_index.
+#define ML_MAP_STEP 256
+
+/// Data block of a snapshot.
+typedef struct {
+  linenr_T sb_low;              ///< first line in the block
+  mfshared_T *sb_data;          ///< the DataBlock, shared with the memfile
+} snapblock_T;
+
+/// Read-only view of the text of a buffer at the time ml_snapshot() was
+/// called.  It can be read from any thread.
+typedef struct {
+  int bs_refcount;              ///< protected by a mutex
+  linenr_T bs_line_count;       ///< number of lines
+  size_t bs_nblocks;            ///< number of entries in bs_blocks
+  snapblock_T *bs_blocks;       ///< data blocks, in line order
+  mapline_T *bs_map;            ///< lines of a mapped file, NULL if not used
+} buf_snapshot_T;
+
+/// Where ml_snapshot_get_line() found the previous line, so that the next one
+/// is found quickly in a mapped file.
+typedef struct {
+  linenr_T sp_lnum;             ///< line found last, zero if none
+  size_t sp_end;                ///< offset just after its text
+} snappos_T;
+
 typedef struct {
   int mlcs_numlines;
   int mlcs_totalsize;
@@ -33,7 +102,9 @@ typedef struct {
 ///   data_block: leaf nodes
 ///
 /// Memline also has "chunks" of 800 lines that are separate from the 128-tree
-/// structure, primarily used to speed up line2byte() and byte2line().
+/// structure, primarily used to speed up line2byte() and byte2line().  A
+/// Fenwick tree over the chunks keeps their prefix sums, so that the chunk for
+/// a line or byte offset is found in O(log n).
 ///
 /// Motivation: If you have a file that is 10000 lines long, and you insert
 ///             a line at linenr 1000, you don't want to move 9000 lines in
@@ -69,4 +140,15 @@ typedef struct {
   chunksize_T *ml_chunksize;
   int ml_numchunks;
   int ml_usedchunks;
+  chunksize_T *ml_chunktree;    // Fenwick tree of ml_chunksize, 1-based,
+                                // ml_numchunks + 1 entries
+  bool ml_chunktree_valid;      // ml_chunktree matches ml_chunksize
+
+  mllocator_T ml_locators[ML_LOCATORS];  // recently used paths to data blocks
+  unsigned ml_locator_gen;      // incremented when the tree changes
+  unsigned ml_locator_tick;     // incremented when a path is used
+
+  uint64_t ml_text_gen;         // changed when the text changes
+
+  mapline_T *ml_map;            // lines of a mapped file, NULL if not used
 } memline_T;
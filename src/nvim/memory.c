@@ -8,6 +8,10 @@
 #include <string.h>
 #include <time.h>
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 #include "nvim/api/extmark.h"
 #include "nvim/api/private/helpers.h"
 #include "nvim/api/ui.h"
@@ -27,9 +31,11 @@
 #include "nvim/highlight_group.h"
 #include "nvim/insexpand.h"
 #include "nvim/lua/executor.h"
+#include "nvim/macros_defs.h"
 #include "nvim/main.h"
 #include "nvim/map_defs.h"
 #include "nvim/mapping.h"
+#include "nvim/math.h"
 #include "nvim/memfile.h"
 #include "nvim/memory.h"
 #include "nvim/message.h"
@@ -278,6 +284,179 @@ void *xmemscan(const void *addr, char c, size_t size)
   return p ? p : (char *)addr + size;
 }
 
+/// Like xmemscan(), but looks for any of the bytes `c1`, `c2` and `c3`.
+/// Pass the same byte more than once to look for fewer bytes.
+///
+/// Used for splitting text into lines, where nearly all bytes are skipped.
+/// Checks 16 bytes at a time with SSE2, otherwise 8 bytes at a time.
+///
+/// @param addr The address of the memory object.
+/// @param c1   A char to look for.
+/// @param c2   A char to look for.
+/// @param c3   A char to look for.
+/// @param size The size of the memory object.
+/// @returns a pointer to the first instance of any of the chars, or one past
+///          the end if not found.
+void *xmemscan3(const void *addr, char c1, char c2, char c3, size_t size)
+  FUNC_ATTR_NONNULL_RET FUNC_ATTR_NONNULL_ALL FUNC_ATTR_PURE
+{
+  const char *p = addr;
+  const char *const end = p + size;
+
+#ifdef __SSE2__
+  const __m128i v1 = _mm_set1_epi8(c1);
+  const __m128i v2 = _mm_set1_epi8(c2);
+  const __m128i v3 = _mm_set1_epi8(c3);
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+    __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, v1),
+                                            _mm_cmpeq_epi8(chunk, v2)),
+                               _mm_cmpeq_epi8(chunk, v3));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask != 0) {
+      return (char *)p + xctz((uint64_t)mask);
+    }
+  }
+#else
+  // A byte of "w ^ pattern" is zero where "w" has the char.  Only tells
+  // whether there is a match, the byte loop below finds it.
+  const uint64_t ones = UINT64_C(0x0101010101010101);
+  const uint64_t highs = UINT64_C(0x8080808080808080);
+  const uint64_t p1 = ones * (uint8_t)c1;
+  const uint64_t p2 = ones * (uint8_t)c2;
+  const uint64_t p3 = ones * (uint8_t)c3;
+  for (; end - p >= 8; p += 8) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    uint64_t x1 = w ^ p1;
+    uint64_t x2 = w ^ p2;
+    uint64_t x3 = w ^ p3;
+    if ((((x1 - ones) & ~x1) | ((x2 - ones) & ~x2) | ((x3 - ones) & ~x3)) & highs) {
+      break;
+    }
+  }
+#endif
+
+  for (; p < end; p++) {
+    if (*p == c1 || *p == c2 || *p == c3) {
+      return (char *)p;
+    }
+  }
+  return (char *)end;
+}
+
+/// Compare "n" bytes, ignoring the case of ASCII letters when "ic" is true.
+static bool xmemeq(const uint8_t *a, const uint8_t *b, size_t n, bool ic)
+  FUNC_ATTR_NONNULL_ALL FUNC_ATTR_PURE
+{
+  if (!ic) {
+    return memcmp(a, b, n) == 0;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (TOLOWER_ASC(a[i]) != TOLOWER_ASC(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Like memmem(), but when `ic` is true ASCII letters also match the other
+/// case.
+///
+/// Used to skip lines that cannot match a regexp.  With SSE2 the first and
+/// last byte of `needle` are checked at 16 positions at a time and the other
+/// bytes only where both of them match.
+///
+/// @param hay    The memory to search in.
+/// @param hlen   The size of `hay`.
+/// @param needle The bytes to look for, must not be empty.
+/// @param nlen   The size of `needle`.
+/// @param ic     Ignore case of ASCII letters.
+/// @returns a pointer to the first instance of `needle` in `hay`, or NULL if
+///          not found.
+void *xmemmem(const void *hay, size_t hlen, const void *needle, size_t nlen, bool ic)
+  FUNC_ATTR_NONNULL_ALL FUNC_ATTR_PURE
+{
+  assert(nlen > 0);
+  if (nlen > hlen) {
+    return NULL;
+  }
+
+  const uint8_t *const h = hay;
+  const uint8_t *const n = needle;
+  const uint8_t first = ic ? (uint8_t)TOLOWER_ASC(n[0]) : n[0];
+  const uint8_t last = ic ? (uint8_t)TOLOWER_ASC(n[nlen - 1]) : n[nlen - 1];
+  const size_t npos = hlen - nlen + 1;  // number of possible positions
+  size_t i = 0;
+
+#ifdef __SSE2__
+  // Setting bit 0x20 turns an ASCII upper case letter into lower case, and no
+  // other byte into an ASCII lower case letter.
+  const __m128i vfirst = _mm_set1_epi8((char)first);
+  const __m128i vlast = _mm_set1_epi8((char)last);
+  const __m128i ffirst = _mm_set1_epi8(ic && ASCII_ISLOWER(first) ? 0x20 : 0);
+  const __m128i flast = _mm_set1_epi8(ic && ASCII_ISLOWER(last) ? 0x20 : 0);
+  for (; npos - i >= 16; i += 16) {
+    __m128i f = _mm_or_si128(_mm_loadu_si128((const __m128i *)(h + i)), ffirst);
+    __m128i l = _mm_or_si128(_mm_loadu_si128((const __m128i *)(h + i + nlen - 1)), flast);
+    int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(f, vfirst),
+                                               _mm_cmpeq_epi8(l, vlast)));
+    while (mask != 0) {
+      const size_t pos = i + (size_t)xctz((uint64_t)mask);
+      if (xmemeq(h + pos, n, nlen, ic)) {
+        return (void *)(h + pos);
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  for (; i < npos; i++) {
+    if ((ic ? TOLOWER_ASC(h[i]) : h[i]) == first && xmemeq(h + i, n, nlen, ic)) {
+      return (void *)(h + i);
+    }
+  }
+  return NULL;
+}
+
+/// Check whether all bytes of a memory object are ASCII, below 0x80.
+///
+/// @param addr The address of the memory object.
+/// @param size The size of the memory object.
+bool xmemisascii(const void *addr, size_t size)
+  FUNC_ATTR_NONNULL_ALL FUNC_ATTR_PURE
+{
+  const uint8_t *p = addr;
+  const uint8_t *const end = p + size;
+
+#ifdef __SSE2__
+  __m128i acc = _mm_setzero_si128();
+  for (; end - p >= 16; p += 16) {
+    acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)p));
+  }
+  if (_mm_movemask_epi8(acc) != 0) {
+    return false;
+  }
+#else
+  uint64_t acc = 0;
+  for (; end - p >= 8; p += 8) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    acc |= w;
+  }
+  if (acc & UINT64_C(0x8080808080808080)) {
+    return false;
+  }
+#endif
+
+  for (; p < end; p++) {
+    if (*p >= 0x80) {
+      return false;
+    }
+  }
+  return true;
+}
+
 /// Replaces every instance of `c` with `x`.
 ///
 /// @warning Will read past `str + strlen(str)` if `c == NUL`.
@@ -1438,6 +1438,23 @@ static void shift_delete_registers(bool y_append)
   y_regs[1].y_array = NULL;  // set register "1 to empty
 }
 
+/// Put line "lnum" into register 1 and shift the numbered registers, like
+/// deleting the line with ":delete" does.  For deleting many lines without
+/// calling op_delete() for each of them.
+void yank_deleted_line(linenr_T lnum)
+{
+  oparg_T oa;
+  clear_oparg(&oa);
+  oa.op_type = OP_DELETE;
+  oa.motion_type = kMTLineWise;
+  oa.start.lnum = lnum;
+  oa.end.lnum = lnum;
+  oa.line_count = 1;
+
+  shift_delete_registers(false);
+  op_yank_reg(&oa, false, &y_regs[1], false);
+}
+
 /// Handle a delete operation.
 ///
 /// @return  FAIL if undo failed, OK otherwise.
@@ -3449,6 +3466,18 @@ void do_put(int regname, yankreg_T *reg, int dir, int count, int flags)
           i = 1;
         }
 
+        if (!(flags & PUT_FIXINDENT)) {
+          // No need to look at every line, append them all at once.
+          size_t n = y_size - i - (y_type == kMTCharWise ? 1 : 0);
+          if (n > 0 && ml_append_many(curbuf, lnum, y_array + i, NULL, (linenr_T)n,
+                                      false) == FAIL) {
+            goto error;
+          }
+          new_lnum += (linenr_T)n;
+          lnum += (linenr_T)(y_size - i);
+          nr_lines += (linenr_T)(y_size - i);
+          i = y_size;
+        }
         for (; i < y_size; i++) {
           if ((y_type != kMTCharWise || i < y_size - 1)) {
             if (ml_append(lnum, y_array[i], 0, false) == FAIL) {
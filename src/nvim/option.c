@@ -2228,6 +2228,22 @@ static const char *did_set_lisp(optset_T *args)
   return NULL;
 }
 
+/// Process the new 'maxmemtot' option value.
+static const char *did_set_maxmemtot(optset_T *args FUNC_ATTR_UNUSED)
+{
+  // release blocks when the limit was lowered
+  mf_trim_cache();
+  return NULL;
+}
+
+/// Process the new 'memcompress' option value.
+static const char *did_set_memcompress(optset_T *args FUNC_ATTR_UNUSED)
+{
+  // compress blocks when the limit was lowered
+  mf_trim_cache();
+  return NULL;
+}
+
 /// Process the updated 'modifiable' option value.
 static const char *did_set_modifiable(optset_T *args FUNC_ATTR_UNUSED)
 {
@@ -2907,6 +2923,22 @@ static const char *validate_num_option(OptIndex opt_idx, void *varp, OptInt *new
     if (value < 0) {
       return e_positive;
     }
+  } else if (varp == &p_mmt) {
+    if (value < 0) {
+      return e_positive;
+    }
+  } else if (varp == &p_mfs) {
+    if (value < 0) {
+      return e_positive;
+    }
+  } else if (varp == &p_mcm) {
+    if (value < 0) {
+      return e_positive;
+    }
+  } else if (varp == &p_umem) {
+    if (value < 0) {
+      return e_positive;
+    }
   } else if (varp == &p_ch) {
     if (value < 0) {
       return e_positive;
@@ -562,11 +562,14 @@ EXTERN int p_magic;             ///< 'magic'
 EXTERN char *p_menc;            ///< 'makeencoding'
 EXTERN char *p_mef;             ///< 'makeef'
 EXTERN char *p_mp;              ///< 'makeprg'
+EXTERN OptInt p_mfs;            ///< 'mapfilesize'
 EXTERN char *p_mps;             ///< 'matchpairs'
 EXTERN OptInt p_mat;            ///< 'matchtime'
 EXTERN OptInt p_mfd;            ///< 'maxfuncdepth'
 EXTERN OptInt p_mmd;            ///< 'maxmapdepth'
 EXTERN OptInt p_mmp;            ///< 'maxmempattern'
+EXTERN OptInt p_mmt;            ///< 'maxmemtot'
+EXTERN OptInt p_mcm;            ///< 'memcompress'
 EXTERN OptInt p_mis;            ///< 'menuitems'
 EXTERN char *p_msm;             ///< 'mkspellmem'
 EXTERN int p_ml;                ///< 'modeline'
@@ -740,6 +743,7 @@ EXTERN OptInt p_ttm;            ///< 'ttimeoutlen'
 EXTERN char *p_udir;            ///< 'undodir'
 EXTERN int p_udf;               ///< 'undofile'
 EXTERN OptInt p_ul;             ///< 'undolevels'
+EXTERN OptInt p_umem;           ///< 'undomemory'
 EXTERN OptInt p_ur;             ///< 'undoreload'
 EXTERN OptInt p_uc;             ///< 'updatecount'
 EXTERN OptInt p_ut;             ///< 'updatetime'
@@ -789,6 +793,7 @@ EXTERN OptInt p_wm;             ///< 'wrapmargin'
 EXTERN int p_ws;                ///< 'wrapscan'
 EXTERN int p_write;             ///< 'write'
 EXTERN int p_wa;                ///< 'writeany'
+EXTERN int p_was;               ///< 'writeasync'
 EXTERN int p_wb;                ///< 'writebackup'
 EXTERN OptInt p_wd;             ///< 'writedelay'
 EXTERN int p_cdh;               ///< 'cdhome'
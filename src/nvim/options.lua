@@ -5113,6 +5113,34 @@ return {
       type = 'string',
       varname = 'p_mp',
     },
+    {
+      abbreviation = 'mfs',
+      defaults = { if_true = 0 },
+      desc = [=[
+        Files of at least this many Kbyte are read through a read-only memory
+        mapping instead of being copied into the buffer.  The lines are taken
+        directly from the mapping until the buffer is changed for the first
+        time, then the text is copied into the buffer like for any other
+        file.  This makes opening very large files, such as logs, fast and
+        keeps the memory use proportional to the part that is looked at.
+        Zero disables mapping.
+        A file is only mapped when it is read for editing, uses "unix"
+        'fileformat', is valid UTF-8 (or 'binary' is set), contains no NUL
+        bytes, does not need conversion and no undo file is read for it
+        ('undofile').  Otherwise it is read as usual.
+        When the mapped file was changed by another program Nvim notices it
+        before using the mapping and copies the text that is still there into
+        the buffer, text may be lost then.  A file that is truncated at the
+        very moment its text is used can still make Nvim crash, better not use
+        this for files that are truncated in place (e.g. by logrotate).
+        Not available on systems without mmap().
+      ]=],
+      full_name = 'mapfilesize',
+      scope = { 'global' },
+      short_desc = N_('read files of this many Kbyte through a mapping'),
+      type = 'number',
+      varname = 'p_mfs',
+    },
     {
       abbreviation = 'mps',
       alloced = true,
@@ -5225,6 +5253,46 @@ return {
       type = 'number',
       varname = 'p_mmp',
     },
+    {
+      abbreviation = 'mmt',
+      cb = 'did_set_maxmemtot',
+      defaults = { if_true = 0 },
+      desc = [=[
+        Maximum amount of memory in Kbyte to use for the text of all buffers
+        together.  When more is used, the least recently used blocks of text are
+        written to the swap file, if they were changed, and dropped from
+        memory.  They are read back when needed.  Only buffers that have a
+        swap file can give back memory, see 'swapfile'.
+        Zero means no limit: the text of all buffers is kept in memory.
+        The number of blocks found in memory, read from the swap file and
+        dropped can be obtained with `nvim__stats()`.
+      ]=],
+      full_name = 'maxmemtot',
+      scope = { 'global' },
+      short_desc = N_('maximum memory (in Kbyte) used for all buffers'),
+      type = 'number',
+      varname = 'p_mmt',
+    },
+    {
+      abbreviation = 'mcm',
+      cb = 'did_set_memcompress',
+      defaults = { if_true = 0 },
+      desc = [=[
+        Amount of memory in Kbyte for the most recently used text of all
+        buffers together.  Blocks of text that were used less recently are
+        compressed in memory, which usually makes them two to four times
+        smaller.  They are decompressed when used again.  This lets the text
+        of huge files stay in memory, see also 'maxmemtot'.
+        Zero means text is never compressed.
+        The memory used by compressed blocks and their size when decompressed
+        can be obtained with `nvim__stats()`.
+      ]=],
+      full_name = 'memcompress',
+      scope = { 'global' },
+      short_desc = N_('memory (in Kbyte) used for text that is not compressed'),
+      type = 'number',
+      varname = 'p_mcm',
+    },
     {
       abbreviation = 'mis',
       defaults = { if_true = 25 },
@@ -9197,6 +9265,23 @@ return {
       type = 'number',
       varname = 'p_ul',
     },
+    {
+      abbreviation = 'um',
+      defaults = { if_true = 0 },
+      desc = [=[
+        Maximum amount of memory in Kbyte to use for the undo information of
+        one buffer.  When a new change is started and more memory is used,
+        the oldest changes are forgotten, like when there are more changes
+        than 'undolevels'.  Older branches of the undo tree go first.  The
+        current change is always kept, even when it is bigger.
+        Zero means there is no limit.
+      ]=],
+      full_name = 'undomemory',
+      scope = { 'global' },
+      short_desc = N_('maximum memory (in Kbyte) used for undo of a buffer'),
+      type = 'number',
+      varname = 'p_umem',
+    },
     {
       abbreviation = 'ur',
       defaults = { if_true = 10000 },
@@ -10095,6 +10180,30 @@ return {
       type = 'boolean',
       varname = 'p_wa',
     },
+    {
+      abbreviation = 'was',
+      defaults = { if_true = false },
+      desc = [=[
+        When on, ":write" and ":update" of a whole buffer write the text on a
+        worker thread, so that editing can continue while a large file is
+        being written.  Lines are written from a copy-on-write snapshot of
+        the buffer, and 'fsync' is done on the worker thread too.
+        The "written" message, resetting 'modified' and the |BufWritePost|
+        autocommands come when writing is done.  When the buffer was changed
+        meanwhile it stays modified.  When writing fails an error is given
+        then and the backup file is put back.
+        The file is written the normal way when it needs conversion
+        ('fileencoding', "mac" 'fileformat', ++opt), when 'undofile' or
+        'patchmode' is set, and when writing part of a buffer, appending or
+        filtering.  Reading a file, abandoning a buffer and exiting wait for
+        pending writes.
+      ]=],
+      full_name = 'writeasync',
+      scope = { 'global' },
+      short_desc = N_('write buffers on a worker thread'),
+      type = 'boolean',
+      varname = 'p_was',
+    },
     {
       abbreviation = 'wb',
       defaults = { if_true = true },
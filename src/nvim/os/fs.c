@@ -53,6 +53,10 @@
 # include <sys/uio.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
 #ifdef MSWIN
 # include "nvim/mbyte.h"
 # include "nvim/option.h"
@@ -709,6 +713,49 @@ ptrdiff_t os_write(const int fd, const char *const buf, const size_t size, const
   return (ptrdiff_t)written_bytes;
 }
 
+/// Write multiple buffers to a file at once
+///
+/// Wrapper for writev(), through libuv.  Can be used on a worker thread.
+///
+/// @param[in]  fd  File descriptor to write to.
+/// @param[in]  bufs  Buffers to write. Note: the descriptions may change, it is
+///                   incorrect to use them after os_writev().
+/// @param[in]  nbufs  Number of buffers in bufs.
+///
+/// @return Number of bytes written or libuv error code (< 0).
+ptrdiff_t os_writev(const int fd, uv_buf_t *bufs, size_t nbufs)
+  FUNC_ATTR_NONNULL_ALL FUNC_ATTR_WARN_UNUSED_RESULT
+{
+  size_t written_bytes = 0;
+  while (nbufs > 0) {
+    if (bufs->len == 0) {
+      bufs++;
+      nbufs--;
+      continue;
+    }
+    int r;
+    RUN_UV_FS_FUNC(r, uv_fs_write, fd, bufs, (unsigned)nbufs, -1, NULL);
+    if (r == UV_EINTR || r == UV_EAGAIN) {
+      continue;
+    } else if (r < 0) {
+      return r;
+    } else if (r == 0) {
+      return UV_UNKNOWN;
+    }
+    written_bytes += (size_t)r;
+    size_t n = (size_t)r;
+    while (nbufs > 0 && n >= bufs->len) {
+      n -= bufs->len;
+      bufs++;
+      nbufs--;
+    }
+    if (n > 0) {
+      *bufs = uv_buf_init(bufs->base + n, (unsigned)(bufs->len - n));
+    }
+  }
+  return (ptrdiff_t)written_bytes;
+}
+
 /// Copies a file from `path` to `new_path`.
 ///
 /// @see http://docs.libuv.org/en/v1.x/fs.html#c.uv_fs_copyfile
@@ -737,6 +784,108 @@ int os_fsync(int fd)
   return r;
 }
 
+/// Maps the first `size` bytes of a file read-only into memory.
+///
+/// The mapping stays valid after `fd` is closed. It must be released with
+/// os_munmap().
+///
+/// @param fd the file descriptor of the file to map.
+/// @param size number of bytes to map, must not be zero.
+///
+/// @return the start of the mapping, or NULL when the file cannot be mapped
+///         (including platforms without mmap()).
+char *os_mmap_readonly(int fd, size_t size)
+  FUNC_ATTR_WARN_UNUSED_RESULT
+{
+#ifdef HAVE_SYS_MMAN_H
+  if (size == 0) {
+    return NULL;
+  }
+  void *addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+# ifdef MADV_SEQUENTIAL
+  // The first pass over the mapping goes from start to end.
+  madvise(addr, size, MADV_SEQUENTIAL);
+# endif
+  return addr;
+#else
+  (void)fd;
+  (void)size;
+  return NULL;
+#endif
+}
+
+/// Tells the system that the pages of a mapping made with
+/// os_mmap_readonly() are not needed right now.  They are read from the
+/// file again when accessed.
+void os_mmap_release(char *addr, size_t size)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_DONTNEED)
+  if (addr != NULL) {
+    madvise(addr, size, MADV_DONTNEED);
+# ifdef MADV_NORMAL
+    madvise(addr, size, MADV_NORMAL);
+# endif
+  }
+#else
+  (void)addr;
+  (void)size;
+#endif
+}
+
+/// Gives a mapping made with os_mmap_readonly() its own copy of the pages,
+/// so that it no longer changes with the file and stays valid when the file
+/// is truncated.  Other threads can keep on reading the mapping meanwhile.
+void os_mmap_privatize(char *addr, size_t size)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(MREMAP_FIXED)
+  // Linux also drops the copied pages of a private mapping when the file is
+  // truncated.  Copy the text to anonymous memory and move that over the
+  // mapping in one step.
+  if (addr == NULL) {
+    return;
+  }
+  void *copy = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (copy == MAP_FAILED) {
+    return;
+  }
+  memcpy(copy, addr, size);
+  mprotect(copy, size, PROT_READ);
+  if (mremap(copy, size, size, MREMAP_MAYMOVE | MREMAP_FIXED, addr) == MAP_FAILED) {
+    munmap(copy, size);
+  }
+#elif defined(HAVE_SYS_MMAN_H)
+  if (addr == NULL || mprotect(addr, size, PROT_READ | PROT_WRITE) != 0) {
+    return;
+  }
+  // Writing the byte that is there makes the system copy the page.  4096 is
+  // the smallest page size in use.
+  for (size_t off = 0; off < size; off += 4096) {
+    volatile char *p = addr + off;
+    *p = *p;
+  }
+  mprotect(addr, size, PROT_READ);
+#else
+  (void)addr;
+  (void)size;
+#endif
+}
+
+/// Releases a mapping made with os_mmap_readonly().
+void os_munmap(char *addr, size_t size)
+{
+#ifdef HAVE_SYS_MMAN_H
+  if (addr != NULL) {
+    munmap(addr, size);
+  }
+#else
+  (void)addr;
+  (void)size;
+#endif
+}
+
 /// Get stat information for a file.
 ///
 /// @return libuv return code, or -errno
@@ -29,6 +29,7 @@
 #include "nvim/profile.h"
 #include "nvim/state.h"
 #include "nvim/state_defs.h"
+#include "nvim/syntax.h"
 
 #define READ_BUFFER_SIZE 0xfff
 #define INPUT_BUFFER_SIZE ((READ_BUFFER_SIZE * 4) + MAX_KEY_CODE_LEN)
@@ -129,7 +130,15 @@ int os_inchar(uint8_t *buf, int maxlen, int ms, int tb_change_cnt, MultiQueue *e
   } else {
     uint64_t wait_start = os_hrtime();
     cursorhold_time = MIN(cursorhold_time, (int)p_ut);
-    if ((result = inbuf_poll((int)p_ut - cursorhold_time, events)) == kInputNone) {
+    // Compute syntax states in short slices until there is input, this
+    // counts as waiting for 'updatetime'.
+    while ((result = inbuf_poll(0, events)) == kInputNone && events == main_loop.events
+           && syntax_idle_update()) {}
+    if (result == kInputNone) {
+      int waited = (int)((os_hrtime() - wait_start) / 1000000);
+      result = inbuf_poll(MAX((int)p_ut - cursorhold_time - waited, 0), events);
+    }
+    if (result == kInputNone) {
       if (read_stream.s.closed && silent_mode) {
         // Drained eventloop & initial input; exit silent/batch-mode (-es/-Es).
         read_error_exit();
@@ -2,13 +2,16 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <uv.h>
 
 #include "nvim/arglist.h"
 #include "nvim/ascii_defs.h"
@@ -24,6 +27,7 @@
 #include "nvim/eval.h"
 #include "nvim/eval/typval.h"
 #include "nvim/eval/window.h"
+#include "nvim/event/loop.h"
 #include "nvim/ex_cmds.h"
 #include "nvim/ex_cmds2.h"
 #include "nvim/ex_cmds_defs.h"
@@ -42,6 +46,7 @@
 #include "nvim/highlight_defs.h"
 #include "nvim/highlight_group.h"
 #include "nvim/macros_defs.h"
+#include "nvim/main.h"
 #include "nvim/mark.h"
 #include "nvim/mbyte.h"
 #include "nvim/mbyte_defs.h"
@@ -253,6 +258,27 @@ typedef struct {
   char *qf_title;      ///< quickfix list title
 } vgr_args_T;
 
+/// A file that :vimgrep reads ahead on a worker thread.
+typedef struct {
+  uv_work_t vr_req;
+  char *vr_fname;       ///< full name of the file
+  bool vr_detect_ff;    ///< 'fileformat' is to be detected
+  size_t vr_map_size;   ///< map the file when it has at least this size
+  bool vr_done;         ///< reading is done, protected by vgr_read_mutex
+  bool vr_ok;           ///< the lines can be used without loading the file
+  mapline_T *vr_map;    ///< lines of the file, NULL for an empty file
+  linenr_T vr_count;    ///< number of lines in vr_map
+  bool vr_released;     ///< no longer used by :vimgrep
+  bool vr_finished;     ///< vgr_read_done() was called
+} vgr_read_T;
+
+/// Number of files that :vimgrep reads ahead.
+enum { VGR_READ_AHEAD = 32, };
+
+static uv_mutex_t vgr_read_mutex;
+static uv_cond_t vgr_read_cond;
+static bool vgr_read_init = false;
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "quickfix.c.generated.h"
 #endif
@@ -5458,6 +5484,216 @@ static bool existing_swapfile(const buf_T *buf)
   return false;
 }
 
+/// @return  true when :vimgrep can read files ahead on worker threads: the
+///          options are such that a file with valid UTF-8 text, without NUL
+///          or CR bytes, is read as it is.
+static bool vgr_can_read_ahead(void)
+{
+  // With ":hide" the buffers are to be kept loaded.
+  if (p_bin || (cmdmod.cmod_flags & CMOD_HIDE)) {
+    return false;
+  }
+  // A NL must end a line.
+  if (*p_ffs == NUL ? *p_ff != 'u' : strstr(p_ffs, "unix") == NULL) {
+    return false;
+  }
+  // The first encoding that is tried must be UTF-8.
+  char *p = p_fencs;
+  if (*p == NUL) {
+    return true;
+  }
+  if (strncmp(p, "ucs-bom,", 8) == 0) {
+    p += 8;
+  }
+  return (strncmp(p, "utf-8", 5) == 0 && (p[5] == ',' || p[5] == NUL))
+         || (strncmp(p, "utf8", 4) == 0 && (p[4] == ',' || p[4] == NUL));
+}
+
+/// @return  true when file "fname" has to be loaded into a buffer for
+///          :vimgrep, because it is loaded already or reading it triggers
+///          autocommands.
+static bool vgr_need_buffer(char *fname)
+{
+  buf_T *buf = buflist_findname_exp(fname);
+  if (buf != NULL && buf->b_ml.ml_mfp != NULL) {
+    return true;
+  }
+
+  // The default autocommands for detecting the filetype and for editorconfig
+  // only set options, the one for SwapExists is only used when a swap file
+  // is created.  Without a buffer none of them matter.
+  static const char *const skip_names[] = { "filetypedetect", "editorconfig", "nvim_swapfile" };
+  int skip_groups[ARRAY_SIZE(skip_names)];
+  size_t nskip = 0;
+  for (size_t i = 0; i < ARRAY_SIZE(skip_names); i++) {
+    int group = augroup_find(skip_names[i]);
+    if (group > 0) {
+      skip_groups[nskip++] = group;
+    }
+  }
+
+  static const event_T events[] = {
+    EVENT_BUFREADCMD, EVENT_BUFREADPRE, EVENT_BUFREADPOST, EVENT_SWAPEXISTS
+  };
+  for (size_t i = 0; i < ARRAY_SIZE(events); i++) {
+    if (will_trigger_autocmd(events[i], fname, buf, skip_groups, nskip)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Read the lines of a file for :vimgrep, runs on a worker thread.  Only a
+/// file of at least 'mapfilesize' is mapped.
+static void vgr_read_work(uv_work_t *req)
+{
+  vgr_read_T *vr = req->data;
+  bool ok = false;
+
+  int fd = os_open(vr->vr_fname, O_RDONLY, 0);
+  if (fd >= 0) {
+    FileInfo file_info;
+    if (os_fileinfo_fd(fd, &file_info) && S_ISREG(file_info.stat.st_mode)) {
+      uint64_t size = os_fileinfo_size(&file_info);
+      if (size == 0) {
+        ok = true;
+      } else if (size == (size_t)size) {
+        vr->vr_map = size >= vr->vr_map_size
+                     ? file_map_lines(fd, (size_t)size, true, true, vr->vr_detect_ff,
+                                      &vr->vr_count)
+                     : file_read_lines(fd, (size_t)size, true, true, vr->vr_detect_ff,
+                                       &vr->vr_count);
+        ok = vr->vr_map != NULL;
+      }
+    }
+    os_close(fd);
+  }
+
+  uv_mutex_lock(&vgr_read_mutex);
+  vr->vr_ok = ok;
+  vr->vr_done = true;
+  uv_cond_broadcast(&vgr_read_cond);
+  uv_mutex_unlock(&vgr_read_mutex);
+}
+
+/// Called on the main loop when a worker finished reading a file for
+/// :vimgrep or reading it was cancelled.
+static void vgr_read_done(uv_work_t *req, int status)
+{
+  vgr_read_T *vr = req->data;
+  vr->vr_finished = true;
+  if (vr->vr_released) {
+    vgr_read_free(vr);
+  }
+}
+
+static void vgr_read_free(vgr_read_T *vr)
+{
+  if (vr->vr_map != NULL) {
+    ml_map_free(vr->vr_map);
+  }
+  xfree(vr->vr_fname);
+  xfree(vr);
+}
+
+/// Called when :vimgrep does not need "vr" anymore.  It is freed when the
+/// worker is done with it.
+static void vgr_read_release(vgr_read_T *vr)
+{
+  vr->vr_released = true;
+  if (vr->vr_finished) {
+    vgr_read_free(vr);
+  } else {
+    // Only has an effect when the worker did not start yet.
+    uv_cancel((uv_req_t *)&vr->vr_req);
+  }
+}
+
+/// Start reading the files for :vimgrep that do not need to be loaded into a
+/// buffer on worker threads, up to VGR_READ_AHEAD files from file "fi".
+/// "*next" is the first file that was not considered yet.
+static void vgr_read_ahead(vgr_args_T *cmd_args, vgr_read_T **reads, int *next, int fi)
+{
+  if (!vgr_read_init) {
+    uv_mutex_init(&vgr_read_mutex);
+    uv_cond_init(&vgr_read_cond);
+    vgr_read_init = true;
+  }
+
+  // When there are several 'fileformats', a NL must be found where
+  // readfile() would look for it.
+  bool detect_ff = vim_strchr(p_ffs, ',') != NULL;
+  // Like readfile() only map a file when 'mapfilesize' is set.
+  size_t map_size = p_mfs > 0 ? (size_t)p_mfs * 1024 : SIZE_MAX;
+
+  for (; *next < cmd_args->fcount && *next < fi + VGR_READ_AHEAD; (*next)++) {
+    char *fname = cmd_args->fnames[*next];
+    if (vgr_need_buffer(fname)) {
+      continue;
+    }
+    vgr_read_T *vr = xcalloc(1, sizeof(vgr_read_T));
+    vr->vr_req.data = vr;
+    vr->vr_fname = FullName_save(fname, true);
+    vr->vr_detect_ff = detect_ff;
+    vr->vr_map_size = map_size;
+    if (uv_queue_work(&main_loop.uv, &vr->vr_req, vgr_read_work, vgr_read_done) != 0) {
+      xfree(vr->vr_fname);
+      xfree(vr);
+      continue;
+    }
+    reads[*next] = vr;
+  }
+}
+
+/// Wait for the worker to be done with "vr".
+///
+/// @return  true when the lines of the file can be used without loading it.
+static bool vgr_read_wait(vgr_read_T *vr)
+{
+  uv_mutex_lock(&vgr_read_mutex);
+  while (!vr->vr_done) {
+    uv_cond_wait(&vgr_read_cond, &vgr_read_mutex);
+  }
+  uv_mutex_unlock(&vgr_read_mutex);
+  return vr->vr_ok;
+}
+
+/// Search for a pattern in the lines of a file that was read ahead.  Instead
+/// of a dummy buffer "*scratchp" holds the lines, it is created when needed.
+/// The file is not loaded, thus no autocommands are triggered and no swap
+/// file is created.
+///
+/// @return  false when the file has to be loaded into a buffer after all.
+static bool vgr_match_read_ahead(qf_list_T *qfl, char *fname, vgr_read_T *vr, buf_T **scratchp,
+                                 vgr_args_T *cmd_args)
+{
+  buf_T *buf = *scratchp;
+  if (buf == NULL) {
+    // Allocate a buffer without putting it in the buffer list.
+    buf = buflist_new(NULL, NULL, 1, BLN_DUMMY);
+    if (buf == NULL) {
+      return false;
+    }
+    buf_copy_options(buf, BCO_ENTER | BCO_NOHELP);
+    buf->b_p_swf = false;
+    *scratchp = buf;
+  } else {
+    ml_close(buf, false);
+  }
+  if (ml_open(buf) == FAIL) {
+    return false;
+  }
+  if (vr->vr_map != NULL) {
+    ml_map_set(buf, vr->vr_map, vr->vr_count);
+    vr->vr_map = NULL;
+  }
+
+  // The scratch buffer is reused, entries are added by file name.
+  vgr_match_buflines(qfl, fname, buf, cmd_args->spat, &cmd_args->regmatch,
+                     &cmd_args->tomatch, true, cmd_args->flags);
+  return true;
+}
+
 /// Process :vimgrep command arguments. The command syntax is:
 ///
 /// :{count}vimgrep /{pattern}/[g][j] {file} ...
@@ -5518,6 +5754,15 @@ static int vgr_process_files(win_T *wp, qf_info_T *qi, vgr_args_T *cmd_args, boo
   // ":lcd %:p:h" changes the meaning of short path names.
   os_dirname(dirname_start, MAXPATHL);
 
+  // Files that can be used without loading them into a buffer are read ahead
+  // on worker threads.  Matching is done here, in the order of the files.
+  vgr_read_T **reads = NULL;
+  int next_read = 0;
+  buf_T *scratch = NULL;
+  if (vgr_can_read_ahead()) {
+    reads = xcalloc((size_t)cmd_args->fcount, sizeof(*reads));
+  }
+
   time_t seconds = 0;
   for (int fi = 0; fi < cmd_args->fcount && !got_int && cmd_args->tomatch > 0; fi++) {
     char *fname = path_try_shorten_fname(cmd_args->fnames[fi]);
@@ -5528,6 +5773,28 @@ static int vgr_process_files(win_T *wp, qf_info_T *qi, vgr_args_T *cmd_args, boo
       vgr_display_fname(fname);
     }
 
+    if (reads != NULL) {
+      vgr_read_ahead(cmd_args, reads, &next_read, fi);
+      vgr_read_T *vr = reads[fi];
+      reads[fi] = NULL;
+      if (vr != NULL) {
+        bool done = false;
+        // Autocommands for a file loaded before may have changed things.
+        if (vgr_read_wait(vr) && !vgr_need_buffer(cmd_args->fnames[fi])) {
+          if (!vgr_qflist_valid(wp, qi, save_qfid, cmd_args->qf_title)) {
+            vgr_read_release(vr);
+            goto theend;
+          }
+          save_qfid = qf_get_curlist(qi)->qf_id;
+          done = vgr_match_read_ahead(qf_get_curlist(qi), fname, vr, &scratch, cmd_args);
+        }
+        vgr_read_release(vr);
+        if (done) {
+          continue;
+        }
+      }
+    }
+
     buf_T *buf = buflist_findname_exp(cmd_args->fnames[fi]);
     bool using_dummy;
     if (buf == NULL || buf->b_ml.ml_mfp == NULL) {
@@ -5626,6 +5893,17 @@ static int vgr_process_files(win_T *wp, qf_info_T *qi, vgr_args_T *cmd_args, boo
   status = OK;
 
 theend:
+  if (reads != NULL) {
+    for (int i = 0; i < next_read; i++) {
+      if (reads[i] != NULL) {
+        vgr_read_release(reads[i]);
+      }
+    }
+    xfree(reads);
+  }
+  if (scratch != NULL) {
+    wipe_buffer(scratch, false);
+  }
   xfree(dirname_now);
   xfree(dirname_start);
   return status;
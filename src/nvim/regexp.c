@@ -15,6 +15,7 @@
 #include <string.h>
 #include <uv.h>
 
+#include "klib/kvec.h"
 #include "nvim/ascii_defs.h"
 #include "nvim/buffer_defs.h"
 #include "nvim/charset.h"
@@ -28,6 +29,7 @@
 #include "nvim/globals.h"
 #include "nvim/keycodes.h"
 #include "nvim/macros_defs.h"
+#include "nvim/map_defs.h"
 #include "nvim/mark.h"
 #include "nvim/mark_defs.h"
 #include "nvim/mbyte.h"
@@ -81,6 +83,8 @@ struct regprog {
   unsigned re_engine;  ///< Automatic, backtracking or NFA engine.
   unsigned re_flags;   ///< Second argument for vim_regcomp().
   bool re_in_use;      ///< prog is being executed
+  int re_refcount;     ///< users of a prog kept by vim_regcomp(), zero when
+                       ///< it isn't kept
 };
 
 /// Structure used by the back track matcher.
@@ -93,6 +97,7 @@ typedef struct {
   unsigned re_engine;
   unsigned re_flags;
   bool re_in_use;
+  int re_refcount;
 
   int regstart;
   uint8_t reganch;
@@ -114,6 +119,8 @@ struct nfa_state {
   int val;
 };
 
+typedef struct nfa_dfa_S nfa_dfa_T;
+
 /// Structure used by the NFA matcher.
 typedef struct {
   // These four members implement regprog_T.
@@ -122,22 +129,71 @@ typedef struct {
   unsigned re_engine;
   unsigned re_flags;
   bool re_in_use;
+  int re_refcount;
 
   nfa_state_T *start;   ///< points into state[]
 
   int reganch;          ///< pattern starts with ^
   int regstart;         ///< char at start of pattern
   uint8_t *match_text;  ///< plain text to match with
+  uint8_t *regmust;     ///< ASCII text that a match must contain, or NULL
+  int regmlen;          ///< length of "regmust"
 
   int has_zend;         ///< pattern contains \ze
   int has_backref;      ///< pattern contains \1 .. \9
   int reghasz;
   char *pattern;
   int nsubexp;          ///< number of ()
+  bool dfa_usable;      ///< the lazy DFA can be used, see nfa_dfa_search()
+  nfa_dfa_T *dfa;       ///< lazy DFA, NULL until first used
   int nstate;
   nfa_state_T state[];
 } nfa_regprog_T;
 
+enum {
+  /// Characters below this have their transitions cached in the lazy DFA.
+  NFA_DFA_NCHARS = 128,
+};
+
+/// State of the lazy DFA: the set of NFA states reached after matching a
+/// character, before following the transitions that do not consume one.
+typedef struct nfa_dstate_S nfa_dstate_T;
+struct nfa_dstate_S {
+  nfa_dstate_T *next[NFA_DFA_NCHARS];  ///< state after a character, NULL if
+                                       ///< not computed yet
+  int nids;
+  int key[];  ///< key[0] is true at the start of the line, followed by
+              ///< "nids" sorted indexes in nfa_regprog_T.state[]
+};
+
+/// Lazily built DFA for an NFA program.  States are added when they are first
+/// reached and all of them are dropped when they use more than 'maxmempattern'.
+struct nfa_dfa_S {
+  Map(String, int) map;                ///< state key -> index in "states" + 1
+  kvec_t(nfa_dstate_T *) states;
+  size_t mem;                          ///< memory used by "states"
+  int flushes;                         ///< number of times "states" was cleared
+  int flushed_nstates;                 ///< number of states at the last clear
+  bool ic;                             ///< rex.reg_ic used for the transitions
+  unsigned gen;                        ///< current mark in "seen" and "added"
+  unsigned *seen;                      ///< per NFA state, visited mark
+  unsigned *added;                     ///< per NFA state, in "key" mark
+  nfa_state_T **stack;                 ///< states to visit
+  int *key;                            ///< key being built
+};
+
+enum {
+  /// Number of compiled patterns kept by vim_regcomp().
+  REGCACHE_SIZE = 32,
+};
+
+/// Entry in the cache of compiled patterns, see vim_regcomp().
+typedef struct {
+  char *key;      ///< see regcache_key(), NULL for an unused entry
+  regprog_T *prog;
+  uint64_t used;  ///< "regcache_tick" when last returned
+} regcache_T;
+
 struct regengine {
   /// bt_regcomp or nfa_regcomp
   regprog_T *(*regcomp)(uint8_t *, int);
@@ -5412,6 +5468,7 @@ static regprog_T *bt_regcomp(uint8_t *expr, int re_flags)
   // Allocate space.
   bt_regprog_T *r = xmalloc(offsetof(bt_regprog_T, program) + (size_t)regsize);
   r->re_in_use = false;
+  r->re_refcount = 0;
 
   // Second pass: emit code.
   regcomp_start(expr, re_flags);
@@ -8706,6 +8763,143 @@ static uint8_t *nfa_get_match_text(nfa_state_T *start)
   return ret;
 }
 
+/// Return true if "p" is a literal character that nfa_set_regmust() can use.
+static bool nfa_is_must_char(const nfa_state_T *p)
+{
+  return p->c > 0 && p->c < 0x80 && p->c != NL;
+}
+
+/// Return true if "p" matches without consuming text and has only one next
+/// state.
+static bool nfa_is_must_gap(const nfa_state_T *p)
+{
+  return p->c == NFA_EMPTY || p->c == NFA_NOPEN || p->c == NFA_NCLOSE
+         || p->c == NFA_ZSTART || p->c == NFA_ZEND
+         || (p->c >= NFA_MOPEN && p->c <= NFA_MCLOSE9)
+         || (p->c >= NFA_ZOPEN && p->c <= NFA_ZCLOSE9);
+}
+
+/// Check whether NFA_MATCH can be reached from the start of "prog" without
+/// going through "skip".  Collections are stepped over.  States with their
+/// "mark[]" equal to "gen" have been visited, the caller uses this when
+/// "skip" is NULL.
+///
+/// @return  1 when NFA_MATCH can be reached, 0 when not, -1 for a state that
+///          looks around or matches a line break.
+static int nfa_must_reach(const nfa_regprog_T *prog, const nfa_state_T *skip, int *mark, int gen,
+                          const nfa_state_T **stack)
+{
+  int sp = 0;
+  bool found = false;
+
+  stack[sp++] = prog->start;
+  mark[prog->start - prog->state] = gen;
+  while (sp > 0) {
+    const nfa_state_T *p = stack[--sp];
+    const nfa_state_T *next[2] = { p->out, NULL };
+    const int c = p->c;
+
+    if (c == NFA_MATCH) {
+      found = true;
+      continue;
+    } else if (c == NFA_SPLIT) {
+      next[1] = p->out1;
+    } else if (c == NFA_START_COLL || c == NFA_START_NEG_COLL) {
+      next[0] = p->out1->out;
+    } else if (!(c >= 0 || nfa_is_must_gap(p)
+                 || c == NFA_BOL || c == NFA_EOL || c == NFA_BOW || c == NFA_EOW
+                 || c == NFA_BOF || c == NFA_EOF || c == NFA_SKIP
+                 || (c >= NFA_BACKREF1 && c <= NFA_ZREF9)
+                 || (c >= NFA_ANY && c <= NFA_NUPPER_IC)
+                 || (c >= NFA_CURSOR && c <= NFA_VISUAL))) {
+      return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+      if (next[i] != NULL && next[i] != skip && mark[next[i] - prog->state] != gen) {
+        mark[next[i] - prog->state] = gen;
+        stack[sp++] = next[i];
+      }
+    }
+  }
+  return found ? 1 : 0;
+}
+
+/// Find the longest text that every match of "prog" contains and put it in
+/// "prog->regmust", so that nfa_regexec_both() can quickly skip lines that
+/// don't contain it.  A character is required when NFA_MATCH cannot be
+/// reached without it.  Only ASCII characters are used, so that the text is
+/// the same in every encoding of the line and in both cases with 'ignorecase'.
+static void nfa_set_regmust(nfa_regprog_T *prog)
+{
+  prog->regmust = NULL;
+  prog->regmlen = 0;
+  // Each required character takes a walk over the states, avoid that for
+  // very long patterns.
+  if (prog->nstate > 500) {
+    return;
+  }
+
+  const int n = prog->nstate;
+  int *mark = xcalloc((size_t)n, sizeof(*mark));
+  const nfa_state_T **stack = xmalloc((size_t)n * sizeof(*stack));
+  bool *required = xcalloc((size_t)n, sizeof(*required));
+
+  if (nfa_must_reach(prog, NULL, mark, 1, stack) != 1) {
+    goto theend;
+  }
+  // Only states visited above are outside of collections.
+  for (int i = 0; i < n; i++) {
+    required[i] = mark[i] == 1 && nfa_is_must_char(&prog->state[i]);
+  }
+  int gen = 1;
+  for (int i = 0; i < n; i++) {
+    if (required[i]) {
+      required[i] = nfa_must_reach(prog, &prog->state[i], mark, ++gen, stack) == 0;
+    }
+  }
+
+  // Required characters that directly follow each other are one text.
+  int best = -1;
+  int bestlen = 0;
+  for (int i = 0; i < n; i++) {
+    if (!required[i]) {
+      continue;
+    }
+    int len = 1;
+    for (const nfa_state_T *p = prog->state[i].out; len < n; p = p->out) {
+      if (nfa_is_must_gap(p)) {
+        continue;
+      }
+      if (!nfa_is_must_char(p) || !required[p - prog->state]) {
+        break;
+      }
+      len++;
+    }
+    // Prefer later text, the start is often checked with regstart.
+    if (len >= bestlen) {
+      best = i;
+      bestlen = len;
+    }
+  }
+
+  if (best >= 0) {
+    uint8_t *s = xmallocz((size_t)bestlen);
+    const nfa_state_T *p = &prog->state[best];
+    for (int i = 0; i < bestlen; p = p->out) {
+      if (!nfa_is_must_gap(p)) {
+        s[i++] = (uint8_t)p->c;
+      }
+    }
+    prog->regmust = s;
+    prog->regmlen = bestlen;
+  }
+
+theend:
+  xfree(mark);
+  xfree(stack);
+  xfree(required);
+}
+
 // Allocate more space for post_start.  Called when
 // running above the estimated number of states.
 static void realloc_post_list(void)
@@ -15450,6 +15644,405 @@ theend:
   return nfa_match;
 }
 
+/// Check whether the lazy DFA can be used for "prog": it only handles states
+/// that match one character, "^", "$" and states that do not consume
+/// anything.  States that look around, use options or match a line break are
+/// left to the NFA.
+static bool nfa_dfa_usable(const nfa_regprog_T *prog)
+{
+  if (prog->has_backref || prog->reganch) {
+    return false;
+  }
+  for (int i = 0; i < prog->nstate; i++) {
+    const int c = prog->state[i].c;
+    if (c >= 0) {
+      continue;
+    }
+    switch (c) {
+    case NFA_SPLIT:
+    case NFA_MATCH:
+    case NFA_EMPTY:
+    case NFA_START_COLL:
+    case NFA_END_COLL:
+    case NFA_START_NEG_COLL:
+    case NFA_RANGE_MIN:
+    case NFA_RANGE_MAX:
+    case NFA_BOL:
+    case NFA_EOL:
+    case NFA_ZSTART:
+    case NFA_ZEND:
+    case NFA_NOPEN:
+    case NFA_NCLOSE:
+    case NFA_ANY:
+    case NFA_CLASS_ALNUM:
+    case NFA_CLASS_ALPHA:
+    case NFA_CLASS_BLANK:
+    case NFA_CLASS_CNTRL:
+    case NFA_CLASS_DIGIT:
+    case NFA_CLASS_GRAPH:
+    case NFA_CLASS_LOWER:
+    case NFA_CLASS_PUNCT:
+    case NFA_CLASS_SPACE:
+    case NFA_CLASS_UPPER:
+    case NFA_CLASS_XDIGIT:
+    case NFA_CLASS_TAB:
+    case NFA_CLASS_RETURN:
+    case NFA_CLASS_BACKSPACE:
+    case NFA_CLASS_ESCAPE:
+      break;
+    default:
+      if ((c >= NFA_MOPEN && c <= NFA_MCLOSE9)
+          || (c >= NFA_ZOPEN && c <= NFA_ZCLOSE9)
+          || (c >= NFA_WHITE && c <= NFA_NUPPER_IC)) {
+        break;
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+static nfa_dfa_T *nfa_dfa_new(const nfa_regprog_T *prog)
+{
+  nfa_dfa_T *dfa = xcalloc(1, sizeof(*dfa));
+  size_t n = (size_t)prog->nstate;
+  dfa->seen = xcalloc(n, sizeof(*dfa->seen));
+  dfa->added = xcalloc(n, sizeof(*dfa->added));
+  dfa->stack = xmalloc(n * sizeof(*dfa->stack));
+  dfa->key = xmalloc((n + 1) * sizeof(*dfa->key));
+  return dfa;
+}
+
+/// Drop all states of "dfa".
+static void nfa_dfa_clear(nfa_dfa_T *dfa)
+{
+  map_destroy(String, &dfa->map);
+  dfa->flushed_nstates = (int)kv_size(dfa->states);
+  for (size_t i = 0; i < kv_size(dfa->states); i++) {
+    xfree(kv_A(dfa->states, i));
+  }
+  kv_size(dfa->states) = 0;
+  dfa->mem = 0;
+  dfa->flushes++;
+}
+
+static void nfa_dfa_free(nfa_dfa_T *dfa)
+{
+  if (dfa == NULL) {
+    return;
+  }
+  nfa_dfa_clear(dfa);
+  kv_destroy(dfa->states);
+  xfree(dfa->seen);
+  xfree(dfa->added);
+  xfree(dfa->stack);
+  xfree(dfa->key);
+  xfree(dfa);
+}
+
+/// Find the state with "key" of "nids" NFA states, adding it when it does
+/// not exist yet.  May clear all other states.
+static nfa_dstate_T *nfa_dfa_add_state(nfa_dfa_T *dfa, const int *key, int nids)
+{
+  String k = { .data = (char *)key, .size = (size_t)(nids + 1) * sizeof(int) };
+  int idx = map_get(String, int)(&dfa->map, k);
+  if (idx > 0) {
+    return kv_A(dfa->states, idx - 1);
+  }
+
+  size_t size = offsetof(nfa_dstate_T, key) + k.size;
+  if ((int64_t)((dfa->mem + size) >> 10) >= p_mmp) {
+    nfa_dfa_clear(dfa);
+  }
+  nfa_dstate_T *d = xcalloc(1, size);
+  d->nids = nids;
+  memcpy(d->key, key, k.size);
+  kv_push(dfa->states, d);
+  dfa->mem += size;
+  k.data = (char *)d->key;
+  map_put(String, int)(&dfa->map, k, (int)kv_size(dfa->states));
+  return d;
+}
+
+/// Check whether "state", which consumes a character, matches "c".  Must be
+/// the same as what nfa_regmatch() does for the states accepted by
+/// nfa_dfa_usable().
+static bool nfa_dfa_char_match(const nfa_state_T *state, int c)
+{
+  switch (state->c) {
+  case NFA_ANY:
+    return c > 0;
+
+  case NFA_START_COLL:
+  case NFA_START_NEG_COLL: {
+    const bool result_if_matched = state->c == NFA_START_COLL;
+    for (state = state->out; state->c != NFA_END_COLL; state = state->out) {
+      if (state->c == NFA_RANGE_MIN) {
+        int c1 = state->val;
+        state = state->out;  // advance to NFA_RANGE_MAX
+        const int c2 = state->val;
+        if (c >= c1 && c <= c2) {
+          return result_if_matched;
+        }
+        if (rex.reg_ic) {
+          const int c_low = utf_fold(c);
+          for (; c1 <= c2; c1++) {
+            if (utf_fold(c1) == c_low) {
+              return result_if_matched;
+            }
+          }
+        }
+      } else if (state->c < 0 ? check_char_class(state->c, c)
+                              : (c == state->c
+                                 || (rex.reg_ic && utf_fold(c) == utf_fold(state->c)))) {
+        return result_if_matched;
+      }
+    }
+    return !result_if_matched;
+  }
+
+  case NFA_WHITE:
+    return ascii_iswhite(c);
+  case NFA_NWHITE:
+    return c != NUL && !ascii_iswhite(c);
+  case NFA_DIGIT:
+    return ri_digit(c);
+  case NFA_NDIGIT:
+    return c != NUL && !ri_digit(c);
+  case NFA_HEX:
+    return ri_hex(c);
+  case NFA_NHEX:
+    return c != NUL && !ri_hex(c);
+  case NFA_OCTAL:
+    return ri_octal(c);
+  case NFA_NOCTAL:
+    return c != NUL && !ri_octal(c);
+  case NFA_WORD:
+    return ri_word(c);
+  case NFA_NWORD:
+    return c != NUL && !ri_word(c);
+  case NFA_HEAD:
+    return ri_head(c);
+  case NFA_NHEAD:
+    return c != NUL && !ri_head(c);
+  case NFA_ALPHA:
+    return ri_alpha(c);
+  case NFA_NALPHA:
+    return c != NUL && !ri_alpha(c);
+  case NFA_LOWER:
+    return ri_lower(c);
+  case NFA_NLOWER:
+    return c != NUL && !ri_lower(c);
+  case NFA_UPPER:
+    return ri_upper(c);
+  case NFA_NUPPER:
+    return c != NUL && !ri_upper(c);
+  case NFA_LOWER_IC:
+    return ri_lower(c) || (rex.reg_ic && ri_upper(c));
+  case NFA_NLOWER_IC:
+    return c != NUL && !(ri_lower(c) || (rex.reg_ic && ri_upper(c)));
+  case NFA_UPPER_IC:
+    return ri_upper(c) || (rex.reg_ic && ri_lower(c));
+  case NFA_NUPPER_IC:
+    return c != NUL && !(ri_upper(c) || (rex.reg_ic && ri_lower(c)));
+
+  default:  // regular character
+    return state->c == c || (rex.reg_ic && utf_fold(state->c) == utf_fold(c));
+  }
+}
+
+static int nfa_dfa_key_cmp(const void *a, const void *b)
+{
+  const int x = *(const int *)a;
+  const int y = *(const int *)b;
+  return x < y ? -1 : x > y;
+}
+
+/// Marker returned by nfa_dfa_next() when a match ends before the character.
+static nfa_dstate_T nfa_dfa_matched;
+
+/// Compute the lazy DFA state after character "c" in state "d": follow the
+/// transitions that do not consume a character from the NFA states of "d" and
+/// from the start state, then keep the states after the ones matching "c".
+///
+/// @return  &nfa_dfa_matched when a match ends before "c", otherwise the next
+///          state, or NULL when "c" is NUL.
+static nfa_dstate_T *nfa_dfa_next(nfa_regprog_T *prog, nfa_dfa_T *dfa, const nfa_dstate_T *d,
+                                  int c)
+{
+  if (++dfa->gen == 0) {
+    memset(dfa->seen, 0, (size_t)prog->nstate * sizeof(*dfa->seen));
+    memset(dfa->added, 0, (size_t)prog->nstate * sizeof(*dfa->added));
+    dfa->gen = 1;
+  }
+  const unsigned gen = dfa->gen;
+  const bool bol = d->key[0];
+  int sp = 0;
+  int nids = 0;
+
+#define DFA_PUSH(s) \
+  do { \
+    nfa_state_T *s_ = (s); \
+    if (dfa->seen[s_ - prog->state] != gen) { \
+      dfa->seen[s_ - prog->state] = gen; \
+      dfa->stack[sp++] = s_; \
+    } \
+  } while (0)
+
+  DFA_PUSH(prog->start);
+  for (int i = 1; i <= d->nids; i++) {
+    DFA_PUSH(&prog->state[d->key[i]]);
+  }
+
+  while (sp > 0) {
+    nfa_state_T *state = dfa->stack[--sp];
+    switch (state->c) {
+    case NFA_MATCH:
+      return &nfa_dfa_matched;
+
+    case NFA_SPLIT:
+      DFA_PUSH(state->out);
+      DFA_PUSH(state->out1);
+      break;
+
+    case NFA_BOL:
+      if (bol) {
+        DFA_PUSH(state->out);
+      }
+      break;
+
+    case NFA_EOL:
+      if (c == NUL) {
+        DFA_PUSH(state->out);
+      }
+      break;
+
+    case NFA_EMPTY:
+    case NFA_ZSTART:
+    case NFA_ZEND:
+    case NFA_NOPEN:
+    case NFA_NCLOSE:
+      DFA_PUSH(state->out);
+      break;
+
+    default:
+      if ((state->c >= NFA_MOPEN && state->c <= NFA_MCLOSE9)
+          || (state->c >= NFA_ZOPEN && state->c <= NFA_ZCLOSE9)) {
+        DFA_PUSH(state->out);
+      } else if (c != NUL && nfa_dfa_char_match(state, c)) {
+        // The state after a collection is in out of the NFA_END_COLL.
+        nfa_state_T *next = (state->c == NFA_START_COLL || state->c == NFA_START_NEG_COLL)
+                            ? state->out1->out : state->out;
+        const int id = (int)(next - prog->state);
+        if (dfa->added[id] != gen) {
+          dfa->added[id] = gen;
+          dfa->key[++nids] = id;
+        }
+      }
+      break;
+    }
+  }
+#undef DFA_PUSH
+
+  if (c == NUL) {
+    return NULL;
+  }
+  dfa->key[0] = false;
+  qsort(dfa->key + 1, (size_t)nids, sizeof(*dfa->key), nfa_dfa_key_cmp);
+  return nfa_dfa_add_state(dfa, dfa->key, nids);
+}
+
+/// Run the lazy DFA of "prog" over the line from column "*colp", to find out
+/// quickly whether the pattern matches there.  Used for patterns where
+/// nfa_dfa_usable() is true, when the NFA would follow every state for every
+/// character.
+///
+/// @param tm         timeout limit or NULL
+/// @param timed_out  flag set on timeout or NULL
+///
+/// @return  FAIL when there is no match, OK when there is a match, "*colp"
+///          is then moved to a column no match starts before.  NOTDONE when
+///          the NFA must find out.
+static int nfa_dfa_search(nfa_regprog_T *prog, colnr_T *colp, proftime_T *tm, int *timed_out)
+{
+  if (prog->dfa == NULL) {
+    prog->dfa = nfa_dfa_new(prog);
+  }
+  nfa_dfa_T *dfa = prog->dfa;
+  if (dfa->ic != rex.reg_ic) {
+    // Character transitions depend on ignoring case.
+    nfa_dfa_clear(dfa);
+    dfa->ic = rex.reg_ic;
+  }
+  nfa_time_limit = tm;
+  nfa_timed_out = timed_out;
+
+  const uint8_t *p = rex.line + *colp;
+  const uint8_t *start = p;  // no match starts before this
+  const uint8_t *flush_p = p;
+  int count = 0;
+  const int init_key = *colp == 0;
+  nfa_dstate_T *d = nfa_dfa_add_state(dfa, &init_key, 0);
+  int flushes = dfa->flushes;
+
+  while (true) {
+    int c;
+    int len;
+    if (*p < 0x80 && (*p == NUL || p[1] < 0x80)) {
+      c = *p;
+      len = 1;
+    } else {
+      c = utf_ptr2char((char *)p);
+      len = utf_ptr2len((char *)p);
+      // The NFA handles composing characters depending on the state.
+      if (utf_iscomposing(c) || utfc_ptr2len((char *)p) != len) {
+        return NOTDONE;
+      }
+    }
+    if (d->nids == 0) {
+      // All threads that started before this character have ended.
+      start = p;
+    }
+    if (c == NUL) {
+      if (nfa_dfa_next(prog, dfa, d, NUL) == &nfa_dfa_matched) {
+        *colp = (colnr_T)(start - rex.line);
+        return OK;
+      }
+      return FAIL;
+    }
+
+    nfa_dstate_T *next = c < NFA_DFA_NCHARS ? d->next[c] : NULL;
+    if (next == NULL) {
+      next = nfa_dfa_next(prog, dfa, d, c);
+      if (dfa->flushes != flushes) {
+        // "d" was freed.  Let the NFA do the work when the states keep
+        // changing.
+        if (p - flush_p < 10 * (ptrdiff_t)dfa->flushed_nstates) {
+          return NOTDONE;
+        }
+        flushes = dfa->flushes;
+        flush_p = p;
+      } else if (c < NFA_DFA_NCHARS) {
+        d->next[c] = next;
+      }
+    }
+    if (next == &nfa_dfa_matched) {
+      *colp = (colnr_T)(start - rex.line);
+      return OK;
+    }
+    d = next;
+    p += len;
+
+    if (++count == 4096) {
+      count = 0;
+      reg_breakcheck();
+      if (got_int || nfa_did_time_out()) {
+        return FAIL;
+      }
+    }
+  }
+}
+
 /// Try match of "prog" with at rex.line["col"].
 ///
 /// @param tm         timeout limit or NULL
@@ -15618,6 +16211,21 @@ static int nfa_regexec_both(uint8_t *line, colnr_T startcol, proftime_T *tm, int
     rex.reg_icombine = true;
   }
 
+  // If there is a "must appear" text, look for it.  When it is not found
+  // there is no match, unless the line has a multibyte character: the engine
+  // skips composing characters between two characters of the text.
+  if (prog->regmust != NULL && !rex.reg_icombine) {
+    size_t len = REG_MULTI ? (size_t)reg_getline_len(0) : strlen((char *)line);
+    if ((size_t)col <= len) {
+      const uint8_t *s = line + col;
+      len -= (size_t)col;
+      if (xmemmem(s, len, prog->regmust, (size_t)prog->regmlen, rex.reg_ic) == NULL
+          && xmemisascii(s, len)) {
+        return 0;
+      }
+    }
+  }
+
   rex.line = line;
   rex.lnum = 0;  // relative to line
 
@@ -15669,6 +16277,13 @@ static int nfa_regexec_both(uint8_t *line, colnr_T startcol, proftime_T *tm, int
     goto theend;
   }
 
+  // Find out with the lazy DFA whether there is a match at all, and skip the
+  // text where none can start.
+  if (prog->dfa_usable && !rex.reg_icombine && !rex.reg_line_lbr && rex.reg_maxcol == 0
+      && nfa_dfa_search(prog, &col, tm, timed_out) == FAIL) {
+    goto theend;
+  }
+
   // Set the "nstate" used by nfa_regcomp() to zero to trigger an error when
   // it's accidentally used during execution.
   nstate = 0;
@@ -15763,6 +16378,8 @@ static regprog_T *nfa_regcomp(uint8_t *expr, int re_flags)
   prog = xmalloc(prog_size);
   state_ptr = prog->state;
   prog->re_in_use = false;
+  prog->re_refcount = 0;
+  prog->dfa = NULL;
 
   // PASS 2
   // Build the NFA
@@ -15782,6 +16399,8 @@ static regprog_T *nfa_regcomp(uint8_t *expr, int re_flags)
   prog->reganch = nfa_get_reganch(prog->start, 0);
   prog->regstart = nfa_get_regstart(prog->start, 0);
   prog->match_text = nfa_get_match_text(prog->start);
+  nfa_set_regmust(prog);
+  prog->dfa_usable = nfa_dfa_usable(prog);
 
 #ifdef REGEXP_DEBUG
   nfa_postfix_dump(expr, OK);
@@ -15817,7 +16436,9 @@ static void nfa_regfree(regprog_T *prog)
   }
 
   xfree(((nfa_regprog_T *)prog)->match_text);
+  xfree(((nfa_regprog_T *)prog)->regmust);
   xfree(((nfa_regprog_T *)prog)->pattern);
+  nfa_dfa_free(((nfa_regprog_T *)prog)->dfa);
   xfree(prog);
 }
 
@@ -15920,11 +16541,121 @@ static uint8_t regname[][30] = {
 };
 #endif
 
-// Compile a regular expression into internal code.
-// Returns the program in allocated memory.
-// Use vim_regfree() to free the memory.
-// Returns NULL for an error.
+/// Compiled patterns kept by vim_regcomp(), so that a pattern that is used
+/// over and over (searching, autocommand patterns, 'hlsearch') is only
+/// compiled once.  The least recently used one is dropped when the cache is
+/// full.
+static regcache_T regcache[REGCACHE_SIZE];
+static PMap(cstr_t) regcache_map = MAP_INIT;  ///< key -> entry in regcache[]
+static uint64_t regcache_tick = 0;
+
+/// Return true when compiling "expr" only depends on the arguments of
+/// vim_regcomp() and the options in regcache_key().  Not for "~" (the last
+/// substitute string), "[:keyword:]" and friends (options of the current
+/// buffer) and "\%.l" (the cursor position).
+static bool regcache_usable(const char *expr)
+{
+  return strchr(expr, '~') == NULL && strstr(expr, "[:") == NULL && strstr(expr, "%.") == NULL;
+}
+
+/// Return the cache key for compiling "expr" with "re_flags", in allocated
+/// memory.
+static char *regcache_key(const char *expr, int re_flags)
+{
+  const bool cpo_lit = vim_strchr(p_cpo, CPO_LITERAL) != NULL;
+  size_t len = strlen(expr);
+  char *key = xmalloc(len + 32);
+  int n = snprintf(key, 32, "%d %d %d %d ", re_flags, (int)p_re, reg_do_extmatch, cpo_lit);
+  memcpy(key + n, expr, len + 1);
+  return key;
+}
+
+/// Drop the reference of the cache to the prog of "entry" and clear it.
+static void regcache_clear_entry(regcache_T *entry)
+{
+  pmap_del(cstr_t)(&regcache_map, entry->key, NULL);
+  XFREE_CLEAR(entry->key);
+  vim_regfree(entry->prog);
+  entry->prog = NULL;
+}
+
+/// Drop all patterns kept by vim_regcomp().
+void vim_regcache_clear(void)
+{
+  for (int i = 0; i < REGCACHE_SIZE; i++) {
+    if (regcache[i].key != NULL) {
+      regcache_clear_entry(&regcache[i]);
+    }
+  }
+}
+
+/// Keep "prog", compiled for "key", in the cache.  Takes over "key".
+static void regcache_add(char *key, regprog_T *prog)
+{
+  regcache_T *entry = &regcache[0];
+  for (int i = 0; i < REGCACHE_SIZE; i++) {
+    if (regcache[i].key == NULL) {
+      entry = &regcache[i];
+      break;
+    }
+    if (regcache[i].used < entry->used) {
+      entry = &regcache[i];
+    }
+  }
+  if (entry->key != NULL) {
+    regcache_clear_entry(entry);
+    g_stats.regexp_cache_evict++;
+  }
+
+  // One reference for the cache and one for the caller.
+  prog->re_refcount = 2;
+  entry->key = key;
+  entry->prog = prog;
+  entry->used = ++regcache_tick;
+  pmap_put(cstr_t)(&regcache_map, key, entry);
+}
+
+/// Compile a regular expression into internal code.
+/// A pattern that was compiled before with the same flags and options is
+/// shared, unless it is being executed.  Its users must not change it.
+///
+/// @return  the program in allocated memory, NULL for an error.
+///          Use vim_regfree() to free it.
 regprog_T *vim_regcomp(const char *expr_arg, int re_flags)
+{
+  if (!regcache_usable(expr_arg)) {
+    return vim_regcomp_nocache(expr_arg, re_flags);
+  }
+
+  char *key = regcache_key(expr_arg, re_flags);
+  regcache_T *entry = pmap_get(cstr_t)(&regcache_map, key);
+  if (entry != NULL) {
+    xfree(key);
+    if (entry->prog->re_in_use) {
+      // Cannot share a prog that is being executed.
+      return vim_regcomp_nocache(expr_arg, re_flags);
+    }
+    g_stats.regexp_cache_hit++;
+    entry->used = ++regcache_tick;
+    entry->prog->re_refcount++;
+    return entry->prog;
+  }
+
+  g_stats.regexp_cache_miss++;
+  const int called_emsg_before = called_emsg;
+  regprog_T *prog = vim_regcomp_nocache(expr_arg, re_flags);
+  if (prog == NULL || called_emsg != called_emsg_before) {
+    // Don't keep it when there was a message, it must be given again.
+    xfree(key);
+    return prog;
+  }
+  regcache_add(key, prog);
+  return prog;
+}
+
+/// Compile a regular expression into internal code, without using the cache
+/// of vim_regcomp().
+static regprog_T *vim_regcomp_nocache(const char *expr_arg, int re_flags)
 {
   regprog_T *prog = NULL;
   const char *expr = expr_arg;
@@ -16005,9 +16736,13 @@ regprog_T *vim_regcomp(const char *expr_arg, int re_flags)
 }
 
 // Free a compiled regexp program, returned by vim_regcomp().
+// When it is shared only drop one reference.
 void vim_regfree(regprog_T *prog)
 {
   if (prog != NULL) {
+    if (prog->re_refcount > 0 && --prog->re_refcount > 0) {
+      return;
+    }
     prog->engine->regfree(prog);
   }
 }
@@ -16015,6 +16750,8 @@ void vim_regfree(regprog_T *prog)
 #if defined(EXITFREE)
 void free_regexp_stuff(void)
 {
+  vim_regcache_clear();
+  map_destroy(cstr_t, &regcache_map);
   ga_clear(&regstack);
   ga_clear(&backpos);
   xfree(reg_tofree);
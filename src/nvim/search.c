@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "klib/kvec.h"
 #include "nvim/ascii_defs.h"
 #include "nvim/autocmd.h"
 #include "nvim/autocmd_defs.h"
@@ -40,6 +41,7 @@
 #include "nvim/mbyte.h"
 #include "nvim/mbyte_defs.h"
 #include "nvim/memline.h"
+#include "nvim/memline_defs.h"
 #include "nvim/memory.h"
 #include "nvim/message.h"
 #include "nvim/mouse.h"
@@ -63,6 +65,20 @@
 #include "nvim/vim_defs.h"
 #include "nvim/window.h"
 
+/// A match of the last used search pattern, for the search count.
+typedef struct {
+  pos_T start;
+  pos_T end;
+  pos_T maxend;  ///< largest end of this and the matches before it
+} searchstat_match_T;
+
+/// A change of lines "lnum" to "lnume" (exclusive) that added "xtra" lines.
+typedef struct {
+  linenr_T lnum;
+  linenr_T lnume;
+  linenr_T xtra;
+} searchstat_change_T;
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "search.c.generated.h"
 #endif
@@ -301,6 +317,10 @@ void free_search_patterns(void)
 
   XFREE_CLEAR(mr_pattern);
   mr_patternlen = 0;
+
+  search_stat_clear();
+  kv_destroy(ss_index.matches);
+  kv_destroy(ss_index.changes);
 }
 
 #endif
@@ -2692,6 +2712,330 @@ static void cmdline_search_stat(int dirc, pos_T *pos, pos_T *cursor_pos, bool sh
   msg_hist_off = false;
 }
 
+/// Maximum number of changes that are remembered for updating the matches
+/// for the search count, with more changes searching the whole buffer again
+/// is not much slower.
+enum { SEARCH_STAT_MAX_CHANGES = 100, };
+
+/// Matches of the last used search pattern in one buffer, kept for the search
+/// count.  Changes to the text are remembered by search_stat_changed() and
+/// applied when the count is needed again, only the changed lines are
+/// searched then.
+static struct {
+  buf_T *buf;                   ///< buffer of the matches, NULL if none
+  handle_T handle;              ///< handle of "buf"
+  uint64_t text_gen;            ///< ml_text_gen of "buf" for the matches
+  varnumber_T changedtick;      ///< b:changedtick of "buf" for the matches
+  search_pat_key_T key;         ///< the pattern and options
+  bool line_local;              ///< matches do not span lines and only
+                                ///< depend on the text of their line
+  bool complete;                ///< all matches in the buffer were found
+  kvec_t(searchstat_match_T) matches;
+  kvec_t(searchstat_change_T) changes;
+} ss_index = { .buf = NULL };
+
+static void search_stat_clear(void)
+{
+  ss_index.buf = NULL;
+  search_pat_key_clear(&ss_index.key);
+  ss_index.complete = false;
+  kv_size(ss_index.matches) = 0;
+  kv_size(ss_index.changes) = 0;
+}
+
+/// Called when lines "lnum" to "lnume" (exclusive) of "buf" were changed and
+/// "xtra" lines were added, after b:changedtick was incremented.
+void search_stat_changed(buf_T *buf, linenr_T lnum, linenr_T lnume, linenr_T xtra)
+{
+  if (ss_index.buf != buf) {
+    return;
+  }
+  // Only when nothing else changed since the matches were found.
+  if (ss_index.handle != buf->handle
+      || buf_get_changedtick(buf) != ss_index.changedtick + 1
+      || !ss_index.complete || !ss_index.line_local
+      || kv_size(ss_index.changes) >= SEARCH_STAT_MAX_CHANGES
+      || (buf->b_ml.ml_flags & ML_EMPTY)) {
+    search_stat_clear();
+    return;
+  }
+  kv_push(ss_index.changes, ((searchstat_change_T){ lnum, lnume, xtra }));
+  ss_index.changedtick = buf_get_changedtick(buf);
+  ss_index.text_gen = buf->b_ml.ml_text_gen;
+}
+
+/// Drop the matches for the search count when they are not for the current
+/// buffer and the last used search pattern.
+static void search_stat_check(void)
+{
+  if (ss_index.buf != NULL
+      && ss_index.buf == curbuf
+      && ss_index.handle == curbuf->handle
+      && ss_index.text_gen == curbuf->b_ml.ml_text_gen
+      && search_pat_key_equal(&ss_index.key, curbuf)) {
+    // The text did not change, "b:changedtick" may have.
+    ss_index.changedtick = buf_get_changedtick(curbuf);
+    return;
+  }
+
+  search_stat_clear();
+  if (!search_pat_key_set(&ss_index.key, curbuf, &ss_index.line_local)) {
+    return;
+  }
+  ss_index.buf = curbuf;
+  ss_index.handle = curbuf->handle;
+  ss_index.text_gen = curbuf->b_ml.ml_text_gen;
+  ss_index.changedtick = buf_get_changedtick(curbuf);
+}
+
+/// Check if "key" was set for the last used search pattern and "buf" with the
+/// current option values.
+bool search_pat_key_equal(const search_pat_key_T *key, const buf_T *buf)
+  FUNC_ATTR_NONNULL_ALL
+{
+  const SearchPattern *spat = &spats[last_idx];
+
+  return key->pat != NULL
+         && spat->pat != NULL
+         && strcmp(key->pat, spat->pat) == 0
+         && key->magic == spat->magic
+         && key->no_scs == spat->no_scs
+         && key->ic == p_ic
+         && key->scs == p_scs
+         && key->cpo_search == (vim_strchr(p_cpo, CPO_SEARCH) != NULL)
+         && strcmp(key->isk, buf->b_p_isk) == 0;
+}
+
+/// Set "key" for the last used search pattern and "buf".
+///
+/// @param[out] line_local  set when matches do not span lines and only depend
+///                         on the text of their line, so that after a change
+///                         only the changed lines need to be searched again
+///
+/// @return  false when there is no last used search pattern or its matches
+///          cannot be kept, then "key" is cleared.
+bool search_pat_key_set(search_pat_key_T *key, const buf_T *buf, bool *line_local)
+  FUNC_ATTR_NONNULL_ALL
+{
+  const SearchPattern *spat = &spats[last_idx];
+
+  search_pat_key_clear(key);
+  if (spat->pat == NULL || !search_pat_usable(spat->pat, line_local)) {
+    return false;
+  }
+  key->pat = xstrdup(spat->pat);
+  key->magic = spat->magic;
+  key->no_scs = spat->no_scs;
+  key->ic = p_ic;
+  key->scs = p_scs;
+  key->cpo_search = vim_strchr(p_cpo, CPO_SEARCH) != NULL;
+  key->isk = xstrdup(buf->b_p_isk);
+  return true;
+}
+
+void search_pat_key_clear(search_pat_key_T *key)
+  FUNC_ATTR_NONNULL_ALL
+{
+  XFREE_CLEAR(key->pat);
+  XFREE_CLEAR(key->isk);
+}
+
+/// Check if the matches of "pat" can be kept, they must not depend on the
+/// cursor position, marks, the Visual area or the last substitute string.
+static bool search_pat_usable(const char *pat, bool *line_local)
+{
+  // With "~" the pattern depends on the previous substitute string.
+  if (vim_strchr(pat, '~') != NULL) {
+    return false;
+  }
+  // Look-behind may look in other lines.
+  *line_local = vim_strchr(pat, '@') == NULL;
+  for (const char *p = pat; *p != NUL; p++) {
+    if (*p == '\\' && p[1] != NUL) {
+      p++;
+      if (*p == 'n' || *p == '_') {
+        *line_local = false;
+        continue;
+      }
+    }
+    // Also without a backslash, for "\v".
+    if (*p == '%') {
+      const char *q = p + 1;
+      if (*q == '^' || *q == '$') {
+        *line_local = false;
+        continue;
+      }
+      if (*q == '<' || *q == '>') {
+        q++;
+      }
+      // The cursor, a mark or the Visual area.
+      if (*q == '#' || *q == 'V' || *q == '\'' || *q == '.') {
+        return false;
+      }
+      q = skipdigits(q);
+      if (q > p + 1 && *q == 'l') {
+        *line_local = false;  // a line number
+      }
+    }
+  }
+  return true;
+}
+
+/// @return  index of the first match for the search count that starts in line
+///          "lnum" or below it.
+static size_t search_stat_find_line(linenr_T lnum)
+{
+  size_t lo = 0;
+  size_t hi = kv_size(ss_index.matches);
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (kv_A(ss_index.matches, mid).start.lnum < lnum) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/// Set the "maxend" of the matches for the search count from index "idx".
+static void search_stat_set_maxend(size_t idx)
+{
+  for (size_t i = idx; i < kv_size(ss_index.matches); i++) {
+    searchstat_match_T *m = &kv_A(ss_index.matches, i);
+    m->maxend = m->end;
+    if (i > 0 && lt(m->maxend, kv_A(ss_index.matches, i - 1).maxend)) {
+      m->maxend = kv_A(ss_index.matches, i - 1).maxend;
+    }
+  }
+}
+
+/// Apply the remembered changes to the matches for the search count: drop the
+/// matches in changed lines, move the ones below and search the changed lines
+/// again.
+static void search_stat_apply_changes(void)
+{
+  if (kv_size(ss_index.changes) == 0) {
+    return;
+  }
+
+  // Lines to search again, none when "top" is larger than "bot".
+  linenr_T top = MAXLNUM;
+  linenr_T bot = 0;
+  for (size_t c = 0; c < kv_size(ss_index.changes); c++) {
+    searchstat_change_T ch = kv_A(ss_index.changes, c);
+    size_t n = kv_size(ss_index.matches);
+    size_t i = search_stat_find_line(ch.lnum);
+    size_t j = search_stat_find_line(ch.lnume);
+    if (j > i) {
+      memmove(&kv_A(ss_index.matches, i), &kv_A(ss_index.matches, j),
+              (n - j) * sizeof(searchstat_match_T));
+      n -= j - i;
+      kv_size(ss_index.matches) = n;
+    }
+    if (ch.xtra != 0) {
+      for (size_t k = i; k < n; k++) {
+        kv_A(ss_index.matches, k).start.lnum += ch.xtra;
+        kv_A(ss_index.matches, k).end.lnum += ch.xtra;
+      }
+    }
+
+    if (top <= bot) {
+      top = top < ch.lnum ? top : top >= ch.lnume ? top + ch.xtra : ch.lnum;
+      bot = bot < ch.lnum ? bot : bot >= ch.lnume ? bot + ch.xtra : ch.lnume + ch.xtra - 1;
+    }
+    // The new lines.
+    if (ch.lnume + ch.xtra > ch.lnum) {
+      if (top > bot) {
+        top = ch.lnum;
+        bot = ch.lnume + ch.xtra - 1;
+      } else {
+        top = MIN(top, ch.lnum);
+        bot = MAX(bot, ch.lnume + ch.xtra - 1);
+      }
+    }
+  }
+  kv_size(ss_index.changes) = 0;
+
+  bot = MIN(bot, curbuf->b_ml.ml_line_count);
+  if (top > bot) {
+    search_stat_set_maxend(0);
+    return;
+  }
+
+  // Start at the end of the line above, so that a match in the first line is
+  // found like when searching the whole buffer.
+  kvec_t(searchstat_match_T) found = KV_INITIAL_VALUE;
+  pos_T pos = { top - 1, top > 1 ? MAXCOL : 0, 0 };
+  pos_T endpos = { 0, 0, 0 };
+  searchit_arg_T sia = { .sa_stop_lnum = bot };
+  const int save_ws = p_ws;
+  p_ws = false;
+  while (searchit(curwin, curbuf, &pos, &endpos, FORWARD, NULL, 0, 1, SEARCH_KEEP, RE_LAST,
+                  &sia) != FAIL && pos.lnum <= bot) {
+    if (pos.lnum >= top) {
+      kv_push(found, ((searchstat_match_T){ .start = pos, .end = endpos }));
+    }
+  }
+  p_ws = save_ws;
+
+  size_t i = search_stat_find_line(top);
+  size_t j = search_stat_find_line(bot + 1);
+  size_t n = kv_size(ss_index.matches);
+  size_t newn = n - (j - i) + kv_size(found);
+  kv_ensure_space(ss_index.matches, newn - MIN(n, newn));
+  if (n > j) {
+    memmove(&kv_A(ss_index.matches, i + kv_size(found)), &kv_A(ss_index.matches, j),
+            (n - j) * sizeof(searchstat_match_T));
+  }
+  if (kv_size(found) > 0) {
+    memcpy(&kv_A(ss_index.matches, i), found.items, kv_size(found) * sizeof(searchstat_match_T));
+  }
+  kv_size(ss_index.matches) = newn;
+  kv_destroy(found);
+  search_stat_set_maxend(0);
+}
+
+/// Find matches for the search count after the last one that was found,
+/// until there are no more, more than "maxcount" were found or "timeout"
+/// msec passed.
+///
+/// @return  1 when timed out, 0 otherwise.
+static int search_stat_find_more(int maxcount, int timeout)
+{
+  if (ss_index.complete) {
+    return 0;
+  }
+
+  size_t n = kv_size(ss_index.matches);
+  pos_T lastpos = n > 0 ? kv_A(ss_index.matches, n - 1).start : (pos_T){ 0, 0, 0 };
+  pos_T endpos = { 0, 0, 0 };
+  proftime_T start;
+  int timed_out = 0;
+  const int save_ws = p_ws;
+  p_ws = false;
+  if (timeout > 0) {
+    start = profile_setlimit(timeout);
+  }
+  while (!got_int && (maxcount <= 0 || kv_size(ss_index.matches) <= (size_t)maxcount)) {
+    if (searchit(curwin, curbuf, &lastpos, &endpos, FORWARD, NULL, 0, 1, SEARCH_KEEP, RE_LAST,
+                 NULL) == FAIL) {
+      ss_index.complete = !got_int;
+      break;
+    }
+    // Stop after passing the time limit.
+    if (timeout > 0 && profile_passed_limit(start)) {
+      timed_out = 1;
+      break;
+    }
+    kv_push(ss_index.matches, ((searchstat_match_T){ .start = lastpos, .end = endpos }));
+    fast_breakcheck();
+  }
+  p_ws = save_ws;
+  search_stat_set_maxend(n);
+  return timed_out;
+}
+
 // Add the search count information to "stat".
 // "stat" must not be NULL.
 // When "recompute" is true always recompute the numbers.
@@ -2701,8 +3045,6 @@ static void cmdline_search_stat(int dirc, pos_T *pos, pos_T *cursor_pos, bool sh
 static void update_search_stat(int dirc, pos_T *pos, pos_T *cursor_pos, searchstat_T *stat,
                                bool recompute, int maxcount, int timeout)
 {
-  int save_ws = p_ws;
-  bool wraparound = false;
   pos_T p = (*pos);
   static pos_T lastpos = { 0, 0, 0 };
   static int cur = 0;
@@ -2710,9 +3052,6 @@ static void update_search_stat(int dirc, pos_T *pos, pos_T *cursor_pos, searchst
   static bool exact_match = false;
   static int incomplete = 0;
   static int last_maxcount = SEARCH_STAT_DEF_MAX_COUNT;
-  static int chgtick = 0;
-  static char *lastpat = NULL;
-  static buf_T *lbuf = NULL;
 
   CLEAR_POINTER(stat);
 
@@ -2725,81 +3064,50 @@ static void update_search_stat(int dirc, pos_T *pos, pos_T *cursor_pos, searchst
     return;
   }
   last_maxcount = maxcount;
-  wraparound = ((dirc == '?' && lt(lastpos, p))
-                || (dirc == '/' && lt(p, lastpos)));
-
-  // If anything relevant changed the count has to be recomputed.
-  // STRNICMP ignores case, but we should not ignore case.
-  // Unfortunately, there is no STRNICMP function.
-  // XXX: above comment should be "no MB_STRCMP function" ?
-  if (!(chgtick == buf_get_changedtick(curbuf)
-        && lastpat != NULL  // suppress clang/NULL passed as nonnull parameter
-        && STRNICMP(lastpat, spats[last_idx].pat, strlen(lastpat)) == 0
-        && strlen(lastpat) == strlen(spats[last_idx].pat)
-        && equalpos(lastpos, *cursor_pos)
-        && lbuf == curbuf)
-      || wraparound || cur < 0 || (maxcount > 0 && cur > maxcount)
-      || recompute) {
-    cur = 0;
-    cnt = 0;
-    exact_match = false;
-    incomplete = 0;
-    clearpos(&lastpos);
-    lbuf = curbuf;
-  }
-
-  // when searching backwards and having jumped to the first occurrence,
-  // cur must remain greater than 1
-  if (equalpos(lastpos, *cursor_pos) && !wraparound
-      && (dirc == 0 || dirc == '/' ? cur < cnt : cur > 1)) {
-    cur += dirc == 0 ? 0 : dirc == '/' ? 1 : -1;
-  } else {
-    proftime_T start;
-    bool done_search = false;
-    pos_T endpos = { 0, 0, 0 };
-    p_ws = false;
-    if (timeout > 0) {
-      start = profile_setlimit(timeout);
-    }
-    while (!got_int && searchit(curwin, curbuf, &lastpos, &endpos,
-                                FORWARD, NULL, 0, 1, SEARCH_KEEP, RE_LAST,
-                                NULL) != FAIL) {
-      done_search = true;
-      // Stop after passing the time limit.
-      if (timeout > 0 && profile_passed_limit(start)) {
-        incomplete = 1;
-        break;
-      }
-      cnt++;
-      if (ltoreq(lastpos, p)) {
-        cur = cnt;
-        if (lt(p, endpos)) {
-          exact_match = true;
-        }
-      }
-      fast_breakcheck();
-      if (maxcount > 0 && cnt > maxcount) {
-        incomplete = 2;    // max count exceeded
-        break;
-      }
-    }
-    if (got_int) {
-      cur = -1;  // abort
+
+  // The matches are kept, when the buffer or pattern changed they are found
+  // again.  Then the count is the number of matches starting at or before
+  // "p".
+  search_stat_check();
+  search_stat_apply_changes();
+  incomplete = search_stat_find_more(maxcount, timeout);
+
+  size_t n = kv_size(ss_index.matches);
+  size_t lo = 0;
+  size_t hi = n;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (ltoreq(kv_A(ss_index.matches, mid).start, p)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
     }
-    if (done_search) {
-      xfree(lastpat);
-      lastpat = xstrdup(spats[last_idx].pat);
-      chgtick = (int)buf_get_changedtick(curbuf);
-      lbuf = curbuf;
-      lastpos = p;
+  }
+  if (maxcount > 0 && n > (size_t)maxcount) {
+    // Counting stops after "maxcount" matches.
+    n = (size_t)maxcount + 1;
+    lo = MIN(lo, n);
+    if (incomplete == 0) {
+      incomplete = 2;
     }
   }
+  cur = (int)MIN(lo, INT_MAX);
+  cnt = (int)MIN(n, INT_MAX);
+  exact_match = lo > 0 && lt(p, kv_A(ss_index.matches, lo - 1).maxend);
+  if (got_int) {
+    cur = -1;  // abort
+  }
+  if (ss_index.buf == NULL) {
+    // Not kept, the pattern depends on more than the text.
+    kv_size(ss_index.matches) = 0;
+  }
+  lastpos = p;
+
   stat->cur = cur;
   stat->cnt = cnt;
   stat->exact_match = exact_match;
   stat->incomplete = incomplete;
   stat->last_maxcount = last_maxcount;
-  p_ws = save_ws;
 }
 
 // "searchcount()" function
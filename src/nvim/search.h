@@ -92,6 +92,18 @@ typedef struct {
   dict_T *additional_data;  ///< Additional data from ShaDa file.
 } SearchPattern;
 
+/// The last used search pattern and the options that change where it matches,
+/// to check if matches that were found earlier can still be used.
+typedef struct {
+  char *pat;        ///< copy of the pattern, NULL if not set
+  bool magic;       ///< magicness of the pattern
+  bool no_scs;      ///< no smartcase for the pattern
+  int ic;           ///< 'ignorecase'
+  int scs;          ///< 'smartcase'
+  bool cpo_search;  ///< 'cpoptions' contains 'c'
+  char *isk;        ///< 'iskeyword' of the buffer
+} search_pat_key_T;
+
 /// Optional extra arguments for searchit().
 typedef struct {
   linenr_T sa_stop_lnum;  ///< stop after this line number when != 0
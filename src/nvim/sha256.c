@@ -9,12 +9,25 @@
 ///
 /// Vim specific notes:
 /// sha256_self_test() is implicitly called once.
+///
+/// Blocks are processed with the SHA instructions of the CPU when it has them:
+/// the SHA extensions on x86, checked at runtime, and the ARMv8 cryptography
+/// extensions when compiled for them.
 
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <cpuid.h>
+# include <immintrin.h>
+# define SHA256_X86_SHA
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+# include <arm_neon.h>
+# define SHA256_ARM_SHA
+#endif
+
 #include "nvim/ascii_defs.h"
 #include "nvim/memory.h"
 #include "nvim/sha256.h"
@@ -197,16 +210,17 @@ void sha256_update(context_sha256_T *ctx, const uint8_t *input, size_t length)
 
   if (left && (length >= fill)) {
     memcpy(ctx->buffer + left, input, fill);
-    sha256_process(ctx, ctx->buffer);
+    sha256_process_blocks(ctx, ctx->buffer, 1);
     length -= fill;
     input += fill;
     left = 0;
   }
 
-  while (length >= SHA256_BUFFER_SIZE) {
-    sha256_process(ctx, input);
-    length -= SHA256_BUFFER_SIZE;
-    input += SHA256_BUFFER_SIZE;
+  size_t nblocks = length / SHA256_BUFFER_SIZE;
+  if (nblocks > 0) {
+    sha256_process_blocks(ctx, input, nblocks);
+    length -= nblocks * SHA256_BUFFER_SIZE;
+    input += nblocks * SHA256_BUFFER_SIZE;
   }
 
   if (length) {
@@ -214,6 +228,128 @@ void sha256_update(context_sha256_T *ctx, const uint8_t *input, size_t length)
   }
 }
 
+#if defined(SHA256_X86_SHA) || defined(SHA256_ARM_SHA)
+static const uint32_t sha256_k[64] = {
+  0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+  0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+  0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+  0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+  0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+  0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+  0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+  0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+#endif
+
+#ifdef SHA256_X86_SHA
+/// @return  true when the CPU has the SHA extensions.
+static bool sha256_hw_supported(void)
+{
+  static int supported = -1;
+  if (supported < 0) {
+    unsigned eax, ebx, ecx, edx;
+    supported = __get_cpuid(1, &eax, &ebx, &ecx, &edx)
+                && (ecx & bit_SSSE3) && (ecx & bit_SSE4_1)
+                && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)
+                && (ebx & (1U << 29));  // SHA
+  }
+  return supported;
+}
+
+/// Process "nblocks" blocks of "data" with the SHA extensions.
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_process_hw(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+  const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+
+  // The instructions want the state as ABEF and CDGH.
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+  for (; nblocks > 0; nblocks--, data += SHA256_BUFFER_SIZE) {
+    const __m128i abef = state0;
+    const __m128i cdgh = state1;
+    __m128i msg[4];
+    for (int i = 0; i < 4; i++) {
+      msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * i)), bswap);
+    }
+    // Four rounds at a time, msg[i & 3] holds W[4 * i] to W[4 * i + 3].
+    for (int i = 0; i < 16; i++) {
+      __m128i wk = _mm_add_epi32(msg[i & 3], _mm_loadu_si128((const __m128i *)&sha256_k[4 * i]));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+      if (i < 12) {
+        __m128i w = _mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]);
+        w = _mm_add_epi32(w, _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4));
+        msg[i & 3] = _mm_sha256msg2_epu32(w, msg[(i + 3) & 3]);
+      }
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);
+  state1 = _mm_shuffle_epi32(state1, 0xB1);
+  _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));
+  _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+#endif
+
+#ifdef SHA256_ARM_SHA
+static bool sha256_hw_supported(void)
+{
+  return true;
+}
+
+/// Process "nblocks" blocks of "data" with the ARMv8 SHA-256 instructions.
+static void sha256_process_hw(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+  uint32x4_t state0 = vld1q_u32(&state[0]);
+  uint32x4_t state1 = vld1q_u32(&state[4]);
+
+  for (; nblocks > 0; nblocks--, data += SHA256_BUFFER_SIZE) {
+    const uint32x4_t abcd = state0;
+    const uint32x4_t efgh = state1;
+    uint32x4_t msg[4];
+    for (int i = 0; i < 4; i++) {
+      msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+    }
+    // Four rounds at a time, msg[i & 3] holds W[4 * i] to W[4 * i + 3].
+    for (int i = 0; i < 16; i++) {
+      uint32x4_t wk = vaddq_u32(msg[i & 3], vld1q_u32(&sha256_k[4 * i]));
+      if (i < 12) {
+        msg[i & 3] = vsha256su1q_u32(vsha256su0q_u32(msg[i & 3], msg[(i + 1) & 3]),
+                                     msg[(i + 2) & 3], msg[(i + 3) & 3]);
+      }
+      uint32x4_t prev = state0;
+      state0 = vsha256hq_u32(state0, state1, wk);
+      state1 = vsha256h2q_u32(state1, prev, wk);
+    }
+    state0 = vaddq_u32(state0, abcd);
+    state1 = vaddq_u32(state1, efgh);
+  }
+
+  vst1q_u32(&state[0], state0);
+  vst1q_u32(&state[4], state1);
+}
+#endif
+
+/// Process "nblocks" blocks of "data".
+static void sha256_process_blocks(context_sha256_T *ctx, const uint8_t *data, size_t nblocks)
+{
+#if defined(SHA256_X86_SHA) || defined(SHA256_ARM_SHA)
+  if (sha256_hw_supported()) {
+    sha256_process_hw(ctx->state, data, nblocks);
+    return;
+  }
+#endif
+  for (; nblocks > 0; nblocks--, data += SHA256_BUFFER_SIZE) {
+    sha256_process(ctx, data);
+  }
+}
+
 static uint8_t sha256_padding[SHA256_BUFFER_SIZE] = {
   0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
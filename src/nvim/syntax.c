@@ -46,6 +46,7 @@
 #include "nvim/regexp.h"
 #include "nvim/regexp_defs.h"
 #include "nvim/runtime.h"
+#include "nvim/state_defs.h"
 #include "nvim/strings.h"
 #include "nvim/syntax.h"
 #include "nvim/types_defs.h"
@@ -163,6 +164,26 @@ struct name_list {
   char *name;
 };
 
+// Slot in a keyword index, for all keywords with the same text.
+typedef struct {
+  keyentry_T *ks_kp;            // first keyentry, NULL for an empty slot
+  hash_T ks_hash;               // hash of the keyword
+  size_t ks_len;                // length of the keyword
+} keywslot_T;
+
+// Index of the keywords in b_keywtab or b_keywtab_ic, built when a line is
+// checked for keywords after they changed.  Keywords are looked up in the
+// line text directly, and most words that are not a keyword are rejected on
+// their length or first byte without computing a hash.
+struct keyw_index {
+  uint64_t ki_lens;             // bit N set for keywords of N + 1 bytes,
+                                // bit 63 also for longer ones
+  uint8_t ki_first[32];         // bitmap of the first bytes of keywords
+  size_t ki_mask;               // number of slots minus one
+  keywslot_T ki_slots[];        // open addressing with linear probing
+};
+typedef struct keyw_index keywindex_T;
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "syntax.c.generated.h"
 #endif
@@ -283,6 +304,8 @@ static win_T *syn_win;                  // current window for highlighting
 static buf_T *syn_buf;                  // current buffer for highlighting
 static synblock_T *syn_block;              // current buffer for highlighting
 static proftime_T *syn_tm;                 // timeout limit
+static proftime_T *syn_idle_tm = NULL;     // limit for syntax_start() while idle
+static bool syn_idle_timed_out = false;    // a pattern hit "syn_idle_tm"
 static linenr_T current_lnum = 0;          // lnum of current state
 static colnr_T current_col = 0;            // column of current state
 static bool current_state_stored = false;  // true if stored current state
@@ -299,6 +322,10 @@ static int current_line_id = 0;            // unique number for current line
 static bool syn_time_on = false;
 #define IF_SYN_TIME(p) (p)
 
+#define SYN_IDLE_SLICE    10    // msec of computing states while idle
+#define SYN_IDLE_SCREENS  4     // window heights above and below to do first
+#define SYN_IDLE_LINES    8     // lines parsed between checking the time
+
 // Set the timeout used for syntax highlighting.
 // Use NULL to reset, no timeout.
 void syn_set_timeout(proftime_T *tm)
@@ -406,9 +433,20 @@ void syntax_start(win_T *wp, linenr_T lnum)
   } else {
     dist = syn_buf->b_ml.ml_line_count / (syn_block->b_sst_len - Rows) + 1;
   }
+  int idle_lines = 0;
   while (current_lnum < lnum) {
+    // While idle, stop at the start of a line when the time is up.  The
+    // current state stays valid, the next call continues from here.
+    if (syn_idle_timed_out
+        || (syn_idle_tm != NULL && ++idle_lines % SYN_IDLE_LINES == 0
+            && profile_passed_limit(*syn_idle_tm))) {
+      break;
+    }
     syn_start_line();
     syn_finish_line(false);
+    if (syn_idle_timed_out) {
+      break;  // state is wrong, don't store it, syn_idle_range() drops it
+    }
     current_lnum++;
 
     // If we parsed at least "minlines" lines or started at a valid
@@ -467,6 +505,112 @@ void syntax_start(win_T *wp, linenr_T lnum)
   syn_start_line();
 }
 
+/// Compute syntax states for the current window while waiting for input, for
+/// at most SYN_IDLE_SLICE msec, so that scrolling or jumping later does not
+/// have to parse many lines first.  First the lines just below the window
+/// are done, then the lines just above it.  When syncing may start parsing
+/// far back, e.g. with "fromstart", states for the whole buffer follow.
+///
+/// @return  true when there is more to do.
+bool syntax_idle_update(void)
+{
+  win_T *wp = curwin;
+  synblock_T *block = wp->w_s;
+  buf_T *buf = wp->w_buffer;
+
+  // Stored states are only adjusted for changes when redrawing, don't use
+  // them before that.  Other modes may be in the middle of something.
+  if (!syntax_present(wp) || block->b_syn_error || block->b_syn_slow
+      || buf->b_mod_set || must_redraw != 0 || updating_screen || got_int
+      || !(wp->w_valid & VALID_BOTLINE)
+      || !(State == MODE_NORMAL || State == MODE_INSERT || State == MODE_REPLACE)) {
+    return false;
+  }
+
+  linenr_T line_count = buf->b_ml.ml_line_count;
+  linenr_T around = wp->w_height_inner * SYN_IDLE_SCREENS;
+  linenr_T step = block->b_sst_len <= Rows
+                  ? SST_DIST : line_count / (block->b_sst_len - Rows) + 1;
+  proftime_T tm = profile_setlimit(SYN_IDLE_SLICE);
+
+  int save_did_emsg = did_emsg;
+  did_emsg = false;
+  bool done = syn_idle_range(wp, &block->b_sst_idle_below, MIN(wp->w_botline, line_count),
+                             MIN(wp->w_botline + around, line_count), step, tm)
+              && syn_idle_range(wp, &block->b_sst_idle_above, MAX(wp->w_topline - around, 1),
+                                wp->w_topline, step, tm)
+              && (block->b_syn_sync_minlines < step
+                  || syn_idle_range(wp, &block->b_sst_idle_lnum, 1, line_count, step, tm));
+  if (did_emsg) {
+    block->b_syn_error = true;
+  } else {
+    did_emsg = save_did_emsg;
+  }
+  if (got_int) {
+    // The current state is wrong when interrupted.
+    invalidate_current_state();
+    return false;
+  }
+  return !done && !block->b_syn_error && !block->b_syn_slow;
+}
+
+/// Compute syntax states from line "from" to line "to", until time limit "tm"
+/// passed.  syntax_start() is asked for "step" lines at a time and checks the
+/// time every few lines, it stores states at the usual distance.  Patterns
+/// also stop at "tm", that ends the slice without setting b_syn_slow.  "*done" is
+/// the line up to which states were computed, it is reset when not inside the
+/// range.
+///
+/// @return  true when the whole range is done.
+static bool syn_idle_range(win_T *wp, linenr_T *done, linenr_T from, linenr_T to, linenr_T step,
+                           proftime_T tm)
+{
+  if (*done < from || *done > to) {
+    *done = from;
+  }
+  while (*done < to) {
+    if (profile_passed_limit(tm)) {
+      return false;
+    }
+    linenr_T prev = *done;
+    proftime_T *save_syn_tm = syn_tm;
+    syn_idle_tm = &tm;
+    syn_tm = &tm;
+    syn_idle_timed_out = false;
+    syntax_start(wp, MIN(*done + step, to));
+    syn_idle_tm = NULL;
+    syn_tm = save_syn_tm;
+    if (syn_idle_timed_out) {
+      // A pattern used up the slice, the state in "current_lnum" is wrong.
+      // Continue with that line next time.  When the slice did not get
+      // beyond it give up on the range, redrawing will deal with the line.
+      syn_idle_timed_out = false;
+      linenr_T lnum = current_lnum;
+      invalidate_current_state();
+      *done = lnum > prev ? MIN(lnum, to) : to;
+      return false;
+    }
+    if (got_int || did_emsg) {
+      *done = prev;
+      return false;
+    }
+    if (current_lnum <= prev) {
+      return false;  // no progress, out of memory or out of time
+    }
+    *done = MIN(current_lnum, to);
+  }
+  return true;
+}
+
+/// Forget how far syntax states were computed while idle, below line "lnum"
+/// they must be computed again.
+static void syn_idle_changed(synblock_T *block, linenr_T lnum)
+{
+  block->b_sst_idle_below = MIN(block->b_sst_idle_below, lnum);
+  block->b_sst_idle_above = MIN(block->b_sst_idle_above, lnum);
+  block->b_sst_idle_lnum = MIN(block->b_sst_idle_lnum, lnum);
+}
+
 // We cannot simply discard growarrays full of state_items or buf_states; we
 // have to manually release their extmatch pointers first.
 static void clear_syn_state(synstate_T *p)
@@ -872,6 +1016,10 @@ static void syn_update_ends(bool startofline)
 // entries depends on the number of lines in the buffer.  For small buffers
 // the distance is fixed at SST_DIST, for large buffers there is a fixed
 // number of entries SST_MAX_ENTRIES, and the distance is computed.
+//
+// While waiting for input, syntax_idle_update() stores entries for lines
+// around the current window, and for the whole buffer when syncing may start
+// far back, so that scrolling and jumping have fewer lines to parse.
 
 static void syn_stack_free_block(synblock_T *block)
 {
@@ -885,6 +1033,7 @@ static void syn_stack_free_block(synblock_T *block)
   XFREE_CLEAR(block->b_sst_array);
   block->b_sst_first = NULL;
   block->b_sst_len = 0;
+  syn_idle_changed(block, 0);
 }
 // Free b_sst_array[] for buffer "buf".
 // Used when syntax items changed to force resyncing everywhere.
@@ -985,6 +1134,7 @@ void syn_stack_apply_changes(buf_T *buf)
 static void syn_stack_apply_changes_block(synblock_T *block, buf_T *buf)
 {
   synstate_T *prev = NULL;
+  syn_idle_changed(block, buf->b_mod_top);
   for (synstate_T *p = block->b_sst_first; p != NULL;) {
     if (p->sst_lnum + block->b_syn_sync_linebreaks > buf->b_mod_top) {
       linenr_T n = p->sst_lnum + buf->b_mod_xlines;
@@ -2692,7 +2842,10 @@ static bool syn_regexec(regmmatch_T *rmp, linenr_T lnum, colnr_T col, syn_time_T
       st->match++;
     }
   }
-  if (timed_out && !syn_win->w_s->b_syn_slow) {
+  if (timed_out && syn_idle_tm != NULL) {
+    // While idle the limit is the end of the slice, not 'redrawtime'.
+    syn_idle_timed_out = true;
+  } else if (timed_out && !syn_win->w_s->b_syn_slow) {
     syn_win->w_s->b_syn_slow = true;
     msg(_("'redrawtime' exceeded, syntax highlighting disabled"), 0);
   }
@@ -2731,22 +2884,36 @@ static int check_keyword_id(char *const line, const int startcol, int *const end
     return 0;
   }
 
-  // Must make a copy of the keyword, so we can add a NUL and make it
-  // lowercase.
-  char keyword[MAXKEYWLEN + 1];         // assume max. keyword len is 80
-  xmemcpyz(keyword, kwp, (size_t)kwlen);
-
   keyentry_T *kp = NULL;
 
   // matching case
   if (syn_block->b_keywtab.ht_used != 0) {
-    kp = match_keyword(keyword, &syn_block->b_keywtab, cur_si);
+    kp = match_keyword(keyw_index_find(&syn_block->b_keyw_index, &syn_block->b_keywtab,
+                                       kwp, (size_t)kwlen), cur_si);
   }
 
   // ignoring case
   if (kp == NULL && syn_block->b_keywtab_ic.ht_used != 0) {
-    str_foldcase(kwp, kwlen, keyword, MAXKEYWLEN + 1);
-    kp = match_keyword(keyword, &syn_block->b_keywtab_ic, cur_si);
+    keywindex_T *idx = keyw_index_get(&syn_block->b_keyw_index_ic, &syn_block->b_keywtab_ic);
+    char keyword[MAXKEYWLEN + 1];
+    int i;
+    for (i = 0; i < kwlen && (uint8_t)kwp[i] < 0x80; i++) {}
+    if (i == kwlen) {
+      // ASCII only: folding does not change the length, skip most words
+      // before making a lowercase copy.
+      if (keyw_index_may_have(idx, (uint8_t)TOLOWER_ASC(kwp[0]), (size_t)kwlen)) {
+        for (i = 0; i < kwlen; i++) {
+          keyword[i] = (char)TOLOWER_ASC(kwp[i]);
+        }
+        kp = match_keyword(keyw_index_find(&syn_block->b_keyw_index_ic,
+                                           &syn_block->b_keywtab_ic, keyword, (size_t)kwlen),
+                           cur_si);
+      }
+    } else {
+      str_foldcase(kwp, kwlen, keyword, MAXKEYWLEN + 1);
+      kp = match_keyword(keyw_index_find(&syn_block->b_keyw_index_ic, &syn_block->b_keywtab_ic,
+                                         keyword, strlen(keyword)), cur_si);
+    }
   }
 
   if (kp != NULL) {
@@ -2765,24 +2932,100 @@ static int check_keyword_id(char *const line, const int startcol, int *const end
 /// When current_next_list is non-zero accept only that group, otherwise:
 ///  Accept a not-contained keyword at toplevel.
 ///  Accept a keyword at other levels only if it is in the contains list.
-static keyentry_T *match_keyword(char *keyword, hashtab_T *ht, stateitem_T *cur_si)
+///
+/// @param kp  first keyword with the text to match, or NULL
+static keyentry_T *match_keyword(keyentry_T *kp, stateitem_T *cur_si)
 {
-  hashitem_T *hi = hash_find(ht, keyword);
-  if (!HASHITEM_EMPTY(hi)) {
-    for (keyentry_T *kp = HI2KE(hi); kp != NULL; kp = kp->ke_next) {
-      if (current_next_list != 0
-          ? in_id_list(NULL, current_next_list, &kp->k_syn, 0)
-          : (cur_si == NULL
-             ? !(kp->flags & HL_CONTAINED)
-             : in_id_list(cur_si, cur_si->si_cont_list,
-                          &kp->k_syn, kp->flags & HL_CONTAINED))) {
-        return kp;
-      }
+  for (; kp != NULL; kp = kp->ke_next) {
+    if (current_next_list != 0
+        ? in_id_list(NULL, current_next_list, &kp->k_syn, 0)
+        : (cur_si == NULL
+           ? !(kp->flags & HL_CONTAINED)
+           : in_id_list(cur_si, cur_si->si_cont_list,
+                        &kp->k_syn, kp->flags & HL_CONTAINED))) {
+      return kp;
     }
   }
   return NULL;
 }
 
+/// Get the index for the keywords in "ht", build it when "*idxp" is NULL.
+static keywindex_T *keyw_index_get(keywindex_T **idxp, hashtab_T *ht)
+{
+  if (*idxp != NULL) {
+    return *idxp;
+  }
+
+  // At most half of the slots are used.
+  size_t size = 16;
+  while (size < ht->ht_used * 2) {
+    size *= 2;
+  }
+  keywindex_T *idx = xcalloc(1, offsetof(keywindex_T, ki_slots) + size * sizeof(keywslot_T));
+  idx->ki_mask = size - 1;
+
+  size_t todo = ht->ht_used;
+  for (hashitem_T *hi = ht->ht_array; todo > 0; hi++) {
+    if (HASHITEM_EMPTY(hi)) {
+      continue;
+    }
+    todo--;
+    keyentry_T *kp = HI2KE(hi);
+    size_t len = strlen(kp->keyword);
+    uint8_t c = (uint8_t)kp->keyword[0];
+    idx->ki_lens |= (uint64_t)1 << (MIN(len, 64) - 1);
+    idx->ki_first[c >> 3] |= (uint8_t)(1 << (c & 7));
+
+    size_t i = hi->hi_hash & idx->ki_mask;
+    while (idx->ki_slots[i].ks_kp != NULL) {
+      i = (i + 1) & idx->ki_mask;
+    }
+    idx->ki_slots[i] = (keywslot_T){ .ks_kp = kp, .ks_hash = hi->hi_hash, .ks_len = len };
+  }
+
+  *idxp = idx;
+  return idx;
+}
+
+/// Return false if "idx" cannot have a keyword of "len" bytes that starts
+/// with byte "c".
+static inline bool keyw_index_may_have(const keywindex_T *idx, uint8_t c, size_t len)
+{
+  return (idx->ki_lens & ((uint64_t)1 << (MIN(len, 64) - 1)))
+         && (idx->ki_first[c >> 3] & (1 << (c & 7)));
+}
+
+/// Find the keywords in "ht" with the "len" bytes at "kw" as text.  The
+/// index of "ht" in "*idxp" is used, it is built when needed.
+///
+/// @return  the first of the keywords, NULL if there is none.
+static keyentry_T *keyw_index_find(keywindex_T **idxp, hashtab_T *ht, const char *kw, size_t len)
+{
+  keywindex_T *idx = keyw_index_get(idxp, ht);
+  if (!keyw_index_may_have(idx, (uint8_t)kw[0], len)) {
+    return NULL;
+  }
+
+  hash_T hash = hash_hash_len(kw, len);
+  for (size_t i = hash & idx->ki_mask;; i = (i + 1) & idx->ki_mask) {
+    keywslot_T *slot = &idx->ki_slots[i];
+    if (slot->ks_kp == NULL) {
+      return NULL;
+    }
+    if (slot->ks_hash == hash && slot->ks_len == len
+        && memcmp(slot->ks_kp->keyword, kw, len) == 0) {
+      return slot->ks_kp;
+    }
+  }
+}
+
+/// Free the keyword indexes of "block", after keywords were added or removed.
+static void keyw_index_clear(synblock_T *block)
+{
+  XFREE_CLEAR(block->b_keyw_index);
+  XFREE_CLEAR(block->b_keyw_index_ic);
+}
+
 // Handle ":syntax conceal" command.
 static void syn_cmd_conceal(exarg_T *eap, int syncing)
 {
@@ -2965,6 +3208,7 @@ void syntax_clear(synblock_T *block)
   // free the keywords
   clear_keywtab(&block->b_keywtab);
   clear_keywtab(&block->b_keywtab_ic);
+  keyw_index_clear(block);
 
   // free the syntax patterns
   for (int i = block->b_syn_patterns.ga_len; --i >= 0;) {
@@ -3139,6 +3383,7 @@ static void syn_clear_one(const int id, const bool syncing)
   if (!syncing) {
     syn_clear_keyword(id, &curwin->w_s->b_keywtab);
     syn_clear_keyword(id, &curwin->w_s->b_keywtab_ic);
+    keyw_index_clear(curwin->w_s);
   }
 
   // clear the patterns for "id"
@@ -3722,6 +3967,7 @@ static void add_keyword(char *const name, const int id, const int flags,
     curwin->w_s->b_syn_containedin = true;
   }
   kp->next_list = copy_id_list(next_list);
+  keyw_index_clear(curwin->w_s);
 
   const hash_T hash = hash_hash(kp->keyword);
   hashtab_T *const ht = (curwin->w_s->b_syn_ic)
@@ -110,6 +110,7 @@
 #include "nvim/highlight.h"
 #include "nvim/highlight_defs.h"
 #include "nvim/macros_defs.h"
+#include "nvim/map_defs.h"
 #include "nvim/mark.h"
 #include "nvim/mark_defs.h"
 #include "nvim/marktree_defs.h"
@@ -143,6 +144,23 @@ typedef struct {
   FILE *bi_fp;
 } bufinfo_T;
 
+/// Undo state read from the undofile header or a journal record.
+typedef struct {
+  uint8_t hash[UNDO_HASH_SIZE];
+  linenr_T line_count;
+  char *line_ptr;
+  linenr_T line_lnum;
+  colnr_T line_colnr;
+  int old_header_seq;
+  int new_header_seq;
+  int cur_header_seq;
+  int num_head;
+  int seq_last;
+  int seq_cur;
+  time_t seq_time;
+  int last_save_nr;
+} undo_state_T;
+
 #ifdef INCLUDE_GENERATED_DECLARATIONS
 # include "undo.c.generated.h"
 #endif
@@ -349,6 +367,15 @@ static inline void zero_fmark_additional_data(fmark_T *fmarks)
 }
 
 /// Common code for various ways to save text before a change.
+/// Mark undo header "uhp" as changed since the undo file was written, so that
+/// the next write appends it to the file.
+static void u_header_touch(u_header_T *uhp)
+{
+  if (uhp != NULL) {
+    uhp->uh_dirty = true;
+  }
+}
+
 /// "top" is the line above the first changed line.
 /// "bot" is the line below the last changed line.
 /// "newbot" is the new bottom line.  Use zero when not known.
@@ -415,7 +442,7 @@ int u_savecommon(buf_T *buf, linenr_T top, linenr_T bot, linenr_T newbot, bool r
     }
 
     // free headers to keep the size right
-    while (buf->b_u_numhead > get_undolevel(buf)
+    while ((buf->b_u_numhead > get_undolevel(buf) || u_over_memory(buf))
            && buf->b_u_oldhead != NULL) {
       u_header_T *uhfree = buf->b_u_oldhead;
 
@@ -453,9 +480,11 @@ int u_savecommon(buf_T *buf, linenr_T top, linenr_T bot, linenr_T newbot, bool r
 
       if (uhp->uh_alt_prev.ptr != NULL) {
         uhp->uh_alt_prev.ptr->uh_alt_next.ptr = uhp;
+        u_header_touch(uhp->uh_alt_prev.ptr);
       }
 
       old_curhead->uh_alt_prev.ptr = uhp;
+      u_header_touch(old_curhead);
 
       if (buf->b_u_oldhead == old_curhead) {
         buf->b_u_oldhead = uhp;
@@ -466,12 +495,14 @@ int u_savecommon(buf_T *buf, linenr_T top, linenr_T bot, linenr_T newbot, bool r
 
     if (buf->b_u_newhead != NULL) {
       buf->b_u_newhead->uh_prev.ptr = uhp;
+      u_header_touch(buf->b_u_newhead);
     }
 
     uhp->uh_seq = ++buf->b_u_seq_last;
     buf->b_u_seq_cur = uhp->uh_seq;
     uhp->uh_time = time(NULL);
     uhp->uh_save_nr = 0;
+    uhp->uh_dirty = true;
     buf->b_u_time_cur = uhp->uh_time + 1;
 
     uhp->uh_walk = 0;
@@ -500,11 +531,15 @@ int u_savecommon(buf_T *buf, linenr_T top, linenr_T bot, linenr_T newbot, bool r
       buf->b_u_oldhead = uhp;
     }
     buf->b_u_numhead++;
+    buf->b_u_memused += sizeof(u_header_T);
   } else {
     if (get_undolevel(buf) < 0) {  // no undo at all
       return OK;
     }
 
+    // Entries are added to or updated in the newest header.
+    u_header_touch(buf->b_u_newhead);
+
     // When saving a single line, and it has been saved just before, it
     // doesn't make sense saving it again.  Saves a lot of memory when
     // making lots of changes inside the same line.
@@ -572,6 +607,25 @@ int u_savecommon(buf_T *buf, linenr_T top, linenr_T bot, linenr_T newbot, bool r
 
     // find line number for ue_bot for previous u_save()
     u_getbot(buf);
+
+    // When saving the line just below the lines saved last, and neither
+    // change inserted or deleted lines, add it to the same entry.  Keeps
+    // the undo information for ":s" on many lines compact.
+    uep = buf->b_u_newhead->uh_entry;
+    if (size == 1 && newbot == 0 && !reload && bot <= buf->b_ml.ml_line_count
+        && uep != NULL && uep->ue_size > 0
+        && uep->ue_bot == uep->ue_top + uep->ue_size + 1
+        && top == uep->ue_top + uep->ue_size) {
+      size_t oldcap = uep->ue_textcap;
+      u_entry_add_lines(buf, uep, top + 1, 1);
+      buf->b_u_memused += uep->ue_textcap - oldcap;
+      uep->ue_size++;
+      uep->ue_lcount = buf->b_ml.ml_line_count;
+      buf->b_u_newhead->uh_getbot_entry = uep;
+      buf->b_u_synced = false;
+      undo_undoes = false;
+      return OK;
+    }
   }
 
   // add lines in front of entry list
@@ -594,21 +648,16 @@ int u_savecommon(buf_T *buf, linenr_T top, linenr_T bot, linenr_T newbot, bool r
     buf->b_u_newhead->uh_getbot_entry = uep;
   }
 
-  if (size > 0) {
-    uep->ue_array = xmalloc(sizeof(char *) * (size_t)size);
-    linenr_T lnum;
-    int i;
-    for (i = 0, lnum = top + 1; i < size; i++) {
-      fast_breakcheck();
-      if (got_int) {
-        u_freeentry(uep, i);
-        return FAIL;
-      }
-      uep->ue_array[i] = u_save_line_buf(buf, lnum++);
+  for (linenr_T lnum = top + 1; lnum < top + 1 + size; lnum++) {
+    fast_breakcheck();
+    if (got_int) {
+      u_freeentry(NULL, uep);
+      return FAIL;
     }
-  } else {
-    uep->ue_array = NULL;
+    u_entry_add_lines(buf, uep, lnum, 1);
   }
+  u_entry_trim(uep);
+  buf->b_u_memused += u_entry_memsize(uep);
 
   uep->ue_next = buf->b_u_newhead->uh_entry;
   buf->b_u_newhead->uh_entry = uep;
@@ -636,6 +685,8 @@ int u_savecommon(buf_T *buf, linenr_T top, linenr_T bot, linenr_T newbot, bool r
 #define UF_ENTRY_MAGIC         0xf518
 // magic after last entry
 #define UF_ENTRY_END_MAGIC     0x3581
+// magic at start of a journal record appended after the headers
+#define UF_JOURNAL_MAGIC       0x4a6e
 
 // 2-byte undofile version number
 #define UF_VERSION             3
@@ -655,6 +706,9 @@ static const char e_not_open[] = N_("E828: Cannot open undo file for writing: %s
 ///                 the hash
 void u_compute_hash(buf_T *buf, uint8_t *hash)
 {
+  if (u_get_cached_hash(buf, hash)) {
+    return;
+  }
   context_sha256_T ctx;
   sha256_start(&ctx);
   for (linenr_T lnum = 1; lnum <= buf->b_ml.ml_line_count; lnum++) {
@@ -662,6 +716,34 @@ void u_compute_hash(buf_T *buf, uint8_t *hash)
     sha256_update(&ctx, (uint8_t *)p, strlen(p) + 1);
   }
   sha256_finish(&ctx, hash);
+  u_set_cached_hash(buf, hash);
+}
+
+/// Get the hash of the text of "buf" remembered by u_set_cached_hash(), if
+/// the text did not change since then.
+///
+/// @return  true when "hash" was set.
+bool u_get_cached_hash(buf_T *buf, uint8_t *hash)
+  FUNC_ATTR_NONNULL_ALL
+{
+  if (buf->b_u_hash_gen == 0
+      || buf->b_u_hash_gen != buf->b_ml.ml_text_gen
+      || buf->b_u_hash_tick != buf_get_changedtick(buf)) {
+    return false;
+  }
+  memcpy(hash, buf->b_u_hash, UNDO_HASH_SIZE);
+  return true;
+}
+
+/// Remember "hash" as the hash of the current text of "buf", so that it does
+/// not need to be computed again until the text changes.  In-place changes
+/// that bypass the memline functions still increment b:changedtick.
+void u_set_cached_hash(buf_T *buf, const uint8_t *hash)
+  FUNC_ATTR_NONNULL_ALL
+{
+  memcpy(buf->b_u_hash, hash, UNDO_HASH_SIZE);
+  buf->b_u_hash_gen = buf->b_ml.ml_text_gen;
+  buf->b_u_hash_tick = buf_get_changedtick(buf);
 }
 
 /// Return an allocated string of the full path of the target undofile.
@@ -775,7 +857,7 @@ static void u_free_uhp(u_header_T *uhp)
   u_entry_T *uep = uhp->uh_entry;
   while (uep != NULL) {
     u_entry_T *nuep = uep->ue_next;
-    u_freeentry(uep, uep->ue_size);
+    u_freeentry(NULL, uep);
     uep = nuep;
   }
   xfree(uhp);
@@ -790,7 +872,6 @@ static void u_free_uhp(u_header_T *uhp)
 static bool serialize_header(bufinfo_T *bi, uint8_t *hash)
   FUNC_ATTR_NONNULL_ALL
 {
-  buf_T *buf = bi->bi_buf;
   FILE *fp = bi->bi_fp;
 
   // Start writing, first the magic marker and undo info version.
@@ -800,6 +881,21 @@ static bool serialize_header(bufinfo_T *bi, uint8_t *hash)
 
   undo_write_bytes(bi, UF_VERSION, 2);
 
+  return serialize_state(bi, hash);
+}
+
+/// Writes the undo state of the buffer, which follows the magic and version
+/// in the undofile header and starts every journal record.
+///
+/// @param bi   The buffer information
+/// @param hash The hash of the buffer contents
+//
+/// @returns false in case of an error.
+static bool serialize_state(bufinfo_T *bi, uint8_t *hash)
+  FUNC_ATTR_NONNULL_ALL
+{
+  buf_T *buf = bi->bi_buf;
+
   // Write a hash of the buffer text, so that we can verify it is
   // still the same when reading the buffer text.
   if (!undo_write(bi, hash, UNDO_HASH_SIZE)) {
@@ -834,9 +930,7 @@ static bool serialize_header(bufinfo_T *bi, uint8_t *hash)
   undo_write_bytes(bi, (uintmax_t)buf->b_u_save_nr_last, 4);
 
   // Write end marker.
-  undo_write_bytes(bi, 0, 1);
-
-  return true;
+  return undo_write_bytes(bi, 0, 1);
 }
 
 /// Writes an undo header.
@@ -896,6 +990,146 @@ static bool serialize_uhp(bufinfo_T *bi, u_header_T *uhp)
   return true;
 }
 
+/// Writes the undo headers of the buffer, walking the tree from the top down.
+///
+/// @param bi            The buffer information
+/// @param changed_only  Only write headers changed since the undo file was
+///                      last written.
+/// @param mark_written  Clear the changed flag of all headers.
+///
+/// @returns the number of headers written, -1 in case of an error.
+static int serialize_uhps(bufinfo_T *bi, bool changed_only, bool mark_written)
+{
+  int headers_written = 0;
+  int mark = ++lastmark;
+  u_header_T *uhp = bi->bi_buf->b_u_oldhead;
+  while (uhp != NULL) {
+    // Serialize current UHP if we haven't seen it
+    if (uhp->uh_walk != mark) {
+      uhp->uh_walk = mark;
+      if (!changed_only || uhp->uh_dirty) {
+        if (!serialize_uhp(bi, uhp)) {
+          return -1;
+        }
+        headers_written++;
+      }
+      if (mark_written) {
+        uhp->uh_dirty = false;
+      }
+    }
+
+    // Now walk through the tree - algorithm from undo_time().
+    if (uhp->uh_prev.ptr != NULL && uhp->uh_prev.ptr->uh_walk != mark) {
+      uhp = uhp->uh_prev.ptr;
+    } else if (uhp->uh_alt_next.ptr != NULL
+               && uhp->uh_alt_next.ptr->uh_walk != mark) {
+      uhp = uhp->uh_alt_next.ptr;
+    } else if (uhp->uh_next.ptr != NULL && uhp->uh_alt_prev.ptr == NULL
+               && uhp->uh_next.ptr->uh_walk != mark) {
+      uhp = uhp->uh_next.ptr;
+    } else if (uhp->uh_alt_prev.ptr != NULL) {
+      uhp = uhp->uh_alt_prev.ptr;
+    } else {
+      uhp = uhp->uh_next.ptr;
+    }
+  }
+  return headers_written;
+}
+
+/// Reads the undo state written by serialize_state() into "state".
+///
+/// @returns false in case of an error.
+static bool unserialize_state(bufinfo_T *bi, undo_state_T *state, const char *file_name)
+{
+  if (!undo_read(bi, state->hash, UNDO_HASH_SIZE)) {
+    corruption_error("hash", file_name);
+    return false;
+  }
+  state->line_count = (linenr_T)undo_read_4c(bi);
+
+  // Read undo data for "U" command.
+  XFREE_CLEAR(state->line_ptr);
+  int str_len = undo_read_4c(bi);
+  if (str_len < 0) {
+    return false;
+  }
+  if (str_len > 0) {
+    state->line_ptr = undo_read_string(bi, (size_t)str_len);
+  }
+  state->line_lnum = (linenr_T)undo_read_4c(bi);
+  state->line_colnr = (colnr_T)undo_read_4c(bi);
+  if (state->line_lnum < 0 || state->line_colnr < 0) {
+    corruption_error("line lnum/col", file_name);
+    return false;
+  }
+
+  // Begin general undo data
+  state->old_header_seq = undo_read_4c(bi);
+  state->new_header_seq = undo_read_4c(bi);
+  state->cur_header_seq = undo_read_4c(bi);
+  state->num_head = undo_read_4c(bi);
+  state->seq_last = undo_read_4c(bi);
+  state->seq_cur = undo_read_4c(bi);
+  state->seq_time = undo_read_time(bi);
+
+  // Optional header fields.
+  state->last_save_nr = 0;
+  while (true) {
+    int len = undo_read_byte(bi);
+
+    if (len == 0 || len == EOF) {
+      break;
+    }
+    int what = undo_read_byte(bi);
+    switch (what) {
+    case UF_LAST_SAVE_NR:
+      state->last_save_nr = undo_read_4c(bi);
+      break;
+
+    default:
+      // field not supported, skip
+      while (--len >= 0) {
+        undo_read_byte(bi);
+      }
+    }
+  }
+  return true;
+}
+
+/// Reads undo headers up to the end marker into "uhp_map", keyed by their
+/// sequence numbers.
+///
+/// @param replace  When true a header replaces the one read before with the
+///                 same sequence number, otherwise that is an error.
+///
+/// @returns false in case of an error.
+static bool unserialize_uhps(bufinfo_T *bi, PMap(int) *uhp_map, bool replace,
+                             const char *file_name)
+{
+  int c;
+  while ((c = undo_read_2c(bi)) == UF_HEADER_MAGIC) {
+    u_header_T *uhp = unserialize_uhp(bi, file_name);
+    if (uhp == NULL) {
+      return false;
+    }
+    ptr_t *ref = pmap_put_ref(int)(uhp_map, uhp->uh_seq, NULL, NULL);
+    if (*ref != NULL) {
+      if (!replace) {
+        corruption_error("duplicate uh_seq", file_name);
+        u_free_uhp(uhp);
+        return false;
+      }
+      u_free_uhp(*ref);
+    }
+    *ref = uhp;
+  }
+  if (c != UF_HEADER_END_MAGIC) {
+    corruption_error("end marker", file_name);
+    return false;
+  }
+  return true;
+}
+
 static u_header_T *unserialize_uhp(bufinfo_T *bi, const char *file_name)
 {
   u_header_T *uhp = xmalloc(sizeof(u_header_T));
@@ -1069,14 +1303,16 @@ static bool serialize_uep(bufinfo_T *bi, u_entry_T *uep)
   undo_write_bytes(bi, (uintmax_t)uep->ue_lcount, 4);
   undo_write_bytes(bi, (uintmax_t)uep->ue_size, 4);
 
+  char *line = uep->ue_text;
   for (size_t i = 0; i < (size_t)uep->ue_size; i++) {
-    size_t len = strlen(uep->ue_array[i]);
+    size_t len = strlen(line);
     if (!undo_write_bytes(bi, len, 4)) {
       return false;
     }
-    if (len > 0 && !undo_write(bi, (uint8_t *)uep->ue_array[i], len)) {
+    if (len > 0 && !undo_write(bi, (uint8_t *)line, len)) {
       return false;
     }
+    line += len + 1;
   }
   return true;
 }
@@ -1091,32 +1327,22 @@ static u_entry_T *unserialize_uep(bufinfo_T *bi, bool *error, const char *file_n
   uep->ue_top = undo_read_4c(bi);
   uep->ue_bot = undo_read_4c(bi);
   uep->ue_lcount = undo_read_4c(bi);
-  uep->ue_size = undo_read_4c(bi);
+  linenr_T size = undo_read_4c(bi);
 
-  char **array = NULL;
-  if (uep->ue_size > 0) {
-    if ((size_t)uep->ue_size < SIZE_MAX / sizeof(char *)) {
-      array = xmalloc(sizeof(char *) * (size_t)uep->ue_size);
-      memset(array, 0, sizeof(char *) * (size_t)uep->ue_size);
-    }
-  }
-  uep->ue_array = array;
-
-  for (size_t i = 0; i < (size_t)uep->ue_size; i++) {
+  for (uep->ue_size = 0; uep->ue_size < size; uep->ue_size++) {
     int line_len = undo_read_4c(bi);
-    char *line;
-    if (line_len >= 0) {
-      line = undo_read_string(bi, (size_t)line_len);
-    } else {
-      line = NULL;
+    if (line_len < 0) {
       corruption_error("line length", file_name);
+      *error = true;
+      return uep;
     }
-    if (line == NULL) {
+    char *line = u_entry_new_line(uep, (size_t)line_len);
+    if (line_len > 0 && !undo_read(bi, (uint8_t *)line, (size_t)line_len)) {
       *error = true;
       return uep;
     }
-    array[i] = line;
   }
+  u_entry_trim(uep);
   return uep;
 }
 
@@ -1163,6 +1389,86 @@ static void unserialize_visualinfo(bufinfo_T *bi, visualinfo_T *info)
   info->vi_curswant = undo_read_4c(bi);
 }
 
+/// Remember undo file "fd" as holding the undo tree of "buf", so that the
+/// next write only needs to append what changed.
+static void u_undofile_synced(buf_T *buf, int fd)
+{
+  FileInfo file_info;
+  buf->b_u_file_valid = os_fileinfo_fd(fd, &file_info);
+  if (buf->b_u_file_valid) {
+    os_fileinfo_id(&file_info, &buf->b_u_file_id);
+    buf->b_u_file_size = os_fileinfo_size(&file_info);
+  }
+  kv_size(buf->b_u_freed) = 0;
+}
+
+/// Append a journal record to undo file "file_name": the undo state, the
+/// sequence numbers of the headers freed and the headers changed since the
+/// file was last written or read.
+///
+/// @return  OK when appended, NOTDONE when the file must be written from
+///          scratch, FAIL for a write error.
+static int u_write_undo_journal(buf_T *buf, const char *file_name, uint8_t *hash)
+  FUNC_ATTR_NONNULL_ALL
+{
+  // Compact the file by writing it from scratch once the journal records
+  // take more space than the rest.
+  if (!buf->b_u_file_valid
+      || buf->b_u_file_size - buf->b_u_file_base > buf->b_u_file_base) {
+    return NOTDONE;
+  }
+
+  int fd = os_open(file_name, O_WRONLY|O_APPEND|O_NOFOLLOW, 0);
+  if (fd < 0) {
+    return NOTDONE;
+  }
+  // Check nobody else wrote the file in the meantime.
+  FileInfo file_info;
+  if (!os_fileinfo_fd(fd, &file_info)
+      || !os_fileid_equal_fileinfo(&buf->b_u_file_id, &file_info)
+      || os_fileinfo_size(&file_info) != buf->b_u_file_size) {
+    os_close(fd);
+    return NOTDONE;
+  }
+  FILE *fp = fdopen(fd, "a");
+  if (fp == NULL) {
+    os_close(fd);
+    return NOTDONE;
+  }
+  if (p_verbose > 0) {
+    verbose_enter();
+    smsg(0, _("Appending to undo file: %s"), file_name);
+    verbose_leave();
+  }
+
+  // Undo must be synced.
+  u_sync(true);
+
+  bufinfo_T bi = {
+    .bi_buf = buf,
+    .bi_fp = fp,
+  };
+  bool write_ok = undo_write_bytes(&bi, (uintmax_t)UF_JOURNAL_MAGIC, 2)
+                  && serialize_state(&bi, hash)
+                  && undo_write_bytes(&bi, (uintmax_t)kv_size(buf->b_u_freed), 4);
+  for (size_t i = 0; write_ok && i < kv_size(buf->b_u_freed); i++) {
+    write_ok = undo_write_bytes(&bi, (uintmax_t)kv_A(buf->b_u_freed, i), 4);
+  }
+  write_ok = write_ok
+             && serialize_uhps(&bi, true, true) >= 0
+             && undo_write_bytes(&bi, (uintmax_t)UF_HEADER_END_MAGIC, 2)
+             && fflush(fp) == 0
+             && (!p_fs || os_fsync(fd) == 0);
+
+  if (write_ok) {
+    u_undofile_synced(buf, fd);
+  } else {
+    buf->b_u_file_valid = false;
+  }
+  fclose(fp);
+  return write_ok ? OK : FAIL;
+}
+
 /// Write the undo tree in an undo file.
 ///
 /// @param[in]  name  Name of the undo file or NULL if this function needs to
@@ -1175,9 +1481,6 @@ void u_write_undo(const char *const name, const bool forceit, buf_T *const buf,
   FUNC_ATTR_NONNULL_ARG(3, 4)
 {
   char *file_name;
-#ifdef U_DEBUG
-  int headers_written = 0;
-#endif
   FILE *fp = NULL;
   bool write_ok = false;
 
@@ -1209,6 +1512,22 @@ void u_write_undo(const char *const name, const bool forceit, buf_T *const buf,
   // Strip any sticky and executable bits.
   perm = perm & 0666;
 
+  if (name == NULL) {
+    // When the undo file is the one last written or read for this buffer,
+    // only append what changed since then.
+    if (buf->b_u_numhead > 0 || buf->b_u_line_ptr != NULL) {
+      int ret = u_write_undo_journal(buf, file_name, hash);
+      if (ret != NOTDONE) {
+        if (ret == FAIL) {
+          semsg(_(e_write_error_in_undo_file_str), file_name);
+        }
+        goto theend;
+      }
+    }
+    // Otherwise it is written from scratch.
+    buf->b_u_file_valid = false;
+  }
+
   int fd;
 
   // If the undo file already exists, verify that it actually is an undo
@@ -1313,35 +1632,11 @@ void u_write_undo(const char *const name, const bool forceit, buf_T *const buf,
     goto write_error;
   }
 
-  // Iteratively serialize UHPs and their UEPs from the top down.
-  int mark = ++lastmark;
-  u_header_T *uhp = buf->b_u_oldhead;
-  while (uhp != NULL) {
-    // Serialize current UHP if we haven't seen it
-    if (uhp->uh_walk != mark) {
-      uhp->uh_walk = mark;
-#ifdef U_DEBUG
-      headers_written++;
-#endif
-      if (!serialize_uhp(&bi, uhp)) {
-        goto write_error;
-      }
-    }
-
-    // Now walk through the tree - algorithm from undo_time().
-    if (uhp->uh_prev.ptr != NULL && uhp->uh_prev.ptr->uh_walk != mark) {
-      uhp = uhp->uh_prev.ptr;
-    } else if (uhp->uh_alt_next.ptr != NULL
-               && uhp->uh_alt_next.ptr->uh_walk != mark) {
-      uhp = uhp->uh_alt_next.ptr;
-    } else if (uhp->uh_next.ptr != NULL && uhp->uh_alt_prev.ptr == NULL
-               && uhp->uh_next.ptr->uh_walk != mark) {
-      uhp = uhp->uh_next.ptr;
-    } else if (uhp->uh_alt_prev.ptr != NULL) {
-      uhp = uhp->uh_alt_prev.ptr;
-    } else {
-      uhp = uhp->uh_next.ptr;
-    }
+  // Iteratively serialize UHPs and their UEPs from the top down.  The undo
+  // file of the buffer is up to date with all of them afterwards.
+  int headers_written = serialize_uhps(&bi, false, name == NULL);
+  if (headers_written < 0) {
+    goto write_error;
   }
 
   if (undo_write_bytes(&bi, (uintmax_t)UF_HEADER_END_MAGIC, 2)) {
@@ -1357,6 +1652,11 @@ void u_write_undo(const char *const name, const bool forceit, buf_T *const buf,
   if (p_fs && fflush(fp) == 0 && os_fsync(fd) != 0) {
     write_ok = false;
   }
+  if (write_ok && name == NULL && fflush(fp) == 0) {
+    // Following writes append the changes to this file.
+    u_undofile_synced(buf, fd);
+    buf->b_u_file_base = buf->b_u_file_size;
+  }
 
 write_error:
   fclose(fp);
@@ -1385,8 +1685,8 @@ theend:
 void u_read_undo(char *name, const uint8_t *hash, const char *orig_name FUNC_ATTR_UNUSED)
   FUNC_ATTR_NONNULL_ARG(2)
 {
-  u_header_T **uhp_table = NULL;
-  char *line_ptr = NULL;
+  undo_state_T state = { 0 };
+  PMap(int) uhp_map = MAP_INIT;
 
   char *file_name;
   if (name == NULL) {
@@ -1449,210 +1749,101 @@ void u_read_undo(char *name, const uint8_t *hash, const char *orig_name FUNC_ATT
     goto error;
   }
 
-  uint8_t read_hash[UNDO_HASH_SIZE];
-  if (!undo_read(&bi, read_hash, UNDO_HASH_SIZE)) {
-    corruption_error("hash", file_name);
-    goto error;
-  }
-  linenr_T line_count = (linenr_T)undo_read_4c(&bi);
-  if (memcmp(hash, read_hash, UNDO_HASH_SIZE) != 0
-      || line_count != curbuf->b_ml.ml_line_count) {
-    if (p_verbose > 0 || name != NULL) {
-      if (name == NULL) {
-        verbose_enter();
-      }
-      give_warning(_("File contents changed, cannot use undo info"), true);
-      if (name == NULL) {
-        verbose_leave();
-      }
-    }
-    goto error;
-  }
-
-  // Read undo data for "U" command.
-  int str_len = undo_read_4c(&bi);
-  if (str_len < 0) {
+  if (!unserialize_state(&bi, &state, file_name)) {
     goto error;
   }
 
-  if (str_len > 0) {
-    line_ptr = undo_read_string(&bi, (size_t)str_len);
-  }
-  linenr_T line_lnum = (linenr_T)undo_read_4c(&bi);
-  colnr_T line_colnr = (colnr_T)undo_read_4c(&bi);
-  if (line_lnum < 0 || line_colnr < 0) {
-    corruption_error("line lnum/col", file_name);
+  // uhp_map stores the freshly created undo headers we allocate until we
+  // insert them into curbuf, keyed by their sequence numbers.
+  if (!unserialize_uhps(&bi, &uhp_map, false, file_name)) {
     goto error;
   }
+  const long base_size = ftell(fp);
 
-  // Begin general undo data
-  int old_header_seq = undo_read_4c(&bi);
-  int new_header_seq = undo_read_4c(&bi);
-  int cur_header_seq = undo_read_4c(&bi);
-  int num_head = undo_read_4c(&bi);
-  int seq_last = undo_read_4c(&bi);
-  int seq_cur = undo_read_4c(&bi);
-  time_t seq_time = undo_read_time(&bi);
-
-  // Optional header fields.
-  int last_save_nr = 0;
-  while (true) {
-    int len = undo_read_byte(&bi);
-
-    if (len == 0 || len == EOF) {
-      break;
+  // Apply the journal records appended by later writes: each one has the
+  // undo state at the time, the headers freed and the headers changed.
+  int c;
+  while ((c = undo_read_2c(&bi)) == UF_JOURNAL_MAGIC) {
+    if (!unserialize_state(&bi, &state, file_name)) {
+      goto error;
     }
-    int what = undo_read_byte(&bi);
-    switch (what) {
-    case UF_LAST_SAVE_NR:
-      last_save_nr = undo_read_4c(&bi);
-      break;
-
-    default:
-      // field not supported, skip
-      while (--len >= 0) {
-        undo_read_byte(&bi);
-      }
+    int num_freed = undo_read_4c(&bi);
+    if (num_freed < 0) {
+      corruption_error("journal", file_name);
+      goto error;
     }
-  }
-
-  // uhp_table will store the freshly created undo headers we allocate
-  // until we insert them into curbuf. The table remains sorted by the
-  // sequence numbers of the headers.
-  // When there are no headers uhp_table is NULL.
-  if (num_head > 0) {
-    if ((size_t)num_head < SIZE_MAX / sizeof(*uhp_table)) {
-      uhp_table = xmalloc((size_t)num_head * sizeof(*uhp_table));
+    for (int i = 0; i < num_freed; i++) {
+      u_header_T *uhp = pmap_del(int)(&uhp_map, undo_read_4c(&bi), NULL);
+      if (uhp != NULL) {
+        u_free_uhp(uhp);
+      }
     }
-  }
-
-  int num_read_uhps = 0;
-
-  int c;
-  while ((c = undo_read_2c(&bi)) == UF_HEADER_MAGIC) {
-    if (num_read_uhps >= num_head) {
-      corruption_error("num_head too small", file_name);
+    if (!unserialize_uhps(&bi, &uhp_map, true, file_name)) {
       goto error;
     }
+  }
 
-    u_header_T *uhp = unserialize_uhp(&bi, file_name);
-    if (uhp == NULL) {
-      goto error;
+  if (memcmp(hash, state.hash, UNDO_HASH_SIZE) != 0
+      || state.line_count != curbuf->b_ml.ml_line_count) {
+    if (p_verbose > 0 || name != NULL) {
+      if (name == NULL) {
+        verbose_enter();
+      }
+      give_warning(_("File contents changed, cannot use undo info"), true);
+      if (name == NULL) {
+        verbose_leave();
+      }
     }
-    uhp_table[num_read_uhps++] = uhp;
+    goto error;
   }
 
-  if (num_read_uhps != num_head) {
+  if (map_size(&uhp_map) != (uint32_t)state.num_head) {
     corruption_error("num_head", file_name);
     goto error;
   }
-  if (c != UF_HEADER_END_MAGIC) {
-    corruption_error("end marker", file_name);
-    goto error;
-  }
-
-#ifdef U_DEBUG
-  size_t amount = num_head * sizeof(int) + 1;
-  int *uhp_table_used = xmalloc(amount);
-  memset(uhp_table_used, 0, amount);
-# define SET_FLAG(j) ++uhp_table_used[j]
-#else
-# define SET_FLAG(j)
-#endif
 
-  // We have put all of the headers into a table. Now we iterate through the
-  // table and swizzle each sequence number we have stored in uh_*_seq into
-  // a pointer corresponding to the header with that sequence number.
-  int16_t old_idx = -1;
-  int16_t new_idx = -1;
-  int16_t cur_idx = -1;
-  for (int i = 0; i < num_head; i++) {
-    u_header_T *uhp = uhp_table[i];
-    if (uhp == NULL) {
-      continue;
-    }
-    for (int j = 0; j < num_head; j++) {
-      if (uhp_table[j] != NULL && i != j
-          && uhp_table[i]->uh_seq == uhp_table[j]->uh_seq) {
-        corruption_error("duplicate uh_seq", file_name);
-        goto error;
-      }
-    }
-    for (int j = 0; j < num_head; j++) {
-      if (uhp_table[j] != NULL
-          && uhp_table[j]->uh_seq == uhp->uh_next.seq) {
-        uhp->uh_next.ptr = uhp_table[j];
-        SET_FLAG(j);
-        break;
-      }
-    }
-    for (int j = 0; j < num_head; j++) {
-      if (uhp_table[j] != NULL
-          && uhp_table[j]->uh_seq == uhp->uh_prev.seq) {
-        uhp->uh_prev.ptr = uhp_table[j];
-        SET_FLAG(j);
-        break;
-      }
-    }
-    for (int j = 0; j < num_head; j++) {
-      if (uhp_table[j] != NULL
-          && uhp_table[j]->uh_seq == uhp->uh_alt_next.seq) {
-        uhp->uh_alt_next.ptr = uhp_table[j];
-        SET_FLAG(j);
-        break;
-      }
-    }
-    for (int j = 0; j < num_head; j++) {
-      if (uhp_table[j] != NULL
-          && uhp_table[j]->uh_seq == uhp->uh_alt_prev.seq) {
-        uhp->uh_alt_prev.ptr = uhp_table[j];
-        SET_FLAG(j);
-        break;
-      }
-    }
-    if (old_header_seq > 0 && old_idx < 0 && uhp->uh_seq == old_header_seq) {
-      assert(i <= INT16_MAX);
-      old_idx = (int16_t)i;
-      SET_FLAG(i);
-    }
-    if (new_header_seq > 0 && new_idx < 0 && uhp->uh_seq == new_header_seq) {
-      assert(i <= INT16_MAX);
-      new_idx = (int16_t)i;
-      SET_FLAG(i);
-    }
-    if (cur_header_seq > 0 && cur_idx < 0 && uhp->uh_seq == cur_header_seq) {
-      assert(i <= INT16_MAX);
-      cur_idx = (int16_t)i;
-      SET_FLAG(i);
-    }
-  }
+  // We have put all of the headers into a map. Now we iterate through them
+  // and swizzle each sequence number we have stored in uh_*_seq into a
+  // pointer to the header with that sequence number.
+  u_header_T *uhp;
+  map_foreach_value(&uhp_map, uhp, {
+    uhp->uh_next.ptr = pmap_get(int)(&uhp_map, uhp->uh_next.seq);
+    uhp->uh_prev.ptr = pmap_get(int)(&uhp_map, uhp->uh_prev.seq);
+    uhp->uh_alt_next.ptr = pmap_get(int)(&uhp_map, uhp->uh_alt_next.seq);
+    uhp->uh_alt_prev.ptr = pmap_get(int)(&uhp_map, uhp->uh_alt_prev.seq);
+  });
 
   // Now that we have read the undo info successfully, free the current undo
   // info and use the info from the file.
   u_blockfree(curbuf);
-  curbuf->b_u_oldhead = old_idx < 0 ? NULL : uhp_table[old_idx];
-  curbuf->b_u_newhead = new_idx < 0 ? NULL : uhp_table[new_idx];
-  curbuf->b_u_curhead = cur_idx < 0 ? NULL : uhp_table[cur_idx];
-  curbuf->b_u_line_ptr = line_ptr;
-  curbuf->b_u_line_lnum = line_lnum;
-  curbuf->b_u_line_colnr = line_colnr;
-  curbuf->b_u_numhead = num_head;
-  curbuf->b_u_seq_last = seq_last;
-  curbuf->b_u_seq_cur = seq_cur;
-  curbuf->b_u_time_cur = seq_time;
-  curbuf->b_u_save_nr_last = last_save_nr;
-  curbuf->b_u_save_nr_cur = last_save_nr;
+  curbuf->b_u_oldhead = pmap_get(int)(&uhp_map, state.old_header_seq);
+  curbuf->b_u_newhead = pmap_get(int)(&uhp_map, state.new_header_seq);
+  curbuf->b_u_curhead = pmap_get(int)(&uhp_map, state.cur_header_seq);
+  curbuf->b_u_line_ptr = state.line_ptr;
+  curbuf->b_u_line_lnum = state.line_lnum;
+  curbuf->b_u_line_colnr = state.line_colnr;
+  curbuf->b_u_numhead = state.num_head;
+  curbuf->b_u_memused = 0;
+  map_foreach_value(&uhp_map, uhp, {
+    curbuf->b_u_memused += u_header_memsize(uhp);
+  });
+  curbuf->b_u_seq_last = state.seq_last;
+  curbuf->b_u_seq_cur = state.seq_cur;
+  curbuf->b_u_time_cur = state.seq_time;
+  curbuf->b_u_save_nr_last = state.last_save_nr;
+  curbuf->b_u_save_nr_cur = state.last_save_nr;
 
   curbuf->b_u_synced = true;
-  xfree(uhp_table);
+  map_destroy(int, &uhp_map);
 
-#ifdef U_DEBUG
-  for (int i = 0; i < num_head; i++) {
-    if (uhp_table_used[i] == 0) {
-      semsg("uhp_table entry %" PRId64 " not used, leaking memory", (int64_t)i);
-    }
+  // Writing the undo file for the buffer can append to this file, unless
+  // there is something after the records.
+  if (name == NULL && c == -1 && base_size > 0) {
+    u_undofile_synced(curbuf, fileno(fp));
+    curbuf->b_u_file_base = (uint64_t)base_size;
   }
-  xfree(uhp_table_used);
+
+#ifdef U_DEBUG
   u_check(true);
 #endif
 
@@ -1662,15 +1853,11 @@ void u_read_undo(char *name, const uint8_t *hash, const char *orig_name FUNC_ATT
   goto theend;
 
 error:
-  xfree(line_ptr);
-  if (uhp_table != NULL) {
-    for (int i = 0; i < num_read_uhps; i++) {
-      if (uhp_table[i] != NULL) {
-        u_free_uhp(uhp_table[i]);
-      }
-    }
-    xfree(uhp_table);
-  }
+  xfree(state.line_ptr);
+  map_foreach_value(&uhp_map, uhp, {
+    u_free_uhp(uhp);
+  });
+  map_destroy(int, &uhp_map);
 
 theend:
   if (fp != NULL) {
@@ -1836,6 +2023,7 @@ bool u_undo_and_forget(int count, bool do_buf_event)
   if (curbuf->b_u_curhead) {
     to_forget->uh_alt_next.ptr = NULL;
     curbuf->b_u_curhead->uh_alt_prev.ptr = to_forget->uh_alt_prev.ptr;
+    u_header_touch(curbuf->b_u_curhead);
     curbuf->b_u_seq_cur = curbuf->b_u_curhead->uh_next.ptr
                           ? curbuf->b_u_curhead->uh_next.ptr->uh_seq : 0;
   } else if (curbuf->b_u_newhead) {
@@ -1843,9 +2031,11 @@ bool u_undo_and_forget(int count, bool do_buf_event)
   }
   if (to_forget->uh_alt_prev.ptr) {
     to_forget->uh_alt_prev.ptr->uh_alt_next.ptr = curbuf->b_u_curhead;
+    u_header_touch(to_forget->uh_alt_prev.ptr);
   }
   if (curbuf->b_u_newhead) {
     curbuf->b_u_newhead->uh_prev.ptr = curbuf->b_u_curhead;
+    u_header_touch(curbuf->b_u_newhead);
   }
   if (curbuf->b_u_seq_last == to_forget->uh_seq) {
     curbuf->b_u_seq_last--;
@@ -2200,11 +2390,15 @@ target_zero:
           }
           if (last->uh_alt_next.ptr != NULL) {
             last->uh_alt_next.ptr->uh_alt_prev.ptr = last->uh_alt_prev.ptr;
+            u_header_touch(last->uh_alt_next.ptr);
           }
           last->uh_alt_prev.ptr->uh_alt_next.ptr = last->uh_alt_next.ptr;
+          u_header_touch(last->uh_alt_prev.ptr);
           last->uh_alt_prev.ptr = NULL;
           last->uh_alt_next.ptr = uhp;
           uhp->uh_alt_prev.ptr = last;
+          u_header_touch(last);
+          u_header_touch(uhp);
 
           if (curbuf->b_u_oldhead == uhp) {
             curbuf->b_u_oldhead = last;
@@ -2212,6 +2406,7 @@ target_zero:
           uhp = last;
           if (uhp->uh_next.ptr != NULL) {
             uhp->uh_next.ptr->uh_prev.ptr = uhp;
+            u_header_touch(uhp->uh_next.ptr);
           }
         }
         curbuf->b_u_curhead = uhp;
@@ -2263,7 +2458,6 @@ target_zero:
 /// @param do_buf_event If `true`, send buffer updates.
 static void u_undoredo(bool undo, bool do_buf_event)
 {
-  char **newarray = NULL;
   linenr_T newlnum = MAXLNUM;
   u_entry_T *nuep;
   u_entry_T *newlist = NULL;
@@ -2322,10 +2516,12 @@ static void u_undoredo(bool undo, bool do_buf_event)
         // undoing auto-formatting puts the cursor in the previous
         // line.
         int i;
+        char *line = uep->ue_text;
         for (i = 0; i < newsize && i < oldsize; i++) {
-          if (strcmp(uep->ue_array[i], ml_get(top + 1 + (linenr_T)i)) != 0) {
+          if (strcmp(line, ml_get(top + 1 + (linenr_T)i)) != 0) {
             break;
           }
+          line += strlen(line) + 1;
         }
         if (i == newsize && newlnum == MAXLNUM && uep->ue_next == NULL) {
           newlnum = top;
@@ -2339,15 +2535,13 @@ static void u_undoredo(bool undo, bool do_buf_event)
 
     bool empty_buffer = false;
 
-    // delete the lines between top and bot and save them in newarray
+    // delete the lines between top and bot and save them in "newtext"
+    u_entry_T newtext = { 0 };
     if (oldsize > 0) {
-      newarray = xmalloc(sizeof(char *) * (size_t)oldsize);
+      u_entry_add_lines(curbuf, &newtext, top + 1, oldsize);
+      u_entry_trim(&newtext);
       // delete backwards, it goes faster in most cases
-      int i;
-      linenr_T lnum;
-      for (lnum = bot - 1, i = oldsize; --i >= 0; lnum--) {
-        // what can we do when we run out of memory?
-        newarray[i] = u_save_line(lnum);
+      for (linenr_T lnum = bot - 1; lnum > top; lnum--) {
         // remember we deleted the last line in the buffer, and a
         // dummy empty line will be inserted
         if (curbuf->b_ml.ml_line_count == 1) {
@@ -2355,26 +2549,27 @@ static void u_undoredo(bool undo, bool do_buf_event)
         }
         ml_delete(lnum, false);
       }
-    } else {
-      newarray = NULL;
     }
 
-    // insert the lines in u_array between top and bot
+    // insert the lines in ue_text between top and bot
     if (newsize) {
       int i;
       linenr_T lnum;
+      char *line = uep->ue_text;
       for (lnum = top, i = 0; i < newsize; i++, lnum++) {
         // If the file is empty, there is an empty line 1 that we
         // should get rid of, by replacing it with the new line
         if (empty_buffer && lnum == 0) {
-          ml_replace(1, uep->ue_array[i], true);
+          ml_replace(1, line, true);
         } else {
-          ml_append(lnum, uep->ue_array[i], 0, false);
+          ml_append(lnum, line, 0, false);
         }
-        xfree(uep->ue_array[i]);
+        line += strlen(line) + 1;
       }
-      xfree(uep->ue_array);
     }
+    curbuf->b_u_memused += newtext.ue_textcap;
+    curbuf->b_u_memused -= uep->ue_textcap;
+    xfree(uep->ue_text);
 
     // Adjust marks
     if (oldsize != newsize) {
@@ -2409,7 +2604,9 @@ static void u_undoredo(bool undo, bool do_buf_event)
     u_newcount += newsize;
     u_oldcount += oldsize;
     uep->ue_size = oldsize;
-    uep->ue_array = newarray;
+    uep->ue_text = newtext.ue_text;
+    uep->ue_textlen = newtext.ue_textlen;
+    uep->ue_textcap = newtext.ue_textcap;
     uep->ue_bot = top + newsize + 1;
 
     // insert this entry in front of the new entry list
@@ -2446,6 +2643,7 @@ static void u_undoredo(bool undo, bool do_buf_event)
 
   curhead->uh_entry = newlist;
   curhead->uh_flags = new_flags;
+  u_header_touch(curhead);
   if ((old_flags & UH_EMPTYBUF) && buf_is_empty(curbuf)) {
     curbuf->b_ml.ml_flags |= ML_EMPTY;
   }
@@ -2662,6 +2860,14 @@ void u_sync(bool force)
   } else {
     u_getbot(curbuf);  // compute ue_bot of previous u_save
     curbuf->b_u_curhead = NULL;
+
+    // Lines are no longer added to the last entry, give back unused space.
+    u_entry_T *uep = curbuf->b_u_newhead != NULL ? curbuf->b_u_newhead->uh_entry : NULL;
+    if (uep != NULL) {
+      curbuf->b_u_memused -= uep->ue_textcap;
+      u_entry_trim(uep);
+      curbuf->b_u_memused += uep->ue_textcap;
+    }
   }
 }
 
@@ -2788,18 +2994,22 @@ void u_find_first_changed(void)
   }
 
   linenr_T lnum;
+  char *line = uep->ue_text;
   for (lnum = 1; lnum < curbuf->b_ml.ml_line_count
        && lnum <= uep->ue_size; lnum++) {
-    if (strcmp(ml_get_buf(curbuf, lnum), uep->ue_array[lnum - 1]) != 0) {
+    if (strcmp(ml_get_buf(curbuf, lnum), line) != 0) {
       clearpos(&(uhp->uh_cursor));
       uhp->uh_cursor.lnum = lnum;
+      u_header_touch(uhp);
       return;
     }
+    line += strlen(line) + 1;
   }
   if (curbuf->b_ml.ml_line_count != uep->ue_size) {
     // lines added or deleted at the end, put the cursor there
     clearpos(&(uhp->uh_cursor));
     uhp->uh_cursor.lnum = lnum;
+    u_header_touch(uhp);
   }
 }
 
@@ -2817,13 +3027,17 @@ void u_update_save_nr(buf_T *buf)
   }
   if (uhp != NULL) {
     uhp->uh_save_nr = buf->b_u_save_nr_last;
+    u_header_touch(uhp);
   }
 }
 
 static void u_unch_branch(u_header_T *uhp)
 {
   for (u_header_T *uh = uhp; uh != NULL; uh = uh->uh_prev.ptr) {
-    uh->uh_flags |= UH_CHANGED;
+    if (!(uh->uh_flags & UH_CHANGED)) {
+      uh->uh_flags |= UH_CHANGED;
+      u_header_touch(uh);
+    }
     if (uh->uh_alt_next.ptr != NULL) {
       u_unch_branch(uh->uh_alt_next.ptr);           // recursive
     }
@@ -2884,6 +3098,7 @@ static void u_freeheader(buf_T *buf, u_header_T *uhp, u_header_T **uhpp)
 
   if (uhp->uh_alt_prev.ptr != NULL) {
     uhp->uh_alt_prev.ptr->uh_alt_next.ptr = NULL;
+    u_header_touch(uhp->uh_alt_prev.ptr);
   }
 
   // Update the links in the list to remove the header.
@@ -2891,6 +3106,7 @@ static void u_freeheader(buf_T *buf, u_header_T *uhp, u_header_T **uhpp)
     buf->b_u_oldhead = uhp->uh_prev.ptr;
   } else {
     uhp->uh_next.ptr->uh_prev.ptr = uhp->uh_prev.ptr;
+    u_header_touch(uhp->uh_next.ptr);
   }
 
   if (uhp->uh_prev.ptr == NULL) {
@@ -2899,6 +3115,7 @@ static void u_freeheader(buf_T *buf, u_header_T *uhp, u_header_T **uhpp)
     for (u_header_T *uhap = uhp->uh_prev.ptr; uhap != NULL;
          uhap = uhap->uh_alt_next.ptr) {
       uhap->uh_next.ptr = uhp->uh_next.ptr;
+      u_header_touch(uhap);
     }
   }
 
@@ -2921,6 +3138,7 @@ static void u_freebranch(buf_T *buf, u_header_T *uhp, u_header_T **uhpp)
 
   if (uhp->uh_alt_prev.ptr != NULL) {
     uhp->uh_alt_prev.ptr->uh_alt_next.ptr = NULL;
+    u_header_touch(uhp->uh_alt_prev.ptr);
   }
 
   u_header_T *next = uhp;
@@ -2954,10 +3172,15 @@ static void u_freeentries(buf_T *buf, u_header_T *uhp, u_header_T **uhpp)
   u_entry_T *nuep;
   for (u_entry_T *uep = uhp->uh_entry; uep != NULL; uep = nuep) {
     nuep = uep->ue_next;
-    u_freeentry(uep, uep->ue_size);
+    u_freeentry(buf, uep);
   }
 
   kv_destroy(uhp->uh_extmark);
+  buf->b_u_memused -= sizeof(u_header_T);
+  if (buf->b_u_file_valid) {
+    // Tell the next write of the undo file to drop this header.
+    kv_push(buf->b_u_freed, uhp->uh_seq);
+  }
 
 #ifdef U_DEBUG
   uhp->uh_magic = 0;
@@ -2966,13 +3189,16 @@ static void u_freeentries(buf_T *buf, u_header_T *uhp, u_header_T **uhpp)
   buf->b_u_numhead--;
 }
 
-/// free entry 'uep' and 'n' lines in uep->ue_array[]
-static void u_freeentry(u_entry_T *uep, int n)
+/// Free entry "uep".
+///
+/// @param buf  buffer whose undo memory is reduced, NULL when the entry was
+///             not counted
+static void u_freeentry(buf_T *buf, u_entry_T *uep)
 {
-  while (n > 0) {
-    xfree(uep->ue_array[--n]);
+  if (buf != NULL) {
+    buf->b_u_memused -= u_entry_memsize(uep);
   }
-  xfree(uep->ue_array);
+  xfree(uep->ue_text);
 #ifdef U_DEBUG
   uep->ue_magic = 0;
 #endif
@@ -2985,6 +3211,9 @@ void u_clearall(buf_T *buf)
   buf->b_u_newhead = buf->b_u_oldhead = buf->b_u_curhead = NULL;
   buf->b_u_synced = true;
   buf->b_u_numhead = 0;
+  buf->b_u_memused = 0;
+  buf->b_u_file_valid = false;
+  kv_size(buf->b_u_freed) = 0;
   buf->b_u_line_ptr = NULL;
   buf->b_u_line_lnum = 0;
 }
@@ -2992,6 +3221,8 @@ void u_clearall(buf_T *buf)
 /// Free all allocated memory blocks for the buffer 'buf'.
 void u_blockfree(buf_T *buf)
 {
+  buf->b_u_file_valid = false;
+  kv_destroy(buf->b_u_freed);
   while (buf->b_u_oldhead != NULL) {
 #ifndef NDEBUG
     u_header_T *previous_oldhead = buf->b_u_oldhead;
@@ -3077,6 +3308,66 @@ void u_undoline(void)
   check_cursor_col(curwin);
 }
 
+/// Make room for a line of "len" bytes at the end of the text of "uep".  The
+/// space for the text grows in steps, call u_entry_trim() when done adding.
+///
+/// @return  where to store the line, the terminating NUL is already there.
+static char *u_entry_new_line(u_entry_T *uep, size_t len)
+{
+  size_t needed = uep->ue_textlen + len + 1;
+  if (needed > uep->ue_textcap) {
+    uep->ue_textcap = MAX(needed, uep->ue_textcap * 2);
+    uep->ue_text = xrealloc(uep->ue_text, uep->ue_textcap);
+  }
+  char *line = uep->ue_text + uep->ue_textlen;
+  line[len] = NUL;
+  uep->ue_textlen = needed;
+  return line;
+}
+
+/// Add "count" lines of "buf" starting at "lnum" to the text of "uep".
+static void u_entry_add_lines(buf_T *buf, u_entry_T *uep, linenr_T lnum, linenr_T count)
+{
+  for (linenr_T i = 0; i < count; i++) {
+    char *line = ml_get_buf(buf, lnum + i);
+    size_t len = strlen(line);
+    memcpy(u_entry_new_line(uep, len), line, len);
+  }
+}
+
+/// Free the unused space at the end of the text of "uep".
+static void u_entry_trim(u_entry_T *uep)
+{
+  if (uep->ue_textcap > uep->ue_textlen) {
+    uep->ue_text = xrealloc(uep->ue_text, uep->ue_textlen);
+    uep->ue_textcap = uep->ue_textlen;
+  }
+}
+
+/// @return  the number of bytes used by entry "uep".
+static size_t u_entry_memsize(const u_entry_T *uep)
+{
+  return sizeof(u_entry_T) + uep->ue_textcap;
+}
+
+/// @return  the number of bytes used by header "uhp" and its entries.
+static size_t u_header_memsize(const u_header_T *uhp)
+{
+  size_t size = sizeof(u_header_T);
+  for (const u_entry_T *uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next) {
+    size += u_entry_memsize(uep);
+  }
+  return size;
+}
+
+/// @return  true when the undo information of "buf" uses more memory than
+///          'undomemory' allows.  Not while previewing a command, the
+///          preview must be undone.
+static bool u_over_memory(const buf_T *buf)
+{
+  return p_umem > 0 && !cmdpreview && buf->b_u_memused > (size_t)p_umem * 1024;
+}
+
 /// Allocate memory and copy curbuf line into it.
 ///
 /// @param lnum the line to copy
@@ -3232,5 +3523,6 @@ u_header_T *u_force_get_undo_header(buf_T *buf)
       }
     }
   }
+  u_header_touch(uhp);
   return uhp;
 }
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <stdbool.h>
 #include <time.h>
 
+#include "klib/kvec.h"
 #include "nvim/extmark_defs.h"
 #include "nvim/mark_defs.h"
 
@@ -9,6 +11,9 @@ enum { UNDO_HASH_SIZE = 32, };  ///< Size in bytes of the hash used in the undo
 
 typedef struct u_header u_header_T;
 
+/// Sequence numbers of undo headers.
+typedef kvec_t(int) u_seq_vec_t;
+
 /// Structure to store info about the Visual area.
 typedef struct {
   pos_T vi_start;       ///< start pos of last VIsual
@@ -23,8 +28,11 @@ struct u_entry {
   linenr_T ue_top;     ///< number of line above undo block
   linenr_T ue_bot;     ///< number of line below undo block
   linenr_T ue_lcount;  ///< linecount when u_save called
-  char **ue_array;     ///< array of lines in undo block
-  linenr_T ue_size;    ///< number of lines in ue_array
+  char *ue_text;       ///< lines in undo block, each one NUL terminated,
+                       ///< stored one after another
+  size_t ue_textlen;   ///< bytes used in ue_text
+  size_t ue_textcap;   ///< bytes allocated for ue_text
+  linenr_T ue_size;    ///< number of lines in ue_text
 #ifdef U_DEBUG
   int ue_magic;        ///< magic number to check allocation
 #endif
@@ -62,6 +70,7 @@ struct u_header {
   time_t uh_time;                 ///< timestamp when the change was made
   int uh_save_nr;                 ///< set when the file was saved after the
                                   ///< changes in this block
+  bool uh_dirty;                  ///< changed since the undo file was written
 #ifdef U_DEBUG
   int uh_magic;                   ///< magic number to check allocation
 #endif
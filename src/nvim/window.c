@@ -5272,6 +5272,7 @@ void win_free(win_T *wp, tabpage_T *tp)
   clear_virttext(&wp->w_config.footer_chunks);
 
   clear_matches(wp);
+  searchhl_cache_free(wp);
 
   free_jumplist(wp);
 
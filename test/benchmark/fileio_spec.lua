@@ -0,0 +1,90 @@
+local t = require('test.testutil')
+local n = require('test.functional.testnvim')()
+
+local clear = n.clear
+local exec_lua = n.exec_lua
+
+local fname = 'Xbench_fileio'
+
+local files = {
+  {
+    name = 'short lines',
+    line = function(i)
+      return ('line %d'):format(i)
+    end,
+    count = 2000000,
+  },
+  {
+    name = 'code lines',
+    line = function(i)
+      return ('    local value_%d = compute(%d, "some text") -- comment'):format(i, i)
+    end,
+    count = 1000000,
+  },
+  {
+    name = 'long lines',
+    line = function(i)
+      return ('%d '):format(i):rep(500)
+    end,
+    count = 20000,
+  },
+}
+
+describe('reading a large file', function()
+  before_each(function()
+    clear()
+
+    exec_lua([[
+      out = {}
+      function start()
+        ts = vim.uv.hrtime()
+      end
+      function stop(name)
+        out[#out+1] = ('%14.6f ms - %s'):format((vim.uv.hrtime() - ts) / 1000000, name)
+      end
+    ]])
+  end)
+
+  after_each(function()
+    for _, line in ipairs(exec_lua([[return out]])) do
+      print(line)
+    end
+    os.remove(fname)
+  end)
+
+  for _, file in ipairs(files) do
+    for _, ff in ipairs({ 'unix', 'dos' }) do
+      it(('%s, %s'):format(file.name, ff), function()
+        local lines = {}
+        for i = 1, file.count do
+          lines[i] = file.line(i)
+        end
+        t.write_file(fname, table.concat(lines, ff == 'dos' and '\r\n' or '\n') .. '\n')
+
+        exec_lua(
+          [[
+          local fname, name = ...
+          vim.cmd('set fileformats=unix,dos')
+
+          start()
+          vim.cmd.edit(fname)
+          stop(':edit ' .. name)
+          vim.cmd('bwipe!')
+
+          start()
+          vim.fn.readfile(fname)
+          stop('readfile() ' .. name)
+
+          vim.o.mapfilesize = 1
+          start()
+          vim.cmd.edit(fname)
+          stop(':edit with mapfilesize ' .. name)
+          vim.cmd('bwipe!')
+        ]],
+          fname,
+          ('%s, %s'):format(file.name, ff)
+        )
+      end)
+    end
+  end
+end)
@@ -0,0 +1,63 @@
+local n = require('test.functional.testnvim')()
+
+local clear = n.clear
+local exec_lua = n.exec_lua
+
+describe(':global', function()
+  local line_count = 1000000
+
+  before_each(function()
+    clear()
+
+    exec_lua(
+      [[
+      local line_count = ...
+      local lines = {}
+      for i = 1, line_count do
+        local level = i % 3 == 0 and 'DEBUG' or i % 7 == 0 and 'ERROR' or 'INFO'
+        lines[i] = ('2024-01-01 00:00:%02d %s request %d done'):format(i % 60, level, i)
+      end
+      vim.api.nvim_buf_set_lines(0, 0, -1, true, lines)
+
+      out = {}
+      function start()
+        ts = vim.uv.hrtime()
+      end
+      function stop(name)
+        out[#out+1] = ('%14.6f ms - %s'):format((vim.uv.hrtime() - ts) / 1000000, name)
+      end
+    ]],
+      line_count
+    )
+  end)
+
+  after_each(function()
+    for _, line in ipairs(exec_lua([[return out]])) do
+      print(line)
+    end
+  end)
+
+  local function bench(cmd)
+    it(cmd, function()
+      exec_lua(
+        [[
+        local cmd = ...
+        start()
+        vim.cmd(cmd)
+        stop(cmd)
+        start()
+        vim.cmd.undo()
+        stop('undo')
+      ]],
+        cmd
+      )
+    end)
+  end
+
+  bench([[g/DEBUG/d]])
+  bench([[g/DEBUG/d _]])
+  bench([[v/ERROR/d]])
+  bench([[g/DEBUG/normal! x]])
+  bench([[g/DEBUG/s/request/req/]])
+  bench([[g/DEBUG/m0]])
+end)
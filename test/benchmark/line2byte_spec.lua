@@ -0,0 +1,89 @@
+local n = require('test.functional.testnvim')()
+
+local clear = n.clear
+local exec_lua = n.exec_lua
+
+describe('line2byte() and byte2line()', function()
+  local line_count = 10000000
+  local queries = 100000
+
+  before_each(function()
+    clear()
+
+    exec_lua(
+      [[
+      local line_count = ...
+      local lines = {}
+      for i = 1, line_count do
+        lines[i] = ('line %d of the buffer'):format(i)
+      end
+      vim.api.nvim_buf_set_lines(0, 0, -1, true, lines)
+      math.randomseed(42)
+
+      out = {}
+      function start()
+        ts = vim.uv.hrtime()
+      end
+      function stop(name)
+        out[#out+1] = ('%14.6f ms - %s'):format((vim.uv.hrtime() - ts) / 1000000, name)
+      end
+    ]],
+      line_count
+    )
+  end)
+
+  after_each(function()
+    for _, line in ipairs(exec_lua([[return out]])) do
+      print(line)
+    end
+  end)
+
+  it(('random queries on %d lines'):format(line_count), function()
+    exec_lua(
+      [[
+      local line_count, queries = ...
+      local size = vim.fn.line2byte(line_count + 1)
+
+      start()
+      for _ = 1, queries do
+        vim.fn.line2byte(math.random(line_count))
+      end
+      stop('line2byte()')
+
+      start()
+      for _ = 1, queries do
+        vim.fn.byte2line(math.random(size - 1))
+      end
+      stop('byte2line()')
+
+      start()
+      for _ = 1, queries do
+        vim.api.nvim_buf_get_offset(0, math.random(line_count) - 1)
+      end
+      stop('nvim_buf_get_offset()')
+    ]],
+      line_count,
+      queries
+    )
+  end)
+
+  it(('queries after random edits on %d lines'):format(line_count), function()
+    exec_lua(
+      [[
+      local line_count, queries = ...
+
+      start()
+      for _ = 1, queries / 10 do
+        local lnum = math.random(line_count)
+        vim.api.nvim_buf_set_lines(0, lnum - 1, lnum, true, { 'changed', 'lines' })
+        vim.fn.line2byte(math.random(line_count))
+        vim.api.nvim_buf_set_lines(0, lnum - 1, lnum + 1, true, {})
+        vim.fn.byte2line(math.random(line_count))
+      end
+      stop('edit and query')
+    ]],
+      line_count,
+      queries
+    )
+  end)
+end)
@@ -0,0 +1,400 @@
+/// Benchmark for the regexp engines.
+///
+/// Compiles and executes a set of patterns with vim_regcomp() and
+/// vim_regexec_multi() on generated texts, for the backtracking and the NFA
+/// engine, and prints the results as one JSON object per line:
+///
+///   {"pattern": "c_number", "kind": "syntax", "engine": 1, "text": "code", ...}
+///
+/// "compile_ns" is the time to compile the pattern, "compile_cached_ns" the
+/// time when vim_regcomp() finds it in its cache.  "match_ns" is the time to
+/// find all matches in the text once, "mb_per_s" the throughput.  A text that
+/// could not be searched within the timeout has "timed_out" set, a pattern
+/// that gave an error (e.g. for 'maxmempattern') has "error" set.
+///
+/// Usage: regexp-bench [-t msec] [-T msec] [-p name] [file ...]
+///
+///   -t msec  minimal time spent on each pattern and text (default 200)
+///   -T msec  timeout for searching a text once (default 5000)
+///   -p name  only use the patterns whose name contains "name"
+///   file     also search the lines of "file"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvim/ascii_defs.h"
+#include "nvim/buffer_defs.h"
+#include "nvim/globals.h"
+#include "nvim/macros_defs.h"
+#include "nvim/main.h"
+#include "nvim/mbyte.h"
+#include "nvim/memline.h"
+#include "nvim/memory.h"
+#include "nvim/os/time.h"
+#include "nvim/pos_defs.h"
+#include "nvim/profile.h"
+#include "nvim/regexp.h"
+#include "nvim/regexp_defs.h"
+
+typedef struct {
+  const char *name;
+  const char *kind;  ///< "syntax", "search" or "pathological"
+  const char *pat;
+} bench_pattern_T;
+
+typedef struct {
+  char *name;
+  char **lines;
+  linenr_T count;
+  size_t bytes;
+} bench_text_T;
+
+static const bench_pattern_T patterns[] = {
+  // Like the patterns used in syntax files.
+  { "c_number", "syntax", "\\<\\d\\+\\%(u\\=l\\{0,2}\\|ll\\=u\\)\\>" },
+  { "c_string", "syntax", "\"\\%(\\\\.\\|[^\"\\\\]\\)*\"" },
+  { "c_todo", "syntax", "\\<\\%(TODO\\|FIXME\\|XXX\\)\\>" },
+  { "c_comment", "syntax", "/\\*\\_.\\{-}\\*/" },
+  { "function_call", "syntax", "\\<\\h\\w*\\ze\\s*(" },
+  { "html_tag", "syntax", "<\\/\\=\\a[^>]*>" },
+  // Typical searches.
+  { "literal", "search", "error" },
+  { "ignorecase_word", "search", "\\c\\<warning\\>" },
+  { "trailing_space", "search", "\\s\\+$" },
+  { "ipv4", "search", "\\<\\d\\{1,3}\\%(\\.\\d\\{1,3}\\)\\{3}\\>" },
+  { "alternatives", "search", "request\\|response\\|timeout\\|retry" },
+  { "include", "search", "^\\s*#\\s*include\\>" },
+  // Slow for one of the engines.
+  { "nested_star", "pathological", "\\(a*\\)*b" },
+  { "nested_plus", "pathological", "\\(x\\+x\\+\\)\\+y" },
+  { "not_cursor", "pathological", "\\s\\+\\%#\\@<!$" },
+  { "lookbehind", "pathological", "\\(foo.*\\)\\@<!bar" },
+};
+
+static const char *code_lines[] = {
+  "#include <stdio.h>",
+  "#include \"nvim/regexp.h\"",
+  "",
+  "/* Count the words in \"line\", a word is made of keyword",
+  " * characters. */",
+  "static int count_words(const char *line, size_t len)",
+  "{",
+  "  int count = 0;  // TODO: use vim_iswordc()",
+  "  for (size_t i = 0; i < len; i++) {",
+  "    if (line[i] == ' ' && line[i + 1] != ' ') {  ",
+  "      count += 1;",
+  "    }",
+  "  }",
+  "  printf(\"%d words in \\\"%s\\\"\\n\", count, line);",
+  "  return count > 0x7fffffffUL ? -1 : count;  /* FIXME */",
+  "}",
+  "",
+};
+
+static const char *log_levels[] = { "INFO", "WARNING", "ERROR", "DEBUG" };
+static const char *log_messages[] = { "request", "response", "timeout", "retry", "connection" };
+
+static const char *long_line_words[] = {
+  "lorem", "ipsum", "<b>dolor</b>", "foo", "bar", "sit", "amet", "127.0.0.1", "42", "aaaaab",
+};
+
+static int64_t min_time_ms = 200;
+static int64_t timeout_ms = 5000;
+
+static void text_add_line(bench_text_T *text, const char *line, size_t len)
+{
+  text->lines = xrealloc(text->lines, sizeof(char *) * ((size_t)text->count + 1));
+  text->lines[text->count++] = xmemdupz(line, len);
+  text->bytes += len + 1;
+}
+
+static bench_text_T text_code(void)
+{
+  bench_text_T text = { .name = xstrdup("code") };
+  for (int i = 0; i < 1000; i++) {
+    for (size_t j = 0; j < ARRAY_SIZE(code_lines); j++) {
+      text_add_line(&text, code_lines[j], strlen(code_lines[j]));
+    }
+  }
+  return text;
+}
+
+static bench_text_T text_log(void)
+{
+  bench_text_T text = { .name = xstrdup("log") };
+  char line[200];
+  for (int i = 0; i < 20000; i++) {
+    int len = snprintf(line, sizeof(line),
+                       "2024-05-%02d 12:%02d:%02d.%03d [%s] worker-%d: %s from 10.%d.%d.%d took %dms",
+                       i % 28 + 1, i / 60 % 60, i % 60, i % 1000,
+                       log_levels[i % ARRAY_SIZE(log_levels)], i % 8,
+                       log_messages[i % ARRAY_SIZE(log_messages)],
+                       i % 256, i / 7 % 256, i / 13 % 256, i * 7 % 3000);
+    text_add_line(&text, line, (size_t)len);
+  }
+  return text;
+}
+
+static bench_text_T text_long_line(void)
+{
+  bench_text_T text = { .name = xstrdup("long_line") };
+  size_t size = 1024 * 1024;
+  char *line = xmalloc(size + 32);
+  size_t len = 0;
+  for (int i = 0; len < size; i++) {
+    const char *word = long_line_words[i % ARRAY_SIZE(long_line_words)];
+    size_t wlen = strlen(word);
+    memcpy(line + len, word, wlen);
+    line[len + wlen] = ' ';
+    len += wlen + 1;
+  }
+  text_add_line(&text, line, len);
+  xfree(line);
+  return text;
+}
+
+static bench_text_T text_pathological(void)
+{
+  bench_text_T text = { .name = xstrdup("pathological") };
+  for (int i = 0; i < 2000; i++) {
+    if (i % 2 == 0) {
+      const char *line = "aaaaaaaaaaaaaaaaaaaaaaaa foo xxxxxxxxxxxxxxxxxxxxxxxx bar   ";
+      text_add_line(&text, line, strlen(line));
+    } else {
+      const char *line = "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx aaaaaaaaaaaaaaaaaaaaaaaaaaaaab";
+      text_add_line(&text, line, strlen(line));
+    }
+  }
+  return text;
+}
+
+static bench_text_T text_file(const char *fname)
+{
+  FILE *fd = fopen(fname, "rb");
+  if (fd == NULL) {
+    fprintf(stderr, "regexp-bench: cannot open %s\n", fname);
+    exit(2);
+  }
+  bench_text_T text = { .name = xstrdup(fname) };
+  char *data = NULL;
+  size_t size = 0;
+  size_t len = 0;
+  while (true) {
+    if (len == size) {
+      size = size == 0 ? 65536 : size * 2;
+      data = xrealloc(data, size);
+    }
+    size_t n = fread(data + len, 1, size - len, fd);
+    if (n == 0) {
+      break;
+    }
+    len += n;
+  }
+  fclose(fd);
+
+  size_t start = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] == '\n') {
+      text_add_line(&text, data + start, i - start);
+      start = i + 1;
+    }
+  }
+  if (start < len) {
+    text_add_line(&text, data + start, len - start);
+  }
+  xfree(data);
+  return text;
+}
+
+/// Put the lines of "text" in the current buffer.
+static void load_text(const bench_text_T *text)
+{
+  ml_close(curbuf, true);
+  curbuf->b_p_swf = false;
+  ml_open(curbuf);
+  for (linenr_T i = 0; i < text->count; i++) {
+    ml_append(i, text->lines[i], 0, false);
+  }
+  if (text->count > 0) {
+    ml_delete(text->count + 1, false);
+  }
+}
+
+/// Find all matches in the current buffer, like ":%s//" would.
+///
+/// @return  the number of matches.
+static int64_t find_matches(regmmatch_T *rm, int *timed_out)
+{
+  proftime_T tm = profile_setlimit(timeout_ms);
+  int64_t count = 0;
+  linenr_T lnum = 1;
+  colnr_T col = 0;
+
+  while (lnum <= curbuf->b_ml.ml_line_count) {
+    int nmatched = vim_regexec_multi(rm, curwin, curbuf, lnum, col, &tm, timed_out);
+    if (*timed_out || got_int) {
+      break;
+    }
+    if (nmatched == 0) {
+      lnum++;
+      col = 0;
+      continue;
+    }
+    count++;
+
+    lpos_T start = rm->startpos[0];
+    lpos_T end = rm->endpos[0];
+    if (end.lnum > start.lnum || end.col > start.col) {
+      // Continue at the end of the match.
+      lnum += end.lnum;
+      col = end.col;
+    } else {
+      // Empty match: continue at the next character.
+      lnum += start.lnum;
+      const char *p = ml_get_buf(curbuf, lnum) + start.col;
+      if (*p == NUL) {
+        lnum++;
+        col = 0;
+      } else {
+        col = start.col + utfc_ptr2len(p);
+      }
+    }
+  }
+  return count;
+}
+
+/// Average time in nanoseconds to compile "pat", using the cache of
+/// vim_regcomp() or not.
+static uint64_t compile_time(const char *pat, bool cached)
+{
+  uint64_t start = os_hrtime();
+  uint64_t elapsed = 0;
+  uint64_t count = 0;
+  vim_regcache_clear();
+  do {
+    if (!cached) {
+      vim_regcache_clear();
+    }
+    vim_regfree(vim_regcomp(pat, RE_MAGIC));
+    count++;
+    elapsed = os_hrtime() - start;
+  } while (count < 10 || elapsed < (uint64_t)min_time_ms * 1000000 / 4);
+  vim_regcache_clear();
+  return elapsed / count;
+}
+
+static void print_string(const char *s)
+{
+  putchar('"');
+  for (; *s != NUL; s++) {
+    uint8_t c = (uint8_t)(*s);
+    if (c == '"' || c == '\\') {
+      putchar('\\');
+      putchar(c);
+    } else if (c < 0x20) {
+      printf("\\u%04x", c);
+    } else {
+      putchar(c);
+    }
+  }
+  putchar('"');
+}
+
+static void run_bench(const bench_pattern_T *bp, int engine, const bench_text_T *text)
+{
+  char pat[200];
+  snprintf(pat, sizeof(pat), "\\%%#=%d%s", engine, bp->pat);
+  const int called_emsg_before = called_emsg;
+
+  uint64_t compile_ns = compile_time(pat, false);
+  uint64_t compile_cached_ns = compile_time(pat, true);
+
+  regmmatch_T rm = { .regprog = vim_regcomp(pat, RE_MAGIC), .rmm_ic = false };
+  const bool error = rm.regprog == NULL;
+  int64_t matches = 0;
+  int timed_out = false;
+  uint64_t runs = 0;
+  uint64_t start = os_hrtime();
+  uint64_t elapsed = 0;
+  while (rm.regprog != NULL) {
+    matches = find_matches(&rm, &timed_out);
+    runs++;
+    elapsed = os_hrtime() - start;
+    if (timed_out || elapsed >= (uint64_t)min_time_ms * 1000000) {
+      break;
+    }
+  }
+  vim_regfree(rm.regprog);
+  got_int = false;
+
+  uint64_t match_ns = runs > 0 ? elapsed / runs : 0;
+  double mb_per_s = match_ns > 0 ? (double)text->bytes / 1e6 / ((double)match_ns / 1e9) : 0;
+
+  printf("{\"pattern\": ");
+  print_string(bp->name);
+  printf(", \"kind\": ");
+  print_string(bp->kind);
+  printf(", \"regexp\": ");
+  print_string(bp->pat);
+  printf(", \"engine\": %d, \"text\": ", engine);
+  print_string(text->name);
+  printf(", \"lines\": %" PRId64 ", \"bytes\": %zu", (int64_t)text->count, text->bytes);
+  printf(", \"compile_ns\": %" PRIu64 ", \"compile_cached_ns\": %" PRIu64,
+         compile_ns, compile_cached_ns);
+  printf(", \"match_ns\": %" PRIu64 ", \"runs\": %" PRIu64 ", \"matches\": %" PRId64,
+         match_ns, runs, matches);
+  printf(", \"mb_per_s\": %.2f, \"timed_out\": %s, \"error\": %s}\n",
+         mb_per_s, timed_out ? "true" : "false",
+         error || called_emsg != called_emsg_before ? "true" : "false");
+  fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+  const char *filter = NULL;
+  bench_text_T *texts = NULL;
+  size_t ntexts = 0;
+
+  event_init();
+  early_init(NULL);
+  // Errors are reported in the output.
+  emsg_silent++;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      min_time_ms = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+      timeout_ms = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "usage: regexp-bench [-t msec] [-T msec] [-p name] [file ...]\n");
+      return 2;
+    } else {
+      texts = xrealloc(texts, sizeof(*texts) * (ntexts + 1));
+      texts[ntexts++] = text_file(argv[i]);
+    }
+  }
+
+  bench_text_T (*generators[])(void) = { text_code, text_log, text_long_line, text_pathological };
+  texts = xrealloc(texts, sizeof(*texts) * (ntexts + ARRAY_SIZE(generators)));
+  for (size_t i = 0; i < ARRAY_SIZE(generators); i++) {
+    texts[ntexts++] = generators[i]();
+  }
+
+  for (size_t t = 0; t < ntexts; t++) {
+    load_text(&texts[t]);
+    for (size_t p = 0; p < ARRAY_SIZE(patterns); p++) {
+      if (filter != NULL && strstr(patterns[p].name, filter) == NULL) {
+        continue;
+      }
+      for (int engine = 1; engine <= 2; engine++) {
+        run_bench(&patterns[p], engine, &texts[t]);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,92 @@
+local n = require('test.functional.testnvim')()
+
+local clear = n.clear
+local exec_lua = n.exec_lua
+
+describe(':substitute', function()
+  local line_count = 100000
+
+  before_each(function()
+    clear()
+
+    exec_lua(
+      [[
+      local line_count = ...
+      local lines = {}
+      for i = 1, line_count do
+        lines[i] = ('local foo_%d = foo(bar, foo.baz) -- foo'):format(i)
+      end
+      vim.api.nvim_buf_set_lines(0, 0, -1, true, lines)
+
+      out = {}
+      function start()
+        ts = vim.uv.hrtime()
+      end
+      function stop(name)
+        out[#out+1] = ('%14.6f ms - %s'):format((vim.uv.hrtime() - ts) / 1000000, name)
+      end
+    ]],
+      line_count
+    )
+  end)
+
+  after_each(function()
+    for _, line in ipairs(exec_lua([[return out]])) do
+      print(line)
+    end
+  end)
+
+  local function bench(name, cmd, setup)
+    it(name, function()
+      exec_lua(
+        [[
+        local name, cmd, setup = ...
+        if setup then
+          loadstring(setup)()
+        end
+        start()
+        vim.cmd(cmd)
+        stop(name)
+        start()
+        vim.cmd.undo()
+        stop(name .. ', undo')
+      ]],
+        name,
+        cmd,
+        setup
+      )
+    end)
+  end
+
+  bench('every line, all matches', [[%s/foo/quux/g]])
+  bench('every line, first match', [[%s/foo/quux/]])
+  bench('every tenth line', [[%s/^local foo_\d*0 /local quux /]])
+  bench('splitting lines', [[%s/, /,\r/]])
+
+  bench(
+    'every line, all matches, with on_lines and on_bytes',
+    [[%s/foo/quux/g]],
+    [[
+    vim.api.nvim_buf_attach(0, false, { on_lines = function() end, on_bytes = function() end })
+  ]]
+  )
+
+  bench(
+    'every tenth line, with on_lines',
+    [[%s/^local foo_\d*0 /local quux /]],
+    [[
+    vim.api.nvim_buf_attach(0, false, { on_lines = function() end })
+  ]]
+  )
+
+  bench(
+    'every line, all matches, with extmarks',
+    [[%s/foo/quux/g]],
+    [[
+    local ns = vim.api.nvim_create_namespace('')
+    for i = 0, vim.api.nvim_buf_line_count(0) - 1, 100 do
+      vim.api.nvim_buf_set_extmark(0, ns, i, 0, {})
+    end
+  ]]
+  )
+end)
@@ -0,0 +1,102 @@
+local n = require('test.functional.testnvim')()
+
+local clear = n.clear
+local exec_lua = n.exec_lua
+
+describe(':syntax keyword', function()
+  local line_count = 20000
+
+  before_each(function()
+    clear()
+
+    exec_lua(
+      [[
+      local line_count = ...
+      local lines = {}
+      for i = 1, line_count do
+        lines[i] = ('select foo_%d, bar from baz where qux_%d = %d and Quux is not null'):format(i, i, i)
+      end
+      vim.api.nvim_buf_set_lines(0, 0, -1, true, lines)
+
+      out = {}
+      function start()
+        ts = vim.uv.hrtime()
+      end
+      function stop(name)
+        out[#out+1] = ('%14.6f ms - %s'):format((vim.uv.hrtime() - ts) / 1000000, name)
+      end
+
+      -- Highlight every line up to its end.
+      function highlight_all()
+        for lnum = 1, line_count do
+          vim.fn.synID(lnum, #lines[lnum], 1)
+        end
+      end
+    ]],
+      line_count
+    )
+  end)
+
+  after_each(function()
+    for _, line in ipairs(exec_lua([[return out]])) do
+      print(line)
+    end
+  end)
+
+  local function bench(name, setup)
+    it(name, function()
+      exec_lua(
+        [[
+        local name, setup = ...
+        loadstring(setup)()
+        start()
+        highlight_all()
+        stop(name)
+      ]],
+        name,
+        setup
+      )
+    end)
+  end
+
+  -- Keywords like in a SQL syntax file, only a few of them appear in the text.
+  local keywords = [[
+    local words = {}
+    for i = 1, 2000 do
+      words[#words + 1] = ('kw%d_%s'):format(i, ('x'):rep(i % 12))
+    end
+    vim.list_extend(words, { 'select', 'from', 'where', 'and', 'is', 'not', 'null' })
+  ]]
+
+  bench(
+    'matching case',
+    keywords .. [[
+    for i = 1, #words, 100 do
+      vim.cmd('syntax keyword Keyword ' .. table.concat(words, ' ', i, math.min(i + 99, #words)))
+    end
+  ]]
+  )
+
+  bench(
+    'ignoring case',
+    keywords .. [[
+    vim.cmd('syntax case ignore')
+    for i = 1, #words, 100 do
+      vim.cmd('syntax keyword Keyword ' .. table.concat(words, ' ', i, math.min(i + 99, #words)))
+    end
+  ]]
+  )
+
+  bench(
+    'matching and ignoring case',
+    keywords .. [[
+    for i = 1, #words, 200 do
+      vim.cmd('syntax keyword Keyword ' .. table.concat(words, ' ', i, math.min(i + 99, #words)))
+    end
+    vim.cmd('syntax case ignore')
+    for i = 101, #words, 200 do
+      vim.cmd('syntax keyword Keyword ' .. table.concat(words, ' ', i, math.min(i + 99, #words)))
+    end
+  ]]
+  )
+end)
@@ -1956,6 +1956,51 @@ describe('api/buf', function()
       eq(0, get_offset(0, 0))
       eq(5, get_offset(0, 1))
     end)
+
+    it('works when reading and changing distant lines in turn', function()
+      eq(
+        {},
+        exec_lua([[
+          local lines = {}
+          for i = 1, 100000 do
+            lines[i] = ('line %d'):format(i)
+          end
+          vim.api.nvim_buf_set_lines(0, 0, -1, true, lines)
+
+          local function offset(lnum)
+            local size = 0
+            for i = 1, lnum - 1 do
+              size = size + #lines[i] + 1
+            end
+            return size
+          end
+
+          local errors = {}
+          local function check(lnum)
+            local line = vim.api.nvim_buf_get_lines(0, lnum - 1, lnum, true)[1]
+            if line ~= lines[lnum] then
+              errors[#errors + 1] = ('line %d: %s'):format(lnum, line)
+            end
+            if vim.api.nvim_buf_get_offset(0, lnum - 1) ~= offset(lnum) then
+              errors[#errors + 1] = ('offset of line %d'):format(lnum)
+            end
+          end
+
+          for round = 1, 20 do
+            for _, lnum in ipairs({ 100, 50000, 99000, 25000 }) do
+              check(lnum + round)
+              check(lnum - round)
+            end
+            local lnum = round * 4000
+            table.insert(lines, lnum, ('new %d'):format(round))
+            vim.api.nvim_buf_set_lines(0, lnum - 1, lnum - 1, true, { lines[lnum] })
+            table.remove(lines, lnum + 2000)
+            vim.api.nvim_buf_set_lines(0, lnum + 1999, lnum + 2000, true, {})
+          end
+          return errors
+        ]])
+      )
+    end)
   end)
 
   describe('nvim_buf_get_var, nvim_buf_set_var, nvim_buf_del_var', function()
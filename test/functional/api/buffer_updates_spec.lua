@@ -615,6 +615,25 @@ describe('API: buffer events:', function()
     expectn('nvim_buf_lines_event', { b, tick, 0, 5, { 'A', 'B', 'C', 'D', 'E' }, false })
   end)
 
+  it('works with :substitute on lines far apart', function()
+    local lines = {}
+    for i = 1, 20 do
+      lines[i] = 'line ' .. i
+    end
+    local b, tick = editoriginal(true, lines)
+    -- nearby lines are sent together, lines further apart by themselves
+    command([[%s/line \(2\|3\|18\)$/foo/]])
+    expectn('nvim_buf_lines_event', { b, tick + 1, 1, 3, { 'foo', 'foo' }, false })
+    expectn('nvim_buf_lines_event', { b, tick + 2, 17, 18, { 'foo' }, false })
+    eq(tick + 2, eval('b:changedtick'))
+
+    -- splitting lines
+    tick = reopen(b, lines)
+    command([[%s/line \(1\|20\)$/&\r/]])
+    expectn('nvim_buf_lines_event', { b, tick + 1, 0, 1, { 'line 1', '' }, false })
+    expectn('nvim_buf_lines_event', { b, tick + 2, 20, 21, { 'line 20', '' }, false })
+  end)
+
   it('works with :left', function()
     local b, tick = editoriginal(true, { ' A', '  B', 'B', '\tB', '\t\tC' })
     command('2,4left')
@@ -1126,6 +1126,25 @@ describe('API/extmarks', function()
     check_undo_redo(ns, marks[3], 0, 4, 0, 8)
   end)
 
+  it('undo of a substitute keeps marks in unchanged lines between matches', function()
+    -- Without marks the splices of :s are reported together, undo must still
+    -- see them separately.
+    command('enew')
+    api.nvim_buf_set_lines(0, 0, -1, true, { 'a foo', 'bar', 'baz', 'a foo' })
+    command('%s/foo/quux/')
+    set_extmark(ns, marks[1], 0, 0)
+    set_extmark(ns, marks[2], 1, 1)
+    set_extmark(ns, marks[3], 2, 2)
+    feed('u')
+    expect('a foo\nbar\nbaz\na foo')
+    eq({ 0, 0 }, get_extmark_by_id(ns, marks[1]))
+    eq({ 1, 1 }, get_extmark_by_id(ns, marks[2]))
+    eq({ 2, 2 }, get_extmark_by_id(ns, marks[3]))
+    feed('<c-r>')
+    eq({ 1, 1 }, get_extmark_by_id(ns, marks[2]))
+    eq({ 2, 2 }, get_extmark_by_id(ns, marks[3]))
+  end)
+
   it('substitutes over multiple lines with newline in pattern', function()
     feed('A<cr>67890<cr>xx<esc>')
     set_extmark(ns, marks[1], 0, 3)
@@ -46,6 +46,8 @@ describe('fileio', function()
     os.remove('Xtest_тест.md')
     os.remove('Xtest-u8-int-max')
     os.remove('Xtest-overwrite-forced')
+    os.remove('Xtest-mapfilesize')
+    os.remove('Xtest_writeasync')
     rmdir('Xtest_startup_swapdir')
     rmdir('Xtest_backupdir')
     rmdir('Xtest_backupdir with spaces')
@@ -271,6 +273,284 @@ describe('fileio', function()
     assert_alive()
   end)
 
+  it("'mapfilesize' reads a large file through a mapping", function()
+    clear()
+    local lines = {}
+    for i = 1, 3000 do
+      lines[i] = ('line %d тест'):format(i)
+    end
+    lines[1500] = ''
+    write_file('Xtest-mapfilesize', table.concat(lines, '\n'))
+
+    local function check()
+      eq(3000, fn.line('$'))
+      eq(lines, api.nvim_buf_get_lines(0, 0, -1, true))
+      eq('unix', api.nvim_get_option_value('fileformat', {}))
+      eq(false, api.nvim_get_option_value('endofline', {}))
+      local bytes = {}
+      for _, lnum in ipairs({ 1, 2, 257, 1500, 1501, 3000, 3001 }) do
+        table.insert(bytes, fn.line2byte(lnum))
+      end
+      local found = {}
+      for _, off in ipairs({ 1, 2, 5000, 40000, bytes[6], bytes[6] + 5, bytes[7] - 1, bytes[7] }) do
+        table.insert(found, fn.byte2line(off))
+      end
+      return { bytes, found }
+    end
+
+    command('edit Xtest-mapfilesize')
+    local expected = check()
+    command('bwipe!')
+
+    command('set mapfilesize=1')
+    command('edit Xtest-mapfilesize')
+    eq(expected, check())
+
+    -- The first change moves the lines into the buffer.
+    fn.setline(2, 'changed')
+    lines[2] = 'changed'
+    command('3000delete')
+    table.remove(lines)
+    eq(lines, api.nvim_buf_get_lines(0, 0, -1, true))
+    command('undo')
+    command('undo')
+    eq(3000, fn.line('$'))
+    eq('line 2 тест', fn.getline(2))
+  end)
+
+  it("'mapfilesize' file truncated by another program", function()
+    skip(is_os('win'), 'no mmap()')
+    clear()
+    local lines = {}
+    for i = 1, 3000 do
+      lines[i] = ('line %d тест'):format(i)
+    end
+    write_file('Xtest-mapfilesize', table.concat(lines, '\n') .. '\n')
+    command('set mapfilesize=1')
+    command('edit Xtest-mapfilesize')
+    eq('line 1 тест', fn.getline(1))
+
+    -- Truncate the file in place, like logrotate with "copytruncate" does.
+    local f = assert(io.open('Xtest-mapfilesize', 'w'))
+    f:write('new\n')
+    f:close()
+    command('silent! let g:line = getline(2000)')
+    matches('E5432:', api.nvim_get_vvar('errmsg'))
+    eq('', api.nvim_get_var('line'))
+    eq(3000, fn.line('$'))
+    eq('new', fn.getline(1))
+    assert_alive()
+
+    matches('E487:', t.pcall_err(command, 'set mapfilesize=-1'))
+  end)
+
+  it("'mapfilesize' buffer can be written over the mapped file", function()
+    clear()
+    local lines = {}
+    for i = 1, 3000 do
+      lines[i] = ('line %d тест'):format(i)
+    end
+    local text = table.concat(lines, '\n') .. '\n'
+    write_file('Xtest-mapfilesize', text)
+    command('set mapfilesize=1 nowritebackup')
+    command('edit Xtest-mapfilesize')
+
+    -- The file is truncated before the lines are written.
+    command('write')
+    eq(text, read_file('Xtest-mapfilesize'))
+    eq(lines, api.nvim_buf_get_lines(0, 0, -1, true))
+
+    command('set writebackup backupcopy=yes')
+    command('write')
+    eq(text, read_file('Xtest-mapfilesize'))
+
+    -- Writing another buffer over the file keeps the lines of this one.
+    command('bwipe!')
+    command('edit Xtest-mapfilesize')
+    command('new')
+    command('set cpoptions-=F')
+    fn.setline(1, 'other')
+    command('write! Xtest-mapfilesize')
+    eq('other\n', read_file('Xtest-mapfilesize'))
+    command('bwipe!')
+    eq(lines, api.nvim_buf_get_lines(0, 0, -1, true))
+    assert_alive()
+  end)
+
+  it("'maxmemtot' releases blocks to the swap file", function()
+    clear()
+    command('set swapfile maxmemtot=64')
+    command('edit Xtest-maxmemtot')
+    local lines = {}
+    for i = 1, 20000 do
+      lines[i] = ('line %d of many'):format(i)
+    end
+    api.nvim_buf_set_lines(0, 0, -1, true, lines)
+    neq('', fn.swapname('%'))
+
+    -- Changed blocks are written to the swap file and read back.
+    eq(lines, api.nvim_buf_get_lines(0, 0, -1, true))
+    command('5000,15000delete')
+    for _ = 5000, 15000 do
+      table.remove(lines, 5000)
+    end
+    eq(lines, api.nvim_buf_get_lines(0, 0, -1, true))
+    command('undo')
+    eq(20000, fn.line('$'))
+    eq('line 10000 of many', fn.getline(10000))
+
+    local stats = request('nvim__stats')
+    ok(stats.memfile_evict > 0)
+    ok(stats.memfile_writeback > 0)
+    ok(stats.memfile_miss > 0)
+    ok(stats.memfile_bytes < 100 * 1024)
+
+    -- Without a limit blocks stay in memory.
+    command('set maxmemtot=0')
+    eq(lines[1], fn.getline(1))
+    command('bwipe!')
+  end)
+
+  it("'memcompress' compresses blocks in memory", function()
+    clear()
+    command('set memcompress=64')
+    local lines = {}
+    for i = 1, 20000 do
+      lines[i] = ('line %d of many'):format(i)
+    end
+    api.nvim_buf_set_lines(0, 0, -1, true, lines)
+    local stats = request('nvim__stats')
+    ok(stats.memfile_compressed > 0)
+    ok(stats.memfile_compressed * 2 < stats.memfile_compressed_raw)
+
+    -- Compressed blocks are decompressed when used and can be changed.
+    eq(lines, api.nvim_buf_get_lines(0, 0, -1, true))
+    command('5000,15000delete')
+    for _ = 5000, 15000 do
+      table.remove(lines, 5000)
+    end
+    eq(lines, api.nvim_buf_get_lines(0, 0, -1, true))
+    command('undo')
+    eq(20000, fn.line('$'))
+    eq('line 10000 of many', fn.getline(10000))
+
+    -- Also when they are written to the swap file and read back.
+    command('set swapfile maxmemtot=64')
+    eq('line 20000 of many', fn.getline(20000))
+    eq('line 1 of many', fn.getline(1))
+    command('set memcompress=0 maxmemtot=0')
+    command('bwipe!')
+  end)
+
+  it("'writeasync' writes the buffer on a worker thread", function()
+    clear()
+    command('set writeasync fsync')
+    command('edit Xtest_writeasync')
+    local lines = {}
+    for i = 1, 100000 do
+      lines[i] = ('line %d of many'):format(i)
+    end
+    lines[50] = 'with\0nul'
+    api.nvim_buf_set_lines(0, 0, -1, true, lines)
+    command('let g:written = 0 | autocmd BufWritePost * let g:written += 1')
+    command('let g:modified = [] | write | let g:modified += [&modified]')
+    -- 'modified' is only reset when the write is done.
+    eq({ 1 }, api.nvim_get_var('modified'))
+    retry(nil, nil, function()
+      eq(1, api.nvim_get_var('written'))
+    end)
+    eq(false, api.nvim_get_option_value('modified', {}))
+
+    -- Changes made while writing are not written and keep 'modified' set.
+    command('write | call setline(1, "changed")')
+    retry(nil, nil, function()
+      eq(2, api.nvim_get_var('written'))
+    end)
+    eq(table.concat(lines, '\n') .. '\n', read_file('Xtest_writeasync'))
+    eq(true, api.nvim_get_option_value('modified', {}))
+
+    -- Abandoning the buffer waits for the write.
+    command('set nohidden')
+    command('write | enew')
+    -- BufWritePost is triggered later, from the event loop.
+    retry(nil, nil, function()
+      eq(3, api.nvim_get_var('written'))
+    end)
+    command('buffer #')
+    eq(false, api.nvim_get_option_value('modified', {}))
+
+    -- Reading the file waits for the write.
+    command('set fileformat=dos')
+    command('write')
+    command('edit!')
+    retry(nil, nil, function()
+      eq(4, api.nvim_get_var('written'))
+    end)
+    eq('changed', fn.getline(1))
+    eq('dos', api.nvim_get_option_value('fileformat', {}))
+  end)
+
+  it("'writeasync' BufWritePost can wipe out the buffer", function()
+    clear()
+    command('set writeasync nohidden')
+    command('edit Xtest_writeasync')
+    fn.setline(1, fn.range(1, 100000))
+    command('autocmd BufWritePost Xtest_writeasync ++once bwipe! Xtest_writeasync')
+    command('write | enew')
+    retry(nil, nil, function()
+      eq(-1, fn.bufnr('Xtest_writeasync'))
+    end)
+    assert_alive()
+    eq(100000, #vim.split(read_file('Xtest_writeasync'), '\n', { trimempty = true }))
+  end)
+
+  it("'writeasync' puts back the backup when writing fails", function()
+    skip(is_os('win'), 'no ulimit')
+    for _, bkc in ipairs({ 'auto', 'yes' }) do
+      write_file('Xtest_writeasync', 'original\n')
+      os.remove('Xtest_writeasync_result')
+      -- The file size limit makes writing more than 1 Kbyte fail.
+      fn.system({
+        'sh',
+        '-c',
+        ("trap '' XFSZ; ulimit -f 1; exec '%s' --clean --headless -n -i NONE "):format(nvim_prog)
+          .. ("--cmd 'set writeasync backupcopy=%s' "):format(bkc)
+          .. "-c 'edit Xtest_writeasync' "
+          .. "-c 'call setline(1, range(1, 1000))' "
+          .. "-c 'write | call wait(5000, \"!empty(v:errmsg)\")' "
+          .. "-c 'call writefile([&modified, v:errmsg, readfile(\"Xtest_writeasync\")[0]], \"Xtest_writeasync_result\")' "
+          .. "-c 'qall!'",
+      })
+      local result = vim.split(read_file('Xtest_writeasync_result'), '\n', { trimempty = true })
+      os.remove('Xtest_writeasync_result')
+      eq('1', result[1])
+      matches('E514', result[2])
+      eq('original', result[3])
+    end
+  end)
+
+  it("'writeasync' finishes writing before quitting", function()
+    clear()
+    for _, cmd in ipairs({ 'write | quit', 'write | qall' }) do
+      os.remove('Xtest_writeasync')
+      fn.system({
+        nvim_prog,
+        '--clean',
+        '--headless',
+        '--cmd',
+        'set writeasync',
+        '-c',
+        'edit Xtest_writeasync',
+        '-c',
+        'call setline(1, range(1, 100000))',
+        '-c',
+        cmd,
+      })
+      eq(0, api.nvim_get_vvar('shell_error'))
+      eq(100000, #vim.split(read_file('Xtest_writeasync'), '\n', { trimempty = true }))
+    end
+  end)
+
   it(':w! does not show "file has been changed" warning', function()
     clear()
     write_file('Xtest-overwrite-forced', 'foobar')
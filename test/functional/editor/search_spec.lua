@@ -4,7 +4,11 @@ local n = require('test.functional.testnvim')()
 local clear = n.clear
 local command = n.command
 local eq = t.eq
+local feed = n.feed
+local fn = n.fn
+local ok = t.ok
 local pcall_err = t.pcall_err
+local request = n.request
 
 describe('search (/)', function()
   before_each(clear)
@@ -13,4 +17,25 @@ describe('search (/)', function()
     eq([[Vim:E951: \% value too large]], pcall_err(command, '/\\v%18446744071562067968c'))
     eq([[Vim:E951: \% value too large]], pcall_err(command, '/\\v%2147483648c'))
   end)
+
+  it('reuses compiled patterns', function()
+    fn.setline(1, { 'foo 1', 'bar', 'foo 2', 'foo 3' })
+    command('/foo \\d')
+    local before = request('nvim__stats')
+    feed('nnn')
+    local after = request('nvim__stats')
+    ok(after.regexp_cache_hit >= before.regexp_cache_hit + 3)
+    eq(3, fn.line('.'))
+
+    -- The pattern can be used while substituting with it.
+    command([[%s/foo \d/\=search('foo \d', 'nw') > 0/]])
+    eq({ '1', 'bar', '1', '1' }, fn.getline(1, '$'))
+
+    -- "~" is the last substitute string, which changes.
+    fn.setline(1, { 'aaa', 'xxx', 'yyy' })
+    command('s/aaa/xxx/')
+    eq(2, fn.search('~', 'nw'))
+    command('s/xxx/yyy/')
+    eq(3, fn.search('~', 'nw'))
+  end)
 end)
@@ -220,3 +220,106 @@ describe(':undo! command', function()
     eq('E5767: Cannot use :undo! to redo or move to a different undo branch', eval('v:errmsg'))
   end)
 end)
+
+describe('undo information', function()
+  before_each(function()
+    clear()
+    exec_lua(function()
+      local lines = {}
+      for i = 1, 1000 do
+        lines[i] = ('%d '):format(i):rep(20)
+      end
+      vim.api.nvim_buf_set_lines(0, 0, -1, true, lines)
+    end)
+    command('set undolevels=100')
+  end)
+
+  it('for :s on many lines can be undone and redone', function()
+    local orig = fn.getline(1, '$')
+    command('%s/^/x/')
+    command('%s/5 $/five/')
+    local changed = fn.getline(1, '$')
+    eq('x1 1 ', changed[1]:sub(1, 5))
+    command('undo')
+    command('undo')
+    eq(orig, fn.getline(1, '$'))
+    command('redo')
+    command('redo')
+    eq(changed, fn.getline(1, '$'))
+  end)
+
+  it("uses no more than 'undomemory'", function()
+    command('set undomemory=64')
+    command('%s/^/x/')
+    command('%s/^/y/')
+    command('%s/^/z/')
+    eq(1, #fn.undotree().entries)
+    command('undo')
+    eq('yx1 1 ', fn.getline(1):sub(1, 6))
+    command('redo')
+
+    command('set undomemory=0')
+    command('%s/^/a/')
+    command('%s/^/b/')
+    eq(3, #fn.undotree().entries)
+  end)
+end)
+
+describe("'undofile'", function()
+  local fname = 'Xtest_undofile'
+
+  before_each(function()
+    clear()
+    command('set undofile undodir=.')
+  end)
+
+  after_each(function()
+    os.remove(fn.undofile(fname))
+    os.remove(fname)
+  end)
+
+  it('appends the changes since the last write', function()
+    command('edit ' .. fname)
+    fn.setline(1, fn.range(1, 100))
+    command('write')
+    local undofile = fn.undofile(fname)
+    local base = t.read_file(undofile)
+    command('1delete')
+    command('write')
+    command('undo')
+    command('$delete')
+    command('write')
+    local written = t.read_file(undofile)
+    t.ok(#written > #base)
+    eq(base, written:sub(1, #base))
+
+    clear()
+    command('set undofile undodir=.')
+    command('edit ' .. fname)
+    eq({ '1', '99' }, { fn.getline(1), fn.getline('$') })
+    eq(3, fn.undotree().seq_last)
+    command('undo 2')
+    eq({ '2', '100' }, { fn.getline(1), fn.getline('$') })
+    command('undo 0')
+    eq({ '' }, fn.getline(1, '$'))
+  end)
+
+  it('matches the text after writing it again without changes', function()
+    command('edit ' .. fname)
+    fn.setline(1, { 'abc', 'def' })
+    command('write')
+    feed('ggx')
+    command('write')
+    command('write')
+    feed('jx')
+    command('write')
+
+    clear()
+    command('set undofile undodir=.')
+    command('edit ' .. fname)
+    eq({ 'bc', 'ef' }, fn.getline(1, '$'))
+    eq(3, fn.undotree().seq_last)
+    command('undo 1')
+    eq({ 'abc', 'def' }, fn.getline(1, '$'))
+  end)
+end)
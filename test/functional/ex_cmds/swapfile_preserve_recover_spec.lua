@@ -128,6 +128,52 @@ describe("preserve and (R)ecover with custom 'directory'", function()
     screen0:expect({ any = pesc('[Process exited 1]') }) -- Wait for the child process to stop.
     test_recover(swappath1)
   end)
+
+  --- Edits "testfile" and makes sure the blocks of the buffer are in the swap
+  --- file, so that later syncs are not writing new blocks.
+  local function setup_synced()
+    write_file(testfile, 'line1\nline2\nline3\n')
+    exec(init)
+    command('edit! ' .. testfile)
+    feed('ccfirst<esc>')
+    command('preserve')
+    return fn.swapname('%')
+  end
+
+  it('with blocks written on a worker thread when idle and SIGKILL', function()
+    setup_synced()
+    local async_before = api.nvim__stats().memfile_async
+    command('set updatetime=10')
+    feed('ccsecond<esc>')
+    -- The idle sync writes the changed block on a worker thread.
+    retry(nil, nil, function()
+      ok(api.nvim__stats().memfile_async > async_before)
+    end)
+    os_kill(eval('getpid()'))
+
+    local nvim2 = spawn({ nvim_prog, '-u', 'NONE', '-i', 'NONE', '--embed' }, true)
+    set_session(nvim2)
+    exec(init)
+    command('autocmd SwapExists * let v:swapchoice = "r"')
+    command('silent edit! ' .. testfile)
+    expect('second\nline2\nline3')
+    os.remove(testfile)
+  end)
+
+  it('waits for a sync on a worker thread before deleting the swap file', function()
+    local swappath1 = setup_synced()
+    eq(1, fn.filereadable(swappath1))
+    command('set updatecount=1')
+    -- Typed keys are handled without going back to the event loop, the sync
+    -- started for the change is still pending when the buffer is wiped out.
+    feed('ccsecond<esc>:bwipe!<cr>')
+    assert_alive()
+    eq(0, fn.filereadable(swappath1))
+    retry(nil, nil, function()
+      ok(api.nvim__stats().memfile_async > 0)
+    end)
+    os.remove(testfile)
+  end)
 end)
 
 describe('swapfile detection', function()
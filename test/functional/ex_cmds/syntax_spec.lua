@@ -1,9 +1,16 @@
 local t = require('test.testutil')
 local n = require('test.functional.testnvim')()
+local Screen = require('test.functional.ui.screen')
 
 local eq = t.eq
+local ok = t.ok
 local clear = n.clear
+local command = n.command
+local exec = n.exec
+local exec_capture = n.exec_capture
 local exc_exec = n.exc_exec
+local retry = t.retry
+local feed = n.feed
 
 describe(':syntax', function()
   before_each(clear)
@@ -16,4 +23,41 @@ describe(':syntax', function()
       )
     end)
   end)
+
+  describe('sync fromstart', function()
+    local function comment_tries()
+      local count = 0
+      for c in exec_capture('syntime report'):gmatch('[%d.]+%s+(%d+)[^\n]*Comment') do
+        count = count + tonumber(c)
+      end
+      return count
+    end
+
+    it('computes states for the whole buffer while waiting for input', function()
+      local screen = Screen.new(80, 6)
+      screen:attach()
+      exec([[
+        call setline(1, map(range(1, 20000), '"/* " .. v:val .. " */ x"'))
+        syntax region Comment start=+/\*+ end=+\*/+
+        syntax sync fromstart
+        syntime on
+      ]])
+      screen:expect({ any = '/%* 1 %*/' })
+      -- States are computed while Nvim waits for input, until every line was
+      -- parsed and the count no longer changes.
+      local last = -1
+      retry(nil, nil, function()
+        local count, prev = comment_tries(), last
+        last = count
+        ok(count >= 20000, 'at least 20000 tries', count)
+        eq(prev, count)
+      end)
+      command('syntime clear')
+      feed('G')
+      screen:expect({ any = '/%* 20000 %*/' })
+      -- Only a few lines above the window had to be parsed.
+      local count = comment_tries()
+      ok(count > 0 and count < 2000, 'less than 2000 tries', count)
+    end)
+  end)
 end)
@@ -1184,6 +1184,27 @@ describe('lua: nvim_buf_attach on_bytes', function()
       }
     end)
 
+    it('substitute with several matches', function()
+      local check_events = setup_eventcheck(verify, { 'abcb', 'b', 'ccc' })
+
+      -- without extmarks the matches are sent as one change
+      command('%s/b/XY/g')
+      check_events {
+        { 'test1', 'bytes', 1, 3, 0, 1, 1, 1, 1, 5, 1, 2, 8 },
+      }
+
+      -- extmarks need each match
+      local ns = api.nvim_create_namespace('')
+      api.nvim_buf_set_extmark(0, ns, 2, 0, {})
+      command('%s/XY/b/g')
+      check_events {
+        { 'test1', 'bytes', 1, 4, 0, 1, 1, 0, 2, 2, 0, 1, 1 },
+        { 'test1', 'bytes', 1, 4, 0, 3, 3, 0, 2, 2, 0, 1, 1 },
+        { 'test1', 'bytes', 1, 4, 1, 0, 5, 0, 2, 2, 0, 1, 1 },
+      }
+      eq({ 'abcb', 'b', 'ccc' }, api.nvim_buf_get_lines(0, 0, -1, true))
+    end)
+
     it('flushes delbytes on join', function()
       local check_events = setup_eventcheck(verify, { 'AAA', 'BBB', 'CCC' })
 
@@ -365,6 +365,89 @@ describe('threadpool', function()
       eq({ 'notification', 'result', { { 33, NIL, 'text' } } }, next_msg())
     end)
 
+    it('buffer snapshot', function()
+      exec_lua [[
+        local lines = {}
+        for i = 1, 10000 do
+          lines[i] = 'line ' .. i
+        end
+        vim.api.nvim_buf_set_lines(0, 0, -1, true, lines)
+        local snap = vim._buf_snapshot(0)
+        -- Changes after taking the snapshot are not visible in it.
+        vim.api.nvim_buf_set_lines(0, 0, 5000, true, {})
+        vim.api.nvim_buf_set_lines(0, 0, 1, true, { 'changed' })
+        vim.cmd('normal! 2GrX')
+
+        local work_fn = function(args)
+          local snap = args[1]
+          local count = vim._buf_snapshot_line_count(snap)
+          local lines = vim._buf_snapshot_get_lines(snap, 0, -1)
+          return count, lines[1], lines[2], lines[5001], lines[count]
+        end
+        local after_work_fn = function(...)
+          vim._buf_snapshot_free(snap)
+          vim.rpcnotify(1, 'result', ...)
+        end
+        local threadpool_test = Threadpool_Test.new(work_fn, after_work_fn, snap)
+        threadpool_test:do_test()
+      ]]
+
+      eq({
+        'notification',
+        'result',
+        { 10000, 'line 1', 'line 2', 'line 5001', 'line 10000' },
+      }, next_msg())
+      eq({ 'changed', 'Xine 5002' }, exec_lua [[return vim.api.nvim_buf_get_lines(0, 0, 2, true)]])
+    end)
+
+    it('buffer snapshot only copies blocks that are changed', function()
+      eq(
+        { 0, true, 0 },
+        exec_lua [[
+          local lines = {}
+          for i = 1, 10000 do
+            lines[i] = 'line ' .. i
+          end
+          vim.api.nvim_buf_set_lines(0, 0, -1, true, lines)
+          local snap = vim._buf_snapshot(0)
+          -- Reading the buffer does not copy shared blocks.
+          vim.api.nvim_buf_get_lines(0, 0, -1, true)
+          local read = vim.api.nvim__stats().memfile_snapshot
+          vim.api.nvim_buf_set_lines(0, 0, 1, true, { 'changed' })
+          local changed = vim.api.nvim__stats().memfile_snapshot
+          vim._buf_snapshot_free(snap)
+          return { read, changed > 0, vim.api.nvim__stats().memfile_snapshot }
+        ]]
+      )
+    end)
+
+    it('buffer snapshot of a mapped file', function()
+      finally(function()
+        os.remove('Xsnapshot_mapped')
+      end)
+      local lines = {}
+      for i = 1, 3000 do
+        lines[i] = 'line ' .. i
+      end
+      t.write_file('Xsnapshot_mapped', table.concat(lines, '\n') .. '\n')
+      eq(
+        { 3000, 'line 1', 'line 2999', 'line 3000' },
+        exec_lua [[
+          vim.o.mapfilesize = 1
+          vim.o.backupcopy = 'yes'
+          vim.cmd('edit Xsnapshot_mapped')
+          local snap = vim._buf_snapshot(0)
+          -- The file is written over in place while the snapshot uses it.
+          vim.api.nvim_buf_set_lines(0, 0, -1, true, { 'new' })
+          vim.cmd('write')
+          local lines = vim._buf_snapshot_get_lines(snap, 0, -1)
+          local last = vim._buf_snapshot_get_lines(snap, 2998, 3000)
+          vim._buf_snapshot_free(snap)
+          return { #lines, lines[1], last[1], last[2] }
+        ]]
+      )
+    end)
+
     it('work', function()
       exec_lua [[
         local work_fn = function()
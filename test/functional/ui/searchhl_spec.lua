@@ -8,6 +8,7 @@ local feed_command = n.feed_command
 local eq = t.eq
 local eval = n.eval
 local fn = n.fn
+local api = n.api
 local testprg = n.testprg
 
 describe('search highlighting', function()
@@ -325,6 +326,68 @@ describe('search highlighting', function()
     ]])
   end)
 
+  it('is updated after changing lines', function()
+    insert([[
+      foo bar
+      bar foo-bar
+      baz]])
+    feed('gg/bar<cr>')
+    screen:expect([[
+      foo {2:^bar}                                 |
+      {2:bar} foo-{2:bar}                             |
+      baz                                     |
+      {1:~                                       }|*3
+      /bar                                    |
+    ]])
+
+    -- Moving the cursor uses the matches found before.
+    feed('j')
+    screen:expect([[
+      foo {2:bar}                                 |
+      {2:bar} ^foo-{2:bar}                             |
+      baz                                     |
+      {1:~                                       }|*3
+      /bar                                    |
+    ]])
+
+    feed('ciwbar<esc>')
+    screen:expect([[
+      foo {2:bar}                                 |
+      {2:bar} {2:ba^r}-{2:bar}                             |
+      baz                                     |
+      {1:~                                       }|*3
+                                              |
+    ]])
+
+    feed('Obar<esc>')
+    screen:expect([[
+      foo {2:bar}                                 |
+      {2:ba^r}                                     |
+      {2:bar} {2:bar}-{2:bar}                             |
+      baz                                     |
+      {1:~                                       }|*2
+                                              |
+    ]])
+
+    feed('ggdd')
+    screen:expect([[
+      {2:^bar}                                     |
+      {2:bar} {2:bar}-{2:bar}                             |
+      baz                                     |
+      {1:~                                       }|*3
+                                              |
+    ]])
+
+    api.nvim_buf_set_lines(0, 2, 3, true, { 'baz bar' })
+    screen:expect([[
+      {2:^bar}                                     |
+      {2:bar} {2:bar}-{2:bar}                             |
+      baz {2:bar}                                 |
+      {1:~                                       }|*3
+                                              |
+    ]])
+  end)
+
   it('is preserved during :terminal activity', function()
     feed((':terminal "%s" REP 5000 foo<cr>'):format(testprg('shell-test')))
     feed(':file term<CR>')
@@ -109,6 +109,35 @@ func Test_global_wrong_delimiter()
   call assert_fails('g x^bxd', 'E146:')
 endfunc
 
+" Test that ":g/pat/d", which deletes all lines at once, gives the same
+" result as deleting each line by itself.
+func Test_global_delete()
+  let lines = map(range(1, 100), {_, v -> '  line ' .. v})
+  for cmd in ['g/[05]$\|line [1-3]$/d', 'g/line 5[0-3]$/d', 'g/^/d',
+        \ 'v/line .*0$/d', 'g/7/d _', '10,20g/2/d', 'g/line 100/d']
+    let results = []
+    for slow in [0, 1]
+      new
+      call setline(1, lines)
+      for i in range(1, 9)
+        call setreg(i, 'register ' .. i)
+      endfor
+      call setreg('"', 'a')
+      " ":execute" executes ":delete" for each line
+      exe slow ? substitute(cmd, 'd\( _\)\=$', 'exe "&"', '') : cmd
+      let result = [getline(1, '$'), getpos('.'), getpos("'["), getpos("']"),
+            \ map(range(1, 9), {_, v -> getreg(v)}), getreg('"')]
+      undo
+      call extend(result, [getline(1, '$'), getpos('.')])
+      redo
+      call extend(result, [getline(1, '$'), getpos('.')])
+      call add(results, result)
+      bwipe!
+    endfor
+    call assert_equal(results[1], results[0], cmd)
+  endfor
+endfunc
+
 " Test for interrupting :global using Ctrl-C
 func Test_interrupt_global()
   CheckRunVimInTerminal
@@ -54,6 +54,20 @@ func Test_hlsearch_hangs()
   bwipe!
 endfunc
 
+func Test_hlsearch_timeout_resets_hlsearch()
+  " This pattern only looks at one line but takes a long time to match.  When
+  " it times out 'hlsearch' highlighting is stopped.
+  new
+  call setline(1, ['aaa', repeat('a', 50) .. 'xc', 'ccc'])
+  set hlsearch nolazyredraw redrawtime=51 regexpengine=1
+  let @/ = '\(a\|a\)*c'
+  call assert_equal(1, v:hlsearch)
+  redraw
+  call assert_equal(0, v:hlsearch)
+  set nohlsearch redrawtime& regexpengine&
+  bwipe!
+endfunc
+
 func Test_hlsearch_eol_highlight()
   new
   call append(1, repeat([''], 9))
@@ -5970,6 +5970,75 @@ func Test_vimgrep_fuzzy_match()
   call delete('Xfile2')
 endfunc
 
+func s:VimgrepResult(cmd)
+  exe a:cmd
+  return getqflist()->map({_, e -> [bufname(e.bufnr), e.lnum, e.col, e.end_lnum, e.end_col, e.text]})
+endfunc
+
+" Test for :vimgrep on files that are not loaded into a buffer, the results
+" must be the same as when the files are loaded.
+func Test_vimgrep_read_ahead()
+  %bwipe!
+  call mkdir('Xgrepdir')
+  call writefile(['one match', 'two', 'match three match'], 'Xgrepdir/file01')
+  call writefile([], 'Xgrepdir/file02')
+  call writefile(["\xef\xbb\xbfmatch after BOM"], 'Xgrepdir/file03')
+  call writefile(["dos match\r", "line\r"], 'Xgrepdir/file04')
+  call writefile(["latin1 \xe9 match"], 'Xgrepdir/file05')
+  call writefile(['no eol match'], 'Xgrepdir/file06', 'b')
+  call writefile(["nul \n match"], 'Xgrepdir/file07')
+  " More files than are read ahead at once.
+  for i in range(10, 50)
+    call writefile(['file ' .. i, i % 3 ? 'no' : 'match'], 'Xgrepdir/file' .. i)
+  endfor
+
+  let cmds = ['vimgrep /match/j Xgrepdir/*',
+        \ 'vimgrep /match/gj Xgrepdir/*',
+        \ 'vimgrep /^$/j Xgrepdir/*',
+        \ 'vimgrep /two\nmatch/j Xgrepdir/*',
+        \ 'vimgrep /é/j Xgrepdir/*',
+        \ '3vimgrep /match/j Xgrepdir/*',
+        \ 'vimgrep /match/fj Xgrepdir/*']
+  let read_ahead = cmds->mapnew({_, c -> s:VimgrepResult(c)})
+  call assert_equal(0, bufloaded('Xgrepdir/file01'))
+
+  " An autocommand for reading files makes them loaded into a buffer.
+  augroup QF_Test
+    au!
+    au BufReadPre Xgrepdir/* let g:did_read = 1
+  augroup END
+  let loaded = cmds->mapnew({_, c -> s:VimgrepResult(c)})
+  call assert_equal(1, g:did_read)
+  call assert_equal(loaded, read_ahead)
+  call assert_equal([['Xgrepdir/file01', 1, 6, 1, 11, 'one match']],
+        \ read_ahead[0][:0])
+  call assert_equal(3, len(read_ahead[5]))
+  augroup QF_Test
+    au!
+  augroup END
+  unlet g:did_read
+
+  " The text of a loaded buffer is used.
+  new Xgrepdir/file01
+  call setline(2, 'two match')
+  vimgrep /match/j Xgrepdir/file01 Xgrepdir/file03
+  call assert_equal(['one match', 'two match', 'match three match',
+        \ 'match after BOM'], getqflist()->map({_, e -> e.text}))
+  bwipe!
+
+  " Files of at least 'mapfilesize' are mapped, the results are the same.
+  call writefile(range(1000) + ['big match'], 'Xgrepdir/file51')
+  let read = s:VimgrepResult('vimgrep /match/j Xgrepdir/*')
+  set mapfilesize=1
+  call assert_equal(read, s:VimgrepResult('vimgrep /match/j Xgrepdir/*'))
+  call assert_equal('big match', read[-1][5])
+  set mapfilesize&
+
+  call setqflist([], 'f')
+  %bwipe!
+  call delete('Xgrepdir', 'rf')
+endfunc
+
 func Test_locationlist_open_in_newtab()
   call s:create_test_file('Xqftestfile1')
   call s:create_test_file('Xqftestfile2')
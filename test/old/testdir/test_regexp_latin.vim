@@ -1105,4 +1105,32 @@ func Test_recursive_substitute_expr()
   delfunc Repl
 endfunc
 
+" Patterns the NFA engine matches with its lazy DFA must give the same result
+" as the backtracking engine, also on long lines.
+func Test_nfa_dfa_same_result()
+  let long = repeat('abc def 123 ', 2000)
+  let lines = [long .. 'needle' .. long, long, 'needle', '', long .. 'x',
+        \ 'ABC aBc ' .. long]
+  let pats = ['needle', 'ne\+dle', 'x$', '^abc', '^$', 'd[a-f]f \d\+ x',
+        \ '[^a-z ]\{4}', '\(def\|123\) n', 'e\zsd\zel', 'c \w\+ \D*x',
+        \ '\cabc', '[[:upper:]]\{3}', 'z\|needle$']
+  new
+  call setline(1, lines)
+  for pat in pats
+    for ic in [0, 1]
+      let &ignorecase = ic
+      for line in lines
+        for col in [0, 5, len(long)]
+          call assert_equal(matchstrpos(line, '\%#=1' .. pat, col),
+                \ matchstrpos(line, '\%#=2' .. pat, col), pat .. ' ' .. ic)
+        endfor
+      endfor
+      call assert_equal(searchcount(#{pattern: '\%#=1' .. pat, maxcount: 0}),
+            \ searchcount(#{pattern: '\%#=2' .. pat, maxcount: 0}), pat .. ' ' .. ic)
+    endfor
+  endfor
+  set ignorecase&
+  bwipe!
+endfunc
+
 " vim: shiftwidth=2 sts=2 expandtab
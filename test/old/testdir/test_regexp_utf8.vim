@@ -611,4 +611,28 @@ func Test_combining_chars_in_collection()
   bw!
 endfunc
 
+" Lines that don't have the text a match needs are skipped, but not when a
+" multibyte character may match it.
+func Test_match_required_text()
+  let lines = ['foo bar', 'foo baz', 'xxx foo yyy bar', "fo\u0301o bar",
+        \ 'FOO KEY', 'foo key', 'foos', '']
+  let pats = ['foo.*bar', 'o\+ ba[rz]', '\<foo\>.*\(key\|bar\)', 'foo \%(k\)ey',
+        \ '\cfoo.*key', '\cfoos', 'x* f\zsoo', 'o\{2} b']
+  for pat in pats
+    for ic in [0, 1]
+      let &ignorecase = ic
+      for line in lines
+        call assert_equal(matchstrpos(line, '\%#=1' .. pat),
+              \ matchstrpos(line, '\%#=2' .. pat), pat .. ' ' .. ic .. ' ' .. line)
+      endfor
+    endfor
+  endfor
+  set ignorecase&
+
+  " The Kelvin sign and the long s fold to ASCII letters.
+  call assert_equal("foo \u212aey", matchstr("foo \u212aey", '\%#=2\cfoo.*key'))
+  call assert_equal("foo\u017f", matchstr("foo\u017f", '\%#=2\cfoos'))
+  call assert_equal('', matchstr('foo bar', '\%#=2foo.*baz'))
+endfunc
+
 " vim: shiftwidth=2 sts=2 expandtab
@@ -463,4 +463,40 @@ func Test_search_stat_backwards()
   call StopVimInTerminal(buf)
 endfunc
 
+func s:CheckCountAfterChange(pat)
+  let opts = #{pattern: a:pat, maxcount: 0}
+  let positions = [[1, 1, 0], [2, 3, 0], [9, 5, 0], [line('$'), 1, 0]]
+  let counts = positions->mapnew({_, p -> searchcount(extend(#{pos: p}, opts))})
+  " Changing 'iskeyword' makes the whole buffer be searched again.
+  setlocal iskeyword+=#
+  let expected = positions->mapnew({_, p -> searchcount(extend(#{pos: p}, opts))})
+  setlocal iskeyword-=#
+  call assert_equal(expected, counts, a:pat)
+  " Keep the matches for the next change.
+  call searchcount(opts)
+endfunc
+
+" The matches are kept and updated after a change, the count must be the same
+" as when searching the whole buffer.
+func Test_searchcount_after_change()
+  new
+  let steps = ['call setline(5, "foo foo")',
+        \ 'call append(10, ["foo", "", "no"])',
+        \ '3,20delete',
+        \ '%s/bar/foo/ge',
+        \ 'undo',
+        \ 'normal! Gofoo',
+        \ '%delete']
+  for pat in ['foo', 'fo\+', '^$', 'o\nb\?a\?r\?', '\(foo\)\@<=bar']
+    %delete
+    call setline(1, repeat(['foobar', 'foo', 'bar foo foo', ''], 50))
+    call s:CheckCountAfterChange(pat)
+    for step in steps
+      exe step
+      call s:CheckCountAfterChange(pat)
+    endfor
+  endfor
+  bwipe!
+endfunc
+
 " vim: shiftwidth=2 sts=2 expandtab
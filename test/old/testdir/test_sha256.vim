@@ -19,4 +19,11 @@ function Test_sha256()
 
   " test for contains non-ascii char:
   call assert_equal('5f78c33274e43fa9de5659265c1d917e25c03722dcb0b8d27db8d5feaa813953', sha256("\xde\xad\xbe\xef"))
+
+  " test for 56 chars, which needs an extra block for the padding:
+  call assert_equal('248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1', sha256('abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq'))
+
+  " test for input spanning many blocks:
+  call assert_equal('41edece42d63e8d9bf515a9ba6932e1c20cbc9f5a5d134645adb5db1b9737ea3', sha256(repeat('a', 1000)))
+  call assert_equal('bdc2458a0c103e8d1fb7bcd0546807d91b7589b0f44e43c70df8558909f6225e', sha256(range(1, 1000)->map({_, v -> 'line ' .. v})->join("\n") .. "\n"))
 endfunction
@@ -1520,4 +1520,29 @@ func Test_sort_with_marks()
   close!
 endfunc
 
+" Test for sorting many lines, which is done on several threads
+func Test_sort_many_lines()
+  new
+  let n = 60000
+  call setline(1, map(range(n), 'printf("%d %02d", v:val, v:val % 100)'))
+  " Lines with the same key keep their order.
+  sort /\d\+ /
+  let expected = []
+  for s in range(100)
+    let expected += map(range(s, n - 1, 100), 'printf("%d %02d", v:val, s)')
+  endfor
+  call assert_equal(expected, getline(1, '$'))
+
+  sort! n
+  call assert_equal(map(range(n - 1, 0, -1), 'printf("%d %02d", v:val, v:val % 100)'),
+        \ getline(1, '$'))
+
+  call setline(1, map(range(n), 'printf("x%d", v:val * 7919 % n - n / 2)'))
+  call append(0, ['', 'x'])
+  sort n
+  call assert_equal(['', 'x'] + map(range(-n / 2, n / 2 - 1), '"x" .. v:val'),
+        \ getline(1, '$'))
+  close!
+endfunc
+
 " vim: shiftwidth=2 sts=2 expandtab
@@ -976,5 +976,38 @@ func Test_WinEnter_synstack_synID()
   bw!
 endfunc
 
+" Test for looking up keywords, with and without ignoring case, after adding
+" and removing keywords
+func Test_syn_keyword_lookup()
+  new
+  call setline(1, 'if IF Select SELECT selects ÄBC äbc abc x')
+  func s:KeywordGroups()
+    let line = getline(1)
+    let names = []
+    let col = 0
+    for w in split(line)
+      let col = stridx(line, w, col)
+      call add(names, synID(1, col + 1, 1)->synIDattr('name'))
+      let col += len(w)
+    endfor
+    return names
+  endfunc
+
+  syntax keyword KwCase if
+  syntax case ignore
+  syntax keyword KwIgnore select äbc
+  call assert_equal(['KwCase', '', 'KwIgnore', 'KwIgnore', '', 'KwIgnore',
+        \ 'KwIgnore', '', ''], s:KeywordGroups())
+
+  syntax keyword KwIgnore abc
+  syntax clear KwCase
+  call assert_equal(['', '', 'KwIgnore', 'KwIgnore', '', 'KwIgnore',
+        \ 'KwIgnore', 'KwIgnore', ''], s:KeywordGroups())
+
+  delfunc s:KeywordGroups
+  syntax clear
+  bw!
+endfunc
+
 
 " vim: shiftwidth=2 sts=2 expandtab